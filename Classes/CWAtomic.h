@@ -0,0 +1,153 @@
+//
+//  CWAtomic.h
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import <stdint.h>
+
+/*
+ * Atomic operations and a monotonic clock for the concurrency classes.
+ * Darwin uses OSAtomic and mach_absolute_time(), other platforms such as
+ * GNUstep on Linux use the GCC __sync builtins and clock_gettime().
+ *
+ * All atomic operations are full barriers, and CWMemoryBarrier() is a full
+ * barrier alone. Counters return the new value, and compare and swap returns
+ * YES if the value was swapped.
+ */
+
+#if defined(__APPLE__)
+
+#import <libkern/OSAtomic.h>
+#import <mach/mach_time.h>
+
+static inline void CWMemoryBarrier(void)
+{
+	OSMemoryBarrier();
+}
+
+static inline int32_t CWAtomicIncrement32(volatile int32_t* value)
+{
+	return OSAtomicIncrement32Barrier(value);
+}
+
+static inline int32_t CWAtomicDecrement32(volatile int32_t* value)
+{
+	return OSAtomicDecrement32Barrier(value);
+}
+
+static inline int64_t CWAtomicAdd64(int64_t amount, volatile int64_t* value)
+{
+	return OSAtomicAdd64Barrier(amount, value);
+}
+
+static inline BOOL CWAtomicCompareAndSwap32(int32_t oldValue, int32_t newValue, volatile int32_t* value)
+{
+	return OSAtomicCompareAndSwap32Barrier(oldValue, newValue, value);
+}
+
+static inline BOOL CWAtomicCompareAndSwap64(int64_t oldValue, int64_t newValue, volatile int64_t* value)
+{
+	return OSAtomicCompareAndSwap64Barrier(oldValue, newValue, value);
+}
+
+static inline BOOL CWAtomicCompareAndSwapPtr(void* oldValue, void* newValue, void* volatile* value)
+{
+	return OSAtomicCompareAndSwapPtrBarrier(oldValue, newValue, value);
+}
+
+/*
+ * The timebase is published with a barrier after numer, denom is only read
+ * as non zero once numer is set.
+ */
+static inline uint64_t CWMonotonicMicroseconds(void)
+{
+	static volatile uint32_t numer = 0, denom = 0;
+    if (denom == 0) {
+    	mach_timebase_info_data_t timebase;
+        mach_timebase_info(&timebase);
+        numer = timebase.numer;
+        OSMemoryBarrier();
+        denom = timebase.denom;
+    }
+    OSMemoryBarrier();
+    return mach_absolute_time() * numer / denom / 1000;
+}
+
+#else
+
+#import <time.h>
+
+static inline void CWMemoryBarrier(void)
+{
+	__sync_synchronize();
+}
+
+static inline int32_t CWAtomicIncrement32(volatile int32_t* value)
+{
+	return __sync_add_and_fetch(value, 1);
+}
+
+static inline int32_t CWAtomicDecrement32(volatile int32_t* value)
+{
+	return __sync_sub_and_fetch(value, 1);
+}
+
+static inline int64_t CWAtomicAdd64(int64_t amount, volatile int64_t* value)
+{
+	return __sync_add_and_fetch(value, amount);
+}
+
+static inline BOOL CWAtomicCompareAndSwap32(int32_t oldValue, int32_t newValue, volatile int32_t* value)
+{
+	return __sync_bool_compare_and_swap(value, oldValue, newValue);
+}
+
+static inline BOOL CWAtomicCompareAndSwap64(int64_t oldValue, int64_t newValue, volatile int64_t* value)
+{
+	return __sync_bool_compare_and_swap(value, oldValue, newValue);
+}
+
+static inline BOOL CWAtomicCompareAndSwapPtr(void* oldValue, void* newValue, void* volatile* value)
+{
+	return __sync_bool_compare_and_swap(value, oldValue, newValue);
+}
+
+static inline uint64_t CWMonotonicMicroseconds(void)
+{
+	struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+#endif
+
+static inline int64_t CWAtomicIncrement64(volatile int64_t* value)
+{
+	return CWAtomicAdd64(1, value);
+}
@@ -0,0 +1,105 @@
+//
+//  CWCancellationGroup.h
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import <pthread.h>
+
+/*!
+ * @abstract CWCancellationGroup cancels a group of operations at once.
+ *
+ * @discussion Operations are kept in a set until finished, so cancelling a
+ *             group is proportional to the number of unfinished operations in
+ *             the group, not to the number of operations in the queues.
+ *             Cancelled operations that have not started are never run.
+ *
+ *             A cancelled group stays cancelled, operations added later are
+ *             cancelled immediately.
+ */
+@interface CWCancellationGroup : NSObject {
+@private
+	pthread_mutex_t _lock;
+    NSMutableSet* _operations;
+    BOOL _cancelled;
+    NSUInteger _cancelledOperationCount;
+}
+
+@property(readonly, assign, getter=isCancelled) BOOL cancelled;
+
+/*!
+ * @abstract Number of unfinished operations in the group.
+ */
+@property(readonly, assign) NSUInteger operationCount;
+
+/*!
+ * @abstract Number of operations cancelled by the group.
+ */
+@property(readonly, assign) NSUInteger cancelledOperationCount;
+
++(CWCancellationGroup*)group;
+
+/*!
+ * @abstract Add an operation to the group, removed again when finished.
+ */
+-(void)addOperation:(NSOperation*)operation;
+
+-(void)removeOperation:(NSOperation*)operation;
+
+/*!
+ * @abstract Cancel all unfinished operations in the group, and all operations
+ *           added later.
+ * @result The number of operations cancelled.
+ */
+-(NSUInteger)cancel;
+
+@end
+
+
+@interface NSOperationQueue (CWCancellationGroup)
+
+/*!
+ * @abstract Add an operation to a cancellation group and to the queue.
+ */
+-(void)addOperation:(NSOperation*)operation cancellationGroup:(CWCancellationGroup*)group;
+
+@end
+
+
+@interface NSObject (CWCancellationGroup)
+
+/*!
+ * Invokes a method of the receiver on a specific queue, as part of a
+ * cancellation group.
+ *
+ * @result an autoreleased NSInvocationOperation instance, or nil if rejected
+ *         by a bounded queue.
+ */
+-(NSInvocationOperation*)performSelector:(SEL)aSelector onQueue:(NSOperationQueue*)queue withObject:(id)arg cancellationGroup:(CWCancellationGroup*)group;
+
+@end
@@ -0,0 +1,180 @@
+//
+//  CWCancellationGroup.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWCancellationGroup.h"
+#import "NSOperationQueue+CWBoundedQueue.h"
+
+
+@implementation CWCancellationGroup
+
+static char CWCancellationGroupObservingContext;
+
++(CWCancellationGroup*)group;
+{
+	return [[[self alloc] init] autorelease];
+}
+
+-(id)init;
+{
+	self = [super init];
+    if (self) {
+    	pthread_mutex_init(&_lock, NULL);
+        _operations = [[NSMutableSet alloc] init];
+    }
+    return self;
+}
+
+-(void)dealloc;
+{
+	pthread_mutex_destroy(&_lock);
+    [_operations release];
+    [super dealloc];
+}
+
+-(BOOL)isCancelled;
+{
+	pthread_mutex_lock(&_lock);
+    BOOL cancelled = _cancelled;
+    pthread_mutex_unlock(&_lock);
+    return cancelled;
+}
+
+-(NSUInteger)operationCount;
+{
+	pthread_mutex_lock(&_lock);
+    NSUInteger count = [_operations count];
+    pthread_mutex_unlock(&_lock);
+    return count;
+}
+
+-(NSUInteger)cancelledOperationCount;
+{
+	pthread_mutex_lock(&_lock);
+    NSUInteger count = _cancelledOperationCount;
+    pthread_mutex_unlock(&_lock);
+    return count;
+}
+
+-(void)addOperation:(NSOperation*)operation;
+{
+	BOOL observing = NO;
+	pthread_mutex_lock(&_lock);
+    BOOL cancelled = _cancelled;
+    if (cancelled) {
+    	_cancelledOperationCount++;
+    } else if (![_operations containsObject:operation]) {
+    	[_operations addObject:operation];
+        // The group is retained while observing.
+        [self retain];
+        [operation addObserver:self forKeyPath:@"isFinished" options:0 context:&CWCancellationGroupObservingContext];
+        observing = YES;
+    }
+    pthread_mutex_unlock(&_lock);
+    if (cancelled) {
+    	[operation cancel];
+    } else if (observing && [operation isFinished]) {
+    	// Finished before observed, no notification will remove it.
+    	[self removeOperation:operation];
+    }
+}
+
+-(void)removeOperation:(NSOperation*)operation;
+{
+	pthread_mutex_lock(&_lock);
+    BOOL didContain = [_operations containsObject:operation];
+    if (didContain) {
+    	[operation removeObserver:self forKeyPath:@"isFinished"];
+        [_operations removeObject:operation];
+    }
+    pthread_mutex_unlock(&_lock);
+    if (didContain) {
+    	[self release];
+    }
+}
+
+-(NSUInteger)cancel;
+{
+	pthread_mutex_lock(&_lock);
+    _cancelled = YES;
+    NSArray* operations = [_operations allObjects];
+    pthread_mutex_unlock(&_lock);
+    // Cancel without the lock, cancelled operations may finish immediately.
+    NSUInteger count = 0;
+    for (NSOperation* operation in operations) {
+    	if (![operation isCancelled] && ![operation isFinished]) {
+        	[operation cancel];
+            count++;
+        }
+    }
+    pthread_mutex_lock(&_lock);
+    _cancelledOperationCount += count;
+    pthread_mutex_unlock(&_lock);
+    return count;
+}
+
+-(void)observeValueForKeyPath:(NSString*)keyPath ofObject:(id)object change:(NSDictionary*)change context:(void*)context;
+{
+	if (context != &CWCancellationGroupObservingContext) {
+    	[super observeValueForKeyPath:keyPath ofObject:object change:change context:context];
+        return;
+    }
+    if ([object isFinished]) {
+    	[self removeOperation:object];
+    }
+}
+
+@end
+
+
+@implementation NSOperationQueue (CWCancellationGroup)
+
+-(void)addOperation:(NSOperation*)operation cancellationGroup:(CWCancellationGroup*)group;
+{
+	[group addOperation:operation];
+    [self addOperation:operation];
+}
+
+@end
+
+
+@implementation NSObject (CWCancellationGroup)
+
+-(NSInvocationOperation*)performSelector:(SEL)aSelector onQueue:(NSOperationQueue*)queue withObject:(id)arg cancellationGroup:(CWCancellationGroup*)group;
+{
+	NSInvocationOperation* operation = [[[NSInvocationOperation alloc] initWithTarget:self selector:aSelector object:arg] autorelease];
+    [group addOperation:operation];
+    if (![queue addOperation:operation weight:1 error:NULL]) {
+    	[group removeOperation:operation];
+    	return nil;
+    }
+	return operation;  
+}
+
+@end
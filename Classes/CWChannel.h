@@ -0,0 +1,95 @@
+//
+//  CWChannel.h
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import <pthread.h>
+
+/*!
+ * @abstract CWChannel is a bounded first in first out queue of objects for
+ *           passing objects between threads.
+ *
+ * @discussion Producers block while the channel is full, and consumers while
+ *             it is empty. Closing a channel marks the end of the stream,
+ *             consumers get the remaining objects and then nil. Cancelling a
+ *             channel discards all objects and wakes all blocked threads.
+ */
+@interface CWChannel : NSObject {
+@private
+	pthread_mutex_t _lock;
+    pthread_cond_t _notEmpty;
+    pthread_cond_t _notFull;
+    id* _objects;
+    NSUInteger _capacity;
+    NSUInteger _head;
+    NSUInteger _count;
+    NSUInteger _takenCount;
+    BOOL _closed;
+    BOOL _cancelled;
+}
+
+@property(readonly, assign) NSUInteger capacity;
+@property(readonly, assign) NSUInteger count;
+@property(readonly, assign, getter=isClosed) BOOL closed;
+@property(readonly, assign, getter=isCancelled) BOOL cancelled;
+
+/*!
+ * @abstract Init a channel holding at most capacity objects, at least 1.
+ */
+-(id)initWithCapacity:(NSUInteger)capacity;
+
+/*!
+ * @abstract Put an object last in the channel, blocking while full.
+ * @result NO if the channel is closed or cancelled.
+ */
+-(BOOL)putObject:(id)object;
+
+/*!
+ * @abstract Take the first object from the channel, blocking while empty.
+ * @result The object, or nil if closed and empty, or cancelled.
+ */
+-(id)takeObject;
+
+/*!
+ * @abstract Take the first object, and its sequence number.
+ * @discussion Objects are numbered from 0 in the order they were put.
+ */
+-(id)takeObjectWithSequenceNumber:(NSUInteger*)sequenceNumber;
+
+/*!
+ * @abstract Close the channel, marking the end of the stream.
+ */
+-(void)close;
+
+/*!
+ * @abstract Cancel the channel, discarding all objects.
+ */
+-(void)cancel;
+
+@end
@@ -0,0 +1,155 @@
+//
+//  CWChannel.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWChannel.h"
+
+
+@implementation CWChannel
+
+-(id)init;
+{
+	return [self initWithCapacity:1];
+}
+
+-(id)initWithCapacity:(NSUInteger)capacity;
+{
+	self = [super init];
+    if (self) {
+    	pthread_mutex_init(&_lock, NULL);
+        pthread_cond_init(&_notEmpty, NULL);
+        pthread_cond_init(&_notFull, NULL);
+        _capacity = MAX(capacity, 1);
+        _objects = calloc(_capacity, sizeof(id));
+    }
+    return self;
+}
+
+-(void)dealloc;
+{
+	for (NSUInteger index = 0; index < _count; index++) {
+    	[_objects[(_head + index) % _capacity] release];
+    }
+    free(_objects);
+    pthread_cond_destroy(&_notFull);
+    pthread_cond_destroy(&_notEmpty);
+    pthread_mutex_destroy(&_lock);
+    [super dealloc];
+}
+
+-(NSUInteger)capacity;
+{
+	return _capacity;
+}
+
+#define CW_LOCKED_GETTER(type, name, value) \
+-(type)name; \
+{ \
+	pthread_mutex_lock(&_lock); \
+    type result = value; \
+    pthread_mutex_unlock(&_lock); \
+    return result; \
+}
+
+CW_LOCKED_GETTER(NSUInteger, count, _count)
+CW_LOCKED_GETTER(BOOL, isClosed, _closed)
+CW_LOCKED_GETTER(BOOL, isCancelled, _cancelled)
+
+#undef CW_LOCKED_GETTER
+
+-(BOOL)putObject:(id)object;
+{
+	if (object == nil) {
+    	[NSException raise:NSInvalidArgumentException format:@"Can not put nil in a channel"];
+    }
+	pthread_mutex_lock(&_lock);
+    while (_count == _capacity && !_closed && !_cancelled) {
+    	pthread_cond_wait(&_notFull, &_lock);
+    }
+    BOOL put = !_closed && !_cancelled;
+    if (put) {
+    	_objects[(_head + _count) % _capacity] = [object retain];
+        _count++;
+        pthread_cond_signal(&_notEmpty);
+    }
+    pthread_mutex_unlock(&_lock);
+    return put;
+}
+
+-(id)takeObject;
+{
+	return [self takeObjectWithSequenceNumber:NULL];
+}
+
+-(id)takeObjectWithSequenceNumber:(NSUInteger*)sequenceNumber;
+{
+	id object = nil;
+	pthread_mutex_lock(&_lock);
+    while (_count == 0 && !_closed && !_cancelled) {
+    	pthread_cond_wait(&_notEmpty, &_lock);
+    }
+    if (_count > 0 && !_cancelled) {
+    	object = _objects[_head];
+        _objects[_head] = nil;
+        _head = (_head + 1) % _capacity;
+        _count--;
+        if (sequenceNumber) {
+        	*sequenceNumber = _takenCount;
+        }
+        _takenCount++;
+        pthread_cond_signal(&_notFull);
+    }
+    pthread_mutex_unlock(&_lock);
+    return [object autorelease];
+}
+
+-(void)close;
+{
+	pthread_mutex_lock(&_lock);
+    _closed = YES;
+    pthread_cond_broadcast(&_notEmpty);
+    pthread_cond_broadcast(&_notFull);
+    pthread_mutex_unlock(&_lock);
+}
+
+-(void)cancel;
+{
+	pthread_mutex_lock(&_lock);
+    _cancelled = YES;
+    for (; _count > 0; _count--) {
+    	[_objects[_head] release];
+        _objects[_head] = nil;
+        _head = (_head + 1) % _capacity;
+    }
+    pthread_cond_broadcast(&_notEmpty);
+    pthread_cond_broadcast(&_notFull);
+    pthread_mutex_unlock(&_lock);
+}
+
+@end
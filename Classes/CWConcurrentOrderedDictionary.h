@@ -0,0 +1,59 @@
+//
+//  CWConcurrentOrderedDictionary.h
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import <pthread.h>
+#import "CWOrderedDictionary.h"
+
+/*!
+ * @abstract CWConcurrentOrderedDictionary is a thread safe CWOrderedDictionary.
+ *
+ * @discussion All methods of CWOrderedDictionary, NSMutableDictionary and
+ *             NSDictionary can be called from any thread. Access is guarded by
+ *             a reader-writer lock, so that lookups by key or index run
+ *             concurrently and only block while a mutation is in progress.
+ *
+ *             Fast enumeration, keyEnumerator and objectEnumerator iterates a
+ *             copy-on-write snapshot taken in constant time when enumeration
+ *             starts. Writers are never blocked by an ongoing enumeration, and
+ *             enumeration never throws for concurrent mutations.
+ *
+ *             Objects returned are retained and autoreleased on the calling
+ *             thread, and stay valid even if concurrently removed.
+ *
+ *             Comparators and sort functions are called with the lock held,
+ *             and must not access the dictionary being sorted.
+ */
+@interface CWConcurrentOrderedDictionary : CWOrderedDictionary {
+@private
+    pthread_rwlock_t _lock;
+}
+
+@end
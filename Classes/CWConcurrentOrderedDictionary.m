@@ -0,0 +1,441 @@
+//
+//  CWConcurrentOrderedDictionary.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWConcurrentOrderedDictionary.h"
+
+
+@interface CWOrderedDictionary (CWConcurrentOrderedDictionary)
+-(BOOL)needsCompaction;
+-(void)compact;
+@end
+
+
+@implementation CWConcurrentOrderedDictionary
+
+#pragma mark --- Locking
+
+#define CWReadLock(self) pthread_rwlock_rdlock(&(self)->_lock)
+#define CWWriteLock(self) pthread_rwlock_wrlock(&(self)->_lock)
+#define CWUnlock(self) pthread_rwlock_unlock(&(self)->_lock)
+
+/*
+ * Lock for a read that access entries by index. Accessing by index compacts
+ * the storage if it has holes, so a write lock is taken in that case.
+ */
+static void CWLockForIndexing(CWConcurrentOrderedDictionary* self)
+{
+	CWReadLock(self);
+    if ([self needsCompaction]) {
+    	CWUnlock(self);
+        CWWriteLock(self);
+        [self compact];
+    }
+}
+
+#pragma mark --- Life cycle
+
++(id)allocWithZone:(NSZone*)zone;
+{
+	CWConcurrentOrderedDictionary* dictionary = [super allocWithZone:zone];
+    if (dictionary) {
+        pthread_rwlock_init(&dictionary->_lock, NULL);
+    }
+    return dictionary;
+}
+
+-(void)dealloc;
+{
+	pthread_rwlock_destroy(&_lock);
+    [super dealloc];
+}
+
+#pragma mark --- Reading
+
+-(NSUInteger)count;
+{
+	CWReadLock(self);
+    NSUInteger count = [super count];
+    CWUnlock(self);
+    return count;
+}
+
+-(id)objectForKey:(id)key;
+{
+	CWReadLock(self);
+    id object = [[super objectForKey:key] retain];
+    CWUnlock(self);
+    return [object autorelease];
+}
+
+-(id)keyAtIndex:(NSUInteger)index;
+{
+	CWLockForIndexing(self);
+    id key = nil;
+    @try {
+    	key = [[super keyAtIndex:index] retain];
+    }
+    @finally {
+    	CWUnlock(self);
+    }
+    return [key autorelease];
+}
+
+-(id)objectAtIndex:(NSUInteger)index;
+{
+	CWLockForIndexing(self);
+    id object = nil;
+    @try {
+    	object = [[super objectAtIndex:index] retain];
+    }
+    @finally {
+    	CWUnlock(self);
+    }
+    return [object autorelease];
+}
+
+-(NSUInteger)indexForKey:(id)key;
+{
+	CWLockForIndexing(self);
+    NSUInteger index = [super indexForKey:key];
+    CWUnlock(self);
+    return index;
+}
+
+-(NSIndexSet*)allIndexesForObject:(id)object;
+{
+	CWLockForIndexing(self);
+    NSIndexSet* indexes = [[super allIndexesForObject:object] retain];
+    CWUnlock(self);
+    return [indexes autorelease];
+}
+
+-(NSArray*)allKeys;
+{
+	CWLockForIndexing(self);
+    NSArray* keys = [[super allKeys] retain];
+    CWUnlock(self);
+    return [keys autorelease];
+}
+
+-(NSArray*)allValues;
+{
+	CWLockForIndexing(self);
+    NSArray* values = [[super allValues] retain];
+    CWUnlock(self);
+    return [values autorelease];
+}
+
+-(NSEnumerator*)keyEnumerator;
+{
+	return [[self allKeys] objectEnumerator];
+}
+
+-(NSEnumerator*)objectEnumerator;
+{
+	return [[self allValues] objectEnumerator];
+}
+
+-(NSUInteger)countByEnumeratingWithState:(NSFastEnumerationState*)state objects:(id*)stackbuf count:(NSUInteger)len;
+{
+    if (state->state == 0) {
+        CWReadLock(self);
+        BOOL needsCompaction = [self needsCompaction];
+        CWUnlock(self);
+        if (needsCompaction) {
+            CWWriteLock(self);
+            [self compact];
+            CWUnlock(self);
+        }
+        CWOrderedDictionary* snapshot = [[[CWOrderedDictionary alloc] initWithDictionary:self] autorelease];
+        return [snapshot countByEnumeratingWithState:state objects:stackbuf count:len];
+    }
+    return 0;
+}
+
+-(NSUInteger)hash;
+{
+	CWReadLock(self);
+    NSUInteger hash = [super hash];
+    CWUnlock(self);
+    return hash;
+}
+
+-(BOOL)isEqualToDictionary:(NSDictionary*)otherDictionary;
+{
+	CWOrderedDictionary* snapshot = [[[CWOrderedDictionary alloc] initWithDictionary:self] autorelease];
+    return [snapshot isEqualToDictionary:otherDictionary];
+}
+
+-(NSString*)descriptionWithLocale:(id)locale indent:(NSUInteger)level;
+{
+	CWReadLock(self);
+    NSString* description = [[super descriptionWithLocale:locale indent:level] retain];
+    CWUnlock(self);
+    return [description autorelease];
+}
+
+-(id)copyWithZone:(NSZone*)zone;
+{
+	CWReadLock(self);
+    id copy = [super copyWithZone:zone];
+    CWUnlock(self);
+    return copy;
+}
+
+-(void)encodeWithCoder:(NSCoder*)aCoder;
+{
+	CWOrderedDictionary* snapshot = [[[CWOrderedDictionary alloc] initWithDictionary:self] autorelease];
+    [snapshot encodeWithCoder:aCoder];
+}
+
+-(NSData*)compactArchivedData;
+{
+	CWOrderedDictionary* snapshot = [[[CWOrderedDictionary alloc] initWithDictionary:self] autorelease];
+    return [snapshot compactArchivedData];
+}
+
+#pragma mark --- Writing
+
+-(void)setObject:(id)object forKey:(id)key;
+{
+	CWWriteLock(self);
+    @try {
+    	[super setObject:object forKey:key];
+    }
+    @finally {
+    	CWUnlock(self);
+    }
+}
+
+-(void)removeObjectForKey:(id)key;
+{
+	CWWriteLock(self);
+    @try {
+    	[super removeObjectForKey:key];
+    }
+    @finally {
+    	CWUnlock(self);
+    }
+}
+
+-(void)removeAllObjects;
+{
+	CWWriteLock(self);
+    @try {
+    	[super removeAllObjects];
+    }
+    @finally {
+    	CWUnlock(self);
+    }
+}
+
+-(void)insertObject:(id)object forKey:(id)key atIndex:(NSUInteger)index;
+{
+	CWWriteLock(self);
+    @try {
+    	[super insertObject:object forKey:key atIndex:index];
+    }
+    @finally {
+    	CWUnlock(self);
+    }
+}
+
+-(void)removeObjectAtIndex:(NSUInteger)index;
+{
+	CWWriteLock(self);
+    @try {
+    	[super removeObjectAtIndex:index];
+    }
+    @finally {
+    	CWUnlock(self);
+    }
+}
+
+-(void)moveObjectForKey:(id)key toIndex:(NSUInteger)index;
+{
+	CWWriteLock(self);
+    @try {
+    	[super moveObjectForKey:key toIndex:index];
+    }
+    @finally {
+    	CWUnlock(self);
+    }
+}
+
+-(void)insertObjects:(NSArray*)objects forKeys:(NSArray*)keys atIndexes:(NSIndexSet*)indexes;
+{
+	CWWriteLock(self);
+    @try {
+    	[super insertObjects:objects forKeys:keys atIndexes:indexes];
+    }
+    @finally {
+    	CWUnlock(self);
+    }
+}
+
+-(void)removeObjectsAtIndexes:(NSIndexSet*)indexes;
+{
+	CWWriteLock(self);
+    @try {
+    	[super removeObjectsAtIndexes:indexes];
+    }
+    @finally {
+    	CWUnlock(self);
+    }
+}
+
+-(void)removeObjectsForKeys:(NSArray*)keys;
+{
+	CWWriteLock(self);
+    @try {
+    	[super removeObjectsForKeys:keys];
+    }
+    @finally {
+    	CWUnlock(self);
+    }
+}
+
+-(void)moveObjectsAtIndexes:(NSIndexSet*)indexes toIndex:(NSUInteger)index;
+{
+	CWWriteLock(self);
+    @try {
+    	[super moveObjectsAtIndexes:indexes toIndex:index];
+    }
+    @finally {
+    	CWUnlock(self);
+    }
+}
+
+#pragma mark --- Sorting
+
+-(void)sortByKeyUsingDescriptors:(NSArray*)sortDescriptors;
+{
+	CWWriteLock(self);
+    @try {
+    	[super sortByKeyUsingDescriptors:sortDescriptors];
+    }
+    @finally {
+    	CWUnlock(self);
+    }
+}
+
+#if NS_BLOCKS_AVAILABLE
+-(void)sortByKeyUsingComparator:(NSComparator)cmptr;
+{
+	CWWriteLock(self);
+    @try {
+    	[super sortByKeyUsingComparator:cmptr];
+    }
+    @finally {
+    	CWUnlock(self);
+    }
+}
+
+-(void)sortByKeyWithOptions:(NSSortOptions)opts usingComparator:(NSComparator)cmptr;
+{
+	CWWriteLock(self);
+    @try {
+    	[super sortByKeyWithOptions:opts usingComparator:cmptr];
+    }
+    @finally {
+    	CWUnlock(self);
+    }
+}
+#endif
+
+-(void)sortByKeyUsingFunction:(NSInteger(*)(id, id, void*))compare context:(void*)context;
+{
+	CWWriteLock(self);
+    @try {
+    	[super sortByKeyUsingFunction:compare context:context];
+    }
+    @finally {
+    	CWUnlock(self);
+    }
+}
+
+-(void)sortByKeyUsingSelector:(SEL)comparator;
+{
+	CWWriteLock(self);
+    @try {
+    	[super sortByKeyUsingSelector:comparator];
+    }
+    @finally {
+    	CWUnlock(self);
+    }
+}
+
+-(void)sortByValueUsingDescriptors:(NSArray*)sortDescriptors;
+{
+	CWWriteLock(self);
+    @try {
+    	[super sortByValueUsingDescriptors:sortDescriptors];
+    }
+    @finally {
+    	CWUnlock(self);
+    }
+}
+
+-(void)sortByValueUsingSelector:(SEL)comparator;
+{
+	CWWriteLock(self);
+    @try {
+    	[super sortByValueUsingSelector:comparator];
+    }
+    @finally {
+    	CWUnlock(self);
+    }
+}
+
+#if NS_BLOCKS_AVAILABLE
+-(void)sortByValueUsingComparator:(NSComparator)cmptr;
+{
+	CWWriteLock(self);
+    @try {
+    	[super sortByValueUsingComparator:cmptr];
+    }
+    @finally {
+    	CWUnlock(self);
+    }
+}
+
+-(void)sortByValueWithOptions:(NSSortOptions)opts usingComparator:(NSComparator)cmptr;
+{
+	CWWriteLock(self);
+    @try {
+    	[super sortByValueWithOptions:opts usingComparator:cmptr];
+    }
+    @finally {
+    	CWUnlock(self);
+    }
+}
+#endif
+
+@end
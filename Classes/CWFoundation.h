@@ -28,10 +28,23 @@
 //  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 
+#import "CWCancellationGroup.h"
+#import "CWChannel.h"
+#import "CWConcurrentOrderedDictionary.h"
 #import "CWFileURLFromDataTransformer.h"
+#import "CWFuture.h"
+#import "CWHistogram.h"
 #import "CWLocalization.h"
 #import "CWLog.h"
+#import "CWLRUCache.h"
+#import "CWMainThreadDispatcher.h"
 #import "CWOrderedDictionary.h"
+#import "CWPipeline.h"
+#import "CWSortedArray.h"
+#import "CWSortKeys.h"
+#import "CWThreadPool.h"
+#import "CWTimerWheel.h"
+#import "CWWorkStealingQueue.h"
 #import "CWXMLTranslation.h"
 #import "CWXMLTranslator.h"
 #import "NSArray+CWSortedInsert.h"
@@ -42,7 +55,9 @@
 #import "NSInvocation+CWVariableArguments.h"
 #import "NSObject+CWAssociatedObject.h"
 #import "NSObject+CWInvocationProxy.h"
+#import "NSOperationQueue+CWBoundedQueue.h"
 #import "NSOperationQueue+CWDefaultQueue.h"
+#import "NSOperationQueue+CWInstrumentation.h"
 #import "NSOperationQueue+CWReplaceOperation.h"
 #import "NSString+CWAdditions.h"
 #import "NSURLLoadingSystem+CWAdditions.h"
@@ -0,0 +1,159 @@
+//
+//  CWFuture.h
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import <pthread.h>
+
+/*!
+ * @abstract CWFuture is the result of an asynchronous operation, that may not
+ *           yet have finished.
+ *
+ * @discussion A future is finished once, with a result, an exception, or by
+ *             being cancelled. Threads waiting for the result are woken using a
+ *             condition variable as soon as the future is finished.
+ *
+ *             Continuations are performed when the future is finished, on the
+ *             finishing thread or on a queue, and are themselves futures so
+ *             they can be chained.
+ */
+@interface CWFuture : NSObject {
+@private
+	pthread_mutex_t _lock;
+    pthread_cond_t _condition;
+    BOOL _finished;
+    BOOL _cancelled;
+    id _result;
+    NSException* _exception;
+    NSMutableArray* _continuations;
+    NSMutableArray* _continuationQueues;
+}
+
+/*!
+ * @abstract YES if finished with a result, an exception or cancelled.
+ */
+@property(readonly, assign, getter=isFinished) BOOL finished;
+@property(readonly, assign, getter=isCancelled) BOOL cancelled;
+
+/*!
+ * @abstract The exception the future finished with, or nil.
+ * @discussion Does not wait for the future to finish.
+ */
+@property(readonly, retain) NSException* exception;
+
+/*!
+ * @abstract Returns a new unfinished future.
+ */
++(CWFuture*)future;
+
++(CWFuture*)futureWithResult:(id)result;
+
+/*!
+ * @abstract Returns a future finished when all futures are finished.
+ * @discussion The result is an array with the results of all futures, in
+ *             order, with NSNull for nil results. If any future finish with
+ *             an exception the returned future finish with that exception.
+ */
++(CWFuture*)whenAll:(NSArray*)futures;
+
+/*!
+ * @abstract Returns a future finished when any of the futures is finished.
+ * @discussion The result is the first future that finished.
+ */
++(CWFuture*)whenAny:(NSArray*)futures;
+
+/*!
+ * @abstract Wait until finished and return the result.
+ * @discussion Raises the exception if the future finished with an exception,
+ *             returns nil if cancelled.
+ */
+-(id)result;
+
+-(void)waitUntilFinished;
+
+/*!
+ * @abstract Wait until finished, or date. Returns YES if finished.
+ */
+-(BOOL)waitUntilFinishedBeforeDate:(NSDate*)date;
+
+/*!
+ * @abstract Finish the future, returns NO if it was already finished.
+ */
+-(BOOL)finishWithResult:(id)result;
+-(BOOL)finishWithException:(NSException*)exception;
+-(BOOL)cancel;
+
+/*!
+ * @abstract Invoke the invocation and finish with its return value.
+ *
+ * @discussion Object return values are used as is, scalars are boxed as
+ *             NSNumber, and other types as NSValue. Void methods finish with
+ *             a nil result. An exception raised by the invocation finishes the
+ *             future with that exception. Does nothing if already finished.
+ */
+-(BOOL)finishWithInvocation:(NSInvocation*)invocation;
+
+/*!
+ * @abstract Perform a selector taking the finished future as argument, when
+ *           finished.
+ *
+ * @discussion The selector is performed on the thread finishing the future, or
+ *             immediately if already finished. Returns a future for the return
+ *             value of the selector.
+ */
+-(CWFuture*)continueWithTarget:(id)target selector:(SEL)aSelector;
+
+/*!
+ * @abstract Perform a selector taking the finished future as argument, on a
+ *           queue when finished.
+ */
+-(CWFuture*)continueOnQueue:(NSOperationQueue*)queue withTarget:(id)target selector:(SEL)aSelector;
+
+#if NS_BLOCKS_AVAILABLE
+-(CWFuture*)continueWithBlock:(id (^)(CWFuture* future))block;
+-(CWFuture*)continueOnQueue:(NSOperationQueue*)queue withBlock:(id (^)(CWFuture* future))block;
+#endif
+
+@end
+
+
+/*!
+ * @abstract An invocation operation finishing a future with the return value of
+ *           the invocation.
+ *
+ * @discussion Cancelling the operation cancels the future.
+ */
+@interface CWFutureOperation : NSInvocationOperation {
+@private
+	CWFuture* _future;
+}
+
+@property(readonly, retain) CWFuture* future;
+
+@end
@@ -0,0 +1,464 @@
+//
+//  CWFuture.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWFuture.h"
+#import "CWAtomic.h"
+
+/*
+ * Combines several futures for whenAll: and whenAny:.
+ */
+@interface CWFutureCombination : NSObject {
+@private
+	NSArray* _futures;
+    CWFuture* _future;
+    volatile int32_t _remainingCount;
+    BOOL _any;
+}
+
+-(id)initWithFutures:(NSArray*)futures any:(BOOL)any;
+-(CWFuture*)future;
+-(void)futureDidFinish:(CWFuture*)future;
+
+@end
+
+
+#if NS_BLOCKS_AVAILABLE
+@interface CWFutureBlockContinuation : NSObject {
+@private
+	id (^_block)(CWFuture* future);
+}
+
+-(id)initWithBlock:(id (^)(CWFuture* future))block;
+-(id)performWithFuture:(CWFuture*)future;
+
+@end
+#endif
+
+
+@implementation CWFuture
+
+#pragma mark --- Private helpers
+
+/*
+ * The return value of an invoked invocation as an object.
+ */
+static id CWFutureReturnValue(NSInvocation* invocation)
+{
+	NSMethodSignature* signature = [invocation methodSignature];
+    const char* type = [signature methodReturnType];
+    while (*type && strchr("rnNoORV", *type)) {
+    	type++;
+    }
+    switch (*type) {
+        case 'v':
+            return nil;
+        case '@':
+        case '#': {
+            id value = nil;
+            [invocation getReturnValue:&value];
+            return value;
+        }
+#define CW_RETURN_NUMBER(typeCode, ctype, method) \
+        case typeCode: { \
+            ctype value; \
+            [invocation getReturnValue:&value]; \
+            return [NSNumber method:value]; \
+        }
+        CW_RETURN_NUMBER('c', char, numberWithChar)
+        CW_RETURN_NUMBER('C', unsigned char, numberWithUnsignedChar)
+        CW_RETURN_NUMBER('s', short, numberWithShort)
+        CW_RETURN_NUMBER('S', unsigned short, numberWithUnsignedShort)
+        CW_RETURN_NUMBER('i', int, numberWithInt)
+        CW_RETURN_NUMBER('I', unsigned int, numberWithUnsignedInt)
+        CW_RETURN_NUMBER('l', long, numberWithLong)
+        CW_RETURN_NUMBER('L', unsigned long, numberWithUnsignedLong)
+        CW_RETURN_NUMBER('q', long long, numberWithLongLong)
+        CW_RETURN_NUMBER('Q', unsigned long long, numberWithUnsignedLongLong)
+        CW_RETURN_NUMBER('f', float, numberWithFloat)
+        CW_RETURN_NUMBER('d', double, numberWithDouble)
+        CW_RETURN_NUMBER('B', bool, numberWithBool)
+#undef CW_RETURN_NUMBER
+        default: {
+            void* buffer = malloc([signature methodReturnLength]);
+            [invocation getReturnValue:buffer];
+            NSValue* value = [NSValue valueWithBytes:buffer objCType:type];
+            free(buffer);
+            return value;
+        }
+    }
+}
+
+/*
+ * Finish once, continuations are performed after unlocking since they may
+ * access the future.
+ */
+static BOOL CWFutureFinish(CWFuture* self, id result, NSException* exception, BOOL cancelled)
+{
+	pthread_mutex_lock(&self->_lock);
+    if (self->_finished) {
+    	pthread_mutex_unlock(&self->_lock);
+        return NO;
+    }
+    self->_finished = YES;
+    self->_cancelled = cancelled;
+    self->_result = [result retain];
+    self->_exception = [exception retain];
+    NSArray* continuations = self->_continuations;
+    NSArray* continuationQueues = self->_continuationQueues;
+    self->_continuations = nil;
+    self->_continuationQueues = nil;
+    pthread_cond_broadcast(&self->_condition);
+    pthread_mutex_unlock(&self->_lock);
+    for (NSUInteger index = 0; index < [continuations count]; index++) {
+    	NSOperation* operation = [continuations objectAtIndex:index];
+        id queue = [continuationQueues objectAtIndex:index];
+        if (queue == [NSNull null]) {
+        	[operation start];
+        } else {
+        	[queue addOperation:operation];
+        }
+    }
+    [continuations release];
+    [continuationQueues release];
+    return YES;
+}
+
+static CWFuture* CWFutureAddContinuation(CWFuture* self, CWFutureOperation* operation, NSOperationQueue* queue)
+{
+	pthread_mutex_lock(&self->_lock);
+    if (!self->_finished) {
+    	if (self->_continuations == nil) {
+        	self->_continuations = [[NSMutableArray alloc] initWithCapacity:1];
+            self->_continuationQueues = [[NSMutableArray alloc] initWithCapacity:1];
+        }
+        [self->_continuations addObject:operation];
+        [self->_continuationQueues addObject:queue ? (id)queue : (id)[NSNull null]];
+        pthread_mutex_unlock(&self->_lock);
+    } else {
+    	pthread_mutex_unlock(&self->_lock);
+        if (queue) {
+        	[queue addOperation:operation];
+        } else {
+        	[operation start];
+        }
+    }
+    return [operation future];
+}
+
+#pragma mark --- Life cycle
+
++(CWFuture*)future;
+{
+	return [[[self alloc] init] autorelease];
+}
+
++(CWFuture*)futureWithResult:(id)result;
+{
+	CWFuture* future = [self future];
+    [future finishWithResult:result];
+    return future;
+}
+
++(CWFuture*)whenAll:(NSArray*)futures;
+{
+	CWFutureCombination* combination = [[[CWFutureCombination alloc] initWithFutures:futures any:NO] autorelease];
+    return [combination future];
+}
+
++(CWFuture*)whenAny:(NSArray*)futures;
+{
+	if ([futures count] == 0) {
+    	[NSException raise:NSInvalidArgumentException format:@"Can not wait for any of no futures"];
+    }
+	CWFutureCombination* combination = [[[CWFutureCombination alloc] initWithFutures:futures any:YES] autorelease];
+    return [combination future];
+}
+
+-(id)init;
+{
+	self = [super init];
+    if (self) {
+    	pthread_mutex_init(&_lock, NULL);
+        pthread_cond_init(&_condition, NULL);
+    }
+    return self;
+}
+
+-(void)dealloc;
+{
+	pthread_cond_destroy(&_condition);
+    pthread_mutex_destroy(&_lock);
+    [_result release];
+    [_exception release];
+    [_continuations release];
+    [_continuationQueues release];
+    [super dealloc];
+}
+
+#pragma mark --- Public API
+
+-(BOOL)isFinished;
+{
+	pthread_mutex_lock(&_lock);
+    BOOL finished = _finished;
+    pthread_mutex_unlock(&_lock);
+    return finished;
+}
+
+-(BOOL)isCancelled;
+{
+	pthread_mutex_lock(&_lock);
+    BOOL cancelled = _cancelled;
+    pthread_mutex_unlock(&_lock);
+    return cancelled;
+}
+
+-(NSException*)exception;
+{
+	pthread_mutex_lock(&_lock);
+    NSException* exception = [[_exception retain] autorelease];
+    pthread_mutex_unlock(&_lock);
+    return exception;
+}
+
+-(id)result;
+{
+	[self waitUntilFinished];
+    if (_exception) {
+    	[_exception raise];
+    }
+    return [[_result retain] autorelease];
+}
+
+-(void)waitUntilFinished;
+{
+	pthread_mutex_lock(&_lock);
+    while (!_finished) {
+    	pthread_cond_wait(&_condition, &_lock);
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+-(BOOL)waitUntilFinishedBeforeDate:(NSDate*)date;
+{
+	NSTimeInterval time = [date timeIntervalSince1970];
+    struct timespec deadline;
+    deadline.tv_sec = (time_t)time;
+    deadline.tv_nsec = (long)((time - (NSTimeInterval)deadline.tv_sec) * 1000000000.0);
+	pthread_mutex_lock(&_lock);
+    while (!_finished) {
+    	if (pthread_cond_timedwait(&_condition, &_lock, &deadline) != 0) {
+        	break;
+        }
+    }
+    BOOL finished = _finished;
+    pthread_mutex_unlock(&_lock);
+    return finished;
+}
+
+-(BOOL)finishWithResult:(id)result;
+{
+	return CWFutureFinish(self, result, nil, NO);
+}
+
+-(BOOL)finishWithException:(NSException*)exception;
+{
+	return CWFutureFinish(self, nil, exception, NO);
+}
+
+-(BOOL)cancel;
+{
+	return CWFutureFinish(self, nil, nil, YES);
+}
+
+-(BOOL)finishWithInvocation:(NSInvocation*)invocation;
+{
+	if ([self isFinished]) {
+    	return NO;
+    }
+    id result = nil;
+    @try {
+    	[invocation invoke];
+        result = CWFutureReturnValue(invocation);
+    }
+    @catch (NSException* exception) {
+    	return [self finishWithException:exception];
+    }
+    return [self finishWithResult:result];
+}
+
+-(CWFuture*)continueWithTarget:(id)target selector:(SEL)aSelector;
+{
+	return [self continueOnQueue:nil withTarget:target selector:aSelector];
+}
+
+-(CWFuture*)continueOnQueue:(NSOperationQueue*)queue withTarget:(id)target selector:(SEL)aSelector;
+{
+	CWFutureOperation* operation = [[[CWFutureOperation alloc] initWithTarget:target selector:aSelector object:self] autorelease];
+    return CWFutureAddContinuation(self, operation, queue);
+}
+
+#if NS_BLOCKS_AVAILABLE
+-(CWFuture*)continueWithBlock:(id (^)(CWFuture* future))block;
+{
+	return [self continueOnQueue:nil withBlock:block];
+}
+
+-(CWFuture*)continueOnQueue:(NSOperationQueue*)queue withBlock:(id (^)(CWFuture* future))block;
+{
+	CWFutureBlockContinuation* continuation = [[[CWFutureBlockContinuation alloc] initWithBlock:block] autorelease];
+    return [self continueOnQueue:queue withTarget:continuation selector:@selector(performWithFuture:)];
+}
+#endif
+
+@end
+
+
+@implementation CWFutureCombination
+
+-(id)initWithFutures:(NSArray*)futures any:(BOOL)any;
+{
+	self = [super init];
+    if (self) {
+    	_futures = [futures copy];
+        _future = [[CWFuture alloc] init];
+        _remainingCount = (int32_t)[_futures count];
+        _any = any;
+        if (_remainingCount == 0) {
+        	[_future finishWithResult:[NSArray array]];
+        }
+        for (CWFuture* future in _futures) {
+        	[future continueWithTarget:self selector:@selector(futureDidFinish:)];
+        }
+    }
+    return self;
+}
+
+-(void)dealloc;
+{
+	[_futures release];
+    [_future release];
+    [super dealloc];
+}
+
+-(CWFuture*)future;
+{
+	return _future;
+}
+
+-(void)futureDidFinish:(CWFuture*)future;
+{
+	if (_any) {
+    	[_future finishWithResult:future];
+    } else if (CWAtomicDecrement32(&_remainingCount) == 0) {
+    	NSMutableArray* results = [NSMutableArray arrayWithCapacity:[_futures count]];
+        for (CWFuture* future in _futures) {
+        	NSException* exception = [future exception];
+            if (exception) {
+            	[_future finishWithException:exception];
+                return;
+            }
+            id result = [future result];
+            [results addObject:result ? result : [NSNull null]];
+        }
+        [_future finishWithResult:results];
+    }
+}
+
+@end
+
+
+#if NS_BLOCKS_AVAILABLE
+@implementation CWFutureBlockContinuation
+
+-(id)initWithBlock:(id (^)(CWFuture* future))block;
+{
+	self = [super init];
+    if (self) {
+    	_block = [block copy];
+    }
+    return self;
+}
+
+-(void)dealloc;
+{
+	[_block release];
+    [super dealloc];
+}
+
+-(id)performWithFuture:(CWFuture*)future;
+{
+	return _block(future);
+}
+
+@end
+#endif
+
+
+@implementation CWFutureOperation
+
+@synthesize future = _future;
+
+-(id)initWithInvocation:(NSInvocation*)invocation;
+{
+	self = [super initWithInvocation:invocation];
+    if (self && _future == nil) {
+    	_future = [[CWFuture alloc] init];
+    }
+    return self;
+}
+
+-(id)initWithTarget:(id)target selector:(SEL)sel object:(id)arg;
+{
+	self = [super initWithTarget:target selector:sel object:arg];
+    if (self && _future == nil) {
+    	_future = [[CWFuture alloc] init];
+    }
+    return self;
+}
+
+-(void)dealloc;
+{
+	[_future release];
+    [super dealloc];
+}
+
+-(void)main;
+{
+	[_future finishWithInvocation:[self invocation]];
+}
+
+-(void)cancel;
+{
+	[super cancel];
+    [_future cancel];
+}
+
+@end
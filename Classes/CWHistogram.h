@@ -0,0 +1,65 @@
+//
+//  CWHistogram.h
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+
+/*!
+ * @abstract CWHistogram is a log-linear histogram of unsigned integer values,
+ *           that can be recorded to from many threads without locking.
+ *
+ * @discussion Values below 16 are counted exactly, larger values in 8 linear
+ *             buckets per power of two, so percentiles are within 12.5% of the
+ *             recorded values. Recording is a few atomic operations, a copy is
+ *             a snapshot for reading percentiles.
+ */
+@interface CWHistogram : NSObject <NSCopying> {
+@private
+	volatile int64_t* _counts;
+    volatile int64_t _count;
+    volatile int64_t _sum;
+    volatile int64_t _maximum;
+}
+
+@property(readonly, assign) uint64_t count;
+@property(readonly, assign) uint64_t sum;
+@property(readonly, assign) uint64_t maximum;
+@property(readonly, assign) double mean;
+
+-(void)recordValue:(uint64_t)value;
+
+/*!
+ * @abstract The upper bound of the bucket with the value at percentile, 0 to
+ *           100, never above the maximum recorded value.
+ */
+-(uint64_t)valueAtPercentile:(double)percentile;
+
+-(void)reset;
+
+@end
@@ -0,0 +1,159 @@
+//
+//  CWHistogram.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWHistogram.h"
+#import "CWAtomic.h"
+
+#define CW_SUB_BUCKET_BITS 3
+#define CW_SUB_BUCKETS (1 << CW_SUB_BUCKET_BITS)
+#define CW_LINEAR_BUCKETS (CW_SUB_BUCKETS * 2)
+#define CW_BUCKET_COUNT (CW_LINEAR_BUCKETS + (64 - CW_SUB_BUCKET_BITS - 1) * CW_SUB_BUCKETS)
+
+static unsigned CWBucketForValue(uint64_t value)
+{
+	if (value < CW_LINEAR_BUCKETS) {
+    	return (unsigned)value;
+    }
+    unsigned exponent = 63 - __builtin_clzll(value);
+    return CW_LINEAR_BUCKETS + (exponent - CW_SUB_BUCKET_BITS - 1) * CW_SUB_BUCKETS +
+    	(unsigned)((value >> (exponent - CW_SUB_BUCKET_BITS)) & (CW_SUB_BUCKETS - 1));
+}
+
+static uint64_t CWUpperValueForBucket(unsigned bucket)
+{
+	if (bucket < CW_LINEAR_BUCKETS) {
+    	return bucket;
+    }
+    unsigned exponent = (bucket - CW_LINEAR_BUCKETS) / CW_SUB_BUCKETS + CW_SUB_BUCKET_BITS + 1;
+    unsigned subBucket = (bucket - CW_LINEAR_BUCKETS) % CW_SUB_BUCKETS;
+    return ((uint64_t)(CW_SUB_BUCKETS + subBucket + 1) << (exponent - CW_SUB_BUCKET_BITS)) - 1;
+}
+
+
+@implementation CWHistogram
+
+-(id)init;
+{
+	self = [super init];
+    if (self) {
+    	_counts = calloc(CW_BUCKET_COUNT, sizeof(int64_t));
+    }
+    return self;
+}
+
+-(void)dealloc;
+{
+	free((void*)_counts);
+    [super dealloc];
+}
+
+-(id)copyWithZone:(NSZone*)zone;
+{
+	CWHistogram* copy = [[CWHistogram allocWithZone:zone] init];
+    CWMemoryBarrier();
+    memcpy((void*)copy->_counts, (void*)_counts, CW_BUCKET_COUNT * sizeof(int64_t));
+    copy->_count = _count;
+    copy->_sum = _sum;
+    copy->_maximum = _maximum;
+    return copy;
+}
+
+-(uint64_t)count;
+{
+	return (uint64_t)_count;
+}
+
+-(uint64_t)sum;
+{
+	return (uint64_t)_sum;
+}
+
+-(uint64_t)maximum;
+{
+	return (uint64_t)_maximum;
+}
+
+-(double)mean;
+{
+	int64_t count = _count;
+	return count > 0 ? (double)(uint64_t)_sum / count : 0;
+}
+
+-(void)recordValue:(uint64_t)value;
+{
+	CWAtomicIncrement64(_counts + CWBucketForValue(value));
+    CWAtomicIncrement64(&_count);
+    CWAtomicAdd64((int64_t)value, &_sum);
+    int64_t maximum;
+    do {
+    	maximum = _maximum;
+    } while ((uint64_t)maximum < value && !CWAtomicCompareAndSwap64(maximum, (int64_t)value, &_maximum));
+}
+
+/*
+ * Counts are read one by one, a concurrently recorded value may be missing.
+ */
+-(uint64_t)valueAtPercentile:(double)percentile;
+{
+	uint64_t total = 0;
+    for (unsigned bucket = 0; bucket < CW_BUCKET_COUNT; bucket++) {
+    	total += _counts[bucket];
+    }
+    if (total == 0) {
+    	return 0;
+    }
+    uint64_t rank = (uint64_t)ceil(total * MIN(MAX(percentile, 0), 100) / 100.0);
+    uint64_t count = 0;
+    for (unsigned bucket = 0; bucket < CW_BUCKET_COUNT; bucket++) {
+    	count += _counts[bucket];
+        if (count >= MAX(rank, 1)) {
+        	return MIN(CWUpperValueForBucket(bucket), (uint64_t)_maximum);
+        }
+    }
+    return (uint64_t)_maximum;
+}
+
+-(void)reset;
+{
+	for (unsigned bucket = 0; bucket < CW_BUCKET_COUNT; bucket++) {
+    	_counts[bucket] = 0;
+    }
+    _count = _sum = _maximum = 0;
+    CWMemoryBarrier();
+}
+
+-(NSString*)description;
+{
+	return [NSString stringWithFormat:@"count=%llu mean=%.1f p50=%llu p90=%llu p99=%llu max=%llu",
+            [self count], [self mean], [self valueAtPercentile:50], [self valueAtPercentile:90],
+            [self valueAtPercentile:99], [self maximum]];
+}
+
+@end
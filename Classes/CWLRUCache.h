@@ -0,0 +1,154 @@
+//
+//  CWLRUCache.h
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import <pthread.h>
+
+@protocol CWLRUCacheDelegate;
+
+/*!
+ * @abstract CWLRUCache is a key/value cache evicting the least recently used
+ *           objects when a count or total cost limit is exceeded.
+ *
+ * @discussion Entries are kept in a hash table and linked in a list in order
+ *             of use, so that lookups, inserts, touches and evictions are all
+ *             constant time. Keys are retained, not copied.
+ *
+ *             A cache is by default only safe to use from one thread at a time,
+ *             a thread safe cache guards all access with a mutex.
+ */
+@interface CWLRUCache : NSObject {
+@private
+	CFMutableDictionaryRef _entries;
+    struct CWLRUCacheEntry* _mostRecentEntry;
+    struct CWLRUCacheEntry* _leastRecentEntry;
+    NSUInteger _countLimit;
+    NSUInteger _totalCostLimit;
+    NSUInteger _totalCost;
+    NSUInteger _hitCount;
+    NSUInteger _missCount;
+    NSUInteger _evictionCount;
+    id<CWLRUCacheDelegate> _delegate;
+    BOOL _threadSafe;
+    pthread_mutex_t _lock;
+}
+
+/*!
+ * @abstract The cache delegate, notified of evicted objects.
+ */
+@property(nonatomic, assign) id<CWLRUCacheDelegate> delegate;
+
+/*!
+ * @abstract Maximum number of objects in the cache, or 0 for no limit.
+ * @discussion Lowering the limit evicts objects immediately.
+ */
+@property(nonatomic, assign) NSUInteger countLimit;
+
+/*!
+ * @abstract Maximum total cost of objects in the cache, or 0 for no limit.
+ * @discussion Lowering the limit evicts objects immediately.
+ */
+@property(nonatomic, assign) NSUInteger totalCostLimit;
+
+@property(nonatomic, readonly, assign, getter=isThreadSafe) BOOL threadSafe;
+@property(nonatomic, readonly, assign) NSUInteger count;
+@property(nonatomic, readonly, assign) NSUInteger totalCost;
+
+/*!
+ * @abstract Number of lookups finding, or not finding, an object.
+ */
+@property(nonatomic, readonly, assign) NSUInteger hitCount;
+@property(nonatomic, readonly, assign) NSUInteger missCount;
+
+/*!
+ * @abstract Number of objects evicted due to count or cost limits.
+ */
+@property(nonatomic, readonly, assign) NSUInteger evictionCount;
+
+/*!
+ * @abstract Init a cache without limits, that is not thread safe.
+ */
+-(id)init;
+
+/*!
+ * @abstract Init a cache with count and total cost limit, 0 for no limit.
+ */
+-(id)initWithCountLimit:(NSUInteger)countLimit totalCostLimit:(NSUInteger)totalCostLimit threadSafe:(BOOL)threadSafe;
+
+/*!
+ * @abstract Get the object for key, marking it as most recently used.
+ */
+-(id)objectForKey:(id)key;
+
+/*!
+ * @abstract Get the object for key without marking it as used, and without
+ *           counting a hit or miss.
+ */
+-(id)peekObjectForKey:(id)key;
+
+-(void)setObject:(id)object forKey:(id)key;
+
+/*!
+ * @abstract Set the object for key with a cost, marking it as most recently used.
+ * @discussion Least recently used objects are evicted until the cache is within
+ *             limits. An object with a cost above the total cost limit is
+ *             evicted immediately, together with any object it replaces, and
+ *             no other objects are evicted.
+ */
+-(void)setObject:(id)object forKey:(id)key cost:(NSUInteger)cost;
+
+-(void)removeObjectForKey:(id)key;
+-(void)removeAllObjects;
+
+/*!
+ * @abstract Reset hit, miss and eviction counters to zero.
+ */
+-(void)resetStatistics;
+
+@end
+
+
+/*!
+ * @abstract Delegate notified of evictions from a CWLRUCache.
+ */
+@protocol CWLRUCacheDelegate <NSObject>
+
+@optional
+
+/*!
+ * @abstract Cache did evict an object due to the count or total cost limit.
+ *
+ * @discussion Called on the thread that caused the eviction, after any lock
+ *             has been released, so the cache can safely be accessed.
+ *             Not called for explicitly removed objects.
+ */
+-(void)cache:(CWLRUCache*)cache didEvictObject:(id)object forKey:(id)key;
+
+@end
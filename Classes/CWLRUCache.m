@@ -0,0 +1,364 @@
+//
+//  CWLRUCache.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWLRUCache.h"
+
+/*
+ * Entries are linked from the most to the least recently used. Evicted and
+ * removed entries are unlinked while locked, and released once unlocked, as
+ * releasing objects or calling the delegate may call back into the cache.
+ */
+typedef struct CWLRUCacheEntry {
+    id key;
+    id object;
+    NSUInteger cost;
+    struct CWLRUCacheEntry* moreRecent;
+    struct CWLRUCacheEntry* lessRecent;
+} CWLRUCacheEntry;
+
+
+@implementation CWLRUCache
+
+@synthesize delegate = _delegate;
+@synthesize threadSafe = _threadSafe;
+
+#pragma mark --- Private helpers
+
+static inline void CWLRUCacheLock(CWLRUCache* self)
+{
+	if (self->_threadSafe) {
+    	pthread_mutex_lock(&self->_lock);
+    }
+}
+
+static inline void CWLRUCacheUnlock(CWLRUCache* self)
+{
+	if (self->_threadSafe) {
+    	pthread_mutex_unlock(&self->_lock);
+    }
+}
+
+static inline void CWLRUCacheUnlinkEntry(CWLRUCache* self, CWLRUCacheEntry* entry)
+{
+	if (entry->moreRecent) {
+    	entry->moreRecent->lessRecent = entry->lessRecent;
+    } else {
+    	self->_mostRecentEntry = entry->lessRecent;
+    }
+    if (entry->lessRecent) {
+    	entry->lessRecent->moreRecent = entry->moreRecent;
+    } else {
+    	self->_leastRecentEntry = entry->moreRecent;
+    }
+    entry->moreRecent = entry->lessRecent = NULL;
+}
+
+static inline void CWLRUCacheLinkEntryAsMostRecent(CWLRUCache* self, CWLRUCacheEntry* entry)
+{
+	entry->moreRecent = NULL;
+    entry->lessRecent = self->_mostRecentEntry;
+    if (self->_mostRecentEntry) {
+    	self->_mostRecentEntry->moreRecent = entry;
+    } else {
+    	self->_leastRecentEntry = entry;
+    }
+    self->_mostRecentEntry = entry;
+}
+
+static inline void CWLRUCacheTouchEntry(CWLRUCache* self, CWLRUCacheEntry* entry)
+{
+	if (entry != self->_mostRecentEntry) {
+    	CWLRUCacheUnlinkEntry(self, entry);
+        CWLRUCacheLinkEntryAsMostRecent(self, entry);
+    }
+}
+
+/*
+ * Remove entry from table and list, returning it linked first in the list of
+ * removed entries.
+ */
+static CWLRUCacheEntry* CWLRUCacheRemoveEntry(CWLRUCache* self, CWLRUCacheEntry* entry, CWLRUCacheEntry* removedEntries)
+{
+	CWLRUCacheUnlinkEntry(self, entry);
+    CFDictionaryRemoveValue(self->_entries, entry->key);
+    self->_totalCost -= entry->cost;
+    entry->lessRecent = removedEntries;
+    return entry;
+}
+
+static BOOL CWLRUCacheIsOverLimits(CWLRUCache* self)
+{
+	return (self->_countLimit > 0 && (NSUInteger)CFDictionaryGetCount(self->_entries) > self->_countLimit) ||
+    	   (self->_totalCostLimit > 0 && self->_totalCost > self->_totalCostLimit);
+}
+
+static CWLRUCacheEntry* CWLRUCacheEvictEntries(CWLRUCache* self)
+{
+	CWLRUCacheEntry* evictedEntries = NULL;
+    while (self->_leastRecentEntry && CWLRUCacheIsOverLimits(self)) {
+    	evictedEntries = CWLRUCacheRemoveEntry(self, self->_leastRecentEntry, evictedEntries);
+        self->_evictionCount++;
+    }
+    return evictedEntries;
+}
+
+/*
+ * Release removed entries, must be called unlocked.
+ */
+static void CWLRUCacheReleaseEntries(CWLRUCache* self, CWLRUCacheEntry* entries, BOOL notifyDelegate)
+{
+	id<CWLRUCacheDelegate> delegate = self->_delegate;
+    if (notifyDelegate && entries && ![delegate respondsToSelector:@selector(cache:didEvictObject:forKey:)]) {
+    	notifyDelegate = NO;
+    }
+	while (entries) {
+    	CWLRUCacheEntry* entry = entries;
+        entries = entry->lessRecent;
+        if (notifyDelegate) {
+        	[delegate cache:self didEvictObject:entry->object forKey:entry->key];
+        }
+        [entry->key release];
+        [entry->object release];
+        free(entry);
+    }
+}
+
+#pragma mark --- Life cycle
+
+-(id)init;
+{
+	return [self initWithCountLimit:0 totalCostLimit:0 threadSafe:NO];
+}
+
+-(id)initWithCountLimit:(NSUInteger)countLimit totalCostLimit:(NSUInteger)totalCostLimit threadSafe:(BOOL)threadSafe;
+{
+	self = [super init];
+    if (self) {
+    	_entries = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, NULL);
+        _countLimit = countLimit;
+        _totalCostLimit = totalCostLimit;
+        _threadSafe = threadSafe;
+        if (threadSafe) {
+        	pthread_mutex_init(&_lock, NULL);
+        }
+    }
+    return self;
+}
+
+-(void)dealloc;
+{
+	CWLRUCacheEntry* entries = NULL;
+    while (_mostRecentEntry) {
+    	entries = CWLRUCacheRemoveEntry(self, _mostRecentEntry, entries);
+    }
+    CWLRUCacheReleaseEntries(self, entries, NO);
+    CFRelease(_entries);
+    if (_threadSafe) {
+    	pthread_mutex_destroy(&_lock);
+    }
+    [super dealloc];
+}
+
+#pragma mark --- Limits and statistics
+
+-(NSUInteger)countLimit;
+{
+	return _countLimit;
+}
+
+-(void)setCountLimit:(NSUInteger)countLimit;
+{
+	CWLRUCacheLock(self);
+    _countLimit = countLimit;
+    CWLRUCacheEntry* evictedEntries = CWLRUCacheEvictEntries(self);
+    CWLRUCacheUnlock(self);
+    CWLRUCacheReleaseEntries(self, evictedEntries, YES);
+}
+
+-(NSUInteger)totalCostLimit;
+{
+	return _totalCostLimit;
+}
+
+-(void)setTotalCostLimit:(NSUInteger)totalCostLimit;
+{
+	CWLRUCacheLock(self);
+    _totalCostLimit = totalCostLimit;
+    CWLRUCacheEntry* evictedEntries = CWLRUCacheEvictEntries(self);
+    CWLRUCacheUnlock(self);
+    CWLRUCacheReleaseEntries(self, evictedEntries, YES);
+}
+
+-(NSUInteger)count;
+{
+	CWLRUCacheLock(self);
+    NSUInteger count = CFDictionaryGetCount(_entries);
+    CWLRUCacheUnlock(self);
+    return count;
+}
+
+-(NSUInteger)totalCost;
+{
+	CWLRUCacheLock(self);
+    NSUInteger totalCost = _totalCost;
+    CWLRUCacheUnlock(self);
+    return totalCost;
+}
+
+-(NSUInteger)hitCount;
+{
+	CWLRUCacheLock(self);
+    NSUInteger hitCount = _hitCount;
+    CWLRUCacheUnlock(self);
+    return hitCount;
+}
+
+-(NSUInteger)missCount;
+{
+	CWLRUCacheLock(self);
+    NSUInteger missCount = _missCount;
+    CWLRUCacheUnlock(self);
+    return missCount;
+}
+
+-(NSUInteger)evictionCount;
+{
+	CWLRUCacheLock(self);
+    NSUInteger evictionCount = _evictionCount;
+    CWLRUCacheUnlock(self);
+    return evictionCount;
+}
+
+-(void)resetStatistics;
+{
+	CWLRUCacheLock(self);
+    _hitCount = _missCount = _evictionCount = 0;
+    CWLRUCacheUnlock(self);
+}
+
+#pragma mark --- Accessing objects
+
+-(id)objectForKey:(id)key;
+{
+	id object = nil;
+	CWLRUCacheLock(self);
+    CWLRUCacheEntry* entry = key ? (CWLRUCacheEntry*)CFDictionaryGetValue(_entries, key) : NULL;
+    if (entry) {
+    	CWLRUCacheTouchEntry(self, entry);
+        object = [entry->object retain];
+        _hitCount++;
+    } else {
+    	_missCount++;
+    }
+    CWLRUCacheUnlock(self);
+    return [object autorelease];
+}
+
+-(id)peekObjectForKey:(id)key;
+{
+	id object = nil;
+	CWLRUCacheLock(self);
+    CWLRUCacheEntry* entry = key ? (CWLRUCacheEntry*)CFDictionaryGetValue(_entries, key) : NULL;
+    if (entry) {
+        object = [entry->object retain];
+    }
+    CWLRUCacheUnlock(self);
+    return [object autorelease];
+}
+
+-(void)setObject:(id)object forKey:(id)key;
+{
+	[self setObject:object forKey:key cost:0];
+}
+
+-(void)setObject:(id)object forKey:(id)key cost:(NSUInteger)cost;
+{
+	if (object == nil || key == nil) {
+    	[NSException raise:NSInvalidArgumentException
+                    format:@"Attempt to insert nil object or key"];
+    }
+    id replacedObject = nil;
+	CWLRUCacheLock(self);
+    CWLRUCacheEntry* entry = (CWLRUCacheEntry*)CFDictionaryGetValue(_entries, key);
+    if (_totalCostLimit > 0 && cost > _totalCostLimit) {
+    	// Evict only the new object, and the object it replaces.
+    	CWLRUCacheEntry* removedEntries = entry ? CWLRUCacheRemoveEntry(self, entry, NULL) : NULL;
+        _evictionCount++;
+        CWLRUCacheUnlock(self);
+        CWLRUCacheReleaseEntries(self, removedEntries, NO);
+        id<CWLRUCacheDelegate> delegate = _delegate;
+        if ([delegate respondsToSelector:@selector(cache:didEvictObject:forKey:)]) {
+        	[delegate cache:self didEvictObject:object forKey:key];
+        }
+        return;
+    }
+    if (entry) {
+        replacedObject = entry->object;
+        _totalCost -= entry->cost;
+    	CWLRUCacheTouchEntry(self, entry);
+    } else {
+    	entry = malloc(sizeof(CWLRUCacheEntry));
+        entry->key = [key retain];
+        CFDictionarySetValue(_entries, key, entry);
+        CWLRUCacheLinkEntryAsMostRecent(self, entry);
+    }
+    entry->object = [object retain];
+    entry->cost = cost;
+    _totalCost += cost;
+    CWLRUCacheEntry* evictedEntries = CWLRUCacheEvictEntries(self);
+    CWLRUCacheUnlock(self);
+    [replacedObject release];
+    CWLRUCacheReleaseEntries(self, evictedEntries, YES);
+}
+
+-(void)removeObjectForKey:(id)key;
+{
+	CWLRUCacheEntry* removedEntries = NULL;
+	CWLRUCacheLock(self);
+    CWLRUCacheEntry* entry = key ? (CWLRUCacheEntry*)CFDictionaryGetValue(_entries, key) : NULL;
+    if (entry) {
+    	removedEntries = CWLRUCacheRemoveEntry(self, entry, NULL);
+    }
+    CWLRUCacheUnlock(self);
+    CWLRUCacheReleaseEntries(self, removedEntries, NO);
+}
+
+-(void)removeAllObjects;
+{
+	CWLRUCacheLock(self);
+    CWLRUCacheEntry* removedEntries = _mostRecentEntry;
+    _mostRecentEntry = _leastRecentEntry = NULL;
+    CFDictionaryRemoveAllValues(_entries);
+    _totalCost = 0;
+    CWLRUCacheUnlock(self);
+    CWLRUCacheReleaseEntries(self, removedEntries, NO);
+}
+
+@end
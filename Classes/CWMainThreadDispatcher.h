@@ -0,0 +1,82 @@
+//
+//  CWMainThreadDispatcher.h
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+
+/*!
+ * @abstract CWMainThreadDispatcher performs selectors on the main thread,
+ *           batching asynchronous calls into one run loop callback.
+ *
+ * @discussion Calls are pushed on a lock free queue, and only a call made to
+ *             an empty queue signals and wakes up the main run loop. All calls
+ *             queued before the callback are performed in order in the same
+ *             run loop turn, in the common run loop modes.
+ *
+ *             Calls with a coalescing key replace earlier calls with an equal
+ *             key queued in the same turn, for example to reload a table row
+ *             once for many updates.
+ *
+ *             An exception raised by a call does not stop the batch, the first
+ *             exception is raised again after all calls are performed and all
+ *             waiting threads are signalled.
+ *
+ *             Invocation proxies and NSInvocation use the shared dispatcher for
+ *             calls to the main thread.
+ */
+@interface CWMainThreadDispatcher : NSObject {
+@private
+	struct CWMainThreadTask* volatile _head;
+    CFRunLoopSourceRef _source;
+    CFRunLoopRef _runLoop;
+    volatile int32_t _wakeUpCount;
+}
+
+/*!
+ * @abstract Number of times the main run loop has been signalled.
+ */
+@property(readonly, assign) NSUInteger wakeUpCount;
+
++(CWMainThreadDispatcher*)sharedDispatcher;
+
+/*!
+ * @abstract Perform a selector on the main thread, optionally block until done.
+ * @discussion A call from the main thread first performs all queued calls.
+ */
+-(void)performSelector:(SEL)aSelector onTarget:(id)target withObject:(id)arg waitUntilDone:(BOOL)wait;
+
+/*!
+ * @abstract Perform a selector on the main thread, unless replaced by a later
+ *           call with an equal key before performed.
+ * @discussion The latest call is performed in the order it was queued.
+ *             A nil key is never coalesced.
+ */
+-(void)performSelector:(SEL)aSelector onTarget:(id)target withObject:(id)arg coalescingKey:(id<NSCopying>)key;
+
+@end
@@ -0,0 +1,215 @@
+//
+//  CWMainThreadDispatcher.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWMainThreadDispatcher.h"
+#import "CWAtomic.h"
+
+typedef struct CWMainThreadTask {
+	struct CWMainThreadTask* next;
+    id target;
+    SEL selector;
+    id object;
+    id key;
+    NSConditionLock* doneLock;
+} CWMainThreadTask;
+
+
+@interface CWMainThreadDispatcher ()
+
+-(void)enqueueTask:(CWMainThreadTask*)task;
+-(void)performQueuedTasks;
+
+@end
+
+
+static void cw_PerformQueuedTasks(void* info)
+{
+	[(CWMainThreadDispatcher*)info performQueuedTasks];
+}
+
+
+@implementation CWMainThreadDispatcher
+
+#pragma mark --- Life cycle
+
++(CWMainThreadDispatcher*)sharedDispatcher;
+{
+	static CWMainThreadDispatcher* sharedDispatcher = nil;
+    @synchronized(self) {
+    	if (sharedDispatcher == nil) {
+        	sharedDispatcher = [[CWMainThreadDispatcher alloc] init];
+        }
+    }
+    return sharedDispatcher;
+}
+
+-(id)init;
+{
+	self = [super init];
+    if (self) {
+    	CFRunLoopSourceContext context = {0};
+        context.info = self;
+        context.perform = cw_PerformQueuedTasks;
+        _source = CFRunLoopSourceCreate(NULL, 0, &context);
+        _runLoop = (CFRunLoopRef)CFRetain(CFRunLoopGetMain());
+        CFRunLoopAddSource(_runLoop, _source, kCFRunLoopCommonModes);
+    }
+    return self;
+}
+
+-(void)dealloc;
+{
+	[self performQueuedTasks];
+	CFRunLoopSourceInvalidate(_source);
+    CFRelease(_source);
+    CFRelease(_runLoop);
+    [super dealloc];
+}
+
+#pragma mark --- Public API
+
+-(NSUInteger)wakeUpCount;
+{
+	return (NSUInteger)_wakeUpCount;
+}
+
+-(void)performSelector:(SEL)aSelector onTarget:(id)target withObject:(id)arg waitUntilDone:(BOOL)wait;
+{
+	if (wait && [NSThread isMainThread]) {
+    	[self performQueuedTasks];
+        [target performSelector:aSelector withObject:arg];
+        return;
+    }
+	CWMainThreadTask* task = calloc(1, sizeof(CWMainThreadTask));
+    task->target = [target retain];
+    task->selector = aSelector;
+    task->object = [arg retain];
+    if (wait) {
+    	NSConditionLock* doneLock = [[NSConditionLock alloc] initWithCondition:0];
+        task->doneLock = [doneLock retain];
+        [self enqueueTask:task];
+        [doneLock lockWhenCondition:1];
+        [doneLock unlock];
+        [doneLock release];
+    } else {
+	    [self enqueueTask:task];
+    }
+}
+
+-(void)performSelector:(SEL)aSelector onTarget:(id)target withObject:(id)arg coalescingKey:(id<NSCopying>)key;
+{
+	CWMainThreadTask* task = calloc(1, sizeof(CWMainThreadTask));
+    task->target = [target retain];
+    task->selector = aSelector;
+    task->object = [arg retain];
+    task->key = [(id)key copyWithZone:NULL];
+    [self enqueueTask:task];
+}
+
+#pragma mark --- Private helpers
+
+/*
+ * Only the push to an empty queue signals, later pushes are picked up by the
+ * same callback since the queue is emptied after the signal is cleared.
+ */
+-(void)enqueueTask:(CWMainThreadTask*)task;
+{
+	CWMainThreadTask* head;
+    do {
+    	head = _head;
+        task->next = head;
+    } while (!CWAtomicCompareAndSwapPtr(head, task, (void* volatile*)&_head));
+    if (head == NULL) {
+    	CWAtomicIncrement32(&_wakeUpCount);
+        CFRunLoopSourceSignal(_source);
+        CFRunLoopWakeUp(_runLoop);
+    }
+}
+
+-(void)performQueuedTasks;
+{
+	CWMainThreadTask* head;
+    do {
+    	head = _head;
+    } while (head && !CWAtomicCompareAndSwapPtr(head, NULL, (void* volatile*)&_head));
+    // The queue is a LIFO stack, reverse to perform in order.
+    CWMainThreadTask* task = NULL;
+    CFMutableDictionaryRef latestTasks = NULL;
+    while (head) {
+    	CWMainThreadTask* next = head->next;
+        head->next = task;
+        task = head;
+        if (task->key) {
+        	if (latestTasks == NULL) {
+            	latestTasks = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, NULL);
+            }
+            if (!CFDictionaryContainsKey(latestTasks, task->key)) {
+            	CFDictionarySetValue(latestTasks, task->key, task);
+            }
+        }
+        head = next;
+    }
+    // An exception must not leave waiting threads blocked or drop the rest
+    // of the batch, the first exception is raised once all tasks are done.
+    id exception = nil;
+    while (task) {
+    	CWMainThreadTask* next = task->next;
+        if (task->key == nil || CFDictionaryGetValue(latestTasks, task->key) == task) {
+            NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+            @try {
+	            [task->target performSelector:task->selector withObject:task->object];
+            }
+            @catch (id e) {
+            	if (exception == nil) {
+                	exception = [e retain];
+                }
+            }
+            [pool drain];
+        }
+        if (task->doneLock) {
+        	[task->doneLock lock];
+            [task->doneLock unlockWithCondition:1];
+            [task->doneLock release];
+        }
+        [task->target release];
+        [task->object release];
+        [task->key release];
+        free(task);
+        task = next;
+    }
+    if (latestTasks) {
+    	CFRelease(latestTasks);
+    }
+    if (exception) {
+    	@throw [exception autorelease];
+    }
+}
+
+@end
@@ -43,22 +43,79 @@
  *             keys and values do so in with stable ordering. Eg. allKeys,
  *             allValue and fast enumeration always return objects in the same
  *             predictable order.
+ *
+ *             Key/value pairs are stored once, in insertion order, in dense key,
+ *             value and hash arrays sharing a single allocation with a sparse
+ *             open addressing index. Lookup by key and access by index are both
+ *             constant time, and removing a key leaves a hole that is compacted
+ *             lazily, so that removeObjectForKey: never shifts memory. Batch
+ *             insert, remove and move operations rebuild the order in a single
+ *             pass regardless of the number of affected keys.
+ *
+ *             Copies are constant time and share storage with the original
+ *             until either is mutated, so a writer can hand out immutable
+ *             snapshots to reader threads. A copy must be made on the thread
+ *             owning the original, the copy can then be used from any thread.
  */
 @interface CWOrderedDictionary : NSMutableDictionary {
 @private
-    NSMutableDictionary* _dictionary;
-    NSMutableArray* _array;
+    struct CWOrderedDictionaryStorage* _storage;
+    unsigned long _mutations;
 }
 
 -(void)insertObject:(id)object forKey:(id)key atIndex:(NSUInteger)index;
 -(void)removeObjectAtIndex:(NSUInteger)index;
 -(void)moveObjectForKey:(id)key toIndex:(NSUInteger)index;
 
+/*!
+ * @abstract Insert objects and keys at indexes, indexes are as in the dictionary
+ *           after the insert, like NSMutableArray's insertObjects:atIndexes:.
+ */
+-(void)insertObjects:(NSArray*)objects forKeys:(NSArray*)keys atIndexes:(NSIndexSet*)indexes;
+-(void)removeObjectsAtIndexes:(NSIndexSet*)indexes;
+-(void)removeObjectsForKeys:(NSArray*)keys;
+/*!
+ * @abstract Move objects at indexes to be ordered continously from index, in
+ *           the dictionary as if the moved objects where first removed.
+ */
+-(void)moveObjectsAtIndexes:(NSIndexSet*)indexes toIndex:(NSUInteger)index;
+
 -(id)keyAtIndex:(NSUInteger)index;
 -(id)objectAtIndex:(NSUInteger)index;
 -(NSUInteger)indexForKey:(id)key;
 -(NSIndexSet*)allIndexesForObject:(id)object;
 
+/*!
+ * @abstract Init with data created by compactArchivedData.
+ *
+ * @discussion Keys are decoded immediately, and values lazily when first
+ *             accessed. The data is retained, and may be memory mapped.
+ *             Returns nil if the data is not a valid compact archive.
+ *             Value records are only checked for length, accessing a value
+ *             whose record does not decode raises an
+ *             NSInvalidArchiveOperationException.
+ */
+-(id)initWithCompactArchivedData:(NSData*)data;
+
+/*!
+ * @abstract Create a dictionary from a memory mapped compact archive file.
+ */
++(id)dictionaryWithContentsOfCompactArchiveURL:(NSURL*)url error:(NSError**)error;
+
+/*!
+ * @abstract Return a compact archive with keys and values stored once, in order.
+ *
+ * @discussion Strings and numbers are stored directly, all other keys and
+ *             values must conform to NSCoding and are individually archived.
+ *             Mutable strings are decoded as immutable strings.
+ */
+-(NSData*)compactArchivedData;
+
+/*!
+ * @abstract Sort by key using sort descriptors.
+ * @discussion The key values of each key are extracted once, and not for every
+ *             comparison, see CWSortKeys.
+ */
 -(void)sortByKeyUsingDescriptors:(NSArray*)sortDescriptors;
 #if NS_BLOCKS_AVAILABLE
 -(void)sortByKeyUsingComparator:(NSComparator)cmptr;
@@ -67,6 +124,11 @@
 -(void)sortByKeyUsingFunction:(NSInteger(*)(id, id, void*))compare context:(void*)context;
 -(void)sortByKeyUsingSelector:(SEL)comparator;
 
+/*!
+ * @abstract Sort by value using sort descriptors, keeping the order of equal
+ *           values.
+ */
+-(void)sortByValueUsingDescriptors:(NSArray*)sortDescriptors;
 -(void)sortByValueUsingSelector:(SEL)comparator;
 #if NS_BLOCKS_AVAILABLE
 -(void)sortByValueUsingComparator:(NSComparator)cmptr;
@@ -29,15 +29,768 @@
 //
 
 #import "CWOrderedDictionary.h"
+#import "CWAtomic.h"
+#import "NSError+CWAdditions.h"
+#import "CWSortKeys.h"
+
+#pragma mark --- Storage
+
+/*
+ * All key/value pairs are stored in a single allocation; a header followed by
+ * dense arrays of keys, values and hashes in order, and a sparse open
+ * addressing index table mapping hashes to entries.
+ *
+ * Removed entries leave a nil key hole. Holes at the start or the end are
+ * trimmed directly, so that queue like usage stays hole free. Any other hole
+ * is compacted the next time an entry must be accessed by index.
+ *
+ * Copies share the storage, which is reference counted. A shared storage is
+ * never modified; it is copied by the first instance that needs to mutate it.
+ * Holes are compacted before a storage is shared, so reading a copy by index
+ * never replaces its storage and copies can be read from any thread.
+ *
+ * A storage opened from a compact archive decodes values lazily. Until first
+ * accessed a value is a pointer into a table of archive record offsets, owned
+ * by the storage and never a valid object, resolved with an atomic compare and
+ * swap so that readers of a shared storage can resolve values concurrently.
+ */
+typedef struct CWOrderedDictionaryStorage {
+    volatile int32_t retainCount;
+    NSUInteger count;		// Number of key/value pairs.
+    NSUInteger start;		// First used entry.
+    NSUInteger used;		// One past the last used entry.
+    NSUInteger capacity;	// Number of allocated entries.
+    NSUInteger indexMask;	// Number of index slots minus one.
+    NSUInteger fill;		// Number of index slots not empty.
+    id* keys;
+    id* values;
+    NSUInteger* hashes;
+    int32_t* slots;
+    NSData* archive;		// Compact archive lazy values are decoded from.
+    NSData* lazyOffsets;	// Record offsets in archive, lazy values point into.
+    const NSUInteger* lazyOffsetsStart;
+    const NSUInteger* lazyOffsetsEnd;
+} CWOrderedDictionaryStorage;
+
+#define CW_SLOT_EMPTY ((int32_t)-1)
+#define CW_SLOT_DUMMY ((int32_t)-2)
+
+static id CWCompactArchiveDecodeObject(NSData* archive, NSUInteger offset);
+
+static inline BOOL CWIsLazyValue(CWOrderedDictionaryStorage* storage, id value)
+{
+	return (const NSUInteger*)value >= storage->lazyOffsetsStart && (const NSUInteger*)value < storage->lazyOffsetsEnd;
+}
+
+static inline NSUInteger CWOffsetForLazyValue(id value)
+{
+	return *(const NSUInteger*)value;
+}
+
+static inline id CWRetainValue(CWOrderedDictionaryStorage* storage, id value)
+{
+	return CWIsLazyValue(storage, value) ? value : [value retain];
+}
+
+static inline void CWReleaseValue(CWOrderedDictionaryStorage* storage, id value)
+{
+	if (!CWIsLazyValue(storage, value)) {
+    	[value release];
+    }
+}
+
+static CWOrderedDictionaryStorage* CWStorageCreate(NSUInteger capacity)
+{
+	if (capacity < 8) {
+    	capacity = 8;
+    }
+    NSUInteger indexSize = 8;
+    while (indexSize < capacity + capacity / 2) {
+    	indexSize <<= 1;
+    }
+    if (indexSize > INT32_MAX) {
+    	[NSException raise:NSInvalidArgumentException
+                    format:@"Capacity %lu too large for CWOrderedDictionary", (unsigned long)capacity];
+    }
+    size_t size = sizeof(CWOrderedDictionaryStorage) + capacity * (2 * sizeof(id) + sizeof(NSUInteger)) + indexSize * sizeof(int32_t);
+    CWOrderedDictionaryStorage* storage = malloc(size);
+    if (storage == NULL) {
+    	[NSException raise:NSMallocException
+                    format:@"Could not allocate storage for %lu entries", (unsigned long)capacity];
+    }
+    storage->retainCount = 1;
+    storage->count = 0;
+    storage->start = 0;
+    storage->used = 0;
+    storage->capacity = capacity;
+    storage->indexMask = indexSize - 1;
+    storage->fill = 0;
+    storage->keys = (id*)(storage + 1);
+    storage->values = storage->keys + capacity;
+    storage->hashes = (NSUInteger*)(storage->values + capacity);
+    storage->slots = (int32_t*)(storage->hashes + capacity);
+    memset(storage->slots, 0xff, indexSize * sizeof(int32_t));
+    storage->archive = nil;
+    storage->lazyOffsets = nil;
+    storage->lazyOffsetsStart = storage->lazyOffsetsEnd = NULL;
+    return storage;
+}
+
+static void CWStorageFree(CWOrderedDictionaryStorage* storage)
+{
+	for (NSUInteger entry = storage->start; entry < storage->used; entry++) {
+        if (storage->keys[entry]) {
+            [storage->keys[entry] release];
+            CWReleaseValue(storage, storage->values[entry]);
+        }
+    }
+    [storage->lazyOffsets release];
+    [storage->archive release];
+    free(storage);
+}
+
+static inline CWOrderedDictionaryStorage* CWStorageRetain(CWOrderedDictionaryStorage* storage)
+{
+	CWAtomicIncrement32(&storage->retainCount);
+    return storage;
+}
+
+static inline void CWStorageRelease(CWOrderedDictionaryStorage* storage)
+{
+	if (CWAtomicDecrement32(&storage->retainCount) == 0) {
+    	CWStorageFree(storage);
+    }
+}
+
+static inline BOOL CWStorageIsShared(CWOrderedDictionaryStorage* storage)
+{
+	return storage->retainCount > 1;
+}
+
+/*
+ * Value at entry, decoding a lazy value. Records are only checked for length
+ * when opening an archive, a record that does not decode raises rather than
+ * leaving a nil value for a key.
+ */
+static id CWStorageValueAtEntry(CWOrderedDictionaryStorage* storage, NSUInteger entry)
+{
+	id value = storage->values[entry];
+    if (CWIsLazyValue(storage, value)) {
+    	id decodedValue = [CWCompactArchiveDecodeObject(storage->archive, CWOffsetForLazyValue(value)) retain];
+        if (decodedValue == nil) {
+        	[NSException raise:NSInvalidArchiveOperationException
+                        format:@"Could not decode value for key %@ in compact archive", storage->keys[entry]];
+        }
+        if (CWAtomicCompareAndSwapPtr(value, decodedValue, (void* volatile*)&storage->values[entry])) {
+        	value = decodedValue;
+        } else {
+        	[decodedValue release];
+            value = storage->values[entry];
+        }
+    }
+    return value;
+}
+
+/*
+ * Find the entry for key, or NSNotFound. The index slot of the found entry, or
+ * the slot to use when inserting the key, is returned in slotIndex.
+ */
+static NSUInteger CWStorageLookup(CWOrderedDictionaryStorage* storage, id key, NSUInteger hash, NSUInteger* slotIndex)
+{
+    NSUInteger mask = storage->indexMask;
+    NSUInteger i = hash & mask;
+    NSUInteger perturb = hash;
+    NSUInteger freeSlot = NSNotFound;
+    for (;;) {
+    	int32_t slot = storage->slots[i];
+        if (slot == CW_SLOT_EMPTY) {
+        	if (slotIndex) {
+            	*slotIndex = freeSlot != NSNotFound ? freeSlot : i;
+            }
+            return NSNotFound;
+        } else if (slot == CW_SLOT_DUMMY) {
+            if (freeSlot == NSNotFound) {
+            	freeSlot = i;
+            }
+        } else if (storage->hashes[slot] == hash) {
+        	id other = storage->keys[slot];
+            if (other == key || [other isEqual:key]) {
+                if (slotIndex) {
+                    *slotIndex = i;
+                }
+                return slot;
+            }
+        }
+        perturb >>= 5;
+        i = (i * 5 + perturb + 1) & mask;
+    }
+}
+
+/*
+ * Find the index slot currently pointing to entry, probing with hash.
+ */
+static NSUInteger CWStorageSlotForEntry(CWOrderedDictionaryStorage* storage, NSUInteger entry, NSUInteger hash)
+{
+    NSUInteger mask = storage->indexMask;
+    NSUInteger i = hash & mask;
+    NSUInteger perturb = hash;
+    while (storage->slots[i] != (int32_t)entry) {
+        perturb >>= 5;
+        i = (i * 5 + perturb + 1) & mask;
+    }
+    return i;
+}
+
+static void CWStorageSetSlot(CWOrderedDictionaryStorage* storage, NSUInteger slotIndex, NSUInteger entry)
+{
+	if (storage->slots[slotIndex] == CW_SLOT_EMPTY) {
+    	storage->fill++;
+    }
+    storage->slots[slotIndex] = (int32_t)entry;
+}
+
+static void CWStorageRebuildIndex(CWOrderedDictionaryStorage* storage)
+{
+    NSUInteger mask = storage->indexMask;
+    memset(storage->slots, 0xff, (mask + 1) * sizeof(int32_t));
+    storage->fill = 0;
+    for (NSUInteger entry = storage->start; entry < storage->used; entry++) {
+        if (storage->keys[entry]) {
+            NSUInteger hash = storage->hashes[entry];
+            NSUInteger i = hash & mask;
+            NSUInteger perturb = hash;
+            while (storage->slots[i] != CW_SLOT_EMPTY) {
+                perturb >>= 5;
+                i = (i * 5 + perturb + 1) & mask;
+            }
+            storage->slots[i] = (int32_t)entry;
+            storage->fill++;
+        }
+    }
+}
+
+/*
+ * Renumber the index slots for entries in range after the range has been
+ * shifted delta entries with memmove.
+ */
+static void CWStorageRenumberEntries(CWOrderedDictionaryStorage* storage, NSRange range, NSInteger delta)
+{
+    if (delta > 0) {
+        for (NSUInteger entry = NSMaxRange(range); entry-- > range.location; ) {
+            NSUInteger hash = storage->hashes[entry];
+            storage->slots[CWStorageSlotForEntry(storage, entry - delta, hash)] = (int32_t)entry;
+        }
+    } else {
+        for (NSUInteger entry = range.location; entry < NSMaxRange(range); entry++) {
+            NSUInteger hash = storage->hashes[entry];
+            storage->slots[CWStorageSlotForEntry(storage, entry - delta, hash)] = (int32_t)entry;
+        }
+    }
+}
+
+static void CWStorageMoveEntries(CWOrderedDictionaryStorage* storage, NSUInteger from, NSUInteger to, NSUInteger length)
+{
+	memmove(storage->keys + to, storage->keys + from, length * sizeof(id));
+	memmove(storage->values + to, storage->values + from, length * sizeof(id));
+	memmove(storage->hashes + to, storage->hashes + from, length * sizeof(NSUInteger));
+}
+
+/*
+ * Share the archive and lazy value offsets of storage with newStorage, without
+ * retaining them.
+ */
+static inline void CWStorageTakeArchive(CWOrderedDictionaryStorage* newStorage, CWOrderedDictionaryStorage* storage)
+{
+	newStorage->archive = storage->archive;
+    newStorage->lazyOffsets = storage->lazyOffsets;
+    newStorage->lazyOffsetsStart = storage->lazyOffsetsStart;
+    newStorage->lazyOffsetsEnd = storage->lazyOffsetsEnd;
+}
+
+/*
+ * Create a new hole free storage with capacity, taking ownership of all keys
+ * and values in the old storage and freeing it.
+ */
+static CWOrderedDictionaryStorage* CWStorageResize(CWOrderedDictionaryStorage* storage, NSUInteger capacity)
+{
+    CWOrderedDictionaryStorage* newStorage = CWStorageCreate(MAX(capacity, storage->count));
+    NSUInteger count = 0;
+    for (NSUInteger entry = storage->start; entry < storage->used; entry++) {
+        if (storage->keys[entry]) {
+            newStorage->keys[count] = storage->keys[entry];
+            newStorage->values[count] = storage->values[entry];
+            newStorage->hashes[count] = storage->hashes[entry];
+            count++;
+        }
+    }
+    newStorage->count = count;
+    newStorage->used = count;
+    CWStorageTakeArchive(newStorage, storage);
+    CWStorageRebuildIndex(newStorage);
+    free(storage);
+    return newStorage;
+}
+
+/*
+ * Create a new hole free storage with capacity, retaining all keys and values
+ * in storage, that is left untouched.
+ */
+static CWOrderedDictionaryStorage* CWStorageCopy(CWOrderedDictionaryStorage* storage, NSUInteger capacity)
+{
+    CWOrderedDictionaryStorage* newStorage = CWStorageCreate(MAX(capacity, storage->count));
+    NSUInteger count = 0;
+    for (NSUInteger entry = storage->start; entry < storage->used; entry++) {
+        if (storage->keys[entry]) {
+            newStorage->keys[count] = [storage->keys[entry] retain];
+            newStorage->values[count] = CWRetainValue(storage, storage->values[entry]);
+            newStorage->hashes[count] = storage->hashes[entry];
+            count++;
+        }
+    }
+    newStorage->count = count;
+    newStorage->used = count;
+    CWStorageTakeArchive(newStorage, storage);
+    [newStorage->archive retain];
+    [newStorage->lazyOffsets retain];
+    CWStorageRebuildIndex(newStorage);
+    return newStorage;
+}
+
+static void CWStorageRemoveEntry(CWOrderedDictionaryStorage* storage, NSUInteger entry, NSUInteger slotIndex)
+{
+	storage->slots[slotIndex] = CW_SLOT_DUMMY;
+    [storage->keys[entry] release];
+    CWReleaseValue(storage, storage->values[entry]);
+    storage->keys[entry] = nil;
+    storage->values[entry] = nil;
+    storage->count--;
+    if (storage->count == 0) {
+    	storage->start = storage->used = 0;
+    } else if (entry == storage->start) {
+        while (storage->keys[storage->start] == nil) {
+        	storage->start++;
+        }
+    } else if (entry + 1 == storage->used) {
+        while (storage->keys[storage->used - 1] == nil) {
+        	storage->used--;
+        }
+    }
+}
+
+static inline BOOL CWStorageHasHoles(CWOrderedDictionaryStorage* storage)
+{
+	return storage->used - storage->start != storage->count;
+}
+
+
+#pragma mark --- Compact archive
+
+/*
+ * A compact archive is a header followed by the key and value record of each
+ * entry in order. All integers are little endian.
+ *
+ *   header: 'C' 'W' 'O' 'D', uint32 version, uint64 count
+ *   record: uint8 type, followed by a type specific payload;
+ *     'S' string, uint32 length and UTF-8 bytes.
+ *     'B' boolean number, uint8 0 or 1.
+ *     'Q' integer number, int64.
+ *     'D' floating point number, IEEE 754 double as uint64.
+ *     'O' any other object, uint32 length and NSKeyedArchiver data.
+ */
+
+#define CW_COMPACT_ARCHIVE_VERSION 1
+#define CW_COMPACT_ARCHIVE_HEADER_SIZE 16
+
+static void CWCompactArchiveAppendUInt32(NSMutableData* data, uint32_t value)
+{
+	value = CFSwapInt32HostToLittle(value);
+    [data appendBytes:&value length:sizeof(value)];
+}
+
+static void CWCompactArchiveAppendUInt64(NSMutableData* data, uint64_t value)
+{
+	value = CFSwapInt64HostToLittle(value);
+    [data appendBytes:&value length:sizeof(value)];
+}
+
+static void CWCompactArchiveAppendBytes(NSMutableData* data, uint8_t type, const void* bytes, NSUInteger length)
+{
+    if (length > UINT32_MAX) {
+    	[NSException raise:NSInvalidArgumentException
+                    format:@"Object of %lu bytes too large for compact archive", (unsigned long)length];
+    }
+	[data appendBytes:&type length:1];
+    CWCompactArchiveAppendUInt32(data, (uint32_t)length);
+    [data appendBytes:bytes length:length];
+}
+
+static void CWCompactArchiveAppendObject(NSMutableData* data, id object)
+{
+	uint8_t type;
+	if ([object isKindOfClass:[NSString class]]) {
+        CWCompactArchiveAppendBytes(data, 'S', [object UTF8String], [object lengthOfBytesUsingEncoding:NSUTF8StringEncoding]);
+        return;
+    } else if (object == (id)kCFBooleanTrue || object == (id)kCFBooleanFalse) {
+    	type = 'B';
+        uint8_t value = object == (id)kCFBooleanTrue;
+        [data appendBytes:&type length:1];
+        [data appendBytes:&value length:1];
+        return;
+    } else if ([object isKindOfClass:[NSNumber class]] && ![object isKindOfClass:[NSDecimalNumber class]]) {
+    	const char* objCType = [object objCType];
+        if (strcmp(objCType, @encode(double)) == 0 || strcmp(objCType, @encode(float)) == 0) {
+        	type = 'D';
+            union { double d; uint64_t i; } value = { [object doubleValue] };
+            [data appendBytes:&type length:1];
+            CWCompactArchiveAppendUInt64(data, value.i);
+            return;
+        } else if (strcmp(objCType, @encode(unsigned long long)) != 0 || [object unsignedLongLongValue] <= INT64_MAX) {
+        	type = 'Q';
+            [data appendBytes:&type length:1];
+            CWCompactArchiveAppendUInt64(data, (uint64_t)[object longLongValue]);
+            return;
+        }
+    }
+    NSData* archivedData = [NSKeyedArchiver archivedDataWithRootObject:object];
+    CWCompactArchiveAppendBytes(data, 'O', [archivedData bytes], [archivedData length]);
+}
+
+/*
+ * Length of the record at offset, or 0 if the record is malformed.
+ */
+static NSUInteger CWCompactArchiveRecordLength(const uint8_t* bytes, NSUInteger length, NSUInteger offset)
+{
+	if (offset >= length) {
+    	return 0;
+    }
+    NSUInteger recordLength;
+    switch (bytes[offset]) {
+        case 'B':
+            recordLength = 2;
+            break;
+        case 'Q':
+        case 'D':
+            recordLength = 9;
+            break;
+        case 'S':
+        case 'O':
+            if (length - offset < 5) {
+            	return 0;
+            }
+            uint32_t payloadLength;
+            memcpy(&payloadLength, bytes + offset + 1, sizeof(payloadLength));
+            recordLength = 5 + (NSUInteger)CFSwapInt32LittleToHost(payloadLength);
+            break;
+        default:
+            return 0;
+    }
+    return length - offset < recordLength ? 0 : recordLength;
+}
+
+static id CWCompactArchiveDecodeObject(NSData* archive, NSUInteger offset)
+{
+	const uint8_t* record = (const uint8_t*)[archive bytes] + offset;
+    uint32_t length;
+    uint64_t value;
+    switch (record[0]) {
+        case 'S':
+            memcpy(&length, record + 1, sizeof(length));
+            return [[[NSString alloc] initWithBytes:record + 5
+                                             length:CFSwapInt32LittleToHost(length)
+                                           encoding:NSUTF8StringEncoding] autorelease];
+        case 'B':
+            return [NSNumber numberWithBool:record[1] != 0];
+        case 'Q':
+            memcpy(&value, record + 1, sizeof(value));
+            return [NSNumber numberWithLongLong:(long long)CFSwapInt64LittleToHost(value)];
+        case 'D': {
+            memcpy(&value, record + 1, sizeof(value));
+            union { uint64_t i; double d; } number = { CFSwapInt64LittleToHost(value) };
+            return [NSNumber numberWithDouble:number.d];
+        }
+        default:
+            memcpy(&length, record + 1, sizeof(length));
+            NSData* data = [archive subdataWithRange:NSMakeRange(offset + 5, CFSwapInt32LittleToHost(length))];
+            return [NSKeyedUnarchiver unarchiveObjectWithData:data];
+    }
+}
+
+/*
+ * Create a storage from a compact archive, decoding keys and leaving values
+ * lazy, or NULL if the archive is malformed.
+ */
+static CWOrderedDictionaryStorage* CWStorageCreateWithCompactArchive(NSData* archive)
+{
+	const uint8_t* bytes = [archive bytes];
+    NSUInteger length = [archive length];
+    if (length < CW_COMPACT_ARCHIVE_HEADER_SIZE || memcmp(bytes, "CWOD", 4) != 0) {
+    	return NULL;
+    }
+    uint32_t version;
+    uint64_t count;
+    memcpy(&version, bytes + 4, sizeof(version));
+    memcpy(&count, bytes + 8, sizeof(count));
+    count = CFSwapInt64LittleToHost(count);
+    if (CFSwapInt32LittleToHost(version) != CW_COMPACT_ARCHIVE_VERSION || count > (length - CW_COMPACT_ARCHIVE_HEADER_SIZE) / 4) {
+    	return NULL;
+    }
+    CWOrderedDictionaryStorage* storage = CWStorageCreate((NSUInteger)count);
+    NSMutableData* lazyOffsets = [[NSMutableData alloc] initWithLength:(NSUInteger)count * sizeof(NSUInteger)];
+    NSUInteger* offsets = [lazyOffsets mutableBytes];
+    storage->archive = [archive retain];
+    storage->lazyOffsets = lazyOffsets;
+    storage->lazyOffsetsStart = offsets;
+    storage->lazyOffsetsEnd = offsets + count;
+    NSUInteger offset = CW_COMPACT_ARCHIVE_HEADER_SIZE;
+    for (NSUInteger entry = 0; entry < count; entry++) {
+        NSUInteger keyLength = CWCompactArchiveRecordLength(bytes, length, offset);
+        NSUInteger valueLength = keyLength ? CWCompactArchiveRecordLength(bytes, length, offset + keyLength) : 0;
+        id key = valueLength ? CWCompactArchiveDecodeObject(archive, offset) : nil;
+        NSUInteger hash = [key hash];
+        NSUInteger slotIndex;
+        if (key == nil || CWStorageLookup(storage, key, hash, &slotIndex) != NSNotFound) {
+        	CWStorageFree(storage);
+            return NULL;
+        }
+        storage->keys[entry] = [key retain];
+        offsets[entry] = offset + keyLength;
+        storage->values[entry] = (id)&offsets[entry];
+        storage->hashes[entry] = hash;
+        storage->count++;
+        storage->used++;
+        CWStorageSetSlot(storage, slotIndex, entry);
+        offset += keyLength + valueLength;
+    }
+    return storage;
+}
+
+static NSData* CWStorageCompactArchivedData(CWOrderedDictionaryStorage* storage)
+{
+	NSMutableData* data = [NSMutableData dataWithCapacity:CW_COMPACT_ARCHIVE_HEADER_SIZE + storage->count * 16];
+    [data appendBytes:"CWOD" length:4];
+    CWCompactArchiveAppendUInt32(data, CW_COMPACT_ARCHIVE_VERSION);
+    CWCompactArchiveAppendUInt64(data, storage->count);
+    const uint8_t* archiveBytes = [storage->archive bytes];
+    NSUInteger archiveLength = [storage->archive length];
+    for (NSUInteger entry = storage->start; entry < storage->used; entry++) {
+        if (storage->keys[entry]) {
+            CWCompactArchiveAppendObject(data, storage->keys[entry]);
+            id value = storage->values[entry];
+            if (CWIsLazyValue(storage, value)) {
+                NSUInteger offset = CWOffsetForLazyValue(value);
+                [data appendBytes:archiveBytes + offset length:CWCompactArchiveRecordLength(archiveBytes, archiveLength, offset)];
+            } else {
+            	CWCompactArchiveAppendObject(data, value);
+            }
+        }
+    }
+    return data;
+}
+
+
+@interface CWOrderedDictionary ()
+-(id)initWithStorage:(CWOrderedDictionaryStorage*)storage;
+-(BOOL)needsCompaction;
+-(void)compact;
+@end
 
 
 @implementation CWOrderedDictionary
 
+#pragma mark --- Private helpers
+
+/*
+ * Make sure the storage is not shared with any copy, must be called before
+ * any mutation.
+ */
+static void CWOrderedDictionaryMakeStorageMutable(CWOrderedDictionary* self)
+{
+	CWOrderedDictionaryStorage* storage = self->_storage;
+	if (CWStorageIsShared(storage)) {
+    	self->_storage = CWStorageCopy(storage, storage->capacity);
+        CWStorageRelease(storage);
+    }
+}
+
+/*
+ * Make room for one more entry at the end of the storage.
+ */
+static void CWOrderedDictionaryReserveEntry(CWOrderedDictionary* self)
+{
+    CWOrderedDictionaryMakeStorageMutable(self);
+	CWOrderedDictionaryStorage* storage = self->_storage;
+	if (storage->used == storage->capacity || storage->fill >= storage->capacity) {
+        NSUInteger capacity = storage->capacity;
+        if ((storage->count + 1) * 2 > capacity) {
+        	capacity *= 2;
+        }
+        self->_storage = CWStorageResize(storage, capacity);
+    }
+}
+
+/*
+ * Make sure entries can be accessed by index, that is start + index.
+ */
+static void CWOrderedDictionaryPrepareForIndexing(CWOrderedDictionary* self)
+{
+	CWOrderedDictionaryStorage* storage = self->_storage;
+	if (CWStorageHasHoles(storage)) {
+        if (CWStorageIsShared(storage)) {
+            self->_storage = CWStorageCopy(storage, storage->capacity);
+            CWStorageRelease(storage);
+        } else {
+            self->_storage = CWStorageResize(storage, storage->capacity);
+        }
+    }
+}
+
+static NSUInteger CWOrderedDictionaryEntryAtIndex(CWOrderedDictionary* self, NSUInteger index)
+{
+    CWOrderedDictionaryPrepareForIndexing(self);
+    if (index >= self->_storage->count) {
+        [NSException raise:NSRangeException
+                    format:@"Index %lu beyond bounds [0 .. %ld]", (unsigned long)index, (long)self->_storage->count - 1];
+    }
+    return self->_storage->start + index;
+}
+
+static void CWOrderedDictionarySetObject(CWOrderedDictionary* self, id object, id key)
+{
+	if (object == nil || key == nil) {
+    	[NSException raise:NSInvalidArgumentException
+                    format:@"Attempt to insert nil object or key"];
+    }
+    CWOrderedDictionaryMakeStorageMutable(self);
+    NSUInteger hash = [key hash];
+    NSUInteger slotIndex;
+    NSUInteger entry = CWStorageLookup(self->_storage, key, hash, &slotIndex);
+    if (entry != NSNotFound) {
+        [object retain];
+        CWReleaseValue(self->_storage, self->_storage->values[entry]);
+        self->_storage->values[entry] = object;
+    } else {
+        if (self->_storage->used == self->_storage->capacity || self->_storage->fill >= self->_storage->capacity) {
+            CWOrderedDictionaryReserveEntry(self);
+            CWStorageLookup(self->_storage, key, hash, &slotIndex);
+        }
+        CWOrderedDictionaryStorage* storage = self->_storage;
+        entry = storage->used++;
+        storage->keys[entry] = [key copyWithZone:NULL];
+        storage->values[entry] = [object retain];
+        storage->hashes[entry] = hash;
+        storage->count++;
+        CWStorageSetSlot(storage, slotIndex, entry);
+    }
+    self->_mutations++;
+}
+
+static void CWOrderedDictionaryRemoveAllObjects(CWOrderedDictionary* self)
+{
+    CWStorageRelease(self->_storage);
+    self->_storage = CWStorageCreate(0);
+    self->_mutations++;
+}
+
+/*
+ * Append an entry to a storage being built in a single pass, the index is
+ * rebuilt once all entries has been appended.
+ */
+static inline void CWStorageAppendEntry(CWOrderedDictionaryStorage* storage, id key, id value, NSUInteger hash)
+{
+	NSUInteger entry = storage->used++;
+    storage->keys[entry] = key;
+    storage->values[entry] = value;
+    storage->hashes[entry] = hash;
+    storage->count++;
+}
+
+static void CWOrderedDictionaryReplaceStorage(CWOrderedDictionary* self, CWOrderedDictionaryStorage* newStorage)
+{
+    CWStorageRebuildIndex(newStorage);
+    CWStorageTakeArchive(newStorage, self->_storage);
+    free(self->_storage);
+    self->_storage = newStorage;
+    self->_mutations++;
+}
+
+/*
+ * Reorder all entries to match the order of keys.
+ */
+static void CWOrderedDictionaryReorderWithKeys(CWOrderedDictionary* self, NSArray* keys)
+{
+    CWOrderedDictionaryMakeStorageMutable(self);
+	CWOrderedDictionaryStorage* storage = self->_storage;
+    CWOrderedDictionaryStorage* newStorage = CWStorageCreate(storage->capacity);
+    for (id key in keys) {
+        NSUInteger entry = CWStorageLookup(storage, key, [key hash], NULL);
+        CWStorageAppendEntry(newStorage, storage->keys[entry], storage->values[entry], storage->hashes[entry]);
+    }
+    CWOrderedDictionaryReplaceStorage(self, newStorage);
+}
+
+/*
+ * Reorder all entries by a permutation of indexes, from the keys or values
+ * that were sorted.
+ */
+static void CWOrderedDictionaryReorderWithIndexes(CWOrderedDictionary* self, const NSUInteger* indexes)
+{
+    CWOrderedDictionaryMakeStorageMutable(self);
+    CWOrderedDictionaryPrepareForIndexing(self);
+	CWOrderedDictionaryStorage* storage = self->_storage;
+    CWOrderedDictionaryStorage* newStorage = CWStorageCreate(storage->capacity);
+    for (NSUInteger index = 0; index < storage->count; index++) {
+        NSUInteger entry = storage->start + indexes[index];
+        CWStorageAppendEntry(newStorage, storage->keys[entry], storage->values[entry], storage->hashes[entry]);
+    }
+    CWOrderedDictionaryReplaceStorage(self, newStorage);
+}
+
+/*
+ * Sort by keys or values using cached sort keys, objects must be in entry order.
+ */
+static void CWOrderedDictionarySortWithDescriptors(CWOrderedDictionary* self, NSArray* objects, NSArray* sortDescriptors)
+{
+    CWSortKeys* sortKeys = [[CWSortKeys alloc] initWithObjects:objects sortDescriptors:sortDescriptors];
+    NSUInteger* indexes = malloc(([objects count] + 1) * sizeof(NSUInteger));
+    [sortKeys getSortedIndexes:indexes];
+    CWOrderedDictionaryReorderWithIndexes(self, indexes);
+    free(indexes);
+    [sortKeys release];
+}
+
+static void CWOrderedDictionaryCheckIndexes(NSIndexSet* indexes, NSUInteger count)
+{
+    if ([indexes count] > 0 && [indexes lastIndex] >= count) {
+        [NSException raise:NSRangeException
+                    format:@"Index %lu beyond bounds [0 .. %ld]", (unsigned long)[indexes lastIndex], (long)count - 1];
+    }
+}
+
+static NSArray* CWOrderedDictionaryKeys(CWOrderedDictionary* self)
+{
+    CWOrderedDictionaryPrepareForIndexing(self);
+    return [NSArray arrayWithObjects:self->_storage->keys + self->_storage->start
+                               count:self->_storage->count];
+}
+
+static NSArray* CWOrderedDictionaryValues(CWOrderedDictionary* self)
+{
+    CWOrderedDictionaryPrepareForIndexing(self);
+    CWOrderedDictionaryStorage* storage = self->_storage;
+    if (storage->archive) {
+        for (NSUInteger entry = storage->start; entry < storage->used; entry++) {
+            CWStorageValueAtEntry(storage, entry);
+        }
+    }
+    return [NSArray arrayWithObjects:self->_storage->values + self->_storage->start
+                               count:self->_storage->count];
+}
+
 #pragma mark --- All initializers need to  be overridden for a class cluster :(
 
 -(id)init;
 {
-    return [self initWithDictionary:[NSDictionary dictionary]];
+    return [self initWithCapacity:0];
 }
 
 -(id)initWithDictionary:(NSDictionary*)dictionary;
@@ -47,29 +800,62 @@
 
 -(id)initWithDictionary:(NSDictionary*)dictionary copyItems:(BOOL)copyItems;
 {
-    self = [super init];
+    if ([dictionary isKindOfClass:[CWOrderedDictionary class]]) {
+        CWOrderedDictionary* snapshot = [[dictionary copy] autorelease];
+        if (!copyItems) {
+            return [self initWithStorage:CWStorageRetain(snapshot->_storage)];
+        }
+        dictionary = snapshot;
+    }
+    self = [self initWithCapacity:[dictionary count]];
     if (self) {
-        _dictionary = [[NSMutableDictionary alloc] initWithDictionary:dictionary copyItems:copyItems];
-        _array = [[NSMutableArray alloc] initWithArray:[dictionary allKeys]];
+        if ([dictionary isKindOfClass:[CWOrderedDictionary class]]) {
+        	CWOrderedDictionaryStorage* other = ((CWOrderedDictionary*)dictionary)->_storage;
+            for (NSUInteger entry = other->start; entry < other->used; entry++) {
+                if (other->keys[entry]) {
+                    id object = [[CWStorageValueAtEntry(other, entry) copy] autorelease];
+                    CWOrderedDictionarySetObject(self, object, other->keys[entry]);
+                }
+            }
+        } else {
+            for (id key in dictionary) {
+                id object = [dictionary objectForKey:key];
+                if (copyItems) {
+                	object = [[object copy] autorelease];
+                }
+                CWOrderedDictionarySetObject(self, object, key);
+            }
+        }
     }
     return self;
 }
 
 -(id)initWithObjects:(NSArray *)objects forKeys:(NSArray *)keys;
 {
-    self = [super init];
+    if ([objects count] != [keys count]) {
+        [self release];
+    	[NSException raise:NSInvalidArgumentException
+                    format:@"Count of objects (%lu) differs from count of keys (%lu)", (unsigned long)[objects count], (unsigned long)[keys count]];
+    }
+    self = [self initWithCapacity:[keys count]];
     if (self) {
-        _dictionary = [[NSMutableDictionary alloc] initWithObjects:objects forKeys:keys];
-        _array = [[NSMutableArray alloc] initWithArray:keys];
+        NSUInteger index = 0;
+        for (id key in keys) {
+        	CWOrderedDictionarySetObject(self, [objects objectAtIndex:index++], key);
+        }
     }
     return self;
 }
 
 -(id)initWithObjects:(id*)objectBuf forKeys:(id*)keyBuf count:(NSUInteger)count;
 {
-    NSArray* objects = [NSArray arrayWithObjects:objectBuf count:count];
-    NSArray* keys = [NSArray arrayWithObjects:keyBuf count:count];
-    return [self initWithObjects:objects forKeys:keys];
+    self = [self initWithCapacity:count];
+    if (self) {
+        for (NSUInteger index = 0; index < count; index++) {
+        	CWOrderedDictionarySetObject(self, objectBuf[index], keyBuf[index]);
+        }
+    }
+    return self;
 }
 
 -(id)initWithObjectsAndKeys:(id)firstObject , ...;
@@ -94,19 +880,36 @@
 }
 
 -(id)initWithCapacity:(NSUInteger)capacity;
+{
+    return [self initWithStorage:CWStorageCreate(capacity)];
+}
+
+-(id)initWithStorage:(CWOrderedDictionaryStorage*)storage;
 {
     self = [super init];
     if (self) {
-        _dictionary = [[NSMutableDictionary alloc] initWithCapacity:capacity];
-        _array = [[NSMutableArray alloc] initWithCapacity:capacity];
+        _storage = storage;
+    } else {
+    	CWStorageRelease(storage);
     }
     return self;
 }
 
+-(BOOL)needsCompaction;
+{
+	return CWStorageHasHoles(_storage);
+}
+
+-(void)compact;
+{
+	CWOrderedDictionaryPrepareForIndexing(self);
+}
+
 -(void)dealloc;
 {
-    [_dictionary release];
-    [_array release];
+    if (_storage) {
+    	CWStorageRelease(_storage);
+    }
     [super dealloc];
 }
 
@@ -114,55 +917,83 @@
 
 -(NSUInteger)count;
 {
-    return [_array count];
+    return _storage->count;
 }
 
 -(id)objectForKey:(id)key;
 {
-    return [_dictionary objectForKey:key];
+	if (key == nil) {
+    	return nil;
+    }
+    NSUInteger entry = CWStorageLookup(_storage, key, [key hash], NULL);
+    return entry != NSNotFound ? CWStorageValueAtEntry(_storage, entry) : nil;
 }
 
 -(NSEnumerator*)keyEnumerator;
 {
-    return [_array objectEnumerator];
+    return [CWOrderedDictionaryKeys(self) objectEnumerator];
 }
 
 -(void)setObject:(id)object forKey:(id)key;
 {
-    if (![_dictionary objectForKey:key]) {
-        [_array addObject:key];
-    }
-    [_dictionary setObject:object forKey:key];
+	CWOrderedDictionarySetObject(self, object, key);
 }
 
 -(void)removeObjectForKey:(id)key;
 {
-    [_dictionary removeObjectForKey:key];
-    [_array removeObject:key];
+	if (key == nil) {
+    	[NSException raise:NSInvalidArgumentException
+                    format:@"Attempt to remove nil key"];
+    }
+    CWOrderedDictionaryMakeStorageMutable(self);
+    NSUInteger slotIndex;
+    NSUInteger entry = CWStorageLookup(_storage, key, [key hash], &slotIndex);
+    if (entry != NSNotFound) {
+        CWStorageRemoveEntry(_storage, entry, slotIndex);
+        _mutations++;
+    }
+}
+
+-(void)removeAllObjects;
+{
+	CWOrderedDictionaryRemoveAllObjects(self);
 }
 
 #pragma mark --- Required for conformaing to NSObject, NSCoding, and NSCopying properly
 
 -(id)initWithCoder:(NSCoder *)aDecoder;
 {
-	self = [super initWithCoder:aDecoder];
+    NSArray* keys = [aDecoder decodeObjectForKey:@"CWOrderedDictionary.keys"];
+    if (keys) {
+    	return [self initWithObjects:[aDecoder decodeObjectForKey:@"CWOrderedDictionary.objects"] forKeys:keys];
+    }
+    // Archives written before keys and objects where encoded once.
+    NSDictionary* dictionary = [aDecoder decodeObjectForKey:@"CWOrderedDictionary.dictionary"];
+    keys = [aDecoder decodeObjectForKey:@"CWOrderedDictionary.array"];
+	self = [self initWithCapacity:[keys count]];
     if (self) {
-    	_dictionary = [[aDecoder decodeObjectForKey:@"CWOrderedDictionary.dictionary"] retain];
-    	_array = [[aDecoder decodeObjectForKey:@"CWOrderedDictionary.array"] retain];
+        for (id key in keys) {
+        	CWOrderedDictionarySetObject(self, [dictionary objectForKey:key], key);
+        }
     }
     return self;
 }
 
 -(void)encodeWithCoder:(NSCoder *)aCoder;
 {
- 	[aCoder encodeObject:_dictionary forKey:@"CWOrderedDictionary.dictionary"];
-    [aCoder encodeObject:_array forKey:@"CWOrderedDictionary.array"];
-    [super encodeWithCoder:aCoder];
+    [aCoder encodeObject:CWOrderedDictionaryKeys(self) forKey:@"CWOrderedDictionary.keys"];
+    [aCoder encodeObject:CWOrderedDictionaryValues(self) forKey:@"CWOrderedDictionary.objects"];
+}
+
+-(Class)classForCoder;
+{
+	return [self class];
 }
 
 -(id)copyWithZone:(NSZone*)zone;
 {
-	return [[[self class] alloc] initWithDictionary:self];
+	CWOrderedDictionaryPrepareForIndexing(self);
+	return [[[self class] allocWithZone:zone] initWithStorage:CWStorageRetain(_storage)];
 }
 
 -(id)mutableCopyWithZone:(NSZone*)zone;
@@ -172,16 +1003,34 @@
 
 -(NSUInteger)hash;
 {
-	return [_dictionary hash] ^ [_array hash];
+	return _storage->count;
 }
 
 -(BOOL)isEqualToDictionary:(NSDictionary *)otherDictionary;
 {
 	if ([otherDictionary isKindOfClass:[CWOrderedDictionary class]]) {
-    	CWOrderedDictionary* otherOrderedDictionary = (id)otherDictionary;
-        if ([_dictionary isEqualToDictionary:otherOrderedDictionary->_dictionary]) {
-        	return [_array isEqualToArray:otherOrderedDictionary->_array];
+        CWOrderedDictionary* snapshot = [[otherDictionary copy] autorelease];
+    	CWOrderedDictionaryStorage* storage = _storage;
+    	CWOrderedDictionaryStorage* other = snapshot->_storage;
+        if (storage == other) {
+        	return YES;
+        } else if (storage->count != other->count) {
+        	return NO;
+        }
+        NSUInteger otherEntry = other->start;
+        for (NSUInteger entry = storage->start; entry < storage->used; entry++) {
+            if (storage->keys[entry]) {
+                while (other->keys[otherEntry] == nil) {
+                	otherEntry++;
+                }
+                if (![storage->keys[entry] isEqual:other->keys[otherEntry]] ||
+                    ![CWStorageValueAtEntry(storage, entry) isEqual:CWStorageValueAtEntry(other, otherEntry)]) {
+                	return NO;
+                }
+                otherEntry++;
+            }
         }
+        return YES;
     }
     return NO;
 }
@@ -206,75 +1055,284 @@ static NSString* CWDescriptionForObject(id object, id locale, NSUInteger indent)
 	NSMutableString* indentString = [NSMutableString string];
 	for (NSUInteger i = 0; i < level; i++) {
 		[indentString appendFormat:@"    "];
-	}	
+	}
 	NSMutableString *description = [NSMutableString string];
 	[description appendFormat:@"%@{\n", indentString];
-	for (id key in self) {
-		[description appendFormat:@"%@    %@ = %@;\n",
-        	indentString,
-         	CWDescriptionForObject(key, locale, level),
-         	CWDescriptionForObject([self objectForKey:key], locale, level)];
+    for (NSUInteger entry = _storage->start; entry < _storage->used; entry++) {
+        if (_storage->keys[entry]) {
+            [description appendFormat:@"%@    %@ = %@;\n",
+                indentString,
+                CWDescriptionForObject(_storage->keys[entry], locale, level),
+                CWDescriptionForObject(CWStorageValueAtEntry(_storage, entry), locale, level)];
+        }
 	}
 	[description appendFormat:@"%@}\n", indentString];
 	return description;
 }
 
 
+#pragma mark --- Compact archiving
+
+-(id)initWithCompactArchivedData:(NSData*)data;
+{
+	CWOrderedDictionaryStorage* storage = CWStorageCreateWithCompactArchive(data);
+    if (storage == NULL) {
+    	[self release];
+        return nil;
+    }
+    return [self initWithStorage:storage];
+}
+
++(id)dictionaryWithContentsOfCompactArchiveURL:(NSURL*)url error:(NSError**)error;
+{
+	NSData* data = [NSData dataWithContentsOfURL:url options:NSDataReadingMappedIfSafe error:error];
+    if (data) {
+        id dictionary = [[[self alloc] initWithCompactArchivedData:data] autorelease];
+        if (dictionary == nil && error) {
+            *error = [NSError errorWithDomain:CWFoundationAdditionsErrorDomain
+                                         code:NSFileReadCorruptFileError
+                         localizedDescription:NSLocalizedString(@"Could not read ordered dictionary", nil)
+                              localizedReason:NSLocalizedString(@"The file is not a valid compact archive.", nil)];
+        }
+        return dictionary;
+    }
+    return nil;
+}
+
+-(NSData*)compactArchivedData;
+{
+	return CWStorageCompactArchivedData(_storage);
+}
+
+
 #pragma mark --- Public API
 
 -(void)insertObject:(id)object forKey:(id)key atIndex:(NSUInteger)index;
 {
-    NSUInteger oldIndex = [self indexForKey:key];
-    if (oldIndex == NSNotFound) {
-        [_dictionary setObject:object forKey:key];
-        [_array insertObject:key atIndex:index];
-    } else {
+	if (object == nil || key == nil) {
+    	[NSException raise:NSInvalidArgumentException
+                    format:@"Attempt to insert nil object or key"];
+    }
+    CWOrderedDictionaryPrepareForIndexing(self);
+    CWOrderedDictionaryMakeStorageMutable(self);
+    NSUInteger hash = [key hash];
+    NSUInteger entry = CWStorageLookup(_storage, key, hash, NULL);
+    if (entry != NSNotFound) {
         [NSException raise:NSInvalidArgumentException
-                    format:@"Cannot insert object with key %@ at index %d, already exist at index %d", key, index, oldIndex];
+                    format:@"Cannot insert object with key %@ at index %lu, already exist at index %lu", key, (unsigned long)index, (unsigned long)(entry - _storage->start)];
+    } else if (index > _storage->count) {
+        [NSException raise:NSRangeException
+                    format:@"Index %lu beyond bounds [0 .. %lu]", (unsigned long)index, (unsigned long)_storage->count];
+    } else if (index == _storage->count) {
+    	CWOrderedDictionarySetObject(self, object, key);
+        return;
+    } else if (index == 0 && _storage->start > 0 && _storage->fill < _storage->capacity) {
+        entry = --_storage->start;
+    } else {
+        CWOrderedDictionaryReserveEntry(self);
+        entry = _storage->start + index;
+        NSUInteger length = _storage->used - entry;
+        CWStorageMoveEntries(_storage, entry, entry + 1, length);
+        _storage->used++;
+        CWStorageRenumberEntries(_storage, NSMakeRange(entry + 1, length), 1);
     }
+    NSUInteger slotIndex;
+    CWStorageLookup(_storage, key, hash, &slotIndex);
+    _storage->keys[entry] = [key copyWithZone:NULL];
+    _storage->values[entry] = [object retain];
+    _storage->hashes[entry] = hash;
+    _storage->count++;
+    CWStorageSetSlot(_storage, slotIndex, entry);
+    _mutations++;
 }
 
 -(void)removeObjectAtIndex:(NSUInteger)index;
 {
-    [self removeObjectForKey:[_array objectAtIndex:index]];
+    CWOrderedDictionaryMakeStorageMutable(self);
+    NSUInteger entry = CWOrderedDictionaryEntryAtIndex(self, index);
+    NSUInteger slotIndex = CWStorageSlotForEntry(_storage, entry, _storage->hashes[entry]);
+    CWStorageRemoveEntry(_storage, entry, slotIndex);
+    _mutations++;
 }
 
 -(void)moveObjectForKey:(id)key toIndex:(NSUInteger)index;
 {
-	NSUInteger oldIndex = [_array indexOfObject:key];
-    if (oldIndex == NSNotFound) {
+    CWOrderedDictionaryPrepareForIndexing(self);
+    CWOrderedDictionaryMakeStorageMutable(self);
+    NSUInteger slotIndex;
+    NSUInteger oldEntry = key ? CWStorageLookup(_storage, key, [key hash], &slotIndex) : NSNotFound;
+    if (oldEntry == NSNotFound) {
         [NSException raise:NSInvalidArgumentException
                     format:@"No object for key %@", key];
-    } else if (oldIndex != index) {
-        [key retain];
-        [_array removeObjectAtIndex:oldIndex];
-        [_array insertObject:key atIndex:index];
-        [key release];
+    } else if (index >= _storage->count) {
+        [NSException raise:NSRangeException
+                    format:@"Index %lu beyond bounds [0 .. %ld]", (unsigned long)index, (long)_storage->count - 1];
+    }
+    NSUInteger newEntry = _storage->start + index;
+    if (oldEntry != newEntry) {
+    	id movedKey = _storage->keys[oldEntry];
+        id movedObject = _storage->values[oldEntry];
+        NSUInteger movedHash = _storage->hashes[oldEntry];
+        _storage->slots[slotIndex] = CW_SLOT_DUMMY;
+        if (oldEntry < newEntry) {
+            CWStorageMoveEntries(_storage, oldEntry + 1, oldEntry, newEntry - oldEntry);
+            CWStorageRenumberEntries(_storage, NSMakeRange(oldEntry, newEntry - oldEntry), -1);
+        } else {
+            CWStorageMoveEntries(_storage, newEntry, newEntry + 1, oldEntry - newEntry);
+            CWStorageRenumberEntries(_storage, NSMakeRange(newEntry + 1, oldEntry - newEntry), 1);
+        }
+        _storage->keys[newEntry] = movedKey;
+        _storage->values[newEntry] = movedObject;
+        _storage->hashes[newEntry] = movedHash;
+        _storage->slots[slotIndex] = (int32_t)newEntry;
+        _mutations++;
     } else {
         // Same index, no-op
     }
 }
 
+-(void)insertObjects:(NSArray*)objects forKeys:(NSArray*)keys atIndexes:(NSIndexSet*)indexes;
+{
+    NSUInteger insertCount = [indexes count];
+    if ([objects count] != insertCount || [keys count] != insertCount) {
+    	[NSException raise:NSInvalidArgumentException
+                    format:@"Count of objects (%lu) and keys (%lu) differs from count of indexes (%lu)", (unsigned long)[objects count], (unsigned long)[keys count], (unsigned long)insertCount];
+    } else if (insertCount == 0) {
+    	return;
+    }
+    CWOrderedDictionaryMakeStorageMutable(self);
+    CWOrderedDictionaryStorage* storage = self->_storage;
+    CWOrderedDictionaryCheckIndexes(indexes, storage->count + insertCount);
+    NSUInteger* hashes = malloc(insertCount * sizeof(NSUInteger));
+    for (NSUInteger i = 0; i < insertCount; i++) {
+    	id key = [keys objectAtIndex:i];
+        hashes[i] = [key hash];
+        if (CWStorageLookup(storage, key, hashes[i], NULL) != NSNotFound) {
+            free(hashes);
+            [NSException raise:NSInvalidArgumentException
+                        format:@"Cannot insert object with key %@, already exist", key];
+        }
+    }
+    if ([[NSSet setWithArray:keys] count] != insertCount) {
+        free(hashes);
+        [NSException raise:NSInvalidArgumentException
+                    format:@"Cannot insert objects with duplicate keys %@", keys];
+    }
+    NSUInteger totalCount = storage->count + insertCount;
+    CWOrderedDictionaryStorage* newStorage = CWStorageCreate(MAX(storage->capacity, totalCount + totalCount / 2));
+    NSUInteger entry = storage->start;
+    NSUInteger inserted = 0;
+    for (NSUInteger index = 0; index < totalCount; index++) {
+        if ([indexes containsIndex:index]) {
+            id object = [objects objectAtIndex:inserted];
+            id key = [keys objectAtIndex:inserted];
+            CWStorageAppendEntry(newStorage, [key copyWithZone:NULL], [object retain], hashes[inserted]);
+            inserted++;
+        } else {
+            while (storage->keys[entry] == nil) {
+            	entry++;
+            }
+            CWStorageAppendEntry(newStorage, storage->keys[entry], storage->values[entry], storage->hashes[entry]);
+            entry++;
+        }
+    }
+    free(hashes);
+    CWOrderedDictionaryReplaceStorage(self, newStorage);
+}
+
+-(void)removeObjectsAtIndexes:(NSIndexSet*)indexes;
+{
+    CWOrderedDictionaryPrepareForIndexing(self);
+    CWOrderedDictionaryMakeStorageMutable(self);
+    CWOrderedDictionaryStorage* storage = self->_storage;
+    CWOrderedDictionaryCheckIndexes(indexes, storage->count);
+    NSUInteger start = storage->start;
+    NSUInteger index = [indexes firstIndex];
+    while (index != NSNotFound) {
+        NSUInteger entry = start + index;
+        CWStorageRemoveEntry(storage, entry, CWStorageSlotForEntry(storage, entry, storage->hashes[entry]));
+        index = [indexes indexGreaterThanIndex:index];
+    }
+    _mutations++;
+}
+
+-(void)removeObjectsForKeys:(NSArray*)keys;
+{
+    CWOrderedDictionaryMakeStorageMutable(self);
+    for (id key in keys) {
+        NSUInteger slotIndex;
+        NSUInteger entry = CWStorageLookup(_storage, key, [key hash], &slotIndex);
+        if (entry != NSNotFound) {
+            CWStorageRemoveEntry(_storage, entry, slotIndex);
+        }
+    }
+    _mutations++;
+}
+
+-(void)moveObjectsAtIndexes:(NSIndexSet*)indexes toIndex:(NSUInteger)index;
+{
+    CWOrderedDictionaryPrepareForIndexing(self);
+    CWOrderedDictionaryMakeStorageMutable(self);
+    CWOrderedDictionaryStorage* storage = self->_storage;
+    CWOrderedDictionaryCheckIndexes(indexes, storage->count);
+    NSUInteger moveCount = [indexes count];
+    if (index > storage->count - moveCount) {
+        [NSException raise:NSRangeException
+                    format:@"Index %lu beyond bounds [0 .. %lu]", (unsigned long)index, (unsigned long)(storage->count - moveCount)];
+    } else if (moveCount == 0) {
+    	return;
+    }
+    CWOrderedDictionaryStorage* newStorage = CWStorageCreate(storage->capacity);
+    NSUInteger kept = 0;
+    for (NSUInteger oldIndex = 0; oldIndex < storage->count + 1; oldIndex++) {
+        if (kept == index) {
+            NSUInteger movedIndex = [indexes firstIndex];
+            while (movedIndex != NSNotFound) {
+                NSUInteger entry = storage->start + movedIndex;
+                CWStorageAppendEntry(newStorage, storage->keys[entry], storage->values[entry], storage->hashes[entry]);
+                movedIndex = [indexes indexGreaterThanIndex:movedIndex];
+            }
+            kept = NSNotFound;
+        }
+        if (oldIndex < storage->count && ![indexes containsIndex:oldIndex]) {
+            NSUInteger entry = storage->start + oldIndex;
+            CWStorageAppendEntry(newStorage, storage->keys[entry], storage->values[entry], storage->hashes[entry]);
+            if (kept != NSNotFound) {
+                kept++;
+            }
+        }
+    }
+    CWOrderedDictionaryReplaceStorage(self, newStorage);
+}
+
 -(id)keyAtIndex:(NSUInteger)index;
 {
-    return [_array objectAtIndex:index]; 
+    return _storage->keys[CWOrderedDictionaryEntryAtIndex(self, index)];
 }
 
 -(id)objectAtIndex:(NSUInteger)index;
 {
-    return [_dictionary objectForKey:[_array objectAtIndex:index]];
+    return CWStorageValueAtEntry(_storage, CWOrderedDictionaryEntryAtIndex(self, index));
 }
 
 -(NSUInteger)indexForKey:(id)key;
 {
-    return [_array indexOfObject:key];
+	if (key == nil) {
+    	return NSNotFound;
+    }
+    CWOrderedDictionaryPrepareForIndexing(self);
+    NSUInteger entry = CWStorageLookup(_storage, key, [key hash], NULL);
+    return entry != NSNotFound ? entry - _storage->start : NSNotFound;
 }
 
 -(NSIndexSet*)allIndexesForObject:(id)object;
 {
+    CWOrderedDictionaryPrepareForIndexing(self);
     NSMutableIndexSet* indexes = [NSMutableIndexSet indexSet];
-    for (id key in [_dictionary allKeysForObject:object]) {
-        [indexes addIndex:[_array indexOfObject:key]];
+    for (NSUInteger entry = _storage->start; entry < _storage->used; entry++) {
+        if ([CWStorageValueAtEntry(_storage, entry) isEqual:object]) {
+            [indexes addIndex:entry - _storage->start];
+        }
     }
     return [[[NSIndexSet alloc] initWithIndexSet:indexes] autorelease];
 }
@@ -283,50 +1341,58 @@ static NSString* CWDescriptionForObject(id object, id locale, NSUInteger indent)
 
 -(void)sortByKeyUsingDescriptors:(NSArray*)sortDescriptors;
 {
-	[_array sortUsingDescriptors:sortDescriptors];    
+	CWOrderedDictionarySortWithDescriptors(self, CWOrderedDictionaryKeys(self), sortDescriptors);
 }
 
 #if NS_BLOCKS_AVAILABLE
 -(void)sortByKeyUsingComparator:(NSComparator)cmptr;
 {
-	[_array sortUsingComparator:cmptr];    
+	CWOrderedDictionaryReorderWithKeys(self, [CWOrderedDictionaryKeys(self) sortedArrayUsingComparator:cmptr]);
 }
 
 -(void)sortByKeyWithOptions:(NSSortOptions)opts usingComparator:(NSComparator)cmptr;
 {
-	[_array sortWithOptions:opts usingComparator:cmptr];    
+	CWOrderedDictionaryReorderWithKeys(self, [CWOrderedDictionaryKeys(self) sortedArrayWithOptions:opts usingComparator:cmptr]);
 }
 
 #endif
 
 -(void)sortByKeyUsingFunction:(NSInteger(*)(id, id, void*))compare context:(void*)context;
 {
-	[_array sortUsingFunction:compare context:context];    
+	CWOrderedDictionaryReorderWithKeys(self, [CWOrderedDictionaryKeys(self) sortedArrayUsingFunction:compare context:context]);
 }
 
 -(void)sortByKeyUsingSelector:(SEL)comparator;
 {
-	[_array sortUsingSelector:comparator];
+	CWOrderedDictionaryReorderWithKeys(self, [CWOrderedDictionaryKeys(self) sortedArrayUsingSelector:comparator]);
+}
+
+static NSDictionary* CWOrderedDictionarySnapshot(CWOrderedDictionary* self)
+{
+	return [NSDictionary dictionaryWithObjects:CWOrderedDictionaryValues(self)
+                                       forKeys:CWOrderedDictionaryKeys(self)];
+}
+
+-(void)sortByValueUsingDescriptors:(NSArray*)sortDescriptors;
+{
+	CWOrderedDictionarySortWithDescriptors(self, CWOrderedDictionaryValues(self), sortDescriptors);
 }
 
 -(void)sortByValueUsingSelector:(SEL)comparator;
 {
-	[_array release];
-    _array = [[NSMutableArray alloc] initWithArray:[_dictionary keysSortedByValueUsingSelector:comparator]];
+	CWOrderedDictionaryReorderWithKeys(self, [CWOrderedDictionarySnapshot(self) keysSortedByValueUsingSelector:comparator]);
 }
 
 #if NS_BLOCKS_AVAILABLE
 -(void)sortByValueUsingComparator:(NSComparator)cmptr;
 {
-	[_array release];
-    _array = [[NSMutableArray alloc] initWithArray:[_dictionary keysSortedByValueUsingComparator:cmptr]];
+	CWOrderedDictionaryReorderWithKeys(self, [CWOrderedDictionarySnapshot(self) keysSortedByValueUsingComparator:cmptr]);
 }
 
 -(void)sortByValueWithOptions:(NSSortOptions)opts usingComparator:(NSComparator)cmptr;
 {
-	[_array release];
-    _array = [[NSMutableArray alloc] initWithArray:[_dictionary keysSortedByValueWithOptions:opts 
-                                                                             usingComparator:cmptr]];
+	CWOrderedDictionaryReorderWithKeys(self, [CWOrderedDictionarySnapshot(self) keysSortedByValueWithOptions:opts
+                                                                                             usingComparator:cmptr]);
 }
 #endif
 
@@ -335,21 +1401,29 @@ static NSString* CWDescriptionForObject(id object, id locale, NSUInteger indent)
 
 -(NSArray*)allKeys;
 {
-    return [NSArray arrayWithArray:_array];
+    return CWOrderedDictionaryKeys(self);
 }
 
 -(NSArray*)allValues;
 {
-    NSMutableArray* values = [NSMutableArray arrayWithCapacity:[_array count]];
-    for (id key in _array) {
-        [values addObject:[_dictionary objectForKey:key]];
-    }
-    return [NSArray arrayWithArray:values];
+    return CWOrderedDictionaryValues(self);
+}
+
+-(NSEnumerator*)objectEnumerator;
+{
+	return [CWOrderedDictionaryValues(self) objectEnumerator];
 }
 
 -(NSUInteger)countByEnumeratingWithState:(NSFastEnumerationState*)state objects:(id*)stackbuf count:(NSUInteger)len;
 {
-    return [_array countByEnumeratingWithState:state objects:stackbuf count:len];
+    if (state->state == 0) {
+        CWOrderedDictionaryPrepareForIndexing(self);
+        state->state = 1;
+        state->mutationsPtr = &_mutations;
+        state->itemsPtr = _storage->keys + _storage->start;
+        return _storage->count;
+    }
+    return 0;
 }
 
 @end
@@ -0,0 +1,222 @@
+//
+//  CWPipeline.h
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import <pthread.h>
+#import "CWChannel.h"
+
+@class CWPipeline;
+
+/*!
+ * @abstract A stage of a CWPipeline, with counters for finding bottlenecks.
+ *
+ * @discussion A stage with high utilization, and stages before it with high
+ *             blocked time, is the bottleneck. Counters are updated as objects
+ *             are processed.
+ */
+@interface CWPipelineStage : NSObject {
+@private
+	CWPipeline* _pipeline;
+	NSString* _name;
+    id _target;
+    SEL _selector;
+    NSUInteger _concurrency;
+    BOOL _ordered;
+    CWChannel* _input;
+    CWChannel* _output;
+    NSOperationQueue* _queue;
+    pthread_mutex_t _lock;
+    pthread_cond_t _turn;
+    NSUInteger _nextSequenceNumber;
+    NSUInteger _runningWorkerCount;
+    BOOL _cancelled;
+    NSUInteger _processedCount;
+    NSUInteger _outputCount;
+    NSTimeInterval _busyTime;
+    NSTimeInterval _idleTime;
+    NSTimeInterval _blockedTime;
+}
+
+@property(readonly, copy) NSString* name;
+@property(readonly, retain) id target;
+@property(readonly, assign) SEL selector;
+@property(readonly, assign) NSUInteger concurrency;
+
+/*!
+ * @abstract Number of objects taken from the input and processed.
+ */
+@property(readonly, assign) NSUInteger processedCount;
+
+/*!
+ * @abstract Number of objects put to the output, excluding dropped objects.
+ */
+@property(readonly, assign) NSUInteger outputCount;
+
+/*!
+ * @abstract Total time, over all workers, spent processing objects, waiting
+ *           for input, and blocked by a full output.
+ */
+@property(readonly, assign) NSTimeInterval busyTime;
+@property(readonly, assign) NSTimeInterval idleTime;
+@property(readonly, assign) NSTimeInterval blockedTime;
+
+/*!
+ * @abstract Processed objects per second of busy time and worker.
+ */
+-(double)throughput;
+
+/*!
+ * @abstract Busy time as a fraction of the total time of all workers.
+ */
+-(double)utilization;
+
+@end
+
+
+/*!
+ * @abstract Optional methods for targets of pipeline stages.
+ */
+@protocol CWPipelineStageTarget <NSObject>
+
+@optional
+
+/*!
+ * @abstract The pipeline was aborted.
+ *
+ * @discussion Called on the thread aborting the pipeline, while other stages
+ *             may still be processing. Implement to abort long running work,
+ *             for example by sending abortTranslation to a CWXMLTranslator.
+ */
+-(void)pipelineDidAbort:(CWPipeline*)pipeline;
+
+@end
+
+
+/*!
+ * @abstract CWPipeline processes a stream of objects in stages, each stage with
+ *           its own concurrency and connected to the next by a bounded channel.
+ *
+ * @discussion Each stage sends a selector taking and returning an object to its
+ *             target, returning nil drops the object. A slow stage fills the
+ *             channel before it and blocks earlier stages, and finally the
+ *             producer adding objects to the pipeline.
+ *
+ *             With ordered delivery objects leave each stage in the order they
+ *             entered it, a worker that finishes early waits for its turn.
+ *
+ *             Finishing the pipeline closes the input channel, and each stage
+ *             closes its output channel when its last worker has drained its
+ *             input. Aborting the pipeline cancels all channels, objects not yet
+ *             processed are discarded. A stage raising an exception aborts
+ *             the pipeline.
+ *
+ *             Stage workers are long running operations, added to a private
+ *             queue per stage with performSelector:onQueue:withObject:.
+ */
+@interface CWPipeline : NSObject {
+@private
+	NSMutableArray* _stages;
+    NSUInteger _channelCapacity;
+    BOOL _ordered;
+    CWChannel* _inputChannel;
+    CWChannel* _outputChannel;
+    pthread_mutex_t _lock;
+    pthread_cond_t _finishedCondition;
+    BOOL _started;
+    BOOL _finished;
+    BOOL _aborted;
+    NSUInteger _runningStageCount;
+    NSException* _exception;
+}
+
+@property(readonly, assign) NSUInteger channelCapacity;
+@property(readonly, assign, getter=isOrdered) BOOL ordered;
+@property(readonly, retain) NSArray* stages;
+
+/*!
+ * @abstract Optional channel the results of the last stage are put to, closed
+ *           at the end of the stream. Must be set before the pipeline is started.
+ *
+ * @discussion Results of the last stage are discarded if not set.
+ */
+@property(retain) CWChannel* outputChannel;
+
+@property(readonly, assign, getter=isFinished) BOOL finished;
+@property(readonly, assign, getter=isAborted) BOOL aborted;
+
+/*!
+ * @abstract The exception raised by a stage, that aborted the pipeline.
+ */
+@property(readonly, retain) NSException* exception;
+
+/*!
+ * @abstract Init a pipeline with channels of a capacity between stages.
+ */
+-(id)initWithChannelCapacity:(NSUInteger)capacity ordered:(BOOL)ordered;
+
+/*!
+ * @abstract Add a stage sending selector to target for each object, with a
+ *           number of concurrent workers.
+ *
+ * @discussion The selector must take one object and return an object, or nil to
+ *             drop the object. The target must be thread safe if concurrency
+ *             is more than 1. Stages can not be added once started.
+ */
+-(CWPipelineStage*)addStageWithName:(NSString*)name target:(id)target selector:(SEL)aSelector concurrency:(NSUInteger)concurrency;
+
+/*!
+ * @abstract Start the workers of all stages.
+ */
+-(void)start;
+
+/*!
+ * @abstract Add an object to the first stage, blocking while its input is full.
+ * @result NO if the pipeline has been finished or aborted.
+ */
+-(BOOL)addObject:(id)object;
+
+/*!
+ * @abstract Mark the end of the stream, the pipeline finishes when all added
+ *           objects have been processed.
+ */
+-(void)finish;
+
+/*!
+ * @abstract Abort the pipeline, can be called from a stage or any other thread.
+ */
+-(void)abortPipeline;
+
+/*!
+ * @abstract Block until all stages have finished, or the pipeline is aborted.
+ * @result YES if finished without being aborted.
+ */
+-(BOOL)waitUntilFinished;
+
+@end
@@ -0,0 +1,389 @@
+//
+//  CWPipeline.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWPipeline.h"
+#import "NSOperationQueue+CWDefaultQueue.h"
+
+
+@interface CWPipelineStage ()
+
+-(id)initWithPipeline:(CWPipeline*)pipeline name:(NSString*)name target:(id)target selector:(SEL)aSelector concurrency:(NSUInteger)concurrency ordered:(BOOL)ordered;
+-(void)startWithInput:(CWChannel*)input output:(CWChannel*)output;
+-(void)cancel;
+
+@end
+
+
+@interface CWPipeline ()
+
+-(void)stageDidFinish:(CWPipelineStage*)stage;
+-(void)abortWithException:(NSException*)exception;
+
+@end
+
+
+@implementation CWPipelineStage
+
+@synthesize name = _name, target = _target, selector = _selector, concurrency = _concurrency;
+
+-(id)initWithPipeline:(CWPipeline*)pipeline name:(NSString*)name target:(id)target selector:(SEL)aSelector concurrency:(NSUInteger)concurrency ordered:(BOOL)ordered;
+{
+	self = [super init];
+    if (self) {
+    	_pipeline = pipeline;
+        _name = [name copy];
+        _target = [target retain];
+        _selector = aSelector;
+        _concurrency = MAX(concurrency, 1);
+        _ordered = ordered && _concurrency > 1;
+        pthread_mutex_init(&_lock, NULL);
+        pthread_cond_init(&_turn, NULL);
+    }
+    return self;
+}
+
+-(void)dealloc;
+{
+	[_queue release];
+    [_output release];
+    [_input release];
+    pthread_cond_destroy(&_turn);
+    pthread_mutex_destroy(&_lock);
+    [_target release];
+    [_name release];
+    [super dealloc];
+}
+
+#define CW_LOCKED_GETTER(type, name, value) \
+-(type)name; \
+{ \
+	pthread_mutex_lock(&_lock); \
+    type result = value; \
+    pthread_mutex_unlock(&_lock); \
+    return result; \
+}
+
+CW_LOCKED_GETTER(NSUInteger, processedCount, _processedCount)
+CW_LOCKED_GETTER(NSUInteger, outputCount, _outputCount)
+CW_LOCKED_GETTER(NSTimeInterval, busyTime, _busyTime)
+CW_LOCKED_GETTER(NSTimeInterval, idleTime, _idleTime)
+CW_LOCKED_GETTER(NSTimeInterval, blockedTime, _blockedTime)
+
+#undef CW_LOCKED_GETTER
+
+-(double)throughput;
+{
+	pthread_mutex_lock(&_lock);
+    double throughput = _busyTime > 0 ? _processedCount / _busyTime : 0;
+    pthread_mutex_unlock(&_lock);
+    return throughput;
+}
+
+-(double)utilization;
+{
+	pthread_mutex_lock(&_lock);
+    NSTimeInterval totalTime = _busyTime + _idleTime + _blockedTime;
+    double utilization = totalTime > 0 ? _busyTime / totalTime : 0;
+    pthread_mutex_unlock(&_lock);
+    return utilization;
+}
+
+/*
+ * The stage retains the pipeline until the last worker has finished.
+ */
+-(void)startWithInput:(CWChannel*)input output:(CWChannel*)output;
+{
+	_input = [input retain];
+    _output = [output retain];
+    _queue = [[NSOperationQueue alloc] init];
+    [_queue setMaxConcurrentOperationCount:_concurrency];
+    [_pipeline retain];
+    _runningWorkerCount = _concurrency;
+    for (NSUInteger index = 0; index < _concurrency; index++) {
+    	[self performSelector:@selector(runWorker) onQueue:_queue withObject:nil];
+    }
+}
+
+-(void)cancel;
+{
+	pthread_mutex_lock(&_lock);
+    _cancelled = YES;
+    pthread_cond_broadcast(&_turn);
+    pthread_mutex_unlock(&_lock);
+    [_output cancel];
+}
+
+/*
+ * With ordered delivery a worker holds the turn of its sequence number while
+ * putting to the output, so the output is put in input order.
+ */
+-(void)runWorker;
+{
+	BOOL running = YES;
+	while (running) {
+    	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+        NSUInteger sequenceNumber = 0;
+        CFAbsoluteTime takeTime = CFAbsoluteTimeGetCurrent();
+        id object = [_input takeObjectWithSequenceNumber:&sequenceNumber];
+        CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+        if (object == nil) {
+        	pthread_mutex_lock(&_lock);
+            _idleTime += startTime - takeTime;
+            pthread_mutex_unlock(&_lock);
+            running = NO;
+        } else {
+            id result = nil;
+            @try {
+                result = [_target performSelector:_selector withObject:object];
+            }
+            @catch (NSException* exception) {
+                [_pipeline abortWithException:exception];
+            }
+            CFAbsoluteTime processedTime = CFAbsoluteTimeGetCurrent();
+            pthread_mutex_lock(&_lock);
+            _processedCount++;
+            _idleTime += startTime - takeTime;
+            _busyTime += processedTime - startTime;
+            while (_ordered && _nextSequenceNumber != sequenceNumber && !_cancelled) {
+            	pthread_cond_wait(&_turn, &_lock);
+            }
+            pthread_mutex_unlock(&_lock);
+            BOOL delivered = result == nil || _output == nil || [_output putObject:result];
+            pthread_mutex_lock(&_lock);
+            if (result && _output && delivered) {
+            	_outputCount++;
+            }
+            _blockedTime += CFAbsoluteTimeGetCurrent() - processedTime;
+            _nextSequenceNumber++;
+            pthread_cond_broadcast(&_turn);
+            running = delivered && !_cancelled;
+            pthread_mutex_unlock(&_lock);
+        }
+        [pool drain];
+    }
+    pthread_mutex_lock(&_lock);
+    BOOL lastWorker = --_runningWorkerCount == 0;
+    pthread_mutex_unlock(&_lock);
+    if (lastWorker) {
+    	[_output close];
+        [_pipeline stageDidFinish:self];
+        [_pipeline release];
+    }
+}
+
+@end
+
+
+@implementation CWPipeline
+
+@synthesize channelCapacity = _channelCapacity, ordered = _ordered;
+
+-(id)init;
+{
+	return [self initWithChannelCapacity:1 ordered:NO];
+}
+
+-(id)initWithChannelCapacity:(NSUInteger)capacity ordered:(BOOL)ordered;
+{
+	self = [super init];
+    if (self) {
+    	_stages = [[NSMutableArray alloc] init];
+        _channelCapacity = MAX(capacity, 1);
+        _ordered = ordered;
+        pthread_mutex_init(&_lock, NULL);
+        pthread_cond_init(&_finishedCondition, NULL);
+    }
+    return self;
+}
+
+-(void)dealloc;
+{
+	[_exception release];
+    pthread_cond_destroy(&_finishedCondition);
+    pthread_mutex_destroy(&_lock);
+    [_outputChannel release];
+    [_inputChannel release];
+    [_stages release];
+    [super dealloc];
+}
+
+-(NSArray*)stages;
+{
+	pthread_mutex_lock(&_lock);
+    NSArray* stages = [NSArray arrayWithArray:_stages];
+    pthread_mutex_unlock(&_lock);
+    return stages;
+}
+
+-(CWChannel*)outputChannel;
+{
+	pthread_mutex_lock(&_lock);
+    CWChannel* outputChannel = [[_outputChannel retain] autorelease];
+    pthread_mutex_unlock(&_lock);
+    return outputChannel;
+}
+
+-(void)setOutputChannel:(CWChannel*)outputChannel;
+{
+	pthread_mutex_lock(&_lock);
+    if (_started) {
+	    pthread_mutex_unlock(&_lock);
+    	[NSException raise:NSInternalInconsistencyException format:@"Pipeline already started"];
+    }
+    [_outputChannel autorelease];
+    _outputChannel = [outputChannel retain];
+    pthread_mutex_unlock(&_lock);
+}
+
+-(BOOL)isFinished;
+{
+	pthread_mutex_lock(&_lock);
+    BOOL finished = _finished;
+    pthread_mutex_unlock(&_lock);
+    return finished;
+}
+
+-(BOOL)isAborted;
+{
+	pthread_mutex_lock(&_lock);
+    BOOL aborted = _aborted;
+    pthread_mutex_unlock(&_lock);
+    return aborted;
+}
+
+-(NSException*)exception;
+{
+	pthread_mutex_lock(&_lock);
+    NSException* exception = [[_exception retain] autorelease];
+    pthread_mutex_unlock(&_lock);
+    return exception;
+}
+
+-(CWPipelineStage*)addStageWithName:(NSString*)name target:(id)target selector:(SEL)aSelector concurrency:(NSUInteger)concurrency;
+{
+	CWPipelineStage* stage = [[CWPipelineStage alloc] initWithPipeline:self
+                                                                  name:name
+                                                                target:target
+                                                              selector:aSelector
+                                                           concurrency:concurrency
+                                                               ordered:_ordered];
+	pthread_mutex_lock(&_lock);
+    if (_started) {
+	    pthread_mutex_unlock(&_lock);
+        [stage release];
+    	[NSException raise:NSInternalInconsistencyException format:@"Pipeline already started"];
+    }
+    [_stages addObject:stage];
+    pthread_mutex_unlock(&_lock);
+    return [stage autorelease];
+}
+
+-(void)start;
+{
+	pthread_mutex_lock(&_lock);
+    if (_started || [_stages count] == 0) {
+	    pthread_mutex_unlock(&_lock);
+    	[NSException raise:NSInternalInconsistencyException format:@"Pipeline already started, or without stages"];
+    }
+    _started = YES;
+    _runningStageCount = [_stages count];
+    _inputChannel = [[CWChannel alloc] initWithCapacity:_channelCapacity];
+    pthread_mutex_unlock(&_lock);
+    CWChannel* input = _inputChannel;
+    for (NSUInteger index = 0; index < [_stages count]; index++) {
+    	CWChannel* output = _outputChannel;
+        if (index + 1 < [_stages count]) {
+        	output = [[[CWChannel alloc] initWithCapacity:_channelCapacity] autorelease];
+        }
+        [[_stages objectAtIndex:index] startWithInput:input output:output];
+        input = output;
+    }
+}
+
+-(BOOL)addObject:(id)object;
+{
+	return [_inputChannel putObject:object];
+}
+
+-(void)finish;
+{
+	[_inputChannel close];
+}
+
+-(void)abortPipeline;
+{
+	[self abortWithException:nil];
+}
+
+-(void)abortWithException:(NSException*)exception;
+{
+	pthread_mutex_lock(&_lock);
+    BOOL wasAborted = _aborted;
+    _aborted = YES;
+    if (_exception == nil) {
+    	_exception = [exception retain];
+    }
+    NSArray* stages = [NSArray arrayWithArray:_stages];
+    pthread_mutex_unlock(&_lock);
+    if (!wasAborted) {
+        [_inputChannel cancel];
+        for (CWPipelineStage* stage in stages) {
+            [stage cancel];
+        }
+        for (CWPipelineStage* stage in stages) {
+            if ([[stage target] respondsToSelector:@selector(pipelineDidAbort:)]) {
+                [[stage target] pipelineDidAbort:self];
+            }
+        }
+    }
+}
+
+-(void)stageDidFinish:(CWPipelineStage*)stage;
+{
+	pthread_mutex_lock(&_lock);
+    if (--_runningStageCount == 0) {
+    	_finished = YES;
+        pthread_cond_broadcast(&_finishedCondition);
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+-(BOOL)waitUntilFinished;
+{
+	pthread_mutex_lock(&_lock);
+    while (_started && !_finished) {
+    	pthread_cond_wait(&_finishedCondition, &_lock);
+    }
+    BOOL aborted = _aborted;
+    pthread_mutex_unlock(&_lock);
+    return !aborted;
+}
+
+@end
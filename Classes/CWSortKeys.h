@@ -0,0 +1,88 @@
+//
+//  CWSortKeys.h
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+
+/*!
+ * @abstract CWSortKeys holds the sort descriptor key values of a list of
+ *           objects, extracted once per object.
+ *
+ * @discussion NSSortDescriptor calls valueForKeyPath: on both objects for each
+ *             comparison, that is n log n times for a sort. CWSortKeys extracts
+ *             the values once, and compares the cached values. Numbers, dates
+ *             and strings compared using compare: are compared directly as
+ *             scalars and CFStrings, other values are compared using the
+ *             descriptor selector or comparator.
+ *
+ *             Objects are referenced by the index they were added at.
+ */
+@interface CWSortKeys : NSObject {
+@private
+	NSUInteger _descriptorCount;
+    struct CWSortKeyDescriptor* _descriptors;
+    NSUInteger _count;
+    NSUInteger _capacity;
+    struct CWSortKey* _keys;
+}
+
+@property(nonatomic, readonly, assign) NSUInteger count;
+
+/*!
+ * @abstract Init empty sort keys for an array of NSSortDescriptor.
+ */
+-(id)initWithSortDescriptors:(NSArray*)sortDescriptors;
+
+/*!
+ * @abstract Init sort keys for all objects in an array, the index of each
+ *           key is the index of the object.
+ */
+-(id)initWithObjects:(NSArray*)objects sortDescriptors:(NSArray*)sortDescriptors;
+
+/*!
+ * @abstract Extract and add the sort keys of an object, returns the index.
+ */
+-(NSUInteger)addKeysForObject:(id)anObject;
+
+-(NSComparisonResult)compareKeysAtIndex:(NSUInteger)index toKeysAtIndex:(NSUInteger)otherIndex;
+
+/*!
+ * @abstract Compare an object to the keys at index, without adding its keys.
+ * @discussion Key values are only extracted for as many sort descriptors as
+ *             are needed to order the object.
+ */
+-(NSComparisonResult)compareObject:(id)anObject toKeysAtIndex:(NSUInteger)index;
+
+/*!
+ * @abstract Get the indexes of all keys in sorted order.
+ * @discussion The sort is stable, indexes must have room for count indexes.
+ */
+-(void)getSortedIndexes:(NSUInteger*)indexes;
+
+@end
@@ -0,0 +1,299 @@
+//
+//  CWSortKeys.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWSortKeys.h"
+#import <objc/message.h>
+
+typedef enum {
+	CWSortKeyTypeObject = 0,
+    CWSortKeyTypeInteger,
+    CWSortKeyTypeReal,
+    CWSortKeyTypeString
+} CWSortKeyType;
+
+/*
+ * A retained value, and for typed values the scalar to compare.
+ */
+typedef struct CWSortKey {
+	id value;
+    CWSortKeyType type;
+    union {
+    	long long integer;
+        double real;
+    } scalar;
+} CWSortKey;
+
+typedef struct CWSortKeyDescriptor {
+	NSSortDescriptor* descriptor;
+    NSString* keyPath;
+    SEL selector;
+    BOOL ascending;
+    BOOL typed;
+} CWSortKeyDescriptor;
+
+/*
+ * Runs of at most this many indexes are sorted with an insertion sort.
+ */
+#define CW_INSERTION_SORT_THRESHOLD 16
+
+
+@implementation CWSortKeys
+
+@synthesize count = _count;
+
+#pragma mark --- Private helpers
+
+static Class CWNumberClass = Nil;
+static Class CWDecimalNumberClass = Nil;
+static Class CWDateClass = Nil;
+static Class CWStringClass = Nil;
+
++(void)initialize;
+{
+	if (self == [CWSortKeys class]) {
+    	CWNumberClass = [NSNumber class];
+        CWDecimalNumberClass = [NSDecimalNumber class];
+        CWDateClass = [NSDate class];
+        CWStringClass = [NSString class];
+    }
+}
+
+static void CWSortKeyInit(CWSortKey* key, const CWSortKeyDescriptor* descriptor, id object)
+{
+	// Comparator based descriptors can only compare the objects themselves.
+	id value = object;
+    if (descriptor->keyPath && descriptor->selector) {
+    	value = [object valueForKeyPath:descriptor->keyPath];
+    }
+    key->value = [value retain];
+    key->type = CWSortKeyTypeObject;
+    if (!descriptor->typed || value == nil) {
+    	return;
+    }
+    if ([value isKindOfClass:CWNumberClass]) {
+    	if ([value isKindOfClass:CWDecimalNumberClass]) {
+        	return;
+        }
+        const char* type = [value objCType];
+        if (type[0] == 'f' || type[0] == 'd') {
+        	key->type = CWSortKeyTypeReal;
+            key->scalar.real = [value doubleValue];
+        } else if (type[0] != 'Q' || [value unsignedLongLongValue] <= LLONG_MAX) {
+        	key->type = CWSortKeyTypeInteger;
+            key->scalar.integer = [value longLongValue];
+        }
+    } else if ([value isKindOfClass:CWDateClass]) {
+    	key->type = CWSortKeyTypeReal;
+        key->scalar.real = [value timeIntervalSinceReferenceDate];
+    } else if ([value isKindOfClass:CWStringClass]) {
+    	key->type = CWSortKeyTypeString;
+    }
+}
+
+static NSComparisonResult CWSortKeyCompare(const CWSortKey* key, const CWSortKey* otherKey, const CWSortKeyDescriptor* descriptor)
+{
+	NSComparisonResult result;
+    if (key->value == nil || otherKey->value == nil) {
+    	// Nil orders before any value, as with NSSortDescriptor.
+    	if (key->value == otherKey->value) {
+        	result = NSOrderedSame;
+        } else {
+        	result = key->value == nil ? NSOrderedAscending : NSOrderedDescending;
+        }
+    } else if (key->type != otherKey->type || key->type == CWSortKeyTypeObject) {
+    	if (descriptor->selector) {
+        	result = (NSComparisonResult)objc_msgSend(key->value, descriptor->selector, otherKey->value);
+        } else {
+        	result = [descriptor->descriptor compareObject:key->value toObject:otherKey->value];
+        }
+    } else if (key->type == CWSortKeyTypeInteger) {
+    	result = key->scalar.integer < otherKey->scalar.integer ? NSOrderedAscending : (key->scalar.integer > otherKey->scalar.integer ? NSOrderedDescending : NSOrderedSame);
+    } else if (key->type == CWSortKeyTypeReal) {
+    	result = key->scalar.real < otherKey->scalar.real ? NSOrderedAscending : (key->scalar.real > otherKey->scalar.real ? NSOrderedDescending : NSOrderedSame);
+    } else {
+    	result = CFStringCompare((CFStringRef)key->value, (CFStringRef)otherKey->value, 0);
+    }
+    return descriptor->ascending ? result : -result;
+}
+
+static NSComparisonResult CWSortKeysCompare(CWSortKeys* self, NSUInteger index, NSUInteger otherIndex)
+{
+	CWSortKey* keys = self->_keys + index * self->_descriptorCount;
+    CWSortKey* otherKeys = self->_keys + otherIndex * self->_descriptorCount;
+    for (NSUInteger i = 0; i < self->_descriptorCount; i++) {
+    	NSComparisonResult result = CWSortKeyCompare(keys + i, otherKeys + i, self->_descriptors + i);
+        if (result != NSOrderedSame) {
+        	return result;
+        }
+    }
+    return NSOrderedSame;
+}
+
+/*
+ * Stable merge sort of indexes, buffer must have room for count / 2 indexes.
+ */
+static void CWSortKeysMergeSort(CWSortKeys* self, NSUInteger* indexes, NSUInteger* buffer, NSUInteger count)
+{
+	if (count <= CW_INSERTION_SORT_THRESHOLD) {
+    	for (NSUInteger i = 1; i < count; i++) {
+        	NSUInteger index = indexes[i];
+            NSUInteger insertIndex = i;
+            while (insertIndex > 0 && CWSortKeysCompare(self, indexes[insertIndex - 1], index) > 0) {
+            	indexes[insertIndex] = indexes[insertIndex - 1];
+                insertIndex--;
+            }
+            indexes[insertIndex] = index;
+        }
+        return;
+    }
+    NSUInteger half = count / 2;
+    CWSortKeysMergeSort(self, indexes, buffer, half);
+    CWSortKeysMergeSort(self, indexes + half, buffer, count - half);
+    if (CWSortKeysCompare(self, indexes[half - 1], indexes[half]) <= 0) {
+    	return;
+    }
+    memcpy(buffer, indexes, half * sizeof(NSUInteger));
+    NSUInteger leftIndex = 0, rightIndex = half, i = 0;
+    while (leftIndex < half && rightIndex < count) {
+    	if (CWSortKeysCompare(self, indexes[rightIndex], buffer[leftIndex]) < 0) {
+        	indexes[i++] = indexes[rightIndex++];
+        } else {
+        	indexes[i++] = buffer[leftIndex++];
+        }
+    }
+    while (leftIndex < half) {
+    	indexes[i++] = buffer[leftIndex++];
+    }
+}
+
+#pragma mark --- Life cycle
+
+-(id)init;
+{
+	return [self initWithSortDescriptors:[NSArray array]];
+}
+
+-(id)initWithSortDescriptors:(NSArray*)sortDescriptors;
+{
+	self = [super init];
+    if (self) {
+    	_descriptorCount = [sortDescriptors count];
+        _descriptors = calloc(_descriptorCount + 1, sizeof(CWSortKeyDescriptor));
+        for (NSUInteger i = 0; i < _descriptorCount; i++) {
+        	NSSortDescriptor* descriptor = [sortDescriptors objectAtIndex:i];
+            _descriptors[i].descriptor = [descriptor retain];
+            _descriptors[i].keyPath = [[descriptor key] copy];
+            _descriptors[i].selector = [descriptor selector];
+            _descriptors[i].ascending = [descriptor ascending];
+            _descriptors[i].typed = _descriptors[i].selector == @selector(compare:);
+        }
+    }
+    return self;
+}
+
+-(id)initWithObjects:(NSArray*)objects sortDescriptors:(NSArray*)sortDescriptors;
+{
+	self = [self initWithSortDescriptors:sortDescriptors];
+    if (self) {
+    	_capacity = [objects count];
+        _keys = malloc((_capacity * _descriptorCount + 1) * sizeof(CWSortKey));
+        for (id object in objects) {
+        	[self addKeysForObject:object];
+        }
+    }
+    return self;
+}
+
+-(void)dealloc;
+{
+	for (NSUInteger i = 0; i < _count * _descriptorCount; i++) {
+    	[_keys[i].value release];
+    }
+    free(_keys);
+    for (NSUInteger i = 0; i < _descriptorCount; i++) {
+    	[_descriptors[i].descriptor release];
+        [_descriptors[i].keyPath release];
+    }
+    free(_descriptors);
+    [super dealloc];
+}
+
+#pragma mark --- Public API
+
+-(NSUInteger)addKeysForObject:(id)anObject;
+{
+	if (_count == _capacity) {
+    	_capacity = _capacity > 0 ? _capacity * 2 : 16;
+        _keys = realloc(_keys, (_capacity * _descriptorCount + 1) * sizeof(CWSortKey));
+    }
+    CWSortKey* keys = _keys + _count * _descriptorCount;
+    for (NSUInteger i = 0; i < _descriptorCount; i++) {
+    	CWSortKeyInit(keys + i, _descriptors + i, anObject);
+    }
+    return _count++;
+}
+
+-(NSComparisonResult)compareKeysAtIndex:(NSUInteger)index toKeysAtIndex:(NSUInteger)otherIndex;
+{
+	if (index >= _count || otherIndex >= _count) {
+    	[NSException raise:NSRangeException
+                    format:@"Index %lu beyond bounds [0 .. %ld]", (unsigned long)MAX(index, otherIndex), (long)_count - 1];
+    }
+    return CWSortKeysCompare(self, index, otherIndex);
+}
+
+-(NSComparisonResult)compareObject:(id)anObject toKeysAtIndex:(NSUInteger)index;
+{
+	if (index >= _count) {
+    	[NSException raise:NSRangeException
+                    format:@"Index %lu beyond bounds [0 .. %ld]", (unsigned long)index, (long)_count - 1];
+    }
+    CWSortKey* keys = _keys + index * _descriptorCount;
+    NSComparisonResult result = NSOrderedSame;
+    for (NSUInteger i = 0; i < _descriptorCount && result == NSOrderedSame; i++) {
+    	CWSortKey key;
+        CWSortKeyInit(&key, _descriptors + i, anObject);
+        result = CWSortKeyCompare(&key, keys + i, _descriptors + i);
+        [key.value release];
+    }
+    return result;
+}
+
+-(void)getSortedIndexes:(NSUInteger*)indexes;
+{
+	for (NSUInteger i = 0; i < _count; i++) {
+    	indexes[i] = i;
+    }
+    NSUInteger* buffer = malloc((_count / 2 + 1) * sizeof(NSUInteger));
+    CWSortKeysMergeSort(self, indexes, buffer, _count);
+    free(buffer);
+}
+
+@end
@@ -0,0 +1,109 @@
+//
+//  CWSortedArray.h
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+
+/*!
+ * @abstract CWSortedArray is a collection of objects kept sorted by a comparator.
+ *
+ * @discussion Objects are stored in a counted B+tree, so that insert, remove,
+ *             lookup by object or by index, and lower and upper bounds are all
+ *             O(log n). Fast enumeration and ranges walk the leaves in order.
+ *
+ *             Comparators follow the conventions of NSArray (CWSortedInsert);
+ *             an object is inserted before any objects it compares equal to.
+ *             Objects must not be mutated in ways that change their order
+ *             while in the array.
+ */
+@interface CWSortedArray : NSObject <NSFastEnumeration> {
+@private
+	struct CWSortedArrayNode* _root;
+    NSInteger (*_compare)(id, id, void*);
+    void* _context;
+    NSArray* _descriptors;
+    unsigned long _mutations;
+}
+
+-(id)initSortedUsingFunction:(NSInteger (*)(id, id, void*))compare context:(void*)context;
+-(id)initSortedUsingSelector:(SEL)aSelector;
+-(id)initSortedUsingDescriptors:(NSArray*)descriptors;
+
+-(NSUInteger)count;
+
+/*!
+ * @abstract Insert an object, returning the index it was inserted at.
+ */
+-(NSUInteger)addObject:(id)anObject;
+-(void)addObjectsFromArray:(NSArray*)objects;
+
+/*!
+ * @abstract Remove the first object comparing equal to anObject, if any.
+ */
+-(void)removeObject:(id)anObject;
+-(void)removeObjectAtIndex:(NSUInteger)index;
+-(void)removeAllObjects;
+
+/*!
+ * @abstract Object at index, that is the object with rank index.
+ */
+-(id)objectAtIndex:(NSUInteger)index;
+
+/*!
+ * @abstract Index of the first object comparing equal to anObject, or NSNotFound.
+ */
+-(NSUInteger)indexOfObject:(id)anObject;
+-(BOOL)containsObject:(id)anObject;
+
+/*!
+ * @abstract Index of the first object not ordered before anObject, or count
+ *           if there is no such object.
+ */
+-(NSUInteger)lowerBoundForObject:(id)anObject;
+
+/*!
+ * @abstract Index of the first object ordered after anObject, or count if
+ *           there is no such object.
+ */
+-(NSUInteger)upperBoundForObject:(id)anObject;
+
+/*!
+ * @abstract Range of all objects ordered from fromObject up to and including
+ *           toObject.
+ */
+-(NSRange)rangeOfObjectsFromObject:(id)fromObject toObject:(id)toObject;
+
+-(NSArray*)objectsInRange:(NSRange)range;
+-(NSArray*)allObjects;
+
+#if NS_BLOCKS_AVAILABLE
+-(void)enumerateObjectsInRange:(NSRange)range usingBlock:(void (^)(id obj, NSUInteger idx, BOOL *stop))block;
+#endif
+
+@end
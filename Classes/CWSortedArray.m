@@ -0,0 +1,552 @@
+//
+//  CWSortedArray.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWSortedArray.h"
+#import <objc/runtime.h>
+#import <objc/message.h>
+
+#pragma mark --- Nodes
+
+/*
+ * Leaves hold up to CW_NODE_CAPACITY objects and are linked in order. Branches
+ * hold up to CW_NODE_CAPACITY children, with the first object of each child
+ * as separator. The arrays have room for one extra entry, so that a node can
+ * overflow before it is split.
+ */
+#define CW_NODE_CAPACITY 64
+#define CW_NODE_MINIMUM (CW_NODE_CAPACITY / 4)
+
+typedef struct CWSortedArrayNode {
+    NSUInteger count;		// Number of objects or children.
+    NSUInteger size;		// Number of objects in subtree.
+    BOOL isLeaf;
+    id objects[CW_NODE_CAPACITY + 1];
+} CWSortedArrayNode;
+
+typedef struct CWSortedArrayLeaf {
+    CWSortedArrayNode node;
+    struct CWSortedArrayLeaf* next;
+} CWSortedArrayLeaf;
+
+typedef struct CWSortedArrayBranch {
+    CWSortedArrayNode node;
+    CWSortedArrayNode* children[CW_NODE_CAPACITY + 1];
+} CWSortedArrayBranch;
+
+#define CWLeaf(node) ((CWSortedArrayLeaf*)(node))
+#define CWBranch(node) ((CWSortedArrayBranch*)(node))
+
+static CWSortedArrayNode* CWSortedArrayNodeCreate(BOOL isLeaf)
+{
+	CWSortedArrayNode* node = calloc(1, isLeaf ? sizeof(CWSortedArrayLeaf) : sizeof(CWSortedArrayBranch));
+    if (node == NULL) {
+    	[NSException raise:NSMallocException
+                    format:@"Could not allocate CWSortedArray node"];
+    }
+    node->isLeaf = isLeaf;
+    return node;
+}
+
+static void CWSortedArrayNodeFree(CWSortedArrayNode* node)
+{
+	for (NSUInteger i = 0; i < node->count; i++) {
+    	if (node->isLeaf) {
+        	[node->objects[i] release];
+        } else {
+        	CWSortedArrayNodeFree(CWBranch(node)->children[i]);
+        }
+    }
+    free(node);
+}
+
+/*
+ * Number of objects in count entries of node, starting at index.
+ */
+static NSUInteger CWSortedArrayNodeEntriesSize(CWSortedArrayNode* node, NSUInteger index, NSUInteger count)
+{
+	if (node->isLeaf) {
+    	return count;
+    }
+    NSUInteger size = 0;
+    for (NSUInteger i = index; i < index + count; i++) {
+    	size += CWBranch(node)->children[i]->size;
+    }
+    return size;
+}
+
+static CWSortedArrayNode* CWSortedArrayNodeSplit(CWSortedArrayNode* node)
+{
+	NSUInteger half = node->count / 2;
+    NSUInteger moveCount = node->count - half;
+    CWSortedArrayNode* right = CWSortedArrayNodeCreate(node->isLeaf);
+    memcpy(right->objects, node->objects + half, moveCount * sizeof(id));
+    if (node->isLeaf) {
+        CWLeaf(right)->next = CWLeaf(node)->next;
+        CWLeaf(node)->next = CWLeaf(right);
+    } else {
+    	memcpy(CWBranch(right)->children, CWBranch(node)->children + half, moveCount * sizeof(CWSortedArrayNode*));
+    }
+    right->count = moveCount;
+    right->size = CWSortedArrayNodeEntriesSize(right, 0, moveCount);
+    node->count = half;
+    node->size -= right->size;
+    return right;
+}
+
+/*
+ * Move count entries from the start of right to the end of left, or from the
+ * end of left to the start of right if count is negative.
+ */
+static void CWSortedArrayNodeShift(CWSortedArrayNode* left, CWSortedArrayNode* right, NSInteger count)
+{
+    BOOL isLeaf = left->isLeaf;
+	if (count > 0) {
+        NSUInteger n = count;
+        NSUInteger size = CWSortedArrayNodeEntriesSize(right, 0, n);
+        memcpy(left->objects + left->count, right->objects, n * sizeof(id));
+        memmove(right->objects, right->objects + n, (right->count - n) * sizeof(id));
+        if (!isLeaf) {
+            memcpy(CWBranch(left)->children + left->count, CWBranch(right)->children, n * sizeof(CWSortedArrayNode*));
+            memmove(CWBranch(right)->children, CWBranch(right)->children + n, (right->count - n) * sizeof(CWSortedArrayNode*));
+        }
+        left->count += n;
+        left->size += size;
+        right->count -= n;
+        right->size -= size;
+    } else if (count < 0) {
+    	NSUInteger n = -count;
+        NSUInteger start = left->count - n;
+        NSUInteger size = CWSortedArrayNodeEntriesSize(left, start, n);
+        memmove(right->objects + n, right->objects, right->count * sizeof(id));
+        memcpy(right->objects, left->objects + start, n * sizeof(id));
+        if (!isLeaf) {
+            memmove(CWBranch(right)->children + n, CWBranch(right)->children, right->count * sizeof(CWSortedArrayNode*));
+            memcpy(CWBranch(right)->children, CWBranch(left)->children + start, n * sizeof(CWSortedArrayNode*));
+        }
+        left->count -= n;
+        left->size -= size;
+        right->count += n;
+        right->size += size;
+    }
+}
+
+/*
+ * Merge or redistribute the underfull child at index with a sibling.
+ */
+static void CWSortedArrayBranchRebalance(CWSortedArrayBranch* branch, NSUInteger index)
+{
+	NSUInteger leftIndex = index > 0 ? index - 1 : 0;
+    CWSortedArrayNode* left = branch->children[leftIndex];
+    CWSortedArrayNode* right = branch->children[leftIndex + 1];
+    NSUInteger total = left->count + right->count;
+    if (total <= CW_NODE_CAPACITY) {
+        CWSortedArrayNodeShift(left, right, right->count);
+        if (left->isLeaf) {
+        	CWLeaf(left)->next = CWLeaf(right)->next;
+        }
+        free(right);
+        NSUInteger tail = branch->node.count - leftIndex - 2;
+        memmove(branch->node.objects + leftIndex + 1, branch->node.objects + leftIndex + 2, tail * sizeof(id));
+        memmove(branch->children + leftIndex + 1, branch->children + leftIndex + 2, tail * sizeof(CWSortedArrayNode*));
+        branch->node.count--;
+    } else {
+    	CWSortedArrayNodeShift(left, right, (NSInteger)(total / 2) - (NSInteger)left->count);
+        branch->node.objects[leftIndex + 1] = right->objects[0];
+    }
+    branch->node.objects[leftIndex] = left->objects[0];
+}
+
+
+@implementation CWSortedArray
+
+#pragma mark --- Comparators
+
+static NSInteger CWSortedArraySelectorCompare(id a, id b, void* aSelector)
+{
+	return (NSInteger)objc_msgSend(a, (SEL)aSelector, b);
+}
+
+static NSInteger CWSortedArrayDescriptorCompare(id a, id b, void* descriptors)
+{
+	NSComparisonResult result = NSOrderedSame;
+    for (NSSortDescriptor* sortDescriptor in (NSArray*)descriptors) {
+        result = [sortDescriptor compareObject:a toObject:b];
+        if (result != NSOrderedSame) {
+            break;
+        }
+    }
+    return result;
+}
+
+/*
+ * Index of the first entry in node not ordered before object, or if upper
+ * the first entry ordered after object.
+ */
+static NSUInteger CWSortedArrayNodeBound(CWSortedArray* self, CWSortedArrayNode* node, id object, BOOL upper)
+{
+	NSUInteger index = 0;
+    NSUInteger topIndex = node->count;
+    while (index < topIndex) {
+        NSUInteger midIndex = (index + topIndex) / 2;
+        NSInteger result = self->_compare(object, node->objects[midIndex], self->_context);
+        if (result > 0 || (upper && result == 0)) {
+            index = midIndex + 1;
+        } else {
+            topIndex = midIndex;
+        }
+    }
+    return index;
+}
+
+/*
+ * Index of the child in branch that may hold the bound for object.
+ */
+static inline NSUInteger CWSortedArrayBranchChildForBound(CWSortedArray* self, CWSortedArrayNode* branch, id object, BOOL upper)
+{
+	NSUInteger index = CWSortedArrayNodeBound(self, branch, object, upper);
+    return index > 0 ? index - 1 : 0;
+}
+
+static NSUInteger CWSortedArrayBound(CWSortedArray* self, id object, BOOL upper)
+{
+	CWSortedArrayNode* node = self->_root;
+    NSUInteger index = 0;
+    while (!node->isLeaf) {
+    	NSUInteger child = CWSortedArrayBranchChildForBound(self, node, object, upper);
+        index += CWSortedArrayNodeEntriesSize(node, 0, child);
+        node = CWBranch(node)->children[child];
+    }
+    return index + CWSortedArrayNodeBound(self, node, object, upper);
+}
+
+/*
+ * Find the leaf holding the object at index, index is updated to the index
+ * within the leaf.
+ */
+static CWSortedArrayLeaf* CWSortedArrayLeafForIndex(CWSortedArray* self, NSUInteger* index)
+{
+	CWSortedArrayNode* node = self->_root;
+    while (!node->isLeaf) {
+        NSUInteger child = 0;
+        while (*index >= CWBranch(node)->children[child]->size) {
+        	*index -= CWBranch(node)->children[child]->size;
+            child++;
+        }
+        node = CWBranch(node)->children[child];
+    }
+    return CWLeaf(node);
+}
+
+static CWSortedArrayNode* CWSortedArrayNodeInsert(CWSortedArray* self, CWSortedArrayNode* node, id object, NSUInteger* index)
+{
+	if (node->isLeaf) {
+    	NSUInteger i = CWSortedArrayNodeBound(self, node, object, NO);
+        memmove(node->objects + i + 1, node->objects + i, (node->count - i) * sizeof(id));
+        node->objects[i] = [object retain];
+        *index += i;
+    } else {
+        CWSortedArrayBranch* branch = CWBranch(node);
+    	NSUInteger i = CWSortedArrayBranchChildForBound(self, node, object, NO);
+        *index += CWSortedArrayNodeEntriesSize(node, 0, i);
+        CWSortedArrayNode* child = branch->children[i];
+        CWSortedArrayNode* split = CWSortedArrayNodeInsert(self, child, object, index);
+        node->objects[i] = child->objects[0];
+        if (split) {
+            memmove(node->objects + i + 2, node->objects + i + 1, (node->count - i - 1) * sizeof(id));
+            memmove(branch->children + i + 2, branch->children + i + 1, (node->count - i - 1) * sizeof(CWSortedArrayNode*));
+            node->objects[i + 1] = split->objects[0];
+            branch->children[i + 1] = split;
+        } else {
+        	node->size++;
+            return NULL;
+        }
+    }
+    node->count++;
+    node->size++;
+    return node->count > CW_NODE_CAPACITY ? CWSortedArrayNodeSplit(node) : NULL;
+}
+
+static void CWSortedArrayNodeRemove(CWSortedArrayNode* node, NSUInteger index)
+{
+	if (node->isLeaf) {
+    	[node->objects[index] release];
+        memmove(node->objects + index, node->objects + index + 1, (node->count - index - 1) * sizeof(id));
+        node->count--;
+    } else {
+        CWSortedArrayBranch* branch = CWBranch(node);
+        NSUInteger i = 0;
+        while (index >= branch->children[i]->size) {
+        	index -= branch->children[i]->size;
+            i++;
+        }
+        CWSortedArrayNode* child = branch->children[i];
+        CWSortedArrayNodeRemove(child, index);
+        if (child->count < CW_NODE_MINIMUM) {
+        	CWSortedArrayBranchRebalance(branch, i);
+        } else {
+        	node->objects[i] = child->objects[0];
+        }
+    }
+    node->size--;
+}
+
+#pragma mark --- Life cycle
+
+-(id)init;
+{
+	return [self initSortedUsingSelector:@selector(compare:)];
+}
+
+-(id)initSortedUsingFunction:(NSInteger (*)(id, id, void*))compare context:(void*)context;
+{
+	self = [super init];
+    if (self) {
+    	_root = CWSortedArrayNodeCreate(YES);
+        _compare = compare;
+        _context = context;
+    }
+    return self;
+}
+
+-(id)initSortedUsingSelector:(SEL)aSelector;
+{
+	return [self initSortedUsingFunction:&CWSortedArraySelectorCompare context:aSelector];
+}
+
+-(id)initSortedUsingDescriptors:(NSArray*)descriptors;
+{
+	descriptors = [[descriptors copy] autorelease];
+	self = [self initSortedUsingFunction:&CWSortedArrayDescriptorCompare context:descriptors];
+    if (self) {
+    	_descriptors = [descriptors retain];
+    }
+    return self;
+}
+
+-(void)dealloc;
+{
+	CWSortedArrayNodeFree(_root);
+    [_descriptors release];
+    [super dealloc];
+}
+
+#pragma mark --- Accessing and mutating
+
+-(NSUInteger)count;
+{
+	return _root->size;
+}
+
+-(NSUInteger)addObject:(id)anObject;
+{
+	if (anObject == nil) {
+    	[NSException raise:NSInvalidArgumentException
+                    format:@"Attempt to insert nil object"];
+    }
+	NSUInteger index = 0;
+    CWSortedArrayNode* split = CWSortedArrayNodeInsert(self, _root, anObject, &index);
+    if (split) {
+    	CWSortedArrayNode* root = CWSortedArrayNodeCreate(NO);
+        root->objects[0] = _root->objects[0];
+        root->objects[1] = split->objects[0];
+        CWBranch(root)->children[0] = _root;
+        CWBranch(root)->children[1] = split;
+        root->count = 2;
+        root->size = _root->size + split->size;
+        _root = root;
+    }
+    _mutations++;
+    return index;
+}
+
+-(void)addObjectsFromArray:(NSArray*)objects;
+{
+	for (id object in objects) {
+    	[self addObject:object];
+    }
+}
+
+-(void)removeObject:(id)anObject;
+{
+	NSUInteger index = [self indexOfObject:anObject];
+    if (index != NSNotFound) {
+    	[self removeObjectAtIndex:index];
+    }
+}
+
+-(void)removeObjectAtIndex:(NSUInteger)index;
+{
+	if (index >= _root->size) {
+        [NSException raise:NSRangeException
+                    format:@"Index %lu beyond bounds [0 .. %ld]", (unsigned long)index, (long)_root->size - 1];
+    }
+    CWSortedArrayNodeRemove(_root, index);
+    if (!_root->isLeaf && _root->count == 1) {
+    	CWSortedArrayNode* root = CWBranch(_root)->children[0];
+        free(_root);
+        _root = root;
+    }
+    _mutations++;
+}
+
+-(void)removeAllObjects;
+{
+	CWSortedArrayNodeFree(_root);
+    _root = CWSortedArrayNodeCreate(YES);
+    _mutations++;
+}
+
+-(id)objectAtIndex:(NSUInteger)index;
+{
+	if (index >= _root->size) {
+        [NSException raise:NSRangeException
+                    format:@"Index %lu beyond bounds [0 .. %ld]", (unsigned long)index, (long)_root->size - 1];
+    }
+    CWSortedArrayLeaf* leaf = CWSortedArrayLeafForIndex(self, &index);
+    return leaf->node.objects[index];
+}
+
+-(NSUInteger)indexOfObject:(id)anObject;
+{
+	if (anObject == nil) {
+    	return NSNotFound;
+    }
+	NSUInteger index = CWSortedArrayBound(self, anObject, NO);
+    if (index < _root->size && _compare(anObject, [self objectAtIndex:index], _context) == NSOrderedSame) {
+    	return index;
+    }
+    return NSNotFound;
+}
+
+-(BOOL)containsObject:(id)anObject;
+{
+	return [self indexOfObject:anObject] != NSNotFound;
+}
+
+-(NSUInteger)lowerBoundForObject:(id)anObject;
+{
+	return CWSortedArrayBound(self, anObject, NO);
+}
+
+-(NSUInteger)upperBoundForObject:(id)anObject;
+{
+	return CWSortedArrayBound(self, anObject, YES);
+}
+
+-(NSRange)rangeOfObjectsFromObject:(id)fromObject toObject:(id)toObject;
+{
+	NSUInteger location = CWSortedArrayBound(self, fromObject, NO);
+    NSUInteger end = CWSortedArrayBound(self, toObject, YES);
+    return NSMakeRange(location, end > location ? end - location : 0);
+}
+
+-(NSArray*)objectsInRange:(NSRange)range;
+{
+	if (NSMaxRange(range) > _root->size) {
+        [NSException raise:NSRangeException
+                    format:@"Range %@ beyond bounds [0 .. %ld]", NSStringFromRange(range), (long)_root->size - 1];
+    }
+    NSMutableArray* objects = [NSMutableArray arrayWithCapacity:range.length];
+    if (range.length > 0) {
+        NSUInteger index = range.location;
+        CWSortedArrayLeaf* leaf = CWSortedArrayLeafForIndex(self, &index);
+        while ([objects count] < range.length) {
+            NSUInteger length = MIN(leaf->node.count - index, range.length - [objects count]);
+            [objects addObjectsFromArray:[NSArray arrayWithObjects:leaf->node.objects + index count:length]];
+            leaf = leaf->next;
+            index = 0;
+        }
+    }
+    return objects;
+}
+
+-(NSArray*)allObjects;
+{
+	return [self objectsInRange:NSMakeRange(0, _root->size)];
+}
+
+#if NS_BLOCKS_AVAILABLE
+-(void)enumerateObjectsInRange:(NSRange)range usingBlock:(void (^)(id obj, NSUInteger idx, BOOL *stop))block;
+{
+	if (NSMaxRange(range) > _root->size) {
+        [NSException raise:NSRangeException
+                    format:@"Range %@ beyond bounds [0 .. %ld]", NSStringFromRange(range), (long)_root->size - 1];
+    }
+    if (range.length > 0) {
+        unsigned long mutations = _mutations;
+        NSUInteger leafIndex = range.location;
+        CWSortedArrayLeaf* leaf = CWSortedArrayLeafForIndex(self, &leafIndex);
+        BOOL stop = NO;
+        for (NSUInteger index = range.location; index < NSMaxRange(range) && !stop; index++) {
+            if (leafIndex == leaf->node.count) {
+                leaf = leaf->next;
+                leafIndex = 0;
+            }
+            block(leaf->node.objects[leafIndex++], index, &stop);
+            if (mutations != _mutations) {
+                [NSException raise:NSGenericException
+                            format:@"%@ was mutated while being enumerated", self];
+            }
+        }
+    }
+}
+#endif
+
+-(NSUInteger)countByEnumeratingWithState:(NSFastEnumerationState*)state objects:(id*)stackbuf count:(NSUInteger)len;
+{
+	CWSortedArrayLeaf* leaf;
+	if (state->state == 0) {
+        state->state = 1;
+        state->mutationsPtr = &_mutations;
+        CWSortedArrayNode* node = _root;
+        while (!node->isLeaf) {
+        	node = CWBranch(node)->children[0];
+        }
+        leaf = CWLeaf(node);
+    } else {
+    	leaf = (CWSortedArrayLeaf*)state->extra[0];
+    }
+    while (leaf && leaf->node.count == 0) {
+    	leaf = leaf->next;
+    }
+    if (leaf == NULL) {
+    	return 0;
+    }
+    state->itemsPtr = leaf->node.objects;
+    state->extra[0] = (unsigned long)leaf->next;
+    return leaf->node.count;
+}
+
+-(NSString*)description;
+{
+	return [[self allObjects] description];
+}
+
+@end
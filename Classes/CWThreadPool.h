@@ -0,0 +1,90 @@
+//
+//  CWThreadPool.h
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import <pthread.h>
+
+/*!
+ * @abstract CWThreadPool performs selectors on a bounded pool of background
+ *           threads.
+ *
+ * @discussion Threads are created lazily when there is more work than idle
+ *             threads, up to maximumThreadCount, and exit after being idle for
+ *             idleTimeout seconds. Each performed selector gets its own
+ *             autorelease pool, but no run loop should be relied upon.
+ *
+ *             Background proxies and -[NSInvocation invokeInBackground] use the
+ *             shared pool instead of creating a new thread for each call.
+ */
+@interface CWThreadPool : NSObject {
+@private
+	pthread_mutex_t _lock;
+    pthread_cond_t _condition;
+    struct CWThreadPoolTask* _tasks;
+    NSUInteger _taskCapacity;
+    NSUInteger _taskHead;
+    NSUInteger _taskCount;
+    NSUInteger _threadCount;
+    NSUInteger _idleThreadCount;
+    NSUInteger _maximumThreadCount;
+    NSTimeInterval _idleTimeout;
+}
+
+/*!
+ * @abstract Maximum number of threads, lowering the limit lets surplus threads
+ *           exit once done with their current task.
+ */
+@property(assign) NSUInteger maximumThreadCount;
+
+/*!
+ * @abstract Seconds an idle thread waits for work before exiting.
+ */
+@property(assign) NSTimeInterval idleTimeout;
+
+/*!
+ * @abstract Current number of threads.
+ */
+@property(readonly, assign) NSUInteger threadCount;
+
+/*!
+ * @abstract The shared pool, with four threads per active processor and an
+ *           idle timeout of five seconds.
+ */
++(CWThreadPool*)sharedPool;
+
+-(id)initWithMaximumThreadCount:(NSUInteger)maximumThreadCount idleTimeout:(NSTimeInterval)idleTimeout;
+
+/*!
+ * @abstract Perform a selector on a pool thread.
+ * @discussion Target and object are retained until performed.
+ */
+-(void)performSelector:(SEL)aSelector onTarget:(id)target withObject:(id)arg;
+
+@end
@@ -0,0 +1,213 @@
+//
+//  CWThreadPool.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWThreadPool.h"
+#import <sys/time.h>
+
+typedef struct CWThreadPoolTask {
+	id target;
+    SEL selector;
+    id object;
+} CWThreadPoolTask;
+
+/*
+ * Initial number of tasks in the queue.
+ */
+#define CW_TASK_CAPACITY 64
+
+
+@interface CWThreadPool ()
+
+-(void)runWorker:(id)unused;
+
+@end
+
+
+@implementation CWThreadPool
+
+#pragma mark --- Life cycle
+
++(CWThreadPool*)sharedPool;
+{
+	static CWThreadPool* sharedPool = nil;
+    @synchronized(self) {
+    	if (sharedPool == nil) {
+        	NSUInteger threadCount = [[NSProcessInfo processInfo] activeProcessorCount] * 4;
+        	sharedPool = [[CWThreadPool alloc] initWithMaximumThreadCount:threadCount idleTimeout:5];
+        }
+    }
+    return sharedPool;
+}
+
+-(id)init;
+{
+	return [self initWithMaximumThreadCount:[[NSProcessInfo processInfo] activeProcessorCount] * 4 idleTimeout:5];
+}
+
+-(id)initWithMaximumThreadCount:(NSUInteger)maximumThreadCount idleTimeout:(NSTimeInterval)idleTimeout;
+{
+	self = [super init];
+    if (self) {
+    	pthread_mutex_init(&_lock, NULL);
+        pthread_cond_init(&_condition, NULL);
+        _taskCapacity = CW_TASK_CAPACITY;
+        _tasks = malloc(_taskCapacity * sizeof(CWThreadPoolTask));
+        _maximumThreadCount = MAX(maximumThreadCount, 1);
+        _idleTimeout = idleTimeout;
+    }
+    return self;
+}
+
+/*
+ * Threads retain the pool, so it is only deallocated without threads.
+ */
+-(void)dealloc;
+{
+	for (NSUInteger index = 0; index < _taskCount; index++) {
+    	CWThreadPoolTask* task = _tasks + (_taskHead + index) % _taskCapacity;
+        [task->target release];
+        [task->object release];
+    }
+    free(_tasks);
+    pthread_cond_destroy(&_condition);
+    pthread_mutex_destroy(&_lock);
+    [super dealloc];
+}
+
+#pragma mark --- Properties
+
+-(NSUInteger)maximumThreadCount;
+{
+	pthread_mutex_lock(&_lock);
+    NSUInteger maximumThreadCount = _maximumThreadCount;
+    pthread_mutex_unlock(&_lock);
+    return maximumThreadCount;
+}
+
+-(void)setMaximumThreadCount:(NSUInteger)maximumThreadCount;
+{
+	pthread_mutex_lock(&_lock);
+    _maximumThreadCount = MAX(maximumThreadCount, 1);
+    pthread_cond_broadcast(&_condition);
+    pthread_mutex_unlock(&_lock);
+}
+
+-(NSTimeInterval)idleTimeout;
+{
+	pthread_mutex_lock(&_lock);
+    NSTimeInterval idleTimeout = _idleTimeout;
+    pthread_mutex_unlock(&_lock);
+    return idleTimeout;
+}
+
+-(void)setIdleTimeout:(NSTimeInterval)idleTimeout;
+{
+	pthread_mutex_lock(&_lock);
+    _idleTimeout = idleTimeout;
+    pthread_mutex_unlock(&_lock);
+}
+
+-(NSUInteger)threadCount;
+{
+	pthread_mutex_lock(&_lock);
+    NSUInteger threadCount = _threadCount;
+    pthread_mutex_unlock(&_lock);
+    return threadCount;
+}
+
+#pragma mark --- Public API
+
+-(void)performSelector:(SEL)aSelector onTarget:(id)target withObject:(id)arg;
+{
+	pthread_mutex_lock(&_lock);
+    if (_taskCount == _taskCapacity) {
+    	CWThreadPoolTask* tasks = malloc(_taskCapacity * 2 * sizeof(CWThreadPoolTask));
+        for (NSUInteger index = 0; index < _taskCount; index++) {
+        	tasks[index] = _tasks[(_taskHead + index) % _taskCapacity];
+        }
+        free(_tasks);
+        _tasks = tasks;
+        _taskHead = 0;
+        _taskCapacity *= 2;
+    }
+    CWThreadPoolTask* task = _tasks + (_taskHead + _taskCount++) % _taskCapacity;
+    task->target = [target retain];
+    task->selector = aSelector;
+    task->object = [arg retain];
+    BOOL createThread = _taskCount > _idleThreadCount && _threadCount < _maximumThreadCount;
+    if (createThread) {
+    	_threadCount++;
+    }
+    if (_idleThreadCount > 0) {
+    	pthread_cond_signal(&_condition);
+    }
+    pthread_mutex_unlock(&_lock);
+    if (createThread) {
+    	[NSThread detachNewThreadSelector:@selector(runWorker:) toTarget:self withObject:nil];
+    }
+}
+
+#pragma mark --- Private helpers
+
+-(void)runWorker:(id)unused;
+{
+	pthread_mutex_lock(&_lock);
+    for (;;) {
+    	BOOL timedOut = NO;
+        while (_taskCount == 0 && !timedOut && _threadCount <= _maximumThreadCount) {
+        	struct timeval now;
+            gettimeofday(&now, NULL);
+            NSTimeInterval time = now.tv_sec + now.tv_usec / 1000000.0 + _idleTimeout;
+            struct timespec deadline;
+            deadline.tv_sec = (time_t)time;
+            deadline.tv_nsec = (long)((time - (NSTimeInterval)deadline.tv_sec) * 1000000000.0);
+            _idleThreadCount++;
+            timedOut = pthread_cond_timedwait(&_condition, &_lock, &deadline) != 0;
+            _idleThreadCount--;
+        }
+        if (_taskCount == 0 || _threadCount > _maximumThreadCount) {
+        	break;
+        }
+        CWThreadPoolTask task = _tasks[_taskHead];
+        _taskHead = (_taskHead + 1) % _taskCapacity;
+        _taskCount--;
+        pthread_mutex_unlock(&_lock);
+        NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+        [task.target performSelector:task.selector withObject:task.object];
+        [task.target release];
+        [task.object release];
+        [pool drain];
+        pthread_mutex_lock(&_lock);
+    }
+    _threadCount--;
+    pthread_mutex_unlock(&_lock);
+}
+
+@end
@@ -0,0 +1,112 @@
+//
+//  CWTimerWheel.h
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import <pthread.h>
+
+@class CWTimerWheel;
+
+/*!
+ * @abstract A handle for a selector scheduled on a CWTimerWheel.
+ */
+@interface CWTimerHandle : NSObject {
+@private
+	CWTimerWheel* _wheel;
+    struct CWTimerNode* _node;
+}
+
+@property(readonly, assign, getter=isCancelled) BOOL cancelled;
+
+/*!
+ * @abstract YES once the selector has been performed.
+ */
+@property(readonly, assign, getter=isFired) BOOL fired;
+
+/*!
+ * @abstract Cancel the scheduled selector in constant time.
+ * @result YES if cancelled, NO if already performed or cancelled.
+ */
+-(BOOL)cancel;
+
+@end
+
+
+/*!
+ * @abstract CWTimerWheel is a hierarchical timing wheel performing selectors
+ *           after a delay, on the run loop of the thread it was created on.
+ *
+ * @discussion Scheduling and cancelling are constant time, regardless of the
+ *             number of pending timers, and may be done from any thread.
+ *             Delays have millisecond resolution, and are measured with a
+ *             monotonic clock. Selectors are never performed early, and
+ *             selectors due on the same millisecond are performed in the order
+ *             scheduled.
+ *
+ *             Five levels of 64 slots cover delays up to about 12 days, longer
+ *             delays are rescheduled when reaching the top level. A single run
+ *             loop timer is only fired for milliseconds with due selectors, or
+ *             for moving selectors to a lower level.
+ */
+@interface CWTimerWheel : NSObject {
+@private
+	pthread_mutex_t _lock;
+    CFRunLoopRef _runLoop;
+    CFRunLoopTimerRef _timer;
+    struct CWTimerWheelLevel* _levels;
+    uint64_t _currentTick;
+    uint64_t _fireTick;
+    uint64_t _nextSequence;
+    NSUInteger _count;
+}
+
+/*!
+ * @abstract Number of scheduled selectors not yet due.
+ */
+@property(readonly, assign) NSUInteger count;
+
+/*!
+ * @abstract The timer wheel for the current thread's run loop, created on first
+ *           use.
+ */
++(CWTimerWheel*)currentWheel;
+
+/*!
+ * @abstract Init a timer wheel for the current thread's run loop, in the common
+ *           run loop modes.
+ */
+-(id)init;
+
+/*!
+ * @abstract Perform a selector on the wheel's run loop after a delay.
+ * @discussion Target and object are retained until performed or cancelled.
+ */
+-(CWTimerHandle*)performSelector:(SEL)aSelector onTarget:(id)target withObject:(id)arg afterDelay:(NSTimeInterval)delay;
+
+@end
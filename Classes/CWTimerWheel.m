@@ -0,0 +1,458 @@
+//
+//  CWTimerWheel.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWTimerWheel.h"
+#import "CWAtomic.h"
+
+#define CW_WHEEL_LEVELS 5
+#define CW_WHEEL_BITS 6
+#define CW_WHEEL_SLOTS (1 << CW_WHEEL_BITS)
+#define CW_WHEEL_MASK (CW_WHEEL_SLOTS - 1)
+
+/*
+ * Fire date and interval for the run loop timer when the wheel is empty, a
+ * repeating timer is never invalidated after firing.
+ */
+#define CW_DISTANT_FUTURE 1.0e10
+
+typedef enum {
+	CWTimerStateScheduled,
+    CWTimerStateDue,
+    CWTimerStateFired,
+    CWTimerStateCancelled
+} CWTimerState;
+
+typedef struct CWTimerNode {
+	struct CWTimerNode* prev;
+    struct CWTimerNode* next;
+    uint64_t expiry;
+    uint64_t sequence;
+    unsigned level;
+    unsigned slot;
+    CWTimerState state;
+    id target;
+    SEL selector;
+    id object;
+    id handle;
+} CWTimerNode;
+
+typedef struct CWTimerWheelLevel {
+	uint64_t bitmap;
+    CWTimerNode* heads[CW_WHEEL_SLOTS];
+    CWTimerNode* tails[CW_WHEEL_SLOTS];
+} CWTimerWheelLevel;
+
+/*
+ * Link a node last in the slot for its expiry, relative to the next tick to
+ * process. Expired nodes are due at the next tick, and nodes beyond the top
+ * level are linked to its last slot and relinked when moved down.
+ */
+static void cw_LinkNode(CWTimerWheelLevel* levels, uint64_t nextTick, CWTimerNode* node)
+{
+	uint64_t expiry = node->expiry;
+    uint64_t maximumExpiry = nextTick + (1ULL << (CW_WHEEL_LEVELS * CW_WHEEL_BITS)) - 1;
+    if (expiry < nextTick) {
+    	expiry = nextTick;
+    } else if (expiry > maximumExpiry) {
+    	expiry = maximumExpiry;
+    }
+    unsigned level = 0;
+    while (expiry - nextTick >= (1ULL << ((level + 1) * CW_WHEEL_BITS))) {
+    	level++;
+    }
+    unsigned slot = (unsigned)(expiry >> (level * CW_WHEEL_BITS)) & CW_WHEEL_MASK;
+    CWTimerWheelLevel* wheelLevel = levels + level;
+    node->level = level;
+    node->slot = slot;
+    node->next = NULL;
+    node->prev = wheelLevel->tails[slot];
+    if (node->prev) {
+    	node->prev->next = node;
+    } else {
+    	wheelLevel->heads[slot] = node;
+        wheelLevel->bitmap |= 1ULL << slot;
+    }
+    wheelLevel->tails[slot] = node;
+}
+
+static void cw_UnlinkNode(CWTimerWheelLevel* levels, CWTimerNode* node)
+{
+	CWTimerWheelLevel* wheelLevel = levels + node->level;
+    if (node->prev) {
+    	node->prev->next = node->next;
+    } else {
+    	wheelLevel->heads[node->slot] = node->next;
+    }
+    if (node->next) {
+    	node->next->prev = node->prev;
+    } else {
+    	wheelLevel->tails[node->slot] = node->prev;
+    }
+    if (wheelLevel->heads[node->slot] == NULL) {
+    	wheelLevel->bitmap &= ~(1ULL << node->slot);
+    }
+    node->prev = node->next = NULL;
+}
+
+static CWTimerNode* cw_DetachSlot(CWTimerWheelLevel* wheelLevel, unsigned slot)
+{
+	CWTimerNode* head = wheelLevel->heads[slot];
+    wheelLevel->heads[slot] = wheelLevel->tails[slot] = NULL;
+    wheelLevel->bitmap &= ~(1ULL << slot);
+    return head;
+}
+
+/*
+ * The next tick after the last processed tick with due nodes, or with nodes to
+ * move down a level, or UINT64_MAX if empty. Slots before the current index of
+ * a level belong to the next rotation, that begins with moving nodes down.
+ */
+static uint64_t cw_NextTick(CWTimerWheelLevel* levels, uint64_t currentTick)
+{
+	for (unsigned level = 0; level < CW_WHEEL_LEVELS; level++) {
+    	uint64_t bitmap = levels[level].bitmap;
+        if (bitmap) {
+        	unsigned shift = level * CW_WHEEL_BITS;
+            unsigned index = (unsigned)(currentTick >> shift) & CW_WHEEL_MASK;
+            uint64_t rotation = (currentTick >> (shift + CW_WHEEL_BITS)) << (shift + CW_WHEEL_BITS);
+            uint64_t remaining = index == CW_WHEEL_MASK ? 0 : bitmap & (~0ULL << (index + 1));
+            if (remaining) {
+            	return rotation + ((uint64_t)__builtin_ctzll(remaining) << shift);
+            }
+            return rotation + (1ULL << (shift + CW_WHEEL_BITS));
+        }
+    }
+    return UINT64_MAX;
+}
+
+/*
+ * Merge sort a list of due nodes by sequence, since nodes moved down from
+ * higher levels are appended after nodes scheduled later.
+ */
+static CWTimerNode* cw_SortNodes(CWTimerNode* list)
+{
+	if (list == NULL || list->next == NULL) {
+    	return list;
+    }
+    CWTimerNode* slow = list;
+    CWTimerNode* fast = list->next;
+    while (fast && fast->next) {
+    	slow = slow->next;
+        fast = fast->next->next;
+    }
+    CWTimerNode* second = slow->next;
+    slow->next = NULL;
+    CWTimerNode* first = cw_SortNodes(list);
+    second = cw_SortNodes(second);
+    CWTimerNode head;
+    CWTimerNode* tail = &head;
+    while (first && second) {
+    	if (second->sequence < first->sequence) {
+        	tail->next = second;
+            second = second->next;
+        } else {
+        	tail->next = first;
+            first = first->next;
+        }
+        tail = tail->next;
+    }
+    tail->next = first ? first : second;
+    return head.next;
+}
+
+/*
+ * Process a tick, moving nodes down from higher levels at the start of their
+ * rotation, and return the sorted list of nodes due.
+ */
+static CWTimerNode* cw_ProcessTick(CWTimerWheelLevel* levels, uint64_t tick)
+{
+	for (unsigned level = 1; level < CW_WHEEL_LEVELS; level++) {
+    	unsigned shift = level * CW_WHEEL_BITS;
+        if (tick & ((1ULL << shift) - 1)) {
+        	break;
+        }
+        CWTimerNode* node = cw_DetachSlot(levels + level, (unsigned)(tick >> shift) & CW_WHEEL_MASK);
+        while (node) {
+        	CWTimerNode* next = node->next;
+            cw_LinkNode(levels, tick, node);
+            node = next;
+        }
+    }
+    return cw_SortNodes(cw_DetachSlot(levels, (unsigned)tick & CW_WHEEL_MASK));
+}
+
+/*
+ * Milliseconds of a monotonic clock.
+ */
+static uint64_t cw_CurrentTick(void)
+{
+	return CWMonotonicMicroseconds() / 1000;
+}
+
+static void cw_TimerWheelFired(CFRunLoopTimerRef timer, void* info);
+
+
+@interface CWTimerHandle ()
+
+-(id)initWithWheel:(CWTimerWheel*)wheel node:(CWTimerNode*)node;
+-(CWTimerNode*)node;
+
+@end
+
+
+@interface CWTimerWheel ()
+
+-(BOOL)cancelNode:(CWTimerNode*)node;
+-(CWTimerState)stateOfNode:(CWTimerNode*)node;
+-(void)updateFireDate;
+-(void)performDueSelectors;
+
+@end
+
+
+@implementation CWTimerHandle
+
+-(id)initWithWheel:(CWTimerWheel*)wheel node:(CWTimerNode*)node;
+{
+	self = [super init];
+    if (self) {
+    	_wheel = [wheel retain];
+        _node = node;
+    }
+    return self;
+}
+
+-(void)dealloc;
+{
+	free(_node);
+    [_wheel release];
+    [super dealloc];
+}
+
+-(CWTimerNode*)node;
+{
+	return _node;
+}
+
+-(BOOL)isCancelled;
+{
+	return [_wheel stateOfNode:_node] == CWTimerStateCancelled;
+}
+
+-(BOOL)isFired;
+{
+	return [_wheel stateOfNode:_node] == CWTimerStateFired;
+}
+
+-(BOOL)cancel;
+{
+	return [_wheel cancelNode:_node];
+}
+
+@end
+
+
+@implementation CWTimerWheel
+
+#pragma mark --- Life cycle
+
++(CWTimerWheel*)currentWheel;
+{
+	NSMutableDictionary* threadDictionary = [[NSThread currentThread] threadDictionary];
+    CWTimerWheel* wheel = [threadDictionary objectForKey:@"CWTimerWheel"];
+    if (wheel == nil) {
+    	wheel = [[CWTimerWheel alloc] init];
+        [threadDictionary setObject:wheel forKey:@"CWTimerWheel"];
+        [wheel release];
+    }
+    return wheel;
+}
+
+-(id)init;
+{
+	self = [super init];
+    if (self) {
+    	pthread_mutex_init(&_lock, NULL);
+        _levels = calloc(CW_WHEEL_LEVELS, sizeof(CWTimerWheelLevel));
+        _currentTick = cw_CurrentTick();
+        _fireTick = UINT64_MAX;
+        _runLoop = (CFRunLoopRef)CFRetain(CFRunLoopGetCurrent());
+        CFRunLoopTimerContext context = {0};
+        context.info = self;
+        _timer = CFRunLoopTimerCreate(NULL, CW_DISTANT_FUTURE, CW_DISTANT_FUTURE, 0, 0, cw_TimerWheelFired, &context);
+        CFRunLoopAddTimer(_runLoop, _timer, kCFRunLoopCommonModes);
+    }
+    return self;
+}
+
+/*
+ * Scheduled selectors retain their handle, and handles retain the wheel, so a
+ * wheel is only deallocated when empty.
+ */
+-(void)dealloc;
+{
+	CFRunLoopTimerInvalidate(_timer);
+    CFRelease(_timer);
+    CFRelease(_runLoop);
+    free(_levels);
+    pthread_mutex_destroy(&_lock);
+    [super dealloc];
+}
+
+#pragma mark --- Public API
+
+-(NSUInteger)count;
+{
+	pthread_mutex_lock(&_lock);
+    NSUInteger count = _count;
+    pthread_mutex_unlock(&_lock);
+    return count;
+}
+
+-(CWTimerHandle*)performSelector:(SEL)aSelector onTarget:(id)target withObject:(id)arg afterDelay:(NSTimeInterval)delay;
+{
+	CWTimerNode* node = calloc(1, sizeof(CWTimerNode));
+    node->target = [target retain];
+    node->selector = aSelector;
+    node->object = [arg retain];
+    CWTimerHandle* handle = [[CWTimerHandle alloc] initWithWheel:self node:node];
+    // Retained by the wheel until due or cancelled.
+    node->handle = [handle retain];
+    uint64_t now = cw_CurrentTick();
+    node->expiry = now + (delay > 0 ? (uint64_t)ceil(delay * 1000) : 0);
+    pthread_mutex_lock(&_lock);
+    node->sequence = _nextSequence++;
+    if (_count == 0) {
+    	_currentTick = MAX(_currentTick, now);
+    }
+    cw_LinkNode(_levels, _currentTick + 1, node);
+    _count++;
+    if (cw_NextTick(_levels, _currentTick) < _fireTick) {
+    	[self updateFireDate];
+    }
+    pthread_mutex_unlock(&_lock);
+    return [handle autorelease];
+}
+
+#pragma mark --- Private helpers
+
+-(CWTimerState)stateOfNode:(CWTimerNode*)node;
+{
+	pthread_mutex_lock(&_lock);
+    CWTimerState state = node->state;
+    pthread_mutex_unlock(&_lock);
+    return state;
+}
+
+/*
+ * Only the thread changing the state from scheduled or due releases the node
+ * retains, outside of the lock.
+ */
+-(BOOL)cancelNode:(CWTimerNode*)node;
+{
+	pthread_mutex_lock(&_lock);
+    CWTimerState state = node->state;
+    if (state == CWTimerStateScheduled) {
+    	cw_UnlinkNode(_levels, node);
+        _count--;
+    }
+    if (state == CWTimerStateScheduled || state == CWTimerStateDue) {
+    	node->state = CWTimerStateCancelled;
+    }
+    pthread_mutex_unlock(&_lock);
+    if (state == CWTimerStateScheduled || state == CWTimerStateDue) {
+    	[node->target release];
+        [node->object release];
+    }
+    if (state == CWTimerStateScheduled) {
+    	// Due handles are released after performing, last since the node is
+        // freed with the handle.
+        [node->handle release];
+    }
+    return state == CWTimerStateScheduled || state == CWTimerStateDue;
+}
+
+/*
+ * Must be called with the lock held.
+ */
+-(void)updateFireDate;
+{
+	_fireTick = cw_NextTick(_levels, _currentTick);
+    CFAbsoluteTime fireDate = CW_DISTANT_FUTURE;
+    if (_fireTick != UINT64_MAX) {
+    	uint64_t now = cw_CurrentTick();
+        fireDate = CFAbsoluteTimeGetCurrent() + (_fireTick > now ? (_fireTick - now) / 1000.0 : 0);
+    }
+    CFRunLoopTimerSetNextFireDate(_timer, fireDate);
+}
+
+-(void)performDueSelectors;
+{
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    NSMutableArray* handles = [NSMutableArray array];
+    uint64_t now = cw_CurrentTick();
+	pthread_mutex_lock(&_lock);
+    uint64_t tick;
+    while ((tick = cw_NextTick(_levels, _currentTick)) <= now) {
+    	_currentTick = tick;
+        for (CWTimerNode* node = cw_ProcessTick(_levels, tick); node; node = node->next) {
+        	node->state = CWTimerStateDue;
+            _count--;
+            [handles addObject:node->handle];
+        }
+    }
+    _currentTick = MAX(_currentTick, now);
+    [self updateFireDate];
+    pthread_mutex_unlock(&_lock);
+    for (CWTimerHandle* handle in handles) {
+    	CWTimerNode* node = [handle node];
+        pthread_mutex_lock(&_lock);
+        BOOL perform = node->state == CWTimerStateDue;
+        if (perform) {
+        	node->state = CWTimerStateFired;
+        }
+        pthread_mutex_unlock(&_lock);
+        if (perform) {
+        	[node->target performSelector:node->selector withObject:node->object];
+            [node->target release];
+            [node->object release];
+        }
+        [handle release];
+    }
+    [pool drain];
+}
+
+@end
+
+
+static void cw_TimerWheelFired(CFRunLoopTimerRef timer, void* info)
+{
+	[(CWTimerWheel*)info performDueSelectors];
+}
@@ -0,0 +1,82 @@
+//
+//  CWWorkStealingQueue.h
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+
+/*!
+ * @abstract CWWorkStealingQueue is an operation queue that runs small tasks on
+ *           a fixed set of worker threads with per worker task deques.
+ *
+ * @discussion Tasks added from a worker thread are pushed on the deque of that
+ *             worker and run newest first, while still warm in the cache.
+ *             Tasks added from other threads are distributed round robin and
+ *             run oldest first, after the worker's own tasks. Idle workers
+ *             steal half of the tasks of another worker. There is no central
+ *             queue lock, and tasks are stored inline in the deques.
+ *
+ *             Operations with dependencies, a queue priority other than normal,
+ *             operations that are concurrent or not ready, are run by the
+ *             NSOperationQueue superclass, and only these are limited by
+ *             maxConcurrentOperationCount and observable using KVO.
+ *
+ *             Install as the default queue to route all default queue methods
+ *             through the workers:
+ *             [NSOperationQueue setDefaultQueue:[[[CWWorkStealingQueue alloc] init] autorelease]];
+ */
+@interface CWWorkStealingQueue : NSOperationQueue {
+@private
+	struct CWWorkStealingPool* _pool;
+}
+
+/*!
+ * @abstract Number of worker threads.
+ */
+@property(nonatomic, readonly, assign) NSUInteger workerCount;
+
+/*!
+ * @abstract Init with one worker per active processor.
+ */
+-(id)init;
+
+-(id)initWithWorkerCount:(NSUInteger)workerCount;
+
+/*!
+ * @abstract Add a task calling a function with a context.
+ * @discussion The lightest weight task, no objects are allocated.
+ */
+-(void)addOperationWithFunction:(void (*)(void*))function context:(void*)context;
+
+/*!
+ * @abstract Add a task sending a message with an optional object argument.
+ * @discussion Target and object are retained until the task is done.
+ */
+-(void)addOperationWithTarget:(id)target selector:(SEL)selector object:(id)object;
+
+@end
@@ -0,0 +1,486 @@
+//
+//  CWWorkStealingQueue.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWWorkStealingQueue.h"
+#import "CWAtomic.h"
+#import <pthread.h>
+
+/*
+ * Initial number of tasks in each worker deque.
+ */
+#define CW_DEQUE_CAPACITY 64
+
+/*
+ * Maximum number of tasks stolen at once.
+ */
+#define CW_STEAL_LIMIT 32
+
+struct CWWorkStealingWorker;
+
+/*
+ * A task is stored by value in the deques, the run function is responsible for
+ * releasing any retained objects.
+ */
+typedef struct CWWorkStealingTask {
+	void (*run)(struct CWWorkStealingWorker* worker, struct CWWorkStealingTask* task);
+    void (*function)(void*);
+    void* context;
+    SEL selector;
+    id object;
+} CWWorkStealingTask;
+
+/*
+ * The owner pushes and pops tasks at the tail, newest first while still warm
+ * in the cache, thieves steal from the head. Tasks added from other threads
+ * are pushed at the head, so the owner runs them oldest first once its own
+ * tasks are done.
+ */
+typedef struct CWWorkStealingWorker {
+	pthread_mutex_t lock;
+    CWWorkStealingTask* tasks;
+    NSUInteger capacity;
+    NSUInteger head;
+    NSUInteger tail;
+    NSOperation* executingOperation;
+    struct CWWorkStealingPool* pool;
+    NSUInteger index;
+} CWWorkStealingWorker;
+
+/*
+ * The pool is shared by the queue and all workers, and freed by the last one
+ * done with it. The lock is only taken by workers going idle, or to wake them.
+ */
+typedef struct CWWorkStealingPool {
+	volatile int32_t retainCount;
+    volatile int32_t pendingCount;
+    volatile int32_t idleCount;
+    volatile int32_t nextWorker;
+    volatile BOOL suspended;
+    volatile BOOL stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t idleCondition;
+    pthread_cond_t finishedCondition;
+    NSUInteger workerCount;
+    CWWorkStealingWorker workers[1];
+} CWWorkStealingPool;
+
+static pthread_key_t CWWorkStealingWorkerKey;
+
+
+@interface CWWorkStealingQueue ()
+
++(void)runWorker:(NSValue*)workerValue;
+
+@end
+
+
+@implementation CWWorkStealingQueue
+
+#pragma mark --- Pool
+
+static CWWorkStealingPool* CWPoolCreate(NSUInteger workerCount)
+{
+	CWWorkStealingPool* pool = calloc(1, sizeof(CWWorkStealingPool) + (workerCount - 1) * sizeof(CWWorkStealingWorker));
+    pool->retainCount = 1;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->idleCondition, NULL);
+    pthread_cond_init(&pool->finishedCondition, NULL);
+    pool->workerCount = workerCount;
+    for (NSUInteger index = 0; index < workerCount; index++) {
+    	CWWorkStealingWorker* worker = pool->workers + index;
+        pthread_mutex_init(&worker->lock, NULL);
+        worker->capacity = CW_DEQUE_CAPACITY;
+        worker->tasks = malloc(CW_DEQUE_CAPACITY * sizeof(CWWorkStealingTask));
+        worker->pool = pool;
+        worker->index = index;
+    }
+    return pool;
+}
+
+static void CWPoolRelease(CWWorkStealingPool* pool)
+{
+	if (CWAtomicDecrement32(&pool->retainCount) == 0) {
+    	for (NSUInteger index = 0; index < pool->workerCount; index++) {
+        	pthread_mutex_destroy(&pool->workers[index].lock);
+            free(pool->workers[index].tasks);
+        }
+        pthread_cond_destroy(&pool->finishedCondition);
+        pthread_cond_destroy(&pool->idleCondition);
+        pthread_mutex_destroy(&pool->lock);
+        free(pool);
+    }
+}
+
+static void CWPoolWakeAll(CWWorkStealingPool* pool)
+{
+	pthread_mutex_lock(&pool->lock);
+    pthread_cond_broadcast(&pool->idleCondition);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static BOOL CWPoolHasTasks(CWWorkStealingPool* pool)
+{
+	for (NSUInteger index = 0; index < pool->workerCount; index++) {
+    	CWWorkStealingWorker* worker = pool->workers + index;
+        pthread_mutex_lock(&worker->lock);
+        BOOL hasTasks = worker->tail != worker->head;
+        pthread_mutex_unlock(&worker->lock);
+        if (hasTasks) {
+        	return YES;
+        }
+    }
+    return NO;
+}
+
+#pragma mark --- Worker deques
+
+/*
+ * Must be called with the worker lock held.
+ */
+static void CWWorkerReserveTask(CWWorkStealingWorker* worker)
+{
+    if (worker->tail - worker->head == worker->capacity) {
+    	CWWorkStealingTask* tasks = malloc(worker->capacity * 2 * sizeof(CWWorkStealingTask));
+        for (NSUInteger index = 0; index < worker->capacity; index++) {
+        	tasks[index] = worker->tasks[(worker->head + index) & (worker->capacity - 1)];
+        }
+        free(worker->tasks);
+        worker->tasks = tasks;
+        worker->head = 0;
+        worker->tail = worker->capacity;
+        worker->capacity *= 2;
+    }
+}
+
+static void CWWorkerPushTask(CWWorkStealingWorker* worker, const CWWorkStealingTask* task)
+{
+	pthread_mutex_lock(&worker->lock);
+    CWWorkerReserveTask(worker);
+    worker->tasks[worker->tail++ & (worker->capacity - 1)] = *task;
+    pthread_mutex_unlock(&worker->lock);
+}
+
+static void CWWorkerPushTaskAtHead(CWWorkStealingWorker* worker, const CWWorkStealingTask* task)
+{
+	pthread_mutex_lock(&worker->lock);
+    CWWorkerReserveTask(worker);
+    worker->tasks[--worker->head & (worker->capacity - 1)] = *task;
+    pthread_mutex_unlock(&worker->lock);
+}
+
+static BOOL CWWorkerPopTask(CWWorkStealingWorker* worker, CWWorkStealingTask* task)
+{
+	BOOL didPop = NO;
+	pthread_mutex_lock(&worker->lock);
+    if (worker->tail != worker->head) {
+    	*task = worker->tasks[--worker->tail & (worker->capacity - 1)];
+        didPop = YES;
+    }
+    pthread_mutex_unlock(&worker->lock);
+    return didPop;
+}
+
+/*
+ * Steal half of the tasks at the head, up to CW_STEAL_LIMIT, from the first
+ * other worker that has any. The first task is returned, and the rest pushed
+ * on the deque of worker in order.
+ */
+static BOOL CWWorkerStealTask(CWWorkStealingWorker* worker, CWWorkStealingTask* task)
+{
+	CWWorkStealingPool* pool = worker->pool;
+    CWWorkStealingTask stolenTasks[CW_STEAL_LIMIT];
+    for (NSUInteger offset = 1; offset < pool->workerCount; offset++) {
+    	CWWorkStealingWorker* victim = pool->workers + (worker->index + offset) % pool->workerCount;
+        NSUInteger stolenCount = 0;
+        pthread_mutex_lock(&victim->lock);
+        NSUInteger count = victim->tail - victim->head;
+        if (count > 0) {
+        	stolenCount = MIN((count + 1) / 2, CW_STEAL_LIMIT);
+            for (NSUInteger index = 0; index < stolenCount; index++) {
+            	stolenTasks[index] = victim->tasks[victim->head++ & (victim->capacity - 1)];
+            }
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if (stolenCount > 0) {
+        	*task = stolenTasks[0];
+            for (NSUInteger index = 1; index < stolenCount; index++) {
+            	CWWorkerPushTask(worker, stolenTasks + index);
+            }
+            return YES;
+        }
+    }
+    return NO;
+}
+
+#pragma mark --- Tasks
+
+static void CWRunOperationTask(CWWorkStealingWorker* worker, CWWorkStealingTask* task)
+{
+	NSOperation* operation = task->object;
+    pthread_mutex_lock(&worker->lock);
+    worker->executingOperation = operation;
+    pthread_mutex_unlock(&worker->lock);
+    [operation start];
+    pthread_mutex_lock(&worker->lock);
+    worker->executingOperation = nil;
+    pthread_mutex_unlock(&worker->lock);
+    [operation release];
+}
+
+static void CWRunFunctionTask(CWWorkStealingWorker* worker, CWWorkStealingTask* task)
+{
+	task->function(task->context);
+}
+
+static void CWRunSelectorTask(CWWorkStealingWorker* worker, CWWorkStealingTask* task)
+{
+	id target = (id)task->context;
+    [target performSelector:task->selector withObject:task->object];
+    [target release];
+    [task->object release];
+}
+
+#if NS_BLOCKS_AVAILABLE
+static void CWRunBlockTask(CWWorkStealingWorker* worker, CWWorkStealingTask* task)
+{
+	void (^block)(void) = task->object;
+    block();
+    [block release];
+}
+#endif
+
+static void CWPoolAddTask(CWWorkStealingPool* pool, const CWWorkStealingTask* task)
+{
+	CWWorkStealingWorker* worker = pthread_getspecific(CWWorkStealingWorkerKey);
+    CWAtomicIncrement32(&pool->pendingCount);
+    if (worker && worker->pool == pool) {
+	    CWWorkerPushTask(worker, task);
+    } else {
+    	uint32_t index = (uint32_t)CWAtomicIncrement32(&pool->nextWorker);
+        CWWorkerPushTaskAtHead(pool->workers + index % pool->workerCount, task);
+    }
+    // Pairs with the barrier of idle workers, so either the task is seen by
+    // a worker going idle, or that worker is seen and woken.
+    CWMemoryBarrier();
+    if (pool->idleCount > 0) {
+    	pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->idleCondition);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+static void CWWorkerRunTask(CWWorkStealingWorker* worker, CWWorkStealingTask* task)
+{
+	CWWorkStealingPool* pool = worker->pool;
+	NSAutoreleasePool* autoreleasePool = [[NSAutoreleasePool alloc] init];
+    task->run(worker, task);
+    [autoreleasePool drain];
+    if (CWAtomicDecrement32(&pool->pendingCount) == 0) {
+    	pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->finishedCondition);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
++(void)runWorker:(NSValue*)workerValue;
+{
+	CWWorkStealingWorker* worker = [workerValue pointerValue];
+    CWWorkStealingPool* pool = worker->pool;
+    pthread_setspecific(CWWorkStealingWorkerKey, worker);
+    CWWorkStealingTask task;
+    for (;;) {
+    	if (!pool->suspended && (CWWorkerPopTask(worker, &task) || CWWorkerStealTask(worker, &task))) {
+        	CWWorkerRunTask(worker, &task);
+            continue;
+        }
+        pthread_mutex_lock(&pool->lock);
+        CWAtomicIncrement32(&pool->idleCount);
+        BOOL stop = NO;
+        if (pool->suspended || !CWPoolHasTasks(pool)) {
+        	if (pool->stopping && !pool->suspended) {
+            	stop = YES;
+            } else {
+            	pthread_cond_wait(&pool->idleCondition, &pool->lock);
+            }
+        }
+        CWAtomicDecrement32(&pool->idleCount);
+        pthread_mutex_unlock(&pool->lock);
+        if (stop) {
+        	break;
+        }
+    }
+    pthread_setspecific(CWWorkStealingWorkerKey, NULL);
+    CWPoolRelease(pool);
+}
+
+#pragma mark --- Life cycle
+
++(void)initialize;
+{
+	if (self == [CWWorkStealingQueue class]) {
+    	pthread_key_create(&CWWorkStealingWorkerKey, NULL);
+    }
+}
+
+-(id)init;
+{
+	return [self initWithWorkerCount:[[NSProcessInfo processInfo] activeProcessorCount]];
+}
+
+-(id)initWithWorkerCount:(NSUInteger)workerCount;
+{
+	self = [super init];
+    if (self) {
+    	_pool = CWPoolCreate(MAX(workerCount, 1));
+        for (NSUInteger index = 0; index < _pool->workerCount; index++) {
+        	CWAtomicIncrement32(&_pool->retainCount);
+            [NSThread detachNewThreadSelector:@selector(runWorker:)
+                                     toTarget:[CWWorkStealingQueue class]
+                                   withObject:[NSValue valueWithPointer:_pool->workers + index]];
+        }
+    }
+    return self;
+}
+
+-(void)dealloc;
+{
+	// Workers finish all remaining tasks before exiting.
+	_pool->stopping = YES;
+    _pool->suspended = NO;
+    CWPoolWakeAll(_pool);
+    CWPoolRelease(_pool);
+    [super dealloc];
+}
+
+#pragma mark --- Public API
+
+-(NSUInteger)workerCount;
+{
+	return _pool->workerCount;
+}
+
+-(void)addOperationWithFunction:(void (*)(void*))function context:(void*)context;
+{
+	CWWorkStealingTask task = { &CWRunFunctionTask, function, context, NULL, nil };
+    CWPoolAddTask(_pool, &task);
+}
+
+-(void)addOperationWithTarget:(id)target selector:(SEL)selector object:(id)object;
+{
+	CWWorkStealingTask task = { &CWRunSelectorTask, NULL, [target retain], selector, [object retain] };
+    CWPoolAddTask(_pool, &task);
+}
+
+#pragma mark --- NSOperationQueue overrides
+
+-(void)addOperation:(NSOperation*)operation;
+{
+	if ([[operation dependencies] count] > 0 || [operation queuePriority] != NSOperationQueuePriorityNormal
+        || [operation isConcurrent] || ![operation isReady] || [operation isExecuting] || [operation isFinished]) {
+    	[super addOperation:operation];
+    } else {
+    	CWWorkStealingTask task = { &CWRunOperationTask, NULL, NULL, NULL, [operation retain] };
+        CWPoolAddTask(_pool, &task);
+    }
+}
+
+-(void)addOperations:(NSArray*)operations waitUntilFinished:(BOOL)wait;
+{
+	for (NSOperation* operation in operations) {
+    	[self addOperation:operation];
+    }
+    if (wait) {
+    	for (NSOperation* operation in operations) {
+        	[operation waitUntilFinished];
+        }
+    }
+}
+
+#if NS_BLOCKS_AVAILABLE
+-(void)addOperationWithBlock:(void (^)(void))block;
+{
+	CWWorkStealingTask task = { &CWRunBlockTask, NULL, NULL, NULL, [block copy] };
+    CWPoolAddTask(_pool, &task);
+}
+#endif
+
+-(NSArray*)operations;
+{
+	NSMutableArray* operations = [NSMutableArray arrayWithArray:[super operations]];
+    for (NSUInteger index = 0; index < _pool->workerCount; index++) {
+    	CWWorkStealingWorker* worker = _pool->workers + index;
+        pthread_mutex_lock(&worker->lock);
+        if (worker->executingOperation) {
+        	[operations addObject:worker->executingOperation];
+        }
+        for (NSUInteger taskIndex = worker->head; taskIndex != worker->tail; taskIndex++) {
+        	CWWorkStealingTask* task = worker->tasks + (taskIndex & (worker->capacity - 1));
+            if (task->run == &CWRunOperationTask) {
+            	[operations addObject:task->object];
+            }
+        }
+        pthread_mutex_unlock(&worker->lock);
+    }
+    return operations;
+}
+
+-(NSUInteger)operationCount;
+{
+	return [super operationCount] + MAX(_pool->pendingCount, 0);
+}
+
+-(void)cancelAllOperations;
+{
+	// Cancel outside of the deque locks, cancelling may add new operations.
+	[[self operations] makeObjectsPerformSelector:@selector(cancel)];
+}
+
+-(void)setSuspended:(BOOL)suspended;
+{
+	[super setSuspended:suspended];
+    _pool->suspended = suspended;
+    if (!suspended) {
+    	CWPoolWakeAll(_pool);
+    }
+}
+
+-(void)waitUntilAllOperationsAreFinished;
+{
+	do {
+    	pthread_mutex_lock(&_pool->lock);
+        while (_pool->pendingCount > 0) {
+        	pthread_cond_wait(&_pool->finishedCondition, &_pool->lock);
+        }
+        pthread_mutex_unlock(&_pool->lock);
+    	[super waitUntilAllOperationsAreFinished];
+    } while (_pool->pendingCount > 0);
+}
+
+@end
@@ -59,12 +59,15 @@
     	unsigned int didTranslateObject:1;
     	unsigned int primitiveObjectInstanceOfClass:1;
     } _delegateFlags;
+    BOOL _internsStrings;
+    NSSet* _internedStringKeys;
 // Super private!
 	NSDictionary* translationPlist;
 	NSMutableArray* stateStack;
 	NSMutableString* currentText;
 	NSMutableArray* rootObjects;
 	NSXMLParser* xmlParser;
+	NSMutableSet* internedStrings;
 	BOOL didAbort;
 }
 
@@ -74,6 +77,19 @@
  */
 @property(nonatomic, assign) id<CWXMLTranslatorDelegate> delegate;
 
+/*!
+ * @abstract Intern translated string values.
+ * @discussion If YES then equal string values translated during a single translation will share one
+ *             immutable instance. Defaults to NO.
+ */
+@property(nonatomic, assign) BOOL internsStrings;
+
+/*!
+ * @abstract The keys to limit string interning to, or nil to intern string values for all keys.
+ * @discussion Use @"@root" to intern strings added as root objects.
+ */
+@property(nonatomic, copy) NSSet* internedStringKeys;
+
 /*!
  * @abstract The default NSDateFormatter
  * @discussion Used when translating strings to NSDate.
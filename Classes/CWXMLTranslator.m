@@ -77,6 +77,8 @@ static NSDateFormatter* _defaultDateFormatter = nil;
 #pragma mark --- Properties
 
 @synthesize delegate = _delegate;
+@synthesize internsStrings = _internsStrings;
+@synthesize internedStringKeys = _internedStringKeys;
 
 -(void)setDelegate:(id<CWXMLTranslatorDelegate>)delegate;
 {
@@ -145,6 +147,7 @@ static NSDateFormatter* _defaultDateFormatter = nil;
 -(void)dealloc;
 {
 	[translationPlist release];
+    [_internedStringKeys release];
 	[stateStack release];
     [currentText release];
     [super dealloc];
@@ -159,6 +162,9 @@ static NSDateFormatter* _defaultDateFormatter = nil;
     didAbort = NO;
     xmlParser = [parser retain];
     rootObjects = [NSMutableArray array];
+    if (_internsStrings) {
+    	internedStrings = [[NSMutableSet alloc] init];
+    }
     [xmlParser setDelegate:(id)self];
     CWXMLTranslatorState* state = [[CWXMLTranslatorState alloc] init];
     state->translationPlist = translationPlist;
@@ -176,6 +182,8 @@ static NSDateFormatter* _defaultDateFormatter = nil;
     stateStack = nil;
     [xmlParser release];
     xmlParser = nil;
+    [internedStrings release];
+    internedStrings = nil;
     if (result == NO) {
         CWLogError(@"Unparsable data in %@", parser);
         rootObjects = nil;
@@ -234,6 +242,22 @@ static NSDateFormatter* _defaultDateFormatter = nil;
     return formatter;
 }
 
+-(NSString*)internedStringForString:(NSString*)aString toKey:(NSString*)key;
+{
+	if (internedStrings && aString) {
+        NSString* trimmedKey = key == nil ? @"@root" : ([key hasPrefix:@"+"] ? [key substringFromIndex:1] : key);
+        if (_internedStringKeys == nil || [_internedStringKeys containsObject:trimmedKey]) {
+            NSString* internedString = [internedStrings member:aString];
+            if (internedString == nil) {
+                internedString = [[aString copy] autorelease];
+                [internedStrings addObject:internedString];
+            }
+            return internedString;
+        }
+    }
+    return aString;
+}
+
 -(id)primitiveObjectInstanceOfClass:(Class)aClass withString:(NSString*)aString fromXMLname:(NSString*)name xmlAttributes:(NSDictionary*)attributes toKey:(NSString*)key;
 {
     id result = nil;
@@ -250,7 +274,7 @@ static NSDateFormatter* _defaultDateFormatter = nil;
     }
     if (result == nil && !shouldSkip) {
         if (aClass == [NSString class]) {
-            return aString;
+            return [self internedStringForString:aString toKey:key];
         } else if (aClass == [NSNumber class]) {
             result = [NSDecimalNumber decimalNumberWithString:aString];
         } else if (aClass == [NSDate class]) {
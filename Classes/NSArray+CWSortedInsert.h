@@ -30,6 +30,24 @@
 
 #import <Foundation/Foundation.h>
 
+/*!
+ * @abstract Policy for objects that compare equal when merging a batch of
+ *           objects into a sorted array.
+ *
+ * @constant CWSortedInsertKeepBoth Keep all objects, existing objects are
+ *           ordered before equal inserted objects.
+ * @constant CWSortedInsertKeepFirst Keep existing objects, an inserted object
+ *           is only added if no equal object exist, and only the first of
+ *           several equal inserted objects is added.
+ * @constant CWSortedInsertKeepLast Keep only the last of several equal
+ *           inserted objects, replacing any equal existing objects.
+ */
+typedef enum {
+	CWSortedInsertKeepBoth = 0,
+    CWSortedInsertKeepFirst = 1,
+    CWSortedInsertKeepLast = 2
+} CWSortedInsertMergePolicy;
+
 
 @interface NSArray (CWSortedInsert)
 
@@ -46,5 +64,29 @@
 -(void)insertObject:(id)anObject sortedUsingSelector:(SEL)aSelector;
 -(void)insertObject:(id)anObject sortedUsingDescriptors:(NSArray*)descriptors;
 
+/*!
+ * @abstract Insert all objects from an array into the sorted receiver.
+ *
+ * @discussion The objects are first sorted with a stable sort, concurrently
+ *             for large arrays, and then merged with the receiver in a single
+ *             pass. Inserting m objects into n objects is O(m log m + n),
+ *             compared to O(m * n) for inserting the objects one by one.
+ *             Equal inserted objects keep their relative order. The compare
+ *             function must be safe to call from several threads.
+ *             The descriptor variants extract the key values of each object
+ *             once, see CWSortKeys.
+ */
+-(void)insertObjectsFromArray:(NSArray*)array sortedUsingfunction:(NSInteger (*)(id, id, void *))compare context:(void*)context;
+-(void)insertObjectsFromArray:(NSArray*)array sortedUsingSelector:(SEL)aSelector;
+-(void)insertObjectsFromArray:(NSArray*)array sortedUsingDescriptors:(NSArray*)descriptors;
+
+/*!
+ * @abstract Insert all objects from an array into the sorted receiver, using
+ *           a policy for equal objects.
+ */
+-(void)insertObjectsFromArray:(NSArray*)array sortedUsingfunction:(NSInteger (*)(id, id, void *))compare context:(void*)context mergePolicy:(CWSortedInsertMergePolicy)policy;
+-(void)insertObjectsFromArray:(NSArray*)array sortedUsingSelector:(SEL)aSelector mergePolicy:(CWSortedInsertMergePolicy)policy;
+-(void)insertObjectsFromArray:(NSArray*)array sortedUsingDescriptors:(NSArray*)descriptors mergePolicy:(CWSortedInsertMergePolicy)policy;
+
 @end
 
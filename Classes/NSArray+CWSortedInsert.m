@@ -29,6 +29,7 @@
 //
 
 #import "NSArray+CWSortedInsert.h"
+#import "CWSortKeys.h"
 #import <objc/runtime.h>
 
 @implementation NSArray (CWSortedInsert)
@@ -59,32 +60,186 @@ static NSComparisonResult cw_SelectorCompare(id a, id b, void* aSelector) {
 	return [self indexForInsertingObject:anObject sortedUsingfunction:&cw_SelectorCompare context:aSelector];
 }
 
-static IMP cw_compareObjectToObjectImp = NULL;
-static IMP cw_ascendingImp = NULL;
+/*
+ * Index of the first object in array not ordered before the object with keys
+ * at keysIndex in sortKeys.
+ */
+static NSUInteger cw_IndexForInsertingSortKeys(NSArray* array, CWSortKeys* sortKeys, NSUInteger keysIndex) {
+	NSUInteger index = 0;
+  NSUInteger topIndex = [array count];
+  IMP objectAtIndexImp = [array methodForSelector:@selector(objectAtIndex:)];
+  while (index < topIndex) {
+    NSUInteger midIndex = (index + topIndex) / 2;
+    id testObject = objectAtIndexImp(array, @selector(objectAtIndex:), midIndex);
+    if ([sortKeys compareObject:testObject toKeysAtIndex:keysIndex] < 0) {
+      index = midIndex + 1;
+    } else {
+      topIndex = midIndex;
+    }
+  }
+  return index;
+}
 
-+(void)initialize;
+-(NSUInteger)indexForInsertingObject:(id)anObject sortedUsingDescriptors:(NSArray*)descriptors;
 {
-  cw_compareObjectToObjectImp = [NSSortDescriptor instanceMethodForSelector:@selector(compareObject:toObject:)];
-	cw_ascendingImp = [NSSortDescriptor instanceMethodForSelector:@selector(ascending)];
+	// Extract the key values of anObject once, not once for every probe.
+	CWSortKeys* sortKeys = [[CWSortKeys alloc] initWithSortDescriptors:descriptors];
+  [sortKeys addKeysForObject:anObject];
+  NSUInteger index = cw_IndexForInsertingSortKeys(self, sortKeys, 0);
+  [sortKeys release];
+  return index;
 }
 
-static NSComparisonResult cw_DescriptorCompare(id a, id b, void* descriptors) {
-	NSComparisonResult result = NSOrderedSame;
-  for (NSSortDescriptor* sortDescriptor in (NSArray*)descriptors) {
-		result = (NSComparisonResult)cw_compareObjectToObjectImp(sortDescriptor, @selector(compareObject:toObject:), a, b);
-    if (result != NSOrderedSame) {
-      break;
+@end
+
+
+/*
+ * Batches of at least this many objects are sorted concurrently.
+ */
+#define CW_CONCURRENT_SORT_THRESHOLD 16384
+
+/*
+ * Runs of at most this many objects are sorted with an insertion sort.
+ */
+#define CW_INSERTION_SORT_THRESHOLD 16
+
+/*
+ * Stable merge sort, buffer must have room for count / 2 objects.
+ */
+static void cw_MergeSortObjects(id* objects, id* buffer, NSUInteger count, NSInteger (*compare)(id, id, void *), void* context) {
+	if (count <= CW_INSERTION_SORT_THRESHOLD) {
+    for (NSUInteger index = 1; index < count; index++) {
+      id object = objects[index];
+      NSUInteger insertIndex = index;
+      while (insertIndex > 0 && compare(objects[insertIndex - 1], object, context) > 0) {
+        objects[insertIndex] = objects[insertIndex - 1];
+        insertIndex--;
+      }
+      objects[insertIndex] = object;
     }
+    return;
+  }
+  NSUInteger half = count / 2;
+  cw_MergeSortObjects(objects, buffer, half, compare, context);
+  cw_MergeSortObjects(objects + half, buffer, count - half, compare, context);
+  if (compare(objects[half - 1], objects[half], context) <= 0) {
+    return;
+  }
+  memcpy(buffer, objects, half * sizeof(id));
+  NSUInteger leftIndex = 0, rightIndex = half, index = 0;
+  while (leftIndex < half && rightIndex < count) {
+    if (compare(objects[rightIndex], buffer[leftIndex], context) < 0) {
+      objects[index++] = objects[rightIndex++];
+    } else {
+      objects[index++] = buffer[leftIndex++];
+    }
+  }
+  while (leftIndex < half) {
+    objects[index++] = buffer[leftIndex++];
   }
-  return result;
 }
 
--(NSUInteger)indexForInsertingObject:(id)anObject sortedUsingDescriptors:(NSArray*)descriptors;
-{
-	return [self indexForInsertingObject:anObject sortedUsingfunction:&cw_DescriptorCompare context:descriptors];
+/*
+ * Stable sort of all objects in array into objects. Objects are not retained,
+ * and may be owned by an autoreleased array.
+ */
+static void cw_StableSortObjects(NSArray* array, id* objects, NSInteger (*compare)(id, id, void *), void* context) {
+	NSUInteger count = [array count];
+#if NS_BLOCKS_AVAILABLE
+  if (count >= CW_CONCURRENT_SORT_THRESHOLD) {
+    NSArray* sortedArray = [array sortedArrayWithOptions:NSSortConcurrent | NSSortStable
+                                         usingComparator:^NSComparisonResult(id a, id b) {
+                                           return (NSComparisonResult)compare(a, b, context);
+                                         }];
+    [sortedArray getObjects:objects range:NSMakeRange(0, count)];
+    return;
+  }
+#endif
+  [array getObjects:objects range:NSMakeRange(0, count)];
+  id* buffer = malloc((count / 2 + 1) * sizeof(id));
+  cw_MergeSortObjects(objects, buffer, count, compare, context);
+  free(buffer);
 }
 
-@end
+typedef NSComparisonResult (*cw_IndexCompareFunction)(NSUInteger, NSUInteger, void*);
+
+typedef struct {
+	id* objects;
+  NSInteger (*compare)(id, id, void *);
+  void* context;
+} cw_ObjectsCompareContext;
+
+static NSComparisonResult cw_ObjectsCompare(NSUInteger index, NSUInteger otherIndex, void* context) {
+	cw_ObjectsCompareContext* objectsContext = context;
+  return (NSComparisonResult)objectsContext->compare(objectsContext->objects[index], objectsContext->objects[otherIndex], objectsContext->context);
+}
+
+static NSComparisonResult cw_SortKeysCompare(NSUInteger index, NSUInteger otherIndex, void* sortKeys) {
+	return [(CWSortKeys*)sortKeys compareKeysAtIndex:index toKeysAtIndex:otherIndex];
+}
+
+/*
+ * Remove all but the first, or last, of each run of equal sorted indexes.
+ * Returns the new count.
+ */
+static NSUInteger cw_UniqueSortedIndexes(NSUInteger* indexes, NSUInteger count, cw_IndexCompareFunction compare, void* context, BOOL keepLast) {
+	NSUInteger uniqueCount = 0;
+  for (NSUInteger index = 0; index < count; index++) {
+    if (keepLast) {
+      if (index + 1 < count && compare(indexes[index], indexes[index + 1], context) == NSOrderedSame) {
+        continue;
+      }
+    } else if (uniqueCount > 0 && compare(indexes[uniqueCount - 1], indexes[index], context) == NSOrderedSame) {
+      continue;
+    }
+    indexes[uniqueCount++] = indexes[index];
+  }
+  return uniqueCount;
+}
+
+/*
+ * Merge the inserted objects at the sorted indexes with the existing objects
+ * in array from start, that are also in objects from index existingBase.
+ */
+static void cw_MergeObjects(NSMutableArray* array, NSUInteger start, id* objects, NSUInteger* indexes, NSUInteger insertCount, NSUInteger existingBase, cw_IndexCompareFunction compare, void* context, CWSortedInsertMergePolicy policy) {
+	if (policy != CWSortedInsertKeepBoth) {
+    insertCount = cw_UniqueSortedIndexes(indexes, insertCount, compare, context, policy == CWSortedInsertKeepLast);
+  }
+  NSUInteger existingCount = [array count] - start;
+  id* merged = malloc((existingCount + insertCount) * sizeof(id));
+  NSUInteger existingIndex = existingBase, existingEnd = existingBase + existingCount;
+  NSUInteger insertIndex = 0, mergedCount = 0;
+  while (existingIndex < existingEnd && insertIndex < insertCount) {
+    NSComparisonResult order = compare(existingIndex, indexes[insertIndex], context);
+    if (order == NSOrderedAscending) {
+      merged[mergedCount++] = objects[existingIndex++];
+    } else if (order == NSOrderedDescending) {
+      merged[mergedCount++] = objects[indexes[insertIndex++]];
+    } else {
+      switch (policy) {
+        case CWSortedInsertKeepFirst:
+          insertIndex++;
+          break;
+        case CWSortedInsertKeepLast:
+          existingIndex++;
+          break;
+        default:
+          merged[mergedCount++] = objects[existingIndex++];
+          break;
+      }
+    }
+  }
+  while (existingIndex < existingEnd) {
+    merged[mergedCount++] = objects[existingIndex++];
+  }
+  while (insertIndex < insertCount) {
+    merged[mergedCount++] = objects[indexes[insertIndex++]];
+  }
+  NSArray* mergedArray = [[NSArray alloc] initWithObjects:merged count:mergedCount];
+  [array replaceObjectsInRange:NSMakeRange(start, existingCount) withObjectsFromArray:mergedArray];
+  [mergedArray release];
+  free(merged);
+}
 
 
 @implementation NSMutableArray (CWSortedInsert)
@@ -107,4 +262,71 @@ static NSComparisonResult cw_DescriptorCompare(id a, id b, void* descriptors) {
   [self insertObject:anObject atIndex:index];
 }
 
+-(void)insertObjectsFromArray:(NSArray*)array sortedUsingfunction:(NSInteger (*)(id, id, void *))compare context:(void*)context;
+{
+	[self insertObjectsFromArray:array sortedUsingfunction:compare context:context mergePolicy:CWSortedInsertKeepBoth];
+}
+
+-(void)insertObjectsFromArray:(NSArray*)array sortedUsingSelector:(SEL)aSelector;
+{
+	[self insertObjectsFromArray:array sortedUsingfunction:&cw_SelectorCompare context:aSelector mergePolicy:CWSortedInsertKeepBoth];
+}
+
+-(void)insertObjectsFromArray:(NSArray*)array sortedUsingDescriptors:(NSArray*)descriptors;
+{
+	[self insertObjectsFromArray:array sortedUsingDescriptors:descriptors mergePolicy:CWSortedInsertKeepBoth];
+}
+
+-(void)insertObjectsFromArray:(NSArray*)array sortedUsingfunction:(NSInteger (*)(id, id, void *))compare context:(void*)context mergePolicy:(CWSortedInsertMergePolicy)policy;
+{
+	NSUInteger insertCount = [array count];
+  if (insertCount == 0) {
+    return;
+  }
+  id* objects = malloc(insertCount * sizeof(id));
+  cw_StableSortObjects(array, objects, compare, context);
+  // Objects ordered before all inserted objects are left in place.
+  NSUInteger start = [self indexForInsertingObject:objects[0] sortedUsingfunction:compare context:context];
+  NSUInteger existingCount = [self count] - start;
+  objects = realloc(objects, (insertCount + existingCount) * sizeof(id));
+  [self getObjects:objects + insertCount range:NSMakeRange(start, existingCount)];
+  NSUInteger* indexes = malloc(insertCount * sizeof(NSUInteger));
+  for (NSUInteger index = 0; index < insertCount; index++) {
+    indexes[index] = index;
+  }
+  cw_ObjectsCompareContext objectsContext = { objects, compare, context };
+  cw_MergeObjects(self, start, objects, indexes, insertCount, insertCount, &cw_ObjectsCompare, &objectsContext, policy);
+  free(indexes);
+  free(objects);
+}
+
+-(void)insertObjectsFromArray:(NSArray*)array sortedUsingSelector:(SEL)aSelector mergePolicy:(CWSortedInsertMergePolicy)policy;
+{
+	[self insertObjectsFromArray:array sortedUsingfunction:&cw_SelectorCompare context:aSelector mergePolicy:policy];
+}
+
+-(void)insertObjectsFromArray:(NSArray*)array sortedUsingDescriptors:(NSArray*)descriptors mergePolicy:(CWSortedInsertMergePolicy)policy;
+{
+	NSUInteger insertCount = [array count];
+  if (insertCount == 0) {
+    return;
+  }
+  // Key values are extracted once for every inserted and existing object.
+  CWSortKeys* sortKeys = [[CWSortKeys alloc] initWithObjects:array sortDescriptors:descriptors];
+  NSUInteger* indexes = malloc(insertCount * sizeof(NSUInteger));
+  [sortKeys getSortedIndexes:indexes];
+  NSUInteger start = cw_IndexForInsertingSortKeys(self, sortKeys, indexes[0]);
+  NSUInteger existingCount = [self count] - start;
+  id* objects = malloc((insertCount + existingCount) * sizeof(id));
+  [array getObjects:objects range:NSMakeRange(0, insertCount)];
+  [self getObjects:objects + insertCount range:NSMakeRange(start, existingCount)];
+  for (NSUInteger index = insertCount; index < insertCount + existingCount; index++) {
+    [sortKeys addKeysForObject:objects[index]];
+  }
+  cw_MergeObjects(self, start, objects, indexes, insertCount, insertCount, &cw_SortKeysCompare, sortKeys, policy);
+  free(objects);
+  free(indexes);
+  [sortKeys release];
+}
+
 @end
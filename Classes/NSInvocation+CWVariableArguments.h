@@ -30,6 +30,8 @@
 
 #import <Foundation/Foundation.h>
 
+@class CWTimerHandle;
+
 
 /*!
  * @abstract Category on NSInvocation adding convinience methods for creating invocations and invoking on different targets.
@@ -46,6 +48,9 @@
  *             Arguments are not retained by NSInvocation by default for
  *			   performance. Always retain arguments when passing objects across
  *             thread boundries.
+ *             Struct arguments other than NSRange, points, sizes and rects
+ *             are only supported on i386 and arm, and raise an
+ *             NSInvalidArgumentException on other architectures.
  *
  * @param retainArguments YES if object arguments should be retained.
  * @param ... a list of arguments to send to the method when invoking.
@@ -111,7 +116,7 @@
                            arguments:(va_list)arguments;
 
 /*!
- * @abstract Perform invoke on a new bakcground thread.
+ * @abstract Perform invoke on a background thread from the shared CWThreadPool.
  *
  * @discussion You should NOT read the return value, since there is no way to
  * 						 know when the invokation has finnished.
@@ -126,6 +131,14 @@
  */
 -(void)invokeOnMainThreadWaitUntilDone:(BOOL)wait;
 
+/*!
+ * @abstract Perform invoke on the main thread, unless replaced by a later
+ *           invocation with an equal key before performed.
+ *
+ * @discussion See CWMainThreadDispatcher for details.
+ */
+-(void)invokeOnMainThreadWithCoalescingKey:(id<NSCopying>)key;
+
 /*!
  * @abstract Perform invoke on the specified thread, optionally waut until done.
  *
@@ -154,9 +167,12 @@
 /*!
  * @abstract Perform invoke on current thread after a delay.
  *
+ * @discussion Scheduled on the current thread's CWTimerWheel.
+ *
  * @param delay delay until performing selector.
+ * @result A handle for cancelling the invocation.
  */
--(void)invokeAfterDelay:(NSTimeInterval)delay;
+-(CWTimerHandle*)invokeAfterDelay:(NSTimeInterval)delay;
 
 
 /*!
@@ -173,4 +189,31 @@
  */
 -(void)invokeWithAllTargets:(NSArray*)targets;
 
+/*!
+ * @abstract Perform a copy of the invocation with each target in array
+ *           concurrently, and wait until all are done.
+ *
+ * @discussion Targets must be thread safe, use invokeWithAllTargets: otherwise.
+ *
+ * @param targets List of all targets to invoke with.
+ */
+-(void)invokeConcurrentlyWithAllTargets:(NSArray*)targets;
+
+/*!
+ * @abstract Perform a copy of the invocation with each target in array
+ *           concurrently, and wait until all are done.
+ *
+ * @discussion Return values are boxed as by -[CWFuture finishWithInvocation:],
+ *             with NSNull for nil. If any invocation raise an exception, the
+ *             exception of the first target in array is raised after all
+ *             invocations are done.
+ *
+ * @param targets List of all targets to invoke with.
+ * @param maximumConcurrency Maximum concurrent invocations, or 0 for a default
+ *                           based on system conditions.
+ * @param returnValues YES to return the return values in target order.
+ * @result Return values in target order, or nil.
+ */
+-(NSArray*)invokeConcurrentlyWithAllTargets:(NSArray*)targets maximumConcurrency:(NSUInteger)maximumConcurrency returnValues:(BOOL)returnValues;
+
 @end
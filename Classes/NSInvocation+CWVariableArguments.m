@@ -30,8 +30,174 @@
 
 #import "NSInvocation+CWVariableArguments.h"
 #import "NSOperationQueue+CWDefaultQueue.h"
+#import "CWFuture.h"
+#import "CWMainThreadDispatcher.h"
+#import "NSOperationQueue+CWBoundedQueue.h"
+#import "CWThreadPool.h"
+#import "CWTimerWheel.h"
 #include <stdarg.h>
 #include <objc/runtime.h>
+#include <pthread.h>
+
+#if TARGET_OS_IPHONE
+typedef CGPoint CWPoint;
+typedef CGSize CWSize;
+typedef CGRect CWRect;
+#else
+typedef NSPoint CWPoint;
+typedef NSSize CWSize;
+typedef NSRect CWRect;
+#endif
+
+/*
+ * How an argument is read from a va_list, after default argument promotions.
+ */
+typedef enum {
+	CWArgumentKindChar,
+    CWArgumentKindUnsignedChar,
+    CWArgumentKindShort,
+    CWArgumentKindUnsignedShort,
+    CWArgumentKindInt,
+    CWArgumentKindLong,
+    CWArgumentKindLongLong,
+    CWArgumentKindBool,
+    CWArgumentKindFloat,
+    CWArgumentKindDouble,
+    CWArgumentKindLongDouble,
+    CWArgumentKindPointer,
+    CWArgumentKindRange,
+    CWArgumentKindPoint,
+    CWArgumentKindSize,
+    CWArgumentKindRect,
+    CWArgumentKindOther
+} CWArgumentKind;
+
+/*
+ * Argument layout for a method, built once per class and selector.
+ */
+typedef struct CWArgumentLayout {
+	NSMethodSignature* signature;
+    NSUInteger count;
+    struct {
+    	CWArgumentKind kind;
+        NSUInteger size;
+    } arguments[];
+} CWArgumentLayout;
+
+static CWArgumentKind cw_ArgumentKind(const char* type)
+{
+	while (*type && strchr("rnNoORV", *type)) {
+    	type++;
+    }
+    switch (*type) {
+        case 'c': return CWArgumentKindChar;
+        case 'C': return CWArgumentKindUnsignedChar;
+        case 's': return CWArgumentKindShort;
+        case 'S': return CWArgumentKindUnsignedShort;
+        case 'i': case 'I': return CWArgumentKindInt;
+        case 'l': case 'L': return CWArgumentKindLong;
+        case 'q': case 'Q': return CWArgumentKindLongLong;
+        case 'B': return CWArgumentKindBool;
+        case 'f': return CWArgumentKindFloat;
+        case 'd': return CWArgumentKindDouble;
+        case 'D': return CWArgumentKindLongDouble;
+        case '@': case '#': case ':': case '*': case '^': return CWArgumentKindPointer;
+        case '{':
+        	if (strcmp(type, @encode(NSRange)) == 0) {
+            	return CWArgumentKindRange;
+            } else if (strcmp(type, @encode(CWPoint)) == 0) {
+            	return CWArgumentKindPoint;
+            } else if (strcmp(type, @encode(CWSize)) == 0) {
+            	return CWArgumentKindSize;
+            } else if (strcmp(type, @encode(CWRect)) == 0) {
+            	return CWArgumentKindRect;
+            }
+        default:
+        	return CWArgumentKindOther;
+    }
+}
+
+static pthread_rwlock_t cw_layoutLock = PTHREAD_RWLOCK_INITIALIZER;
+static CFMutableDictionaryRef cw_layouts = NULL;
+
+/*
+ * The cached argument layout for instances of class, or NULL if the class do
+ * not respond to selector. Layouts are never freed.
+ */
+static CWArgumentLayout* cw_ArgumentLayout(Class aClass, SEL selector)
+{
+	CWArgumentLayout* layout = NULL;
+    pthread_rwlock_rdlock(&cw_layoutLock);
+    if (cw_layouts) {
+    	CFDictionaryRef selectors = CFDictionaryGetValue(cw_layouts, aClass);
+        if (selectors) {
+        	layout = (CWArgumentLayout*)CFDictionaryGetValue(selectors, selector);
+        }
+    }
+    pthread_rwlock_unlock(&cw_layoutLock);
+    if (layout == NULL) {
+    	NSMethodSignature* signature = [aClass instanceMethodSignatureForSelector:selector];
+        if (signature == nil) {
+        	return NULL;
+        }
+        NSUInteger count = [signature numberOfArguments];
+        layout = malloc(sizeof(CWArgumentLayout) + count * sizeof(layout->arguments[0]));
+        layout->signature = [signature retain];
+        layout->count = count;
+        for (NSUInteger index = 2; index < count; index++) {
+        	const char* type = [signature getArgumentTypeAtIndex:index];
+        	layout->arguments[index].kind = cw_ArgumentKind(type);
+            NSGetSizeAndAlignment(type, &layout->arguments[index].size, NULL);
+        }
+        pthread_rwlock_wrlock(&cw_layoutLock);
+        if (cw_layouts == NULL) {
+        	cw_layouts = CFDictionaryCreateMutable(NULL, 0, NULL, NULL);
+        }
+        CFMutableDictionaryRef selectors = (CFMutableDictionaryRef)CFDictionaryGetValue(cw_layouts, aClass);
+        if (selectors == NULL) {
+        	selectors = CFDictionaryCreateMutable(NULL, 0, NULL, NULL);
+            CFDictionarySetValue(cw_layouts, aClass, selectors);
+        }
+        CWArgumentLayout* existingLayout = (CWArgumentLayout*)CFDictionaryGetValue(selectors, selector);
+        if (existingLayout) {
+        	[layout->signature release];
+            free(layout);
+            layout = existingLayout;
+        } else {
+        	CFDictionarySetValue(selectors, selector, layout);
+        }
+        pthread_rwlock_unlock(&cw_layoutLock);
+    }
+    return layout;
+}
+
+/*
+ * A copy of the invocation with a new target and retained arguments.
+ */
+static NSInvocation* cw_InvocationWithTarget(NSInvocation* invocation, id target)
+{
+	NSMethodSignature* signature = [invocation methodSignature];
+    NSInvocation* copy = [NSInvocation invocationWithMethodSignature:signature];
+    [copy setTarget:target];
+    [copy setSelector:[invocation selector]];
+    NSUInteger count = [signature numberOfArguments];
+    NSUInteger bufferSize = 0;
+    for (NSUInteger index = 2; index < count; index++) {
+    	NSUInteger size;
+        NSGetSizeAndAlignment([signature getArgumentTypeAtIndex:index], &size, NULL);
+        bufferSize = MAX(bufferSize, size);
+    }
+    if (bufferSize > 0) {
+    	void* buffer = malloc(bufferSize);
+        for (NSUInteger index = 2; index < count; index++) {
+        	[invocation getArgument:buffer atIndex:index];
+            [copy setArgument:buffer atIndex:index];
+        }
+        free(buffer);
+    }
+    [copy retainArguments];
+    return copy;
+}
 
 @implementation NSInvocation (CWVariableArguments)
 
@@ -54,32 +220,56 @@
                               retainArguments:(BOOL)retainArguments
                                     arguments:(va_list)arguments;
 {
-    NSMethodSignature* signature = signature = [aClass instanceMethodSignatureForSelector:selector];
-    if (aClass == Nil || selector == NULL || signature == nil) {
+    if (aClass == Nil || selector == NULL) {
+    	return nil;
+    }
+    CWArgumentLayout* layout = cw_ArgumentLayout(aClass, selector);
+    if (layout == NULL) {
     	return nil;
     }
-    char* args = (char*)arguments;
-    NSInvocation* invocation = [self invocationWithMethodSignature:signature];
+    NSInvocation* invocation = [self invocationWithMethodSignature:layout->signature];
     if (retainArguments) {
         [invocation retainArguments];
     }
     [invocation setSelector:selector];
-    for (int index = 2; index < [signature numberOfArguments]; index++) {
-        const char *type = [signature getArgumentTypeAtIndex:index];
-        NSUInteger size, align = 4;
-        NSGetSizeAndAlignment(type, &size, NULL);
-        NSUInteger mod = (NSUInteger)args % align;
-        if (mod != 0) {
-            args += (align - mod);
-        }
-        // float is stored as double on stack according to mach-o ABI.
-        if (strcmp(type, @encode(float)) == 0) {
-        	float tmp = *(double*)args;
-            [invocation setArgument:&tmp atIndex:index];
-            args += sizeof(double);
-        } else {
-	        [invocation setArgument:args atIndex:index];
-    	    args += size;
+    for (NSUInteger index = 2; index < layout->count; index++) {
+        switch (layout->arguments[index].kind) {
+#define CW_SET_ARGUMENT(kind, type, promotedType) \
+            case kind: { \
+                type value = (type)va_arg(arguments, promotedType); \
+                [invocation setArgument:&value atIndex:index]; \
+                break; \
+            }
+            CW_SET_ARGUMENT(CWArgumentKindChar, char, int)
+            CW_SET_ARGUMENT(CWArgumentKindUnsignedChar, unsigned char, int)
+            CW_SET_ARGUMENT(CWArgumentKindShort, short, int)
+            CW_SET_ARGUMENT(CWArgumentKindUnsignedShort, unsigned short, int)
+            CW_SET_ARGUMENT(CWArgumentKindInt, int, int)
+            CW_SET_ARGUMENT(CWArgumentKindLong, long, long)
+            CW_SET_ARGUMENT(CWArgumentKindLongLong, long long, long long)
+            CW_SET_ARGUMENT(CWArgumentKindBool, bool, int)
+            CW_SET_ARGUMENT(CWArgumentKindFloat, float, double)
+            CW_SET_ARGUMENT(CWArgumentKindDouble, double, double)
+            CW_SET_ARGUMENT(CWArgumentKindLongDouble, long double, long double)
+            CW_SET_ARGUMENT(CWArgumentKindPointer, void*, void*)
+            CW_SET_ARGUMENT(CWArgumentKindRange, NSRange, NSRange)
+            CW_SET_ARGUMENT(CWArgumentKindPoint, CWPoint, CWPoint)
+            CW_SET_ARGUMENT(CWArgumentKindSize, CWSize, CWSize)
+            CW_SET_ARGUMENT(CWArgumentKindRect, CWRect, CWRect)
+#undef CW_SET_ARGUMENT
+            case CWArgumentKindOther: {
+#if defined(__i386__) || defined(__arm__)
+				// va_list is a pointer to 4 byte aligned stack slots.
+                char* args = (char*)arguments;
+                [invocation setArgument:args atIndex:index];
+                arguments = (va_list)(args + ((layout->arguments[index].size + 3) & ~3));
+#else
+                [NSException raise:NSInvalidArgumentException
+                            format:@"Unsupported variable argument type %s for %@",
+                 [layout->signature getArgumentTypeAtIndex:index], NSStringFromSelector(selector)];
+#endif
+                break;
+            }
         }
     }
     return invocation;
@@ -114,7 +304,7 @@
 
 -(void)invokeInBackground;
 {
-	[self performSelectorInBackground:@selector(invoke) withObject:nil];
+	[[CWThreadPool sharedPool] performSelector:@selector(invoke) onTarget:self withObject:nil];
 }
 
 -(void)invokeOnMainThreadWaitUntilDone:(BOOL)wait;
@@ -122,10 +312,23 @@
 	[self invokeOnThread:[NSThread mainThread] waitUntilDone:wait];
 }
 
+-(void)invokeOnMainThreadWithCoalescingKey:(id<NSCopying>)key;
+{
+	[[CWMainThreadDispatcher sharedDispatcher] performSelector:@selector(invoke)
+                                                      onTarget:self
+                                                    withObject:nil
+                                                 coalescingKey:key];
+}
+
 -(void)invokeOnThread:(NSThread*)thread waitUntilDone:(BOOL)wait;
 {
     if ([[NSThread currentThread] isEqual:thread]) {
     	[self invoke];
+    } else if ([thread isEqual:[NSThread mainThread]]) {
+    	[[CWMainThreadDispatcher sharedDispatcher] performSelector:@selector(invoke)
+                                                          onTarget:self
+                                                        withObject:nil
+                                                     waitUntilDone:wait];
     } else {
     	[self performSelector:@selector(invoke) 
                      onThread:thread
@@ -142,8 +345,7 @@
 -(void)invokeOnOperationQueue:(NSOperationQueue*)queue waitUntilDone:(BOOL)wait;
 {
 	NSOperation* operation = [[NSInvocationOperation alloc] initWithInvocation:self];
-    [queue addOperation:operation];
-    if (wait) {
+    if ([queue addOperation:operation weight:1 error:NULL] && wait) {
         if ([operation respondsToSelector:@selector(waitUntilFinished)]) {
 		    [operation performSelector:@selector(waitUntilFinished)];
         } else {
@@ -156,11 +358,12 @@
     [operation release];
 }
 
--(void)invokeAfterDelay:(NSTimeInterval)delay;
+-(CWTimerHandle*)invokeAfterDelay:(NSTimeInterval)delay;
 {
-	[self performSelector:@selector(invoke) 
-               withObject:nil 
-               afterDelay:delay];
+	return [[CWTimerWheel currentWheel] performSelector:@selector(invoke)
+                                               onTarget:self
+                                             withObject:nil
+                                             afterDelay:delay];
 }
 
 -(void)invokeAfterDelayHelperWithDelay:(NSNumber*)delay;
@@ -183,5 +386,32 @@
     }
 }
 
-@end
+-(void)invokeConcurrentlyWithAllTargets:(NSArray*)targets;
+{
+	[self invokeConcurrentlyWithAllTargets:targets maximumConcurrency:0 returnValues:NO];
+}
 
+-(NSArray*)invokeConcurrentlyWithAllTargets:(NSArray*)targets maximumConcurrency:(NSUInteger)maximumConcurrency returnValues:(BOOL)returnValues;
+{
+	NSMutableArray* operations = [NSMutableArray arrayWithCapacity:[targets count]];
+    for (id target in targets) {
+    	CWFutureOperation* operation = [[CWFutureOperation alloc] initWithInvocation:cw_InvocationWithTarget(self, target)];
+        [operations addObject:operation];
+        [operation release];
+    }
+	NSOperationQueue* queue = [[NSOperationQueue alloc] init];
+    if (maximumConcurrency > 0) {
+    	[queue setMaxConcurrentOperationCount:maximumConcurrency];
+    }
+    [queue addOperations:operations waitUntilFinished:YES];
+    [queue release];
+    NSMutableArray* results = returnValues ? [NSMutableArray arrayWithCapacity:[operations count]] : nil;
+    for (CWFutureOperation* operation in operations) {
+    	// Raises the exception of the first failed invocation.
+    	id result = [[operation future] result];
+        [results addObject:result ? result : [NSNull null]];
+    }
+    return results;
+}
+
+@end
@@ -70,10 +70,12 @@
  *			   Associated objects where added to the Objective-C tun-time in
  *             Mac OS X 10.6 and iPhone OS 3.1 respectively. This category will
  *             use the new run-time feature if available, and fall back to a
- *             slower legacy compatible implementation when run on an older OS.
+ *             legacy compatible implementation when run on an older OS.
  *             The legacy implementation is fully compatible to association 
  *             policies (assign, copy, or retain) to avoid retention cycles.
- *             The legacy implementation is always atomic.
+ *             The legacy implementation is always atomic, and keeps
+ *             associations in tables sharded by object address with a lock
+ *             per shard.
  */
 @interface NSObject (CWAssociatedObject)
 
@@ -34,23 +34,187 @@
 
 #if CW_SUPPORT_LEGACY_ASSOCIATED_OBJECTS || CW_FORCE_LEGACY_ASSOCIATED_OBJECTS
 
-// A marker class to support assign policy for legacy associated objects.
-@interface CWIDValue : NSObject { id value; }
-+(id)IDValueWithID:(id)value;
--(id)value;
-@end
-@implementation CWIDValue
-+(id)IDValueWithID:(id)value;
+#import <pthread.h>
+
+#pragma mark --- Legacy association tables
+
+/*
+ * Legacy associated objects are kept in side tables keyed by object address,
+ * sharded by address with a lock per shard. Each shard is an open addressing
+ * table with linear probing. Each object has a list of associations, the first
+ * few stored inline.
+ */
+
+#define CW_ASSOCIATION_SHARD_COUNT 16
+#define CW_INLINE_ASSOCIATION_COUNT 4
+
+typedef struct {
+	void* key;
+    id value;
+    BOOL retained;
+} CWAssociation;
+
+typedef struct {
+	NSUInteger count;
+    NSUInteger overflowCapacity;
+    CWAssociation inlineAssociations[CW_INLINE_ASSOCIATION_COUNT];
+    CWAssociation* overflowAssociations;
+} CWAssociationList;
+
+typedef struct {
+	const void* object;
+    CWAssociationList* associations;
+} CWAssociationEntry;
+
+typedef struct {
+	pthread_mutex_t lock;
+    NSUInteger count;
+    NSUInteger capacity;
+    CWAssociationEntry* entries;
+} CWAssociationShard;
+
+static CWAssociationShard cw_associationShards[CW_ASSOCIATION_SHARD_COUNT];
+
+static inline uintptr_t cw_HashPointer(const void* pointer)
 {
-    CWIDValue* result = [[[CWIDValue alloc] init] autorelease];
-    result->value = value;
-    return result;
+	uintptr_t hash = (uintptr_t)pointer >> 4;
+    hash ^= hash >> 15;
+    hash *= 0x9e3779b1;
+    return hash ^ (hash >> 16);
 }
--(id)value;
+
+static inline CWAssociationShard* cw_ShardForObject(const void* object)
 {
-	return value;
+	return &cw_associationShards[cw_HashPointer(object) & (CW_ASSOCIATION_SHARD_COUNT - 1)];
+}
+
+static inline NSUInteger cw_SlotForObject(CWAssociationShard* shard, const void* object)
+{
+	return (cw_HashPointer(object) >> 4) & (shard->capacity - 1);
+}
+
+static CWAssociationEntry* cw_FindEntry(CWAssociationShard* shard, const void* object)
+{
+	if (shard->count == 0) {
+    	return NULL;
+    }
+    for (NSUInteger slot = cw_SlotForObject(shard, object); ; slot = (slot + 1) & (shard->capacity - 1)) {
+    	CWAssociationEntry* entry = &shard->entries[slot];
+        if (entry->object == object) {
+        	return entry;
+        } else if (entry->object == NULL) {
+        	return NULL;
+        }
+    }
+}
+
+static CWAssociationEntry* cw_InsertEntry(CWAssociationShard* shard, const void* object);
+
+/*
+ * Grow to keep the load factor at most one half.
+ */
+static void cw_GrowShard(CWAssociationShard* shard)
+{
+	NSUInteger oldCapacity = shard->capacity;
+    CWAssociationEntry* oldEntries = shard->entries;
+    shard->capacity = oldCapacity ? oldCapacity * 2 : 16;
+    shard->entries = calloc(shard->capacity, sizeof(CWAssociationEntry));
+    shard->count = 0;
+    for (NSUInteger slot = 0; slot < oldCapacity; slot++) {
+    	if (oldEntries[slot].object) {
+        	cw_InsertEntry(shard, oldEntries[slot].object)->associations = oldEntries[slot].associations;
+        }
+    }
+    free(oldEntries);
+}
+
+static CWAssociationEntry* cw_InsertEntry(CWAssociationShard* shard, const void* object)
+{
+	if ((shard->count + 1) * 2 > shard->capacity) {
+    	cw_GrowShard(shard);
+    }
+    NSUInteger slot = cw_SlotForObject(shard, object);
+    while (shard->entries[slot].object) {
+    	slot = (slot + 1) & (shard->capacity - 1);
+    }
+    shard->count++;
+    shard->entries[slot].object = object;
+    shard->entries[slot].associations = NULL;
+    return &shard->entries[slot];
+}
+
+/*
+ * Remove with backward shift, so that lookups need no tombstones.
+ */
+static void cw_RemoveEntry(CWAssociationShard* shard, CWAssociationEntry* entry)
+{
+	NSUInteger mask = shard->capacity - 1;
+	NSUInteger hole = entry - shard->entries;
+    for (NSUInteger slot = (hole + 1) & mask; shard->entries[slot].object; slot = (slot + 1) & mask) {
+    	NSUInteger home = cw_SlotForObject(shard, shard->entries[slot].object);
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+        	shard->entries[hole] = shard->entries[slot];
+            hole = slot;
+        }
+    }
+    shard->entries[hole].object = NULL;
+    shard->entries[hole].associations = NULL;
+    shard->count--;
+}
+
+static inline CWAssociation* cw_AssociationAtIndex(CWAssociationList* list, NSUInteger index)
+{
+	if (index < CW_INLINE_ASSOCIATION_COUNT) {
+    	return &list->inlineAssociations[index];
+    }
+    return &list->overflowAssociations[index - CW_INLINE_ASSOCIATION_COUNT];
+}
+
+static NSUInteger cw_IndexOfAssociation(CWAssociationList* list, void* key)
+{
+	for (NSUInteger index = 0; index < list->count; index++) {
+    	if (cw_AssociationAtIndex(list, index)->key == key) {
+        	return index;
+        }
+    }
+    return NSNotFound;
+}
+
+static CWAssociation* cw_AddAssociation(CWAssociationList* list, void* key)
+{
+	NSUInteger overflowCount = list->count >= CW_INLINE_ASSOCIATION_COUNT ? list->count - CW_INLINE_ASSOCIATION_COUNT : 0;
+	if (list->count >= CW_INLINE_ASSOCIATION_COUNT && overflowCount == list->overflowCapacity) {
+    	list->overflowCapacity = list->overflowCapacity ? list->overflowCapacity * 2 : 4;
+        list->overflowAssociations = realloc(list->overflowAssociations, list->overflowCapacity * sizeof(CWAssociation));
+    }
+    CWAssociation* association = cw_AssociationAtIndex(list, list->count++);
+    association->key = key;
+    association->value = nil;
+    association->retained = NO;
+    return association;
+}
+
+static void cw_RemoveAssociationAtIndex(CWAssociationList* list, NSUInteger index)
+{
+	*cw_AssociationAtIndex(list, index) = *cw_AssociationAtIndex(list, list->count - 1);
+    list->count--;
+}
+
+/*
+ * Must be called without holding a shard lock, releasing may dealloc objects
+ * with associations.
+ */
+static void cw_FreeAssociationList(CWAssociationList* list)
+{
+	for (NSUInteger index = 0; index < list->count; index++) {
+    	CWAssociation* association = cw_AssociationAtIndex(list, index);
+        if (association->retained) {
+        	[association->value release];
+        }
+    }
+    free(list->overflowAssociations);
+    free(list);
 }
-@end
 
 #endif
 
@@ -58,8 +222,6 @@
 
 #if CW_SUPPORT_LEGACY_ASSOCIATED_OBJECTS || CW_FORCE_LEGACY_ASSOCIATED_OBJECTS
 
-static NSMutableDictionary* cw_associatedObjects = nil;
-
 +(void)exchangeInstanceMethodImplementationsForSelector:(SEL)s1 andSelector:(SEL)s2;
 {
 	Method m1 = class_getInstanceMethod(self, s1);
@@ -78,7 +240,9 @@ static NSMutableDictionary* cw_associatedObjects = nil;
 	if (NSFoundationVersionNumber < minVersion) {
 #endif
         CWLogWarning(@"Uses legacy compatible associated objects");
-        cw_associatedObjects = [[NSMutableDictionary alloc] init];
+        for (NSUInteger index = 0; index < CW_ASSOCIATION_SHARD_COUNT; index++) {
+        	pthread_mutex_init(&cw_associationShards[index].lock, NULL);
+        }
         [self exchangeInstanceMethodImplementationsForSelector:@selector(associatedObjectForStaticKey:) 
                                                    andSelector:@selector(legacy_associatedObjectForStaticKey:)];
         [self exchangeInstanceMethodImplementationsForSelector:@selector(setAssociatedObject:forStaticKey:) 
@@ -98,21 +262,41 @@ static NSMutableDictionary* cw_associatedObjects = nil;
 
 -(void)legacy_associated_objects_dealloc;
 {
-	[cw_associatedObjects removeObjectForKey:[NSValue valueWithPointer:self]];
+	CWAssociationShard* shard = cw_ShardForObject(self);
+    CWAssociationList* associations = NULL;
+    pthread_mutex_lock(&shard->lock);
+    CWAssociationEntry* entry = cw_FindEntry(shard, self);
+    if (entry) {
+    	associations = entry->associations;
+        cw_RemoveEntry(shard, entry);
+    }
+    pthread_mutex_unlock(&shard->lock);
+    if (associations) {
+    	cw_FreeAssociationList(associations);
+    }
     [self legacy_associated_objects_dealloc];
 }
 
 -(id)legacy_associatedObjectForStaticKey:(void*)key;
 {
     id object = nil;
-    @synchronized(self) {
-	    NSMutableDictionary* objects = [cw_associatedObjects objectForKey:[NSValue valueWithPointer:self]];
-    	object = [objects objectForKey:[NSValue valueWithPointer:key]];
-        if ([object isKindOfClass:[CWIDValue class]]) {
-        	object = [object value];
+    BOOL retained = NO;
+	CWAssociationShard* shard = cw_ShardForObject(self);
+    pthread_mutex_lock(&shard->lock);
+    CWAssociationEntry* entry = cw_FindEntry(shard, self);
+    if (entry) {
+    	NSUInteger index = cw_IndexOfAssociation(entry->associations, key);
+        if (index != NSNotFound) {
+        	CWAssociation* association = cw_AssociationAtIndex(entry->associations, index);
+            object = association->value;
+            retained = association->retained;
+            if (retained) {
+            	[object retain];
+            }
         }
     }
-    return object;
+    pthread_mutex_unlock(&shard->lock);
+    return retained ? [object autorelease] : object;
 }
 
 -(void)legacy_setAssociatedObject:(id)value forStaticKey:(void*)key;
@@ -123,30 +307,61 @@ static NSMutableDictionary* cw_associatedObjects = nil;
         withAssociationPolicy:OBJC_ASSOCIATION_RETAIN_NONATOMIC];
 }
 
+/*
+ * Values are copied before, and replaced values released after, holding the
+ * shard lock. Setting nil removes the association.
+ */
 -(void)legacy_setAssociatedObject:(id)value forStaticKey:(void *)key withAssociationPolicy:(objc_AssociationPolicy)policy; 
 {
-    @synchronized(self) {
-        NSMutableDictionary* objects = [cw_associatedObjects objectForKey:[NSValue valueWithPointer:self]];
-        if (objects == nil) {
-            objects = [NSMutableDictionary dictionaryWithCapacity:4];
-            [cw_associatedObjects setObject:objects forKey:[NSValue valueWithPointer:self]];
+	BOOL retained = YES;
+    switch (policy) {
+        case OBJC_ASSOCIATION_ASSIGN:
+        	retained = NO;
+            break;
+        case OBJC_ASSOCIATION_COPY:
+        case OBJC_ASSOCIATION_COPY_NONATOMIC:
+        	value = [value copy];
+            break;
+        default:
+        	[value retain];
+            break;
+    }
+    id oldValue = nil;
+    BOOL oldRetained = NO;
+    CWAssociationList* emptyAssociations = NULL;
+	CWAssociationShard* shard = cw_ShardForObject(self);
+    pthread_mutex_lock(&shard->lock);
+    CWAssociationEntry* entry = cw_FindEntry(shard, self);
+    NSUInteger index = entry ? cw_IndexOfAssociation(entry->associations, key) : NSNotFound;
+    if (index != NSNotFound) {
+    	CWAssociation* association = cw_AssociationAtIndex(entry->associations, index);
+        oldValue = association->value;
+        oldRetained = association->retained;
+        if (value == nil) {
+        	cw_RemoveAssociationAtIndex(entry->associations, index);
+            if (entry->associations->count == 0) {
+            	emptyAssociations = entry->associations;
+            	cw_RemoveEntry(shard, entry);
+            }
+        } else {
+        	association->value = value;
+            association->retained = retained;
         }
-        switch (policy) {
-            case OBJC_ASSOCIATION_ASSIGN:
-                [objects setObject:[CWIDValue IDValueWithID:value]
-                            forKey:[NSValue valueWithPointer:key]];
-                break;
-            case OBJC_ASSOCIATION_COPY:
-            case OBJC_ASSOCIATION_COPY_NONATOMIC:
-                [objects setObject:[value copy] 
-                            forKey:[NSValue valueWithPointer:key]];
-                break;
-            case OBJC_ASSOCIATION_RETAIN:
-            case OBJC_ASSOCIATION_RETAIN_NONATOMIC:
-                [objects setObject:value 
-                            forKey:[NSValue valueWithPointer:key]];
-                break;
+    } else if (value != nil) {
+    	if (entry == NULL) {
+        	entry = cw_InsertEntry(shard, self);
+            entry->associations = calloc(1, sizeof(CWAssociationList));
         }
+        CWAssociation* association = cw_AddAssociation(entry->associations, key);
+        association->value = value;
+        association->retained = retained;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    if (emptyAssociations) {
+    	cw_FreeAssociationList(emptyAssociations);
+    }
+    if (oldRetained) {
+    	[oldValue release];
     }
 }
 
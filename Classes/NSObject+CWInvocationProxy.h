@@ -30,12 +30,18 @@
 
 #import <Foundation/Foundation.h>
 
+@class CWFuture;
+
 /*!
  * @abstract A category on NSObject to access proxies for invoking method calls
  *           on oher threads.
  *
  * @discussion Requesting a proxy to the current thread will always yield the
  *             receiver without creating a proxy.
+ *
+ *             Method signatures are cached per target class and selector.
+ *             Messages with a void return and up to two object or integer
+ *             arguments are forwarded without creating an NSInvocation.
  */
 @interface NSObject (CWInvocationProxy)
 
@@ -46,6 +52,7 @@
 
 /*!
  * @abstract Proxy for invoking methods on a background thread.
+ * @discussion Invocations are performed on the shared CWThreadPool.
  */
 -(id)backgroundProxy;
 
@@ -72,8 +79,18 @@
 
 /*!
  * @abstract Delay method invocation.
- * @discussion Overrides waitUntilDone.
+ * @discussion Overrides waitUntilDone. Returns a new proxy delaying all calls,
+ *             scheduled on the current thread's CWTimerWheel.
  */
 -(id)afterDelay:(NSTimeInterval)delay;
 
+/*!
+ * @abstract Return a future for the next method invocation.
+ *
+ * @discussion A new future is assigned to future immediately, and is finished
+ *             with the return value of the next method called on the proxy,
+ *             once invoked on the target thread or queue.
+ */
+-(id)future:(CWFuture**)future;
+
 @end
@@ -31,6 +31,14 @@
 #import "NSObject+CWInvocationProxy.h"
 
 #import "NSOperationQueue+CWDefaultQueue.h"
+#import "CWFuture.h"
+#import "CWMainThreadDispatcher.h"
+#import "CWThreadPool.h"
+#import "NSInvocation+CWVariableArguments.h"
+#import "NSOperationQueue+CWInstrumentation.h"
+#import <objc/runtime.h>
+#import <objc/message.h>
+#import <pthread.h>
 
 typedef enum {
 	CWInvocationProxyTypeBackgound,
@@ -38,7 +46,7 @@ typedef enum {
 	CWInvocationProxyTypeQueue,
 } CWInvocationProxyType;
 
-@interface CWInvocationProxy : NSObject {
+@interface CWInvocationProxy : NSObject <CWInstrumentedOperationTarget> {
 @private
     id _target;
     CWInvocationProxyType _type;
@@ -46,12 +54,18 @@ typedef enum {
     NSOperationQueue* _queue;
     BOOL _wait;
     NSTimeInterval _delay;
+    CWFuture* _future;
 }
 
 +(id)backgroundProxyForTarget:(id)target;
 +(id)threadProxyForTarget:(id)target onThread:(NSThread*)thread;
 +(id)queueProxyForTarget:(id)target onQueue:(NSOperationQueue*)queue;
 
+/*!
+ * @abstract A new proxy for the same target and context, taking over any future.
+ */
+-(CWInvocationProxy*)proxyCopy;
+
 /*!
  * @abstract Hook for preparing/replacing objects before transfereing to new context.
  */
@@ -62,10 +76,221 @@ typedef enum {
  */
 -(void)prepareInvocationForInvokingInNewContext:(NSInvocation*)invocation;
 
+/*!
+ * @abstract Forward a selector with fast path arguments, called by the IMPs
+ *           added to proxy classes for specific target classes.
+ */
+-(void)forwardSelector:(SEL)aSelector arguments:(intptr_t*)arguments;
+
+-(void)performSelectorInContext:(SEL)performSelector withObject:(id)performObject;
 
 @end
 
 
+/*
+ * A captured message with up to two arguments passed in integer registers,
+ * used instead of an NSInvocation by the fast forwarding path.
+ */
+@interface CWInvocationRecord : NSObject {
+@private
+	id _target;
+    SEL _selector;
+    NSUInteger _count;
+    char _types[2];
+    intptr_t _arguments[2];
+}
+
+-(id)initWithTarget:(id)target selector:(SEL)aSelector signature:(NSMethodSignature*)signature arguments:(intptr_t*)arguments;
+
+-(SEL)selector;
+-(void)invoke;
+
+@end
+
+
+#pragma mark --- Signature cache
+
+static pthread_rwlock_t cw_signatureLock = PTHREAD_RWLOCK_INITIALIZER;
+static CFMutableDictionaryRef cw_signatures = NULL;
+
+/*
+ * Method signature of a method implemented by class, cached per class and
+ * selector. Nil for selectors only handled by dynamic forwarding, since the
+ * signature may then differ between instances.
+ */
+static NSMethodSignature* cw_MethodSignature(Class cls, SEL aSelector)
+{
+	NSMethodSignature* signature = nil;
+	pthread_rwlock_rdlock(&cw_signatureLock);
+    if (cw_signatures) {
+    	CFDictionaryRef selectors = CFDictionaryGetValue(cw_signatures, cls);
+        if (selectors) {
+        	signature = (NSMethodSignature*)CFDictionaryGetValue(selectors, aSelector);
+        }
+    }
+    pthread_rwlock_unlock(&cw_signatureLock);
+    if (signature == nil) {
+    	Method method = class_getInstanceMethod(cls, aSelector);
+        if (method == NULL) {
+        	return nil;
+        }
+        signature = [NSMethodSignature signatureWithObjCTypes:method_getTypeEncoding(method)];
+        pthread_rwlock_wrlock(&cw_signatureLock);
+        if (cw_signatures == NULL) {
+        	cw_signatures = CFDictionaryCreateMutable(NULL, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+        }
+        CFMutableDictionaryRef selectors = (CFMutableDictionaryRef)CFDictionaryGetValue(cw_signatures, cls);
+        if (selectors == NULL) {
+        	selectors = CFDictionaryCreateMutable(NULL, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+            CFDictionarySetValue(cw_signatures, cls, selectors);
+            CFRelease(selectors);
+        }
+        // Add never replaces, cached signatures are never released.
+        CFDictionaryAddValue(selectors, aSelector, signature);
+        pthread_rwlock_unlock(&cw_signatureLock);
+    }
+    return signature;
+}
+
+#pragma mark --- Fast forwarding
+
+static const char* cw_SkipTypeQualifiers(const char* type)
+{
+	while (*type && strchr("rnNoORV", *type)) {
+    	type++;
+    }
+    return type;
+}
+
+/*
+ * Type of an argument passed in a single integer register, or 0. Blocks are
+ * excluded since they must be copied.
+ */
+static char cw_FastArgumentType(const char* type)
+{
+	type = cw_SkipTypeQualifiers(type);
+    switch (*type) {
+        case '@':
+        	return type[1] == '?' ? 0 : '@';
+        case 'c': case 'C': case 's': case 'S': case 'i': case 'I':
+        case 'l': case 'L': case 'B': case '#': case ':': case '*': case '^':
+        	return *type;
+        case 'q': case 'Q':
+        	return sizeof(long long) == sizeof(intptr_t) ? *type : 0;
+        default:
+        	return 0;
+    }
+}
+
+/*
+ * Only the low bits of small integer arguments are defined by the caller.
+ * Arguments are truncated to their declared C type, long is as wide as a
+ * register on both ILP32 and LP64 and is never truncated.
+ */
+static intptr_t cw_NormalizedArgument(char type, intptr_t value)
+{
+	switch (type) {
+        case 'c': return (char)value;
+        case 'C': return (unsigned char)value;
+        case 'B': return (unsigned char)value != 0;
+        case 's': return (short)value;
+        case 'S': return (unsigned short)value;
+        case 'i': return (int)value;
+        case 'I': return (unsigned int)value;
+        case 'l': return (long)value;
+        case 'L': return (unsigned long)value;
+        default: return value;
+    }
+}
+
+static void cw_ForwardNoArguments(CWInvocationProxy* self, SEL _cmd)
+{
+	[self forwardSelector:_cmd arguments:NULL];
+}
+
+static void cw_ForwardOneArgument(CWInvocationProxy* self, SEL _cmd, intptr_t a)
+{
+	intptr_t arguments[1] = { a };
+	[self forwardSelector:_cmd arguments:arguments];
+}
+
+static void cw_ForwardTwoArguments(CWInvocationProxy* self, SEL _cmd, intptr_t a, intptr_t b)
+{
+	intptr_t arguments[2] = { a, b };
+	[self forwardSelector:_cmd arguments:arguments];
+}
+
+/*
+ * IMP forwarding messages with a void return and up to two integer register
+ * arguments, or NULL if the signature requires a full NSInvocation.
+ */
+static IMP cw_FastForwardingIMP(NSMethodSignature* signature)
+{
+	if (signature == nil || *cw_SkipTypeQualifiers([signature methodReturnType]) != 'v') {
+    	return NULL;
+    }
+    NSUInteger count = [signature numberOfArguments] - 2;
+    for (NSUInteger index = 0; index < count && index < 2; index++) {
+    	if (cw_FastArgumentType([signature getArgumentTypeAtIndex:index + 2]) == 0) {
+        	return NULL;
+        }
+    }
+    switch (count) {
+        case 0: return (IMP)cw_ForwardNoArguments;
+        case 1: return (IMP)cw_ForwardOneArgument;
+        case 2: return (IMP)cw_ForwardTwoArguments;
+        default: return NULL;
+    }
+}
+
+#pragma mark --- Proxy classes per target class
+
+static pthread_mutex_t cw_proxyClassLock = PTHREAD_MUTEX_INITIALIZER;
+static CFMutableDictionaryRef cw_proxyClasses = NULL;
+static CFMutableDictionaryRef cw_targetClasses = NULL;
+
+/*
+ * Subclass of CWInvocationProxy for proxying instances of a target class,
+ * created on first use. Fast forwarding IMPs are added to the subclass as
+ * selectors are resolved, so that the ObjC runtime do not have to create an
+ * NSInvocation for each message.
+ */
+static Class cw_ProxyClassForTargetClass(Class targetClass)
+{
+	pthread_mutex_lock(&cw_proxyClassLock);
+    if (cw_proxyClasses == NULL) {
+    	cw_proxyClasses = CFDictionaryCreateMutable(NULL, 0, NULL, NULL);
+        cw_targetClasses = CFDictionaryCreateMutable(NULL, 0, NULL, NULL);
+    }
+    Class proxyClass = (Class)CFDictionaryGetValue(cw_proxyClasses, targetClass);
+    if (proxyClass == Nil) {
+    	// Serial number, since metaclasses share name with their class.
+    	char name[256];
+        snprintf(name, sizeof(name), "CWInvocationProxy_%ld_%s",
+                 (long)CFDictionaryGetCount(cw_proxyClasses), class_getName(targetClass));
+        proxyClass = objc_allocateClassPair([CWInvocationProxy class], name, 0);
+        if (proxyClass) {
+            objc_registerClassPair(proxyClass);
+        } else {
+        	proxyClass = [CWInvocationProxy class];
+        }
+        CFDictionarySetValue(cw_proxyClasses, targetClass, proxyClass);
+        CFDictionarySetValue(cw_targetClasses, proxyClass, targetClass);
+    }
+    pthread_mutex_unlock(&cw_proxyClassLock);
+    return proxyClass;
+}
+
+static Class cw_TargetClassForProxyClass(Class proxyClass)
+{
+	pthread_mutex_lock(&cw_proxyClassLock);
+    Class targetClass = cw_targetClasses ? (Class)CFDictionaryGetValue(cw_targetClasses, proxyClass) : Nil;
+    pthread_mutex_unlock(&cw_proxyClassLock);
+    return targetClass;
+}
+
+
+
 
 @implementation NSObject (CWInvocationProxy)
 
@@ -105,14 +330,46 @@ typedef enum {
     return [proxy afterDelay:delay];
 }
 
+-(id)future:(CWFuture**)future;
+{
+	CWInvocationProxy* proxy = [CWInvocationProxy threadProxyForTarget:self onThread:[NSThread currentThread]];
+    return [proxy future:future];
+}
+
 @end
 
 
 @implementation CWInvocationProxy
 
+/*
+ * Subclasses may override the prepare hooks, and only get the full
+ * NSInvocation forwarding path.
+ */
++(id)allocForTarget:(id)target;
+{
+	if (self == [CWInvocationProxy class] && target) {
+    	return [cw_ProxyClassForTargetClass(object_getClass(target)) alloc];
+    }
+    return [self alloc];
+}
+
++(BOOL)resolveInstanceMethod:(SEL)aSelector;
+{
+	Class targetClass = cw_TargetClassForProxyClass(self);
+    if (targetClass && *sel_getName(aSelector) != '.') {
+        IMP imp = cw_FastForwardingIMP(cw_MethodSignature(targetClass, aSelector));
+        if (imp) {
+        	Method method = class_getInstanceMethod(targetClass, aSelector);
+            class_addMethod(self, aSelector, imp, method_getTypeEncoding(method));
+            return YES;
+        }
+    }
+    return [super resolveInstanceMethod:aSelector];
+}
+
 +(id)backgroundProxyForTarget:(id)target;
 {
-    CWInvocationProxy* proxy = [[[self alloc] init] autorelease];
+    CWInvocationProxy* proxy = [[[self allocForTarget:target] init] autorelease];
     proxy->_target = [target retain];
     proxy->_type = CWInvocationProxyTypeBackgound;
     return proxy;
@@ -120,7 +377,7 @@ typedef enum {
 
 +(id)threadProxyForTarget:(id)target onThread:(NSThread*)thread;
 {
-    CWInvocationProxy* proxy = [[[self alloc] init] autorelease];
+    CWInvocationProxy* proxy = [[[self allocForTarget:target] init] autorelease];
     proxy->_target = [target retain];
     proxy->_type = CWInvocationProxyTypeThread;
     proxy->_thread = [thread retain];
@@ -129,7 +386,7 @@ typedef enum {
 
 +(id)queueProxyForTarget:(id)target onQueue:(NSOperationQueue*)queue;
 {
-    CWInvocationProxy* proxy = [[[self alloc] init] autorelease];
+    CWInvocationProxy* proxy = [[[self allocForTarget:target] init] autorelease];
     proxy->_target = [target retain];
     proxy->_type = CWInvocationProxyTypeQueue;
     proxy->_queue = [queue retain];
@@ -150,6 +407,7 @@ typedef enum {
     [_target release];
     [_thread release];
     [_queue release];
+    [_future release];
     [super dealloc];
 }
 
@@ -161,7 +419,8 @@ typedef enum {
 -(NSMethodSignature*)methodSignatureForSelector:(SEL)aSelector;
 {
 	if ([_target respondsToSelector:aSelector]) {
-	    return [_target methodSignatureForSelector:aSelector];
+    	NSMethodSignature* signature = cw_MethodSignature(object_getClass(_target), aSelector);
+	    return signature ? signature : [_target methodSignatureForSelector:aSelector];
     } else {
     	return [super methodSignatureForSelector:aSelector];
     }
@@ -181,36 +440,111 @@ typedef enum {
     [invocation invoke];
 }
 
+-(void)performInvocationWithFuture:(NSArray*)invocationAndFuture;
+{
+	NSInvocation* invocation = [invocationAndFuture objectAtIndex:0];
+    [self prepareInvocationForInvokingInNewContext:invocation];
+    [[invocationAndFuture objectAtIndex:1] finishWithInvocation:invocation];
+}
+
 -(void)forwardInvocation:(NSInvocation *)invocation;
 {
-    if (_delay >= 0) {
-    	[self performSelector:@selector(forwardInvocation:) 
-                   withObject:invocation
-                   afterDelay:_delay];
-        _delay = -1;
-        return;
-    }
     [invocation setTarget:_target];
     [self prepareInvocationForForwardingToNewContext:invocation];
+    SEL performSelector = @selector(performInvocation:);
+    id performObject = invocation;
+    if (_future) {
+    	performSelector = @selector(performInvocationWithFuture:);
+        performObject = [NSArray arrayWithObjects:invocation, _future, nil];
+        [_future autorelease];
+        _future = nil;
+    }
+    if (_delay >= 0) {
+    	[invocation retainArguments];
+        SEL delayedSelector = @selector(performSelectorInContext:withObject:);
+        NSInvocation* delayedInvocation = [NSInvocation invocationWithMethodSignature:
+                                           [CWInvocationProxy instanceMethodSignatureForSelector:delayedSelector]];
+        [delayedInvocation setTarget:self];
+        [delayedInvocation setSelector:delayedSelector];
+        [delayedInvocation setArgument:&performSelector atIndex:2];
+        [delayedInvocation setArgument:&performObject atIndex:3];
+        [delayedInvocation retainArguments];
+        [delayedInvocation invokeAfterDelay:_delay];
+    } else {
+	    [self performSelectorInContext:performSelector withObject:performObject];
+    }
+}
+
+-(void)performRecord:(CWInvocationRecord*)record;
+{
+	[record invoke];
+}
+
+-(SEL)instrumentedSelectorForSelector:(SEL)aSelector withObject:(id)object;
+{
+	if (aSelector == @selector(performInvocationWithFuture:)) {
+    	object = [object objectAtIndex:0];
+    } else if (aSelector != @selector(performRecord:) && aSelector != @selector(performInvocation:)) {
+    	return aSelector;
+    }
+    return [object selector];
+}
+
+/*
+ * Futures and delays are rare, and handled by the full invocation path.
+ */
+-(void)forwardSelector:(SEL)aSelector arguments:(intptr_t*)arguments;
+{
+	NSMethodSignature* signature = cw_MethodSignature(object_getClass(_target), aSelector);
+    if (_future || _delay >= 0) {
+    	NSInvocation* invocation = [NSInvocation invocationWithMethodSignature:signature];
+        [invocation setSelector:aSelector];
+        NSUInteger count = [signature numberOfArguments] - 2;
+        for (NSUInteger index = 0; index < count; index++) {
+        	char type = cw_FastArgumentType([signature getArgumentTypeAtIndex:index + 2]);
+            intptr_t argument = cw_NormalizedArgument(type, arguments[index]);
+            // Low order bytes first on all supported architectures.
+            [invocation setArgument:&argument atIndex:index + 2];
+        }
+        [invocation retainArguments];
+        [self forwardInvocation:invocation];
+    } else {
+    	CWInvocationRecord* record = [[CWInvocationRecord alloc] initWithTarget:_target
+                                                                       selector:aSelector
+                                                                      signature:signature
+                                                                      arguments:arguments];
+        [self performSelectorInContext:@selector(performRecord:) withObject:record];
+        [record release];
+    }
+}
+
+-(void)performSelectorInContext:(SEL)performSelector withObject:(id)performObject;
+{
 	switch (_type) {
         case CWInvocationProxyTypeBackgound:
-            [self performSelectorInBackground:@selector(performInvocation:)
-                                   withObject:invocation];
+            [[CWThreadPool sharedPool] performSelector:performSelector
+                                              onTarget:self
+                                            withObject:performObject];
             break;
         case CWInvocationProxyTypeThread:
             if ([NSThread currentThread] == _thread) {
-                [self performInvocation:invocation];
+                [self performSelector:performSelector withObject:performObject];
+            } else if (_thread == [NSThread mainThread]) {
+            	[[CWMainThreadDispatcher sharedDispatcher] performSelector:performSelector
+                                                                  onTarget:self
+                                                                withObject:performObject
+                                                             waitUntilDone:_wait];
             } else {
-                [self performSelector:@selector(performInvocation:)
+                [self performSelector:performSelector
                              onThread:_thread
-                           withObject:invocation
+                           withObject:performObject
                         waitUntilDone:_wait];
             }
             break;
         case CWInvocationProxyTypeQueue: {
-            [self performSelector:@selector(performInvocation:)
+            [self performSelector:performSelector
                           onQueue:_queue
-                       withObject:invocation
+                       withObject:performObject
                      dependencies:nil
                          priority:NSOperationQueuePriorityNormal
                     waitUntilDone:_wait];
@@ -225,12 +559,92 @@ typedef enum {
     return self;
 }
 
+-(CWInvocationProxy*)proxyCopy;
+{
+	CWInvocationProxy* proxy = [[[[self class] alloc] init] autorelease];
+    proxy->_target = [_target retain];
+    proxy->_type = _type;
+    proxy->_thread = [_thread retain];
+    proxy->_queue = [_queue retain];
+    proxy->_wait = _wait;
+    proxy->_delay = _delay;
+    proxy->_future = _future;
+    _future = nil;
+    return proxy;
+}
+
+/*
+ * A copy, so that delaying calls never changes a proxy shared between threads.
+ */
 -(id)afterDelay:(NSTimeInterval)delay;
 {
-    _delay = delay;
+	CWInvocationProxy* proxy = [self proxyCopy];
+    proxy->_delay = delay;
+    return proxy;
+}
+
+-(id)future:(CWFuture**)future;
+{
+	[_future release];
+    _future = [[CWFuture alloc] init];
+    if (future) {
+    	*future = _future;
+    }
     return self;
 }
 
 @end
 
 
+@implementation CWInvocationRecord
+
+-(id)initWithTarget:(id)target selector:(SEL)aSelector signature:(NSMethodSignature*)signature arguments:(intptr_t*)arguments;
+{
+	self = [super init];
+    if (self) {
+    	_target = [target retain];
+        _selector = aSelector;
+        _count = [signature numberOfArguments] - 2;
+        for (NSUInteger index = 0; index < _count; index++) {
+        	_types[index] = cw_FastArgumentType([signature getArgumentTypeAtIndex:index + 2]);
+            _arguments[index] = cw_NormalizedArgument(_types[index], arguments[index]);
+            if (_types[index] == '@') {
+            	[(id)_arguments[index] retain];
+            }
+        }
+    }
+    return self;
+}
+
+-(void)dealloc;
+{
+	for (NSUInteger index = 0; index < _count; index++) {
+    	if (_types[index] == '@') {
+        	[(id)_arguments[index] release];
+        }
+    }
+    [_target release];
+    [super dealloc];
+}
+
+-(SEL)selector;
+{
+	return _selector;
+}
+
+-(void)invoke;
+{
+	switch (_count) {
+        case 0:
+        	((void(*)(id, SEL))objc_msgSend)(_target, _selector);
+            break;
+        case 1:
+        	((void(*)(id, SEL, intptr_t))objc_msgSend)(_target, _selector, _arguments[0]);
+            break;
+        case 2:
+        	((void(*)(id, SEL, intptr_t, intptr_t))objc_msgSend)(_target, _selector, _arguments[0], _arguments[1]);
+            break;
+    }
+}
+
+@end
@@ -0,0 +1,112 @@
+//
+//  NSOperationQueue+CWBoundedQueue.h
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+
+/*!
+ * @abstract Error code in CWFoundationAdditionsErrorDomain for operations
+ *           rejected by a full bounded queue.
+ */
+enum {
+	CWOperationQueueFullError = 1
+};
+
+/*!
+ * @abstract What a bounded queue does when adding an operation to a full queue.
+ *
+ * @constant CWQueueOverflowPolicyBlock Block the producer until there is room.
+ * @constant CWQueueOverflowPolicyReject Reject the new operation with an error.
+ * @constant CWQueueOverflowPolicyDropOldest Cancel the oldest operations not yet
+ *           executing, or reject if all are executing. An operation that
+ *           starts while being dropped is not stopped, but still counted as
+ *           dropped.
+ */
+typedef enum {
+	CWQueueOverflowPolicyBlock,
+    CWQueueOverflowPolicyReject,
+    CWQueueOverflowPolicyDropOldest
+} CWQueueOverflowPolicy;
+
+/*!
+ * @abstract Counters for how often producers of a bounded queue are throttled.
+ * @discussion blockedTime is measured with a monotonic clock.
+ */
+typedef struct {
+	NSUInteger blockedCount;
+    NSTimeInterval blockedTime;
+    NSUInteger rejectedCount;
+    NSUInteger droppedCount;
+} CWBoundedQueueMetrics;
+
+
+/*!
+ * @abstract Category on NSOperationQueue limiting the number or total weight of
+ *           pending operations.
+ *
+ * @discussion Pending operations are operations added with
+ *             addOperation:weight:error: that have not finished. Plain
+ *             addOperation: is never bounded or instrumented,
+ *             performSelector:onQueue:, addOperation:coalescingKey: and queue
+ *             proxies add operations with a weight of 1.
+ *
+ *             A producer blocked by an operation of the same queue dead locks,
+ *             use the reject or drop oldest policy if operations add operations
+ *             to their own queue.
+ */
+@interface NSOperationQueue (CWBoundedQueue)
+
+/*!
+ * @abstract Bound the queue, 0 for no limit.
+ * @discussion An operation heavier than the weight limit is only added to an
+ *             empty queue.
+ */
+-(void)setMaximumPendingOperationCount:(NSUInteger)count
+                  maximumPendingWeight:(NSUInteger)weight
+                        overflowPolicy:(CWQueueOverflowPolicy)policy;
+
+-(NSUInteger)maximumPendingOperationCount;
+-(NSUInteger)maximumPendingWeight;
+-(CWQueueOverflowPolicy)overflowPolicy;
+
+-(NSUInteger)pendingOperationCount;
+-(NSUInteger)pendingWeight;
+
+-(CWBoundedQueueMetrics)boundedQueueMetrics;
+-(void)resetBoundedQueueMetrics;
+
+/*!
+ * @abstract Add an operation with a weight, such as its size in bytes,
+ *           applying the overflow policy if the queue is full.
+ *
+ * @result NO if rejected, with a CWOperationQueueFullError.
+ */
+-(BOOL)addOperation:(NSOperation*)operation weight:(NSUInteger)weight error:(NSError**)error;
+
+@end
@@ -0,0 +1,371 @@
+//
+//  NSOperationQueue+CWBoundedQueue.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "NSOperationQueue+CWBoundedQueue.h"
+#import "NSObject+CWAssociatedObject.h"
+#import "NSError+CWAdditions.h"
+#import "NSOperationQueue+CWInstrumentation.h"
+#import <pthread.h>
+#import "CWAtomic.h"
+
+/*
+ * Pending operations are linked from the oldest to the newest, and found by
+ * operation in a hash table, so that finished operations are unlinked in
+ * constant time. Operations are not retained, the queue retains them until
+ * finished.
+ */
+typedef struct CWPendingOperation {
+	NSOperation* operation;
+    NSUInteger weight;
+    struct CWPendingOperation* newer;
+    struct CWPendingOperation* older;
+} CWPendingOperation;
+
+/*
+ * Limits and pending operations of one bounded queue. Operations are removed
+ * when finished or dropped, the state is retained while observing.
+ */
+@interface CWBoundedQueueState : NSObject {
+@private
+	pthread_mutex_t _lock;
+    pthread_cond_t _condition;
+    NSUInteger _maximumCount;
+    NSUInteger _maximumWeight;
+    CWQueueOverflowPolicy _policy;
+    CFMutableDictionaryRef _entries;
+    CWPendingOperation* _oldestEntry;
+    CWPendingOperation* _newestEntry;
+    NSUInteger _count;
+    NSUInteger _weight;
+    CWBoundedQueueMetrics _metrics;
+}
+
+-(void)setMaximumCount:(NSUInteger)count maximumWeight:(NSUInteger)weight policy:(CWQueueOverflowPolicy)policy;
+-(NSUInteger)maximumCount;
+-(NSUInteger)maximumWeight;
+-(CWQueueOverflowPolicy)policy;
+-(NSUInteger)count;
+-(NSUInteger)weight;
+-(CWBoundedQueueMetrics)metrics;
+-(void)resetMetrics;
+-(BOOL)admitOperation:(NSOperation*)operation weight:(NSUInteger)weight error:(NSError**)error;
+
+@end
+
+
+@implementation NSOperationQueue (CWBoundedQueue)
+
+static char CWBoundedQueueStateKey;
+static pthread_mutex_t CWBoundedQueueStateLock = PTHREAD_MUTEX_INITIALIZER;
+
+static CWBoundedQueueState* CWBoundedQueueStateForQueue(NSOperationQueue* queue, BOOL create)
+{
+	CWBoundedQueueState* state = [queue associatedObjectForStaticKey:&CWBoundedQueueStateKey];
+    if (state == nil && create) {
+        pthread_mutex_lock(&CWBoundedQueueStateLock);
+        state = [queue associatedObjectForStaticKey:&CWBoundedQueueStateKey];
+        if (state == nil) {
+            state = [[[CWBoundedQueueState alloc] init] autorelease];
+            [queue setAssociatedObject:state forStaticKey:&CWBoundedQueueStateKey];
+        }
+        pthread_mutex_unlock(&CWBoundedQueueStateLock);
+    }
+    return state;
+}
+
+-(void)setMaximumPendingOperationCount:(NSUInteger)count
+                  maximumPendingWeight:(NSUInteger)weight
+                        overflowPolicy:(CWQueueOverflowPolicy)policy;
+{
+	[CWBoundedQueueStateForQueue(self, YES) setMaximumCount:count maximumWeight:weight policy:policy];
+}
+
+-(NSUInteger)maximumPendingOperationCount;
+{
+	return [CWBoundedQueueStateForQueue(self, NO) maximumCount];
+}
+
+-(NSUInteger)maximumPendingWeight;
+{
+	return [CWBoundedQueueStateForQueue(self, NO) maximumWeight];
+}
+
+-(CWQueueOverflowPolicy)overflowPolicy;
+{
+	return [CWBoundedQueueStateForQueue(self, NO) policy];
+}
+
+-(NSUInteger)pendingOperationCount;
+{
+	return [CWBoundedQueueStateForQueue(self, NO) count];
+}
+
+-(NSUInteger)pendingWeight;
+{
+	return [CWBoundedQueueStateForQueue(self, NO) weight];
+}
+
+-(CWBoundedQueueMetrics)boundedQueueMetrics;
+{
+	CWBoundedQueueState* state = CWBoundedQueueStateForQueue(self, NO);
+    if (state) {
+    	return [state metrics];
+    } else {
+    	CWBoundedQueueMetrics metrics = {0};
+        return metrics;
+    }
+}
+
+-(void)resetBoundedQueueMetrics;
+{
+	[CWBoundedQueueStateForQueue(self, NO) resetMetrics];
+}
+
+-(BOOL)addOperation:(NSOperation*)operation weight:(NSUInteger)weight error:(NSError**)error;
+{
+	CWBoundedQueueState* state = CWBoundedQueueStateForQueue(self, NO);
+    if (state && ![state admitOperation:operation weight:weight error:error]) {
+    	return NO;
+    }
+    [self instrumentOperation:operation];
+    [self addOperation:operation];
+    return YES;
+}
+
+@end
+
+
+@implementation CWBoundedQueueState
+
+static char CWBoundedQueueObservingContext;
+
+/*
+ * Seconds of a monotonic clock, so that blocked time is not skewed by changes
+ * to the wall clock.
+ */
+static NSTimeInterval CWCurrentTime(void)
+{
+	return CWMonotonicMicroseconds() / 1000000.0;
+}
+
+-(id)init;
+{
+	self = [super init];
+    if (self) {
+    	pthread_mutex_init(&_lock, NULL);
+        pthread_cond_init(&_condition, NULL);
+        _entries = CFDictionaryCreateMutable(NULL, 0, NULL, NULL);
+    }
+    return self;
+}
+
+-(void)dealloc;
+{
+	CWPendingOperation* entry = _oldestEntry;
+    while (entry) {
+    	CWPendingOperation* newer = entry->newer;
+        free(entry);
+        entry = newer;
+    }
+	CFRelease(_entries);
+    pthread_cond_destroy(&_condition);
+	pthread_mutex_destroy(&_lock);
+    [super dealloc];
+}
+
+-(void)setMaximumCount:(NSUInteger)count maximumWeight:(NSUInteger)weight policy:(CWQueueOverflowPolicy)policy;
+{
+	pthread_mutex_lock(&_lock);
+    _maximumCount = count;
+    _maximumWeight = weight;
+    _policy = policy;
+    pthread_cond_broadcast(&_condition);
+    pthread_mutex_unlock(&_lock);
+}
+
+#define CW_LOCKED_GETTER(type, name, value) \
+-(type)name; \
+{ \
+	pthread_mutex_lock(&_lock); \
+    type result = value; \
+    pthread_mutex_unlock(&_lock); \
+    return result; \
+}
+
+CW_LOCKED_GETTER(NSUInteger, maximumCount, _maximumCount)
+CW_LOCKED_GETTER(NSUInteger, maximumWeight, _maximumWeight)
+CW_LOCKED_GETTER(CWQueueOverflowPolicy, policy, _policy)
+CW_LOCKED_GETTER(NSUInteger, count, _count)
+CW_LOCKED_GETTER(NSUInteger, weight, _weight)
+CW_LOCKED_GETTER(CWBoundedQueueMetrics, metrics, _metrics)
+
+#undef CW_LOCKED_GETTER
+
+-(void)resetMetrics;
+{
+	pthread_mutex_lock(&_lock);
+    memset(&_metrics, 0, sizeof(_metrics));
+    pthread_mutex_unlock(&_lock);
+}
+
+/*
+ * Must be called with the lock held.
+ */
+-(BOOL)hasRoomForWeight:(NSUInteger)weight;
+{
+    if (_count == 0) {
+    	return YES;
+    }
+    return (_maximumCount == 0 || _count < _maximumCount) &&
+    	(_maximumWeight == 0 || _weight + weight <= _maximumWeight);
+}
+
+/*
+ * Must be called with the lock held.
+ */
+-(void)addEntryForOperation:(NSOperation*)operation weight:(NSUInteger)weight;
+{
+	CWPendingOperation* entry = malloc(sizeof(CWPendingOperation));
+    entry->operation = operation;
+    entry->weight = weight;
+    entry->newer = NULL;
+    entry->older = _newestEntry;
+    if (_newestEntry) {
+    	_newestEntry->newer = entry;
+    } else {
+    	_oldestEntry = entry;
+    }
+    _newestEntry = entry;
+    CFDictionarySetValue(_entries, operation, entry);
+    _count++;
+    _weight += weight;
+}
+
+/*
+ * Must be called with the lock held.
+ */
+-(void)removeEntry:(CWPendingOperation*)entry;
+{
+	if (entry->newer) {
+    	entry->newer->older = entry->older;
+    } else {
+    	_newestEntry = entry->older;
+    }
+    if (entry->older) {
+    	entry->older->newer = entry->newer;
+    } else {
+    	_oldestEntry = entry->newer;
+    }
+    CFDictionaryRemoveValue(_entries, entry->operation);
+    _count--;
+    _weight -= entry->weight;
+    free(entry);
+    pthread_cond_broadcast(&_condition);
+}
+
+-(BOOL)admitOperation:(NSOperation*)operation weight:(NSUInteger)weight error:(NSError**)error;
+{
+	NSMutableArray* droppedOperations = nil;
+    BOOL rejected = NO;
+	pthread_mutex_lock(&_lock);
+    if (![self hasRoomForWeight:weight]) {
+    	switch (_policy) {
+            case CWQueueOverflowPolicyBlock: {
+            	_metrics.blockedCount++;
+                NSTimeInterval start = CWCurrentTime();
+                while (![self hasRoomForWeight:weight]) {
+                	pthread_cond_wait(&_condition, &_lock);
+                }
+                _metrics.blockedTime += CWCurrentTime() - start;
+                break;
+            }
+            case CWQueueOverflowPolicyDropOldest: {
+            	// Cancelled once unlocked, since cancelling sends KVO
+                // notifications that take the lock. An operation starting in
+                // between is still counted as dropped, and runs.
+            	droppedOperations = [NSMutableArray array];
+                CWPendingOperation* entry = _oldestEntry;
+                while (![self hasRoomForWeight:weight] && entry) {
+                	CWPendingOperation* newer = entry->newer;
+                    if (![entry->operation isExecuting]) {
+                    	[droppedOperations addObject:entry->operation];
+                        [self removeEntry:entry];
+                        _metrics.droppedCount++;
+                    }
+                    entry = newer;
+                }
+                rejected = ![self hasRoomForWeight:weight];
+                break;
+            }
+            default:
+            	rejected = YES;
+                break;
+        }
+    }
+    if (rejected) {
+    	_metrics.rejectedCount++;
+    } else {
+    	[self addEntryForOperation:operation weight:weight];
+    }
+    pthread_mutex_unlock(&_lock);
+    [droppedOperations makeObjectsPerformSelector:@selector(cancel)];
+    if (rejected) {
+    	if (error) {
+        	*error = [NSError errorWithDomain:CWFoundationAdditionsErrorDomain
+                                         code:CWOperationQueueFullError
+                         localizedDescription:NSLocalizedString(@"Could not add operation", nil)
+                              localizedReason:NSLocalizedString(@"The operation queue is full.", nil)];
+        }
+        return NO;
+    }
+    [self retain];
+    [operation addObserver:self forKeyPath:@"isFinished" options:0 context:&CWBoundedQueueObservingContext];
+    return YES;
+}
+
+-(void)observeValueForKeyPath:(NSString*)keyPath ofObject:(id)object change:(NSDictionary*)change context:(void*)context;
+{
+	if (context != &CWBoundedQueueObservingContext) {
+    	[super observeValueForKeyPath:keyPath ofObject:object change:change context:context];
+        return;
+    }
+    if ([object isFinished]) {
+    	[object removeObserver:self forKeyPath:@"isFinished"];
+        pthread_mutex_lock(&_lock);
+        CWPendingOperation* entry = (CWPendingOperation*)CFDictionaryGetValue(_entries, object);
+        if (entry) {
+        	[self removeEntry:entry];
+        }
+        pthread_mutex_unlock(&_lock);
+        [self release];
+    }
+}
+
+@end
@@ -30,6 +30,8 @@
 
 #import <Foundation/Foundation.h>
 
+@class CWFuture;
+
 /*!
  * @abstract Category on NSOperationQueue to add support for a default queue.
  */
@@ -54,6 +56,8 @@
 
 /**
  * Cancel all queued and executing operations of a class.
+ * Scans all operations in the queue, use a CWCancellationGroup to cancel a
+ * subset of many queued operations.
  *
  * @param aClass the operation subclass to cancel.
  */
@@ -89,7 +93,8 @@
  * @param arg The argument to pass to the method when it is invoked. 
  *            Pass nil if the method does not take an argument.
  * @result an autoreleased NSInvocationOperation instance.
- *			   Can be used to setup dependencies.
+ *			   Can be used to setup dependencies. Nil if rejected by a bounded
+ *             queue, see NSOperationQueue+CWBoundedQueue.
  */
 -(NSInvocationOperation*)performSelector:(SEL)aSelector onQueue:(NSOperationQueue*)queue withObject:(id)arg;
 
@@ -109,4 +114,23 @@
  */
 -(NSInvocationOperation*)performSelector:(SEL)aSelector onQueue:(NSOperationQueue*)queue withObject:(id)arg dependencies:(NSArray*)dependencies priority:(NSOperationQueuePriority)priority waitUntilDone:(BOOL)wait;
 
+/*!
+ * Invokes a method of the receiver on the default queue, and returns a future
+ * for the return value.
+ *
+ * @param aSelector A selector that identifies the method to invoke. 
+ *									The method should take a single argument of type id,
+ *									or no arguments.
+ * @param arg The argument to pass to the method when it is invoked. 
+ *            Pass nil if the method does not take an argument.
+ * @result a CWFuture for the return value of the method.
+ */
+-(CWFuture*)futureByPerformingSelectorInDefaultQueue:(SEL)aSelector withObject:(id)arg;
+
+/*!
+ * Invokes a method of the receiver on a specific queue, and returns a future
+ * for the return value. The future is cancelled if rejected by a bounded queue.
+ */
+-(CWFuture*)futureByPerformingSelector:(SEL)aSelector onQueue:(NSOperationQueue*)queue withObject:(id)arg;
+
 @end
@@ -29,6 +29,8 @@
 //
 
 #import "NSOperationQueue+CWDefaultQueue.h"
+#import "CWFuture.h"
+#import "NSOperationQueue+CWBoundedQueue.h"
 
 
 @implementation NSOperationQueue (CWDefaultQueue)
@@ -74,30 +76,44 @@ static NSOperationQueue* cw_defaultQueue = nil;
 
 -(NSInvocationOperation*)performSelector:(SEL)aSelector onQueue:(NSOperationQueue*)queue withObject:(id)arg;
 {
-	NSInvocationOperation* operation = [[NSInvocationOperation alloc] initWithTarget:self selector:aSelector object:arg];
-    [queue addOperation:operation];
-	return [operation autorelease];  
+	NSInvocationOperation* operation = [[[NSInvocationOperation alloc] initWithTarget:self selector:aSelector object:arg] autorelease];
+    if (![queue addOperation:operation weight:1 error:NULL]) {
+    	return nil;
+    }
+	return operation;  
 }
 
 -(NSInvocationOperation*)performSelector:(SEL)aSelector onQueue:(NSOperationQueue*)queue withObject:(id)arg dependencies:(NSArray*)dependencies priority:(NSOperationQueuePriority)priority waitUntilDone:(BOOL)wait;
 {
-	NSInvocationOperation* operation = [[NSInvocationOperation alloc] initWithTarget:self selector:aSelector object:arg];
+	CWFutureOperation* operation = [[CWFutureOperation alloc] initWithTarget:self selector:aSelector object:arg];
     [operation setQueuePriority:priority];
     for (NSOperation* dependency in dependencies) {
         [operation addDependency:dependency]; 
     }
-    [[NSOperationQueue defaultQueue] addOperation:operation];
+    [operation autorelease];
+    if (![queue addOperation:operation weight:1 error:NULL]) {
+    	return nil;
+    }
     if (wait) {
-        if ([operation respondsToSelector:@selector(waitUntilFinished)]) {
-		    [operation performSelector:@selector(waitUntilFinished)];
-        } else {
-			while ([[queue operations] containsObject:operation]) {
-            	[[NSRunLoop currentRunLoop] runMode:NSRunLoopCommonModes
-                                         beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
-            }
-        }
+    	[[operation future] waitUntilFinished];
+    }
+	return operation;  
+}
+
+-(CWFuture*)futureByPerformingSelectorInDefaultQueue:(SEL)aSelector withObject:(id)arg;
+{
+	return [self futureByPerformingSelector:aSelector
+                                    onQueue:[NSOperationQueue defaultQueue]
+                                 withObject:arg];
+}
+
+-(CWFuture*)futureByPerformingSelector:(SEL)aSelector onQueue:(NSOperationQueue*)queue withObject:(id)arg;
+{
+	CWFutureOperation* operation = [[[CWFutureOperation alloc] initWithTarget:self selector:aSelector object:arg] autorelease];
+    if (![queue addOperation:operation weight:1 error:NULL]) {
+    	[operation cancel];
     }
-	return [operation autorelease];  
+    return [operation future];
 }
 
 @end
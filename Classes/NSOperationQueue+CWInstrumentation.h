@@ -0,0 +1,126 @@
+//
+//  NSOperationQueue+CWInstrumentation.h
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import "CWHistogram.h"
+
+/*!
+ * @abstract A snapshot of the statistics of an instrumented operation queue.
+ *
+ * @discussion Wait time is from adding an operation until it starts executing,
+ *             run time from start until finished, both in microseconds.
+ *             Depth is the number of added operations not yet finished.
+ */
+@interface CWQueueStatistics : NSObject {
+@private
+	CWHistogram* _waitTime;
+    CWHistogram* _runTime;
+    NSUInteger _currentDepth;
+    NSUInteger _peakDepth;
+    NSDictionary* _selectorStatistics;
+}
+
+@property(nonatomic, readonly, retain) CWHistogram* waitTime;
+@property(nonatomic, readonly, retain) CWHistogram* runTime;
+@property(nonatomic, readonly, assign) NSUInteger currentDepth;
+@property(nonatomic, readonly, assign) NSUInteger peakDepth;
+
+/*!
+ * @abstract Statistics keyed by selector name, or nil if the queue is not
+ *           instrumented per selector.
+ */
+@property(nonatomic, readonly, retain) NSDictionary* selectorStatistics;
+
+@end
+
+
+/*!
+ * @abstract Protocol for targets of invocation operations performing a
+ *           message on behalf of another, such as invocation proxies.
+ */
+@protocol CWInstrumentedOperationTarget
+
+/*!
+ * @abstract The selector to attribute statistics to, for an operation
+ *           performing aSelector with object on the receiver.
+ */
+-(SEL)instrumentedSelectorForSelector:(SEL)aSelector withObject:(id)object;
+
+@end
+
+
+/*!
+ * @abstract Category on NSOperationQueue for opt-in instrumentation of wait
+ *           time, run time and depth.
+ *
+ * @discussion Operations added with addOperation:weight:error:, and thus with
+ *             performSelector:onQueue: and queue proxies, are instrumented if
+ *             the queue is. Plain addOperation: is not instrumented.
+ *
+ *             Recording is lock free, except for looking up the selector of
+ *             each operation on a queue instrumented per selector. The
+ *             selector of a proxied call is the called selector, not the
+ *             selector used internally by the proxy.
+ */
+@interface NSOperationQueue (CWInstrumentation)
+
+-(BOOL)isInstrumented;
+-(BOOL)isInstrumentedPerSelector;
+
+/*!
+ * @abstract Enable or disable instrumentation, disabling discards statistics
+ *           and stops any periodic logging.
+ */
+-(void)setInstrumented:(BOOL)instrumented;
+-(void)setInstrumented:(BOOL)instrumented perSelector:(BOOL)perSelector;
+
+/*!
+ * @abstract A snapshot of the statistics, or nil if not instrumented.
+ */
+-(CWQueueStatistics*)statistics;
+
+/*!
+ * @abstract Reset histograms, and the peak depth to the current depth.
+ */
+-(void)resetStatistics;
+
+/*!
+ * @abstract Log statistics with NSLog periodically from the main run loop,
+ *           or stop with an interval of 0.
+ */
+-(void)logStatisticsWithInterval:(NSTimeInterval)interval;
+
+/*!
+ * @abstract Instrument an operation that is about to be added to the queue.
+ * @discussion Does nothing if the queue is not instrumented.
+ */
+-(void)instrumentOperation:(NSOperation*)operation;
+
+@end
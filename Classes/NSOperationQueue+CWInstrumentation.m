@@ -0,0 +1,419 @@
+//
+//  NSOperationQueue+CWInstrumentation.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "NSOperationQueue+CWInstrumentation.h"
+#import "NSObject+CWAssociatedObject.h"
+#import "CWAtomic.h"
+#import <objc/runtime.h>
+#import <pthread.h>
+
+/*
+ * Live statistics of an instrumented queue, or of one selector on a queue.
+ */
+@interface CWQueueInstrumentation : NSObject {
+@private
+	CWHistogram* _waitTime;
+    CWHistogram* _runTime;
+    volatile int32_t _depth;
+    volatile int32_t _peakDepth;
+    BOOL _perSelector;
+    pthread_mutex_t _lock;
+    NSMutableDictionary* _selectorInstrumentations;
+    CFRunLoopTimerRef _logTimer;
+}
+
+-(id)initWithPerSelector:(BOOL)perSelector;
+-(BOOL)isPerSelector;
+-(CWQueueInstrumentation*)instrumentationForSelector:(SEL)aSelector;
+-(void)operationWasAdded;
+-(void)operationDidFinishWithWaitTime:(uint64_t)waitTime runTime:(uint64_t)runTime;
+-(CWQueueStatistics*)statistics;
+-(void)reset;
+-(void)logWithInterval:(NSTimeInterval)interval name:(NSString*)name;
+
+@end
+
+
+/*
+ * Observes one operation from being added until finished, and is retained
+ * while observing.
+ */
+@interface CWOperationTiming : NSObject {
+@private
+	CWQueueInstrumentation* _instrumentation;
+    CWQueueInstrumentation* _selectorInstrumentation;
+    uint64_t _addTime;
+    uint64_t _startTime;
+}
+
+-(id)initWithOperation:(NSOperation*)operation
+       instrumentation:(CWQueueInstrumentation*)instrumentation
+selectorInstrumentation:(CWQueueInstrumentation*)selectorInstrumentation;
+
+@end
+
+
+@interface CWQueueStatistics ()
+
+-(id)initWithWaitTime:(CWHistogram*)waitTime
+              runTime:(CWHistogram*)runTime
+         currentDepth:(NSUInteger)currentDepth
+            peakDepth:(NSUInteger)peakDepth
+   selectorStatistics:(NSDictionary*)selectorStatistics;
+
+@end
+
+
+@implementation NSOperationQueue (CWInstrumentation)
+
+static char CWQueueInstrumentationKey;
+static pthread_mutex_t CWQueueInstrumentationLock = PTHREAD_MUTEX_INITIALIZER;
+
+-(BOOL)isInstrumented;
+{
+	return [self associatedObjectForStaticKey:&CWQueueInstrumentationKey] != nil;
+}
+
+-(BOOL)isInstrumentedPerSelector;
+{
+	return [[self associatedObjectForStaticKey:&CWQueueInstrumentationKey] isPerSelector];
+}
+
+-(void)setInstrumented:(BOOL)instrumented;
+{
+	[self setInstrumented:instrumented perSelector:NO];
+}
+
+-(void)setInstrumented:(BOOL)instrumented perSelector:(BOOL)perSelector;
+{
+	pthread_mutex_lock(&CWQueueInstrumentationLock);
+    CWQueueInstrumentation* instrumentation = [self associatedObjectForStaticKey:&CWQueueInstrumentationKey];
+    if (instrumentation == nil || !instrumented || [instrumentation isPerSelector] != perSelector) {
+    	[instrumentation logWithInterval:0 name:nil];
+        instrumentation = nil;
+        if (instrumented) {
+        	instrumentation = [[[CWQueueInstrumentation alloc] initWithPerSelector:perSelector] autorelease];
+        }
+        [self setAssociatedObject:instrumentation forStaticKey:&CWQueueInstrumentationKey];
+    }
+    pthread_mutex_unlock(&CWQueueInstrumentationLock);
+}
+
+-(CWQueueStatistics*)statistics;
+{
+	return [[self associatedObjectForStaticKey:&CWQueueInstrumentationKey] statistics];
+}
+
+-(void)resetStatistics;
+{
+	[[self associatedObjectForStaticKey:&CWQueueInstrumentationKey] reset];
+}
+
+-(void)logStatisticsWithInterval:(NSTimeInterval)interval;
+{
+	NSString* name = [self respondsToSelector:@selector(name)] ? [self name] : nil;
+    if (name == nil) {
+    	name = [NSString stringWithFormat:@"<%@ %p>", NSStringFromClass([self class]), self];
+    }
+	[[self associatedObjectForStaticKey:&CWQueueInstrumentationKey] logWithInterval:interval name:name];
+}
+
+/*
+ * Selector of the operation, as attributed by the invocation target if it
+ * performs the message on behalf of another.
+ */
+static SEL CWInstrumentedSelector(NSOperation* operation)
+{
+	if (![operation isKindOfClass:[NSInvocationOperation class]]) {
+    	return NULL;
+    }
+    NSInvocation* invocation = [(NSInvocationOperation*)operation invocation];
+    SEL selector = [invocation selector];
+    id target = [invocation target];
+    SEL hook = @selector(instrumentedSelectorForSelector:withObject:);
+    if (target && class_respondsToSelector(object_getClass(target), hook)) {
+    	id object = nil;
+        NSMethodSignature* signature = [invocation methodSignature];
+        if ([signature numberOfArguments] > 2 && *[signature getArgumentTypeAtIndex:2] == '@') {
+        	[invocation getArgument:&object atIndex:2];
+        }
+        selector = [(id<CWInstrumentedOperationTarget>)target instrumentedSelectorForSelector:selector withObject:object];
+    }
+    return selector;
+}
+
+-(void)instrumentOperation:(NSOperation*)operation;
+{
+	CWQueueInstrumentation* instrumentation = [self associatedObjectForStaticKey:&CWQueueInstrumentationKey];
+    if (instrumentation) {
+        CWQueueInstrumentation* selectorInstrumentation = nil;
+        if ([instrumentation isPerSelector]) {
+            SEL selector = CWInstrumentedSelector(operation);
+            if (selector) {
+            	selectorInstrumentation = [instrumentation instrumentationForSelector:selector];
+            }
+        }
+        [[[CWOperationTiming alloc] initWithOperation:operation
+                                      instrumentation:instrumentation
+                              selectorInstrumentation:selectorInstrumentation] release];
+    }
+}
+
+@end
+
+
+@implementation CWQueueInstrumentation
+
+-(id)initWithPerSelector:(BOOL)perSelector;
+{
+	self = [super init];
+    if (self) {
+    	_waitTime = [[CWHistogram alloc] init];
+        _runTime = [[CWHistogram alloc] init];
+        _perSelector = perSelector;
+        pthread_mutex_init(&_lock, NULL);
+        if (perSelector) {
+        	_selectorInstrumentations = [[NSMutableDictionary alloc] init];
+        }
+    }
+    return self;
+}
+
+-(void)dealloc;
+{
+	[_selectorInstrumentations release];
+    pthread_mutex_destroy(&_lock);
+    [_runTime release];
+    [_waitTime release];
+    [super dealloc];
+}
+
+-(BOOL)isPerSelector;
+{
+	return _perSelector;
+}
+
+-(CWQueueInstrumentation*)instrumentationForSelector:(SEL)aSelector;
+{
+	NSString* key = NSStringFromSelector(aSelector);
+	pthread_mutex_lock(&_lock);
+    CWQueueInstrumentation* instrumentation = [_selectorInstrumentations objectForKey:key];
+    if (instrumentation == nil) {
+    	instrumentation = [[CWQueueInstrumentation alloc] initWithPerSelector:NO];
+        [_selectorInstrumentations setObject:instrumentation forKey:key];
+        [instrumentation release];
+    }
+    pthread_mutex_unlock(&_lock);
+    return instrumentation;
+}
+
+-(void)operationWasAdded;
+{
+	int32_t depth = CWAtomicIncrement32(&_depth);
+    int32_t peakDepth;
+    do {
+    	peakDepth = _peakDepth;
+    } while (peakDepth < depth && !CWAtomicCompareAndSwap32(peakDepth, depth, &_peakDepth));
+}
+
+-(void)operationDidFinishWithWaitTime:(uint64_t)waitTime runTime:(uint64_t)runTime;
+{
+	[_waitTime recordValue:waitTime];
+    [_runTime recordValue:runTime];
+    CWAtomicDecrement32(&_depth);
+}
+
+-(CWQueueStatistics*)statistics;
+{
+	NSMutableDictionary* selectorStatistics = nil;
+    if (_perSelector) {
+    	selectorStatistics = [NSMutableDictionary dictionary];
+        pthread_mutex_lock(&_lock);
+        for (NSString* key in _selectorInstrumentations) {
+        	[selectorStatistics setObject:[[_selectorInstrumentations objectForKey:key] statistics] forKey:key];
+        }
+        pthread_mutex_unlock(&_lock);
+    }
+    CWHistogram* waitTime = [_waitTime copy];
+    CWHistogram* runTime = [_runTime copy];
+    CWQueueStatistics* statistics = [[CWQueueStatistics alloc] initWithWaitTime:waitTime
+                                                                        runTime:runTime
+                                                                   currentDepth:MAX(_depth, 0)
+                                                                      peakDepth:MAX(_peakDepth, 0)
+                                                             selectorStatistics:selectorStatistics];
+    [runTime release];
+    [waitTime release];
+    return [statistics autorelease];
+}
+
+-(void)reset;
+{
+	[_waitTime reset];
+    [_runTime reset];
+    _peakDepth = _depth;
+    CWMemoryBarrier();
+    pthread_mutex_lock(&_lock);
+    [[_selectorInstrumentations allValues] makeObjectsPerformSelector:@selector(reset)];
+    pthread_mutex_unlock(&_lock);
+}
+
+static void CWLogTimerCallBack(CFRunLoopTimerRef timer, void* info)
+{
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    NSArray* instrumentationAndName = (NSArray*)info;
+    NSLog(@"%@: %@", [instrumentationAndName objectAtIndex:1], [[instrumentationAndName objectAtIndex:0] statistics]);
+    [pool release];
+}
+
+/*
+ * The timer retains the instrumentation until stopped.
+ */
+-(void)logWithInterval:(NSTimeInterval)interval name:(NSString*)name;
+{
+	pthread_mutex_lock(&_lock);
+    if (_logTimer) {
+    	CFRunLoopTimerInvalidate(_logTimer);
+        CFRelease(_logTimer);
+        _logTimer = NULL;
+    }
+    if (interval > 0) {
+    	NSArray* instrumentationAndName = [NSArray arrayWithObjects:self, name, nil];
+    	CFRunLoopTimerContext context = {0, instrumentationAndName, CFRetain, CFRelease, NULL};
+        _logTimer = CFRunLoopTimerCreate(NULL, CFAbsoluteTimeGetCurrent() + interval, interval, 0, 0,
+                                         &CWLogTimerCallBack, &context);
+        CFRunLoopAddTimer(CFRunLoopGetMain(), _logTimer, kCFRunLoopCommonModes);
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+@end
+
+
+@implementation CWOperationTiming
+
+static char CWOperationTimingObservingContext;
+
+-(id)initWithOperation:(NSOperation*)operation
+       instrumentation:(CWQueueInstrumentation*)instrumentation
+selectorInstrumentation:(CWQueueInstrumentation*)selectorInstrumentation;
+{
+	self = [super init];
+    if (self) {
+    	_instrumentation = [instrumentation retain];
+        _selectorInstrumentation = [selectorInstrumentation retain];
+        [_instrumentation operationWasAdded];
+        [_selectorInstrumentation operationWasAdded];
+        _addTime = CWMonotonicMicroseconds();
+        [self retain];
+        [operation addObserver:self forKeyPath:@"isExecuting" options:0 context:&CWOperationTimingObservingContext];
+        [operation addObserver:self forKeyPath:@"isFinished" options:0 context:&CWOperationTimingObservingContext];
+    }
+    return self;
+}
+
+-(void)dealloc;
+{
+	[_selectorInstrumentation release];
+    [_instrumentation release];
+    [super dealloc];
+}
+
+/*
+ * An operation cancelled before starting never executes, and only has a wait time.
+ */
+-(void)observeValueForKeyPath:(NSString*)keyPath ofObject:(id)object change:(NSDictionary*)change context:(void*)context;
+{
+	if (context != &CWOperationTimingObservingContext) {
+    	[super observeValueForKeyPath:keyPath ofObject:object change:change context:context];
+        return;
+    }
+    if (_startTime == 0 && [object isExecuting]) {
+    	_startTime = CWMonotonicMicroseconds();
+    } else if ([object isFinished]) {
+    	[object removeObserver:self forKeyPath:@"isExecuting"];
+    	[object removeObserver:self forKeyPath:@"isFinished"];
+        uint64_t finishTime = CWMonotonicMicroseconds();
+        if (_startTime == 0) {
+        	_startTime = finishTime;
+        }
+        [_instrumentation operationDidFinishWithWaitTime:_startTime - _addTime runTime:finishTime - _startTime];
+        [_selectorInstrumentation operationDidFinishWithWaitTime:_startTime - _addTime runTime:finishTime - _startTime];
+        [self release];
+    }
+}
+
+@end
+
+
+@implementation CWQueueStatistics
+
+@synthesize waitTime = _waitTime, runTime = _runTime;
+@synthesize currentDepth = _currentDepth, peakDepth = _peakDepth;
+@synthesize selectorStatistics = _selectorStatistics;
+
+-(id)initWithWaitTime:(CWHistogram*)waitTime
+              runTime:(CWHistogram*)runTime
+         currentDepth:(NSUInteger)currentDepth
+            peakDepth:(NSUInteger)peakDepth
+   selectorStatistics:(NSDictionary*)selectorStatistics;
+{
+	self = [super init];
+    if (self) {
+    	_waitTime = [waitTime retain];
+        _runTime = [runTime retain];
+        _currentDepth = currentDepth;
+        _peakDepth = peakDepth;
+        _selectorStatistics = [selectorStatistics copy];
+    }
+    return self;
+}
+
+-(void)dealloc;
+{
+	[_selectorStatistics release];
+    [_runTime release];
+    [_waitTime release];
+    [super dealloc];
+}
+
+-(NSString*)description;
+{
+	NSMutableString* description = [NSMutableString stringWithFormat:@"depth=%lu peak=%lu\n  wait(us): %@\n  run(us): %@",
+                                    (unsigned long)_currentDepth, (unsigned long)_peakDepth, _waitTime, _runTime];
+    for (NSString* key in [[_selectorStatistics allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+    	CWQueueStatistics* statistics = [_selectorStatistics objectForKey:key];
+        [description appendFormat:@"\n  %@ depth=%lu peak=%lu\n    wait(us): %@\n    run(us): %@", key,
+         (unsigned long)statistics->_currentDepth, (unsigned long)statistics->_peakDepth,
+         statistics->_waitTime, statistics->_runTime];
+    }
+    return description;
+}
+
+@end
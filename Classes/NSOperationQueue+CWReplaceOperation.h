@@ -33,6 +33,31 @@
 
 @interface NSOperationQueue (CWReplaceOperation)
 
+/*!
+ * @abstract Cancel an old operation if not finished, and add a new operation.
+ * @discussion The queue is suspended while cancelling, prefer
+ *             addOperation:coalescingKey: that does not suspend the queue.
+ */
 -(BOOL)replaceOperation:(NSOperation*)oldOperation withOperation:(NSOperation*)newOperation;
 
+/*!
+ * @abstract Add an operation, replacing any pending operation with the same key.
+ *
+ * @discussion At most one pending operation is kept for each key, the previous
+ *             operation for the key is cancelled unless it is already executing
+ *             or finished. Operations are tracked per queue in a hash table,
+ *             and the queue is never suspended. Keys are copied.
+ *
+ *             The operation is added with a weight of 1, and is not added if
+ *             rejected by a bounded queue.
+ *
+ * @result YES if a pending operation was cancelled.
+ */
+-(BOOL)addOperation:(NSOperation*)operation coalescingKey:(id)key;
+
+/*!
+ * @abstract The latest unfinished operation added with a key, or nil.
+ */
+-(NSOperation*)operationForCoalescingKey:(id)key;
+
 @end
@@ -29,6 +29,27 @@
 //
 
 #import "NSOperationQueue+CWReplaceOperation.h"
+#import "NSObject+CWAssociatedObject.h"
+#import "NSOperationQueue+CWBoundedQueue.h"
+#import <pthread.h>
+
+/*
+ * Unfinished operations by coalescing key for one queue, and the key of each
+ * operation so that entries are removed by key when the operation finish.
+ * The table is retained while observing.
+ */
+@interface CWCoalescingTable : NSObject {
+@private
+	pthread_mutex_t _lock;
+    NSMutableDictionary* _operations;
+    CFMutableDictionaryRef _keys;
+}
+
+-(NSOperation*)operationForKey:(id)key;
+-(NSOperation*)replaceOperationForKey:(id)key withOperation:(NSOperation*)operation;
+-(void)removeOperation:(NSOperation*)operation;
+
+@end
 
 
 @implementation NSOperationQueue (CWReplaceOperation)
@@ -49,4 +70,110 @@
     return didCancelOldOperation;
 }
 
+static char CWCoalescingTableKey;
+static pthread_mutex_t CWCoalescingTableLock = PTHREAD_MUTEX_INITIALIZER;
+
+static CWCoalescingTable* CWCoalescingTableForQueue(NSOperationQueue* queue, BOOL create)
+{
+	pthread_mutex_lock(&CWCoalescingTableLock);
+	CWCoalescingTable* table = [queue associatedObjectForStaticKey:&CWCoalescingTableKey];
+    if (table == nil && create) {
+    	table = [[[CWCoalescingTable alloc] init] autorelease];
+        [queue setAssociatedObject:table forStaticKey:&CWCoalescingTableKey];
+    }
+    pthread_mutex_unlock(&CWCoalescingTableLock);
+    return table;
+}
+
+-(BOOL)addOperation:(NSOperation*)operation coalescingKey:(id)key;
+{
+	CWCoalescingTable* table = CWCoalescingTableForQueue(self, YES);
+    NSOperation* oldOperation = [table replaceOperationForKey:key withOperation:operation];
+    BOOL didCancelOldOperation = NO;
+    if (oldOperation && ![oldOperation isExecuting] && ![oldOperation isFinished]) {
+    	[oldOperation cancel];
+        didCancelOldOperation = YES;
+    }
+    if (![self addOperation:operation weight:1 error:NULL]) {
+    	[table removeOperation:operation];
+    }
+    return didCancelOldOperation;
+}
+
+-(NSOperation*)operationForCoalescingKey:(id)key;
+{
+	return [CWCoalescingTableForQueue(self, NO) operationForKey:key];
+}
+
+@end
+
+
+@implementation CWCoalescingTable
+
+static char CWCoalescingTableObservingContext;
+
+-(id)init;
+{
+	self = [super init];
+    if (self) {
+    	pthread_mutex_init(&_lock, NULL);
+        _operations = [[NSMutableDictionary alloc] init];
+        _keys = CFDictionaryCreateMutable(NULL, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+    }
+    return self;
+}
+
+-(void)dealloc;
+{
+	pthread_mutex_destroy(&_lock);
+    CFRelease(_keys);
+    [_operations release];
+    [super dealloc];
+}
+
+-(NSOperation*)operationForKey:(id)key;
+{
+	pthread_mutex_lock(&_lock);
+    NSOperation* operation = [[[_operations objectForKey:key] retain] autorelease];
+    pthread_mutex_unlock(&_lock);
+    return operation;
+}
+
+-(NSOperation*)replaceOperationForKey:(id)key withOperation:(NSOperation*)operation;
+{
+	[self retain];
+	[operation addObserver:self forKeyPath:@"isFinished" options:0 context:&CWCoalescingTableObservingContext];
+    key = [[key copy] autorelease];
+	pthread_mutex_lock(&_lock);
+    NSOperation* oldOperation = [[[_operations objectForKey:key] retain] autorelease];
+    [_operations setObject:operation forKey:key];
+    CFDictionarySetValue(_keys, operation, key);
+    pthread_mutex_unlock(&_lock);
+    return oldOperation;
+}
+
+-(void)removeOperation:(NSOperation*)operation;
+{
+	[operation removeObserver:self forKeyPath:@"isFinished"];
+    pthread_mutex_lock(&_lock);
+    id key = (id)CFDictionaryGetValue(_keys, operation);
+    if (key && [_operations objectForKey:key] == operation) {
+        [_operations removeObjectForKey:key];
+    }
+    CFDictionaryRemoveValue(_keys, operation);
+    pthread_mutex_unlock(&_lock);
+    [self release];
+}
+
+-(void)observeValueForKeyPath:(NSString*)keyPath ofObject:(id)object change:(NSDictionary*)change context:(void*)context;
+{
+	if (context != &CWCoalescingTableObservingContext) {
+    	[super observeValueForKeyPath:keyPath ofObject:object change:change context:context];
+        return;
+    }
+    if ([object isFinished]) {
+    	[self removeOperation:object];
+    }
+}
+
 @end
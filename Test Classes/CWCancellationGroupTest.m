@@ -0,0 +1,84 @@
+//
+//  CWCancellationGroupTest.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWCancellationGroupTest.h"
+
+
+@implementation CWCancellationGroupTest
+
+-(void)incrementRunCount;
+{
+	@synchronized(self) {
+    	runCount++;
+    }
+}
+
+-(void)testCancelGroupOfQueuedOperations;
+{
+	NSOperationQueue* queue = [[[NSOperationQueue alloc] init] autorelease];
+    CWCancellationGroup* cancelledGroup = [CWCancellationGroup group];
+    CWCancellationGroup* otherGroup = [CWCancellationGroup group];
+    runCount = 0;
+    [queue setSuspended:YES];
+    for (NSInteger i = 0; i < 100; i++) {
+    	[self performSelector:@selector(incrementRunCount) onQueue:queue withObject:nil cancellationGroup:cancelledGroup];
+        [self performSelector:@selector(incrementRunCount) onQueue:queue withObject:nil cancellationGroup:otherGroup];
+    }
+    STAssertTrue([cancelledGroup operationCount] == 100, @"Wrong operation count");
+    STAssertTrue([cancelledGroup cancel] == 100, @"Wrong number of operations cancelled");
+    [self performSelector:@selector(incrementRunCount) onQueue:queue withObject:nil cancellationGroup:cancelledGroup];
+    STAssertTrue([cancelledGroup cancelledOperationCount] == 101, @"Operation added after cancel not cancelled");
+    [queue setSuspended:NO];
+    [queue waitUntilAllOperationsAreFinished];
+    STAssertTrue(runCount == 100, @"Cancelled operations was run");
+    STAssertTrue([otherGroup operationCount] == 0, @"Finished operations not removed");
+    STAssertTrue([otherGroup cancelledOperationCount] == 0, @"Wrong cancelled count");
+}
+
+-(void)testOperationFinishingWhileAdded;
+{
+	NSOperationQueue* queue = [[[NSOperationQueue alloc] init] autorelease];
+    CWCancellationGroup* group = [CWCancellationGroup group];
+    NSOperation* finishedOperation = [[[NSOperation alloc] init] autorelease];
+    [queue addOperation:finishedOperation];
+    [queue waitUntilAllOperationsAreFinished];
+    [group addOperation:finishedOperation];
+    STAssertTrue([group operationCount] == 0, @"Finished operation added");
+    for (NSInteger i = 0; i < 1000; i++) {
+    	NSOperation* operation = [[[NSOperation alloc] init] autorelease];
+        [queue addOperation:operation];
+        [group addOperation:operation];
+    }
+    [queue waitUntilAllOperationsAreFinished];
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    STAssertTrue([group operationCount] == 0, @"Operation finished while added not removed");
+}
+
+@end
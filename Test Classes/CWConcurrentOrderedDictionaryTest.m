@@ -0,0 +1,195 @@
+//
+//  CWConcurrentOrderedDictionaryTest.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWConcurrentOrderedDictionaryTest.h"
+
+
+@implementation CWConcurrentOrderedDictionaryTest
+
+-(void)testOrderIsKeptAfterMutations;
+{
+	CWConcurrentOrderedDictionary* dict = [CWConcurrentOrderedDictionary dictionaryWithObjectsAndKeys:
+                                           @"D", @"A", @"E", @"B", @"F", @"C", nil];
+    [dict insertObject:@"G" forKey:@"0" atIndex:0];
+    [dict removeObjectForKey:@"B"];
+    [dict moveObjectForKey:@"C" toIndex:1];
+    NSArray* expectedKeys = [NSArray arrayWithObjects:@"0", @"C", @"A", nil];
+    STAssertEqualObjects(expectedKeys, [dict allKeys], @"keys not properly ordered");
+    STAssertEqualObjects(@"F", [dict objectAtIndex:1], @"objectAtIndex: failed");
+    STAssertTrue([dict indexForKey:@"A"] == 2, @"indexForKey: failed");
+    CWOrderedDictionary* snapshot = [[dict copy] autorelease];
+    STAssertTrue([snapshot isKindOfClass:[CWConcurrentOrderedDictionary class]], @"copy is not concurrent");
+    STAssertEqualObjects(dict, snapshot, @"copy not equal to original");
+}
+
+-(void)readDictionary:(CWConcurrentOrderedDictionary*)dict;
+{
+	for (NSInteger i = 0; i < 100; i++) {
+        NSUInteger count = 0;
+        for (id key in dict) {
+            count++;
+        }
+        [dict objectForKey:[NSNumber numberWithInteger:i]];
+        if (count > 0) {
+        	[dict keyAtIndex:0];
+        }
+    }
+}
+
+-(void)writeDictionary:(CWConcurrentOrderedDictionary*)dict;
+{
+	for (NSInteger i = 0; i < 100; i++) {
+        NSNumber* key = [NSNumber numberWithInteger:i];
+        [dict setObject:key forKey:key];
+        if (i % 2) {
+        	[dict removeObjectForKey:key];
+        }
+    }
+}
+
+-(void)testConcurrentReadersAndWriters;
+{
+	CWConcurrentOrderedDictionary* dict = [CWConcurrentOrderedDictionary dictionary];
+    NSOperationQueue* queue = [[[NSOperationQueue alloc] init] autorelease];
+    [queue setMaxConcurrentOperationCount:8];
+    for (NSInteger i = 0; i < 16; i++) {
+        SEL selector = (i % 4) ? @selector(readDictionary:) : @selector(writeDictionary:);
+        NSOperation* operation = [[NSInvocationOperation alloc] initWithTarget:self
+                                                                      selector:selector
+                                                                        object:dict];
+        [queue addOperation:operation];
+        [operation release];
+    }
+    [queue waitUntilAllOperationsAreFinished];
+    STAssertTrue([dict count] == 50, @"Unexpected count %lu after concurrent writes", (unsigned long)[dict count]);
+}
+
+#define CW_READ_SCALING_KEY_COUNT 10000
+#define CW_READ_SCALING_LOOKUP_COUNT 200000
+
+/*
+ * Started threads wait on the condition until all are started, and signal
+ * it when done.
+ */
+static NSCondition* cw_readScalingCondition = nil;
+static NSInteger cw_readScalingWaitingCount = 0;
+static NSInteger cw_readScalingRunningCount = 0;
+static NSInteger cw_readScalingMissCount = 0;
+
+-(void)timedReadDictionary:(CWOrderedDictionary*)dict;
+{
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    NSMutableArray* dictKeys = [NSMutableArray arrayWithCapacity:CW_READ_SCALING_KEY_COUNT];
+    for (NSInteger i = 0; i < CW_READ_SCALING_KEY_COUNT; i++) {
+    	[dictKeys addObject:[NSNumber numberWithInteger:i]];
+    }
+    [cw_readScalingCondition lock];
+    cw_readScalingWaitingCount--;
+    [cw_readScalingCondition broadcast];
+    while (cw_readScalingWaitingCount > 0) {
+    	[cw_readScalingCondition wait];
+    }
+    [cw_readScalingCondition unlock];
+    BOOL synchronized = ![dict isKindOfClass:[CWConcurrentOrderedDictionary class]];
+    NSInteger missCount = 0;
+    for (NSInteger i = 0; i < CW_READ_SCALING_LOOKUP_COUNT; i++) {
+    	NSAutoreleasePool* innerPool = (i % 1000) == 0 ? [[NSAutoreleasePool alloc] init] : nil;
+        id key = [dictKeys objectAtIndex:(i * 7919) % CW_READ_SCALING_KEY_COUNT];
+        id object;
+        if (synchronized) {
+        	@synchronized(dict) {
+	        	object = [dict objectForKey:key];
+            }
+        } else {
+        	object = [dict objectForKey:key];
+        }
+        if (object != key) {
+        	missCount++;
+        }
+        [innerPool drain];
+    }
+    [cw_readScalingCondition lock];
+    cw_readScalingMissCount += missCount;
+    cw_readScalingRunningCount--;
+    [cw_readScalingCondition broadcast];
+    [cw_readScalingCondition unlock];
+    [pool drain];
+}
+
+-(NSTimeInterval)timeReadsOfDictionary:(CWOrderedDictionary*)dict threadCount:(NSInteger)threadCount;
+{
+    cw_readScalingWaitingCount = threadCount + 1;
+    cw_readScalingRunningCount = threadCount;
+    for (NSInteger i = 0; i < threadCount; i++) {
+    	[NSThread detachNewThreadSelector:@selector(timedReadDictionary:) toTarget:self withObject:dict];
+    }
+    [cw_readScalingCondition lock];
+    cw_readScalingWaitingCount--;
+    [cw_readScalingCondition broadcast];
+    while (cw_readScalingWaitingCount > 0) {
+    	[cw_readScalingCondition wait];
+    }
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    while (cw_readScalingRunningCount > 0) {
+    	[cw_readScalingCondition wait];
+    }
+    NSTimeInterval time = CFAbsoluteTimeGetCurrent() - start;
+    [cw_readScalingCondition unlock];
+    return time;
+}
+
+/*
+ * Aggregate lookups per second with 1, 4, 16 and 64 reader threads, for the
+ * reader-writer lock and for a single @synchronized lock as baseline. Only
+ * logged, scaling depends on the number of cores.
+ */
+-(void)testReadScaling;
+{
+	cw_readScalingCondition = [[NSCondition alloc] init];
+	CWOrderedDictionary* plainDict = [CWOrderedDictionary dictionary];
+	CWConcurrentOrderedDictionary* concurrentDict = [CWConcurrentOrderedDictionary dictionary];
+    for (NSInteger i = 0; i < CW_READ_SCALING_KEY_COUNT; i++) {
+    	NSNumber* key = [NSNumber numberWithInteger:i];
+        [plainDict setObject:key forKey:key];
+        [concurrentDict setObject:key forKey:key];
+    }
+    cw_readScalingMissCount = 0;
+    for (NSInteger threadCount = 1; threadCount <= 64; threadCount *= 4) {
+    	NSTimeInterval synchronizedTime = [self timeReadsOfDictionary:plainDict threadCount:threadCount];
+    	NSTimeInterval concurrentTime = [self timeReadsOfDictionary:concurrentDict threadCount:threadCount];
+        double lookups = (double)threadCount * CW_READ_SCALING_LOOKUP_COUNT;
+        NSLog(@"%2ld readers: %.2f M lookups/s with reader-writer lock, %.2f M lookups/s with @synchronized",
+              (long)threadCount, lookups / concurrentTime / 1.0e6, lookups / synchronizedTime / 1.0e6);
+    }
+    STAssertTrue(cw_readScalingMissCount == 0, @"Lookups failed");
+    [cw_readScalingCondition release], cw_readScalingCondition = nil;
+}
+
+@end
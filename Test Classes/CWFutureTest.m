@@ -0,0 +1,109 @@
+//
+//  CWFutureTest.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWFutureTest.h"
+#import "NSObject+CWInvocationProxy.h"
+#import "NSOperationQueue+CWDefaultQueue.h"
+
+
+@implementation CWFutureTest
+
+-(NSInteger)squareOfNumber:(NSNumber*)number;
+{
+	return [number integerValue] * [number integerValue];
+}
+
+-(NSNumber*)incrementResultOfFuture:(CWFuture*)future;
+{
+	return [NSNumber numberWithInteger:[[future result] integerValue] + 1];
+}
+
+-(void)raiseException;
+{
+	[NSException raise:NSInternalInconsistencyException format:@"Expected exception"];
+}
+
+-(void)testResultOfQueuedSelector;
+{
+	NSOperationQueue* queue = [[[NSOperationQueue alloc] init] autorelease];
+    CWFuture* future = [self futureByPerformingSelector:@selector(squareOfNumber:)
+                                                onQueue:queue
+                                             withObject:[NSNumber numberWithInteger:7]];
+    STAssertEqualObjects([NSNumber numberWithInteger:49], [future result], @"Wrong result");
+    STAssertTrue([future isFinished], @"Not finished after result");
+    
+    future = [self futureByPerformingSelector:@selector(raiseException) onQueue:queue withObject:nil];
+    [future waitUntilFinished];
+    STAssertNotNil([future exception], @"Exception not captured");
+    STAssertThrows([future result], @"Exception not raised by result");
+    
+    CWFuture* unfinished = [CWFuture future];
+    STAssertFalse([unfinished waitUntilFinishedBeforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]], @"Unfinished future finished");
+    STAssertTrue([unfinished cancel], @"Could not cancel");
+    STAssertFalse([unfinished finishWithResult:@"late"], @"Finished twice");
+    STAssertNil([unfinished result], @"Cancelled future has result");
+}
+
+-(void)testContinuationsAndCombinators;
+{
+	NSOperationQueue* queue = [[[NSOperationQueue alloc] init] autorelease];
+    CWFuture* source = [CWFuture future];
+    CWFuture* continuation = [source continueWithTarget:self selector:@selector(incrementResultOfFuture:)];
+    CWFuture* chained = [continuation continueOnQueue:queue withTarget:self selector:@selector(incrementResultOfFuture:)];
+    STAssertFalse([continuation isFinished], @"Continuation performed early");
+    [source finishWithResult:[NSNumber numberWithInteger:1]];
+    STAssertEqualObjects([NSNumber numberWithInteger:2], [continuation result], @"Wrong continuation result");
+    STAssertEqualObjects([NSNumber numberWithInteger:3], [chained result], @"Wrong chained result");
+    
+    NSMutableArray* futures = [NSMutableArray array];
+    for (NSInteger i = 0; i < 10; i++) {
+    	[futures addObject:[self futureByPerformingSelector:@selector(squareOfNumber:)
+                                                    onQueue:queue
+                                                 withObject:[NSNumber numberWithInteger:i]]];
+    }
+    NSArray* results = [[CWFuture whenAll:futures] result];
+    STAssertTrue([results count] == 10, @"Wrong number of results");
+    STAssertEqualObjects([NSNumber numberWithInteger:81], [results lastObject], @"Wrong result");
+    
+    CWFuture* never = [CWFuture future];
+    CWFuture* any = [CWFuture whenAny:[NSArray arrayWithObjects:never, [CWFuture futureWithResult:@"done"], nil]];
+    STAssertEqualObjects(@"done", [[any result] result], @"Wrong first future");
+    STAssertEqualObjects([NSArray array], [[CWFuture whenAll:[NSArray array]] result], @"No futures not finished");
+}
+
+-(void)testProxyFuture;
+{
+	CWFuture* future = nil;
+    [[[self defaultQueueProxy] future:&future] squareOfNumber:[NSNumber numberWithInteger:5]];
+    STAssertNotNil(future, @"No future assigned");
+    STAssertEqualObjects([NSNumber numberWithInteger:25], [future result], @"Wrong proxy result");
+}
+
+@end
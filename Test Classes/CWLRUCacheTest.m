@@ -0,0 +1,106 @@
+//
+//  CWLRUCacheTest.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWLRUCacheTest.h"
+
+
+@implementation CWLRUCacheTest
+
+-(void)setUp;
+{
+	evictedKeys = [[NSMutableArray alloc] init];
+}
+
+-(void)tearDown;
+{
+	[evictedKeys release], evictedKeys = nil;
+}
+
+-(void)cache:(CWLRUCache*)cache didEvictObject:(id)object forKey:(id)key;
+{
+	[evictedKeys addObject:key];
+}
+
+-(void)testEvictsLeastRecentlyUsed;
+{
+	CWLRUCache* cache = [[[CWLRUCache alloc] initWithCountLimit:3 totalCostLimit:0 threadSafe:NO] autorelease];
+    cache.delegate = self;
+    [cache setObject:@"1" forKey:@"A"];
+    [cache setObject:@"2" forKey:@"B"];
+    [cache setObject:@"3" forKey:@"C"];
+    STAssertEqualObjects(@"1", [cache objectForKey:@"A"], @"objectForKey: failed");
+    [cache setObject:@"4" forKey:@"D"];
+    STAssertNil([cache peekObjectForKey:@"B"], @"Least recently used object not evicted");
+    STAssertEqualObjects(@"1", [cache peekObjectForKey:@"A"], @"Touched object evicted");
+    [cache setObject:@"5" forKey:@"E"];
+    NSArray* expectedKeys = [NSArray arrayWithObjects:@"B", @"C", nil];
+    STAssertEqualObjects(expectedKeys, evictedKeys, @"Wrong objects evicted");
+    STAssertTrue(cache.count == 3, @"Wrong count");
+}
+
+-(void)testEvictsByTotalCost;
+{
+	CWLRUCache* cache = [[[CWLRUCache alloc] initWithCountLimit:0 totalCostLimit:10 threadSafe:YES] autorelease];
+    cache.delegate = self;
+    [cache setObject:@"1" forKey:@"A" cost:4];
+    [cache setObject:@"2" forKey:@"B" cost:4];
+    [cache setObject:@"3" forKey:@"C" cost:4];
+    STAssertTrue(cache.totalCost == 8, @"Wrong total cost");
+    NSArray* expectedKeys = [NSArray arrayWithObject:@"A"];
+    STAssertEqualObjects(expectedKeys, evictedKeys, @"Wrong objects evicted");
+    [cache setObject:@"4" forKey:@"D" cost:11];
+    STAssertNil([cache peekObjectForKey:@"D"], @"Object above cost limit not evicted");
+    STAssertEqualObjects(@"2", [cache peekObjectForKey:@"B"], @"Object evicted by object above cost limit");
+    STAssertEqualObjects(@"3", [cache peekObjectForKey:@"C"], @"Object evicted by object above cost limit");
+    STAssertTrue(cache.totalCost == 8, @"Wrong total cost");
+    expectedKeys = [NSArray arrayWithObjects:@"A", @"D", nil];
+    STAssertEqualObjects(expectedKeys, evictedKeys, @"Wrong objects evicted");
+    [cache setObject:@"5" forKey:@"E" cost:6];
+    cache.totalCostLimit = 5;
+    STAssertTrue(cache.count == 0, @"Lowering limit did not evict");
+}
+
+-(void)testCountsHitsMissesAndEvictions;
+{
+	CWLRUCache* cache = [[[CWLRUCache alloc] initWithCountLimit:1 totalCostLimit:0 threadSafe:NO] autorelease];
+    [cache setObject:@"1" forKey:@"A"];
+    [cache objectForKey:@"A"];
+    [cache objectForKey:@"B"];
+    [cache setObject:@"2" forKey:@"B"];
+    [cache objectForKey:@"A"];
+    [cache removeObjectForKey:@"B"];
+    STAssertTrue(cache.hitCount == 1, @"Wrong hit count");
+    STAssertTrue(cache.missCount == 2, @"Wrong miss count");
+    STAssertTrue(cache.evictionCount == 1, @"Wrong eviction count");
+    [cache resetStatistics];
+    STAssertTrue(cache.hitCount + cache.missCount + cache.evictionCount == 0, @"Statistics not reset");
+}
+
+@end
@@ -0,0 +1,106 @@
+//
+//  CWMainThreadDispatcherTest.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWMainThreadDispatcherTest.h"
+
+
+@implementation CWMainThreadDispatcherTest
+
+-(void)incrementRunCount;
+{
+    STAssertTrue([NSThread isMainThread], @"Must be main thread");
+	runCount++;
+}
+
+-(void)setLastValue:(NSNumber*)value;
+{
+	lastValue = [value integerValue];
+}
+
+-(void)testCoalesceCallsInOneRunLoopTurn;
+{
+	CWMainThreadDispatcher* dispatcher = [CWMainThreadDispatcher sharedDispatcher];
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    NSUInteger wakeUpCount = [dispatcher wakeUpCount];
+    runCount = 0;
+    lastValue = 0;
+    for (NSInteger i = 1; i <= 100; i++) {
+    	[dispatcher performSelector:@selector(incrementRunCount) onTarget:self withObject:nil waitUntilDone:NO];
+        [dispatcher performSelector:@selector(setLastValue:) 
+                           onTarget:self
+                         withObject:[NSNumber numberWithInteger:i]
+                      coalescingKey:@"row7"];
+    }
+    STAssertTrue(runCount == 0, @"Performed before run loop");
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    STAssertTrue(runCount == 100, @"Not all calls performed");
+    STAssertTrue(lastValue == 100, @"Latest coalesced call not performed");
+    STAssertTrue([dispatcher wakeUpCount] - wakeUpCount == 1, @"Run loop signalled more than once");
+}
+
+-(void)raiseException;
+{
+	[NSException raise:NSGenericException format:@"Expected exception"];
+}
+
+-(void)performRaisingSelectorAndWait;
+{
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+	[[CWMainThreadDispatcher sharedDispatcher] performSelector:@selector(raiseException)
+                                                      onTarget:self
+                                                    withObject:nil
+                                                 waitUntilDone:YES];
+    waiterReturned = YES;
+    [pool drain];
+}
+
+-(void)testExceptionDoesNotStopBatch;
+{
+	CWMainThreadDispatcher* dispatcher = [CWMainThreadDispatcher sharedDispatcher];
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    runCount = 0;
+    waiterReturned = NO;
+    [NSThread detachNewThreadSelector:@selector(performRaisingSelectorAndWait) toTarget:self withObject:nil];
+    [NSThread sleepForTimeInterval:0.1];
+    [dispatcher performSelector:@selector(incrementRunCount) onTarget:self withObject:nil waitUntilDone:NO];
+    BOOL raised = NO;
+    @try {
+	    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    }
+    @catch (NSException* exception) {
+    	raised = [[exception name] isEqualToString:NSGenericException];
+    }
+    [NSThread sleepForTimeInterval:0.1];
+    STAssertTrue(raised, @"Exception not raised after batch");
+    STAssertTrue(runCount == 1, @"Task after exception not performed");
+    STAssertTrue(waiterReturned, @"Waiting thread not signalled");
+}
+
+@end
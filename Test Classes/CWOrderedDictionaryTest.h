@@ -47,4 +47,18 @@
 -(void)testKeyAndObjectAtIndex;
 -(void)testObjectAtIndexAndForKey;
 
+-(void)testIndexForKeyAfterInitialization;
+-(void)testIndexForKeyAfterMutations;
+-(void)testIndexForKeyScaling;
+-(void)testOrderIsKeptWhenGrowingAndRemoving;
+-(void)testBatchOperations;
+-(void)testCopiesAreIndependentAfterMutation;
+-(void)testEnumerateCopyWithHolesFromManyThreads;
+-(void)testKeyedArchiving;
+-(void)testCompactArchiving;
+-(void)testCompactArchiveWithUndecodableValue;
+-(void)testTaggedPointerValues;
+-(void)testSortByValueUsingDescriptors;
+-(void)testSortWithNilKeyValues;
+
 @end
@@ -119,4 +119,328 @@
     STAssertEquals(2u, [orderedDictionary indexForKey:@"C"], @"indexForKey: failed");
 }
 
+-(void)assertIndexesForKeysInDictionary:(CWOrderedDictionary*)dict;
+{
+	NSArray* allKeys = [dict allKeys];
+    for (NSUInteger index = 0; index < [allKeys count]; index++) {
+    	STAssertEquals(index, [dict indexForKey:[allKeys objectAtIndex:index]], @"indexForKey: failed for %@", [allKeys objectAtIndex:index]);
+    }
+}
+
+-(void)testIndexForKeyAfterInitialization;
+{
+	[self assertIndexesForKeysInDictionary:orderedDictionary];
+    [self assertIndexesForKeysInDictionary:[[orderedDictionary copy] autorelease]];
+    [self assertIndexesForKeysInDictionary:[[orderedDictionary mutableCopy] autorelease]];
+    [self assertIndexesForKeysInDictionary:[[[CWOrderedDictionary alloc] initWithDictionary:orderedDictionary] autorelease]];
+    [self assertIndexesForKeysInDictionary:[[[CWOrderedDictionary alloc] initWithObjectsAndKeys:@"D", @"A", @"E", @"B", nil] autorelease]];
+    CWOrderedDictionary* dict = [[[CWOrderedDictionary alloc] initWithDictionary:[NSDictionary dictionaryWithObjects:objects forKeys:keys]] autorelease];
+    [self assertIndexesForKeysInDictionary:dict];
+    [dict removeObjectForKey:[dict keyAtIndex:1]];
+    STAssertTrue([dict count] == 2, @"removeObjectForKey: failed for initialized key");
+}
+
+-(void)testIndexForKeyAfterMutations;
+{
+	CWOrderedDictionary* dict = [[orderedDictionary mutableCopy] autorelease];
+    [dict insertObject:@"G" forKey:@"0" atIndex:0];
+    [self assertIndexesForKeysInDictionary:dict];
+    [dict setObject:@"H" forKey:@"D"];
+    [dict insertObject:@"I" forKey:@"1" atIndex:2];
+    [self assertIndexesForKeysInDictionary:dict];
+    [dict removeObjectAtIndex:0];
+    [dict removeObjectForKey:@"B"];
+    [self assertIndexesForKeysInDictionary:dict];
+    [dict moveObjectForKey:@"D" toIndex:0];
+    [self assertIndexesForKeysInDictionary:dict];
+    [dict removeObjectForKey:@"D"];
+    [dict sortByKeyUsingSelector:@selector(compare:)];
+    [self assertIndexesForKeysInDictionary:dict];
+    STAssertTrue([dict indexForKey:@"B"] == NSNotFound, @"indexForKey: for removed key failed");
+    NSArray* expectedKeys = [NSArray arrayWithObjects:@"1", @"A", @"C", nil];
+    STAssertEqualObjects(expectedKeys, [dict allKeys], @"keys not properly ordered");
+}
+
+/*
+ * indexForKey: after a removal and an insertion in the middle of 1k to 100k
+ * keys. Setting CW_BENCHMARK_MAX_COUNT raises the largest size, and also logs
+ * the time per lookup for each size, use 10000000 for the full range.
+ */
+-(void)testIndexForKeyScaling;
+{
+	NSUInteger maxCount = 100000;
+    NSString* maxCountString = [[[NSProcessInfo processInfo] environment] objectForKey:@"CW_BENCHMARK_MAX_COUNT"];
+    if (maxCountString) {
+    	maxCount = (NSUInteger)[maxCountString longLongValue];
+    }
+    const NSUInteger lookupCount = 100000;
+    for (NSUInteger count = 1000; count <= maxCount; count *= 10) {
+    	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    	CWOrderedDictionary* dict = [[[CWOrderedDictionary alloc] initWithCapacity:count] autorelease];
+        NSMutableArray* dictKeys = [NSMutableArray arrayWithCapacity:count];
+        for (NSUInteger i = 0; i < count; i++) {
+        	NSNumber* key = [NSNumber numberWithUnsignedInteger:i];
+            [dictKeys addObject:key];
+            [dict setObject:key forKey:key];
+        }
+        [dict removeObjectAtIndex:count / 2];
+        [dict insertObject:@"X" forKey:@"X" atIndex:count / 3];
+        NSUInteger wrongCount = 0;
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger i = 0; i < lookupCount; i++) {
+        	NSUInteger keyIndex = (i * 7919) % count;
+            NSUInteger expectedIndex = keyIndex;
+            if (keyIndex == count / 2) {
+            	expectedIndex = NSNotFound;
+            } else if (keyIndex >= count / 3 && keyIndex < count / 2) {
+            	expectedIndex++;
+            }
+        	if ([dict indexForKey:[dictKeys objectAtIndex:keyIndex]] != expectedIndex) {
+            	wrongCount++;
+            }
+        }
+        double time = (CFAbsoluteTimeGetCurrent() - start) / lookupCount;
+        STAssertTrue(wrongCount == 0, @"Wrong index for %lu of %lu keys", (unsigned long)wrongCount, (unsigned long)count);
+        STAssertTrue([dict indexForKey:@"X"] == count / 3, @"Wrong index for inserted key");
+        if (maxCountString) {
+	        NSLog(@"indexForKey: %lu keys, %.0f ns per lookup", (unsigned long)count, time * 1.0e9);
+        }
+        [pool drain];
+    }
+}
+
+-(void)testOrderIsKeptWhenGrowingAndRemoving;
+{
+	CWOrderedDictionary* dict = [CWOrderedDictionary dictionary];
+    NSMutableArray* expectedKeys = [NSMutableArray array];
+    for (NSInteger i = 0; i < 100; i++) {
+    	NSNumber* key = [NSNumber numberWithInteger:i];
+        [dict setObject:[key stringValue] forKey:key];
+        [expectedKeys addObject:key];
+    }
+    for (NSInteger i = 0; i < 100; i += 3) {
+    	NSNumber* key = [NSNumber numberWithInteger:i];
+        [dict removeObjectForKey:key];
+        [expectedKeys removeObject:key];
+    }
+    NSMutableArray* enumeratedKeys = [NSMutableArray array];
+    for (id key in dict) {
+    	[enumeratedKeys addObject:key];
+    }
+    STAssertEqualObjects(expectedKeys, enumeratedKeys, @"enumeration order not kept");
+    STAssertEqualObjects(expectedKeys, [dict allKeys], @"keys not properly ordered");
+    for (NSUInteger index = 0; index < [expectedKeys count]; index++) {
+        id key = [expectedKeys objectAtIndex:index];
+    	STAssertEqualObjects([key stringValue], [dict objectAtIndex:index], @"objectAtIndex: failed");
+    	STAssertEqualObjects([key stringValue], [dict objectForKey:key], @"objectForKey: failed");
+    }
+    [self assertIndexesForKeysInDictionary:dict];
+}
+
+-(void)testBatchOperations;
+{
+	CWOrderedDictionary* dict = [[orderedDictionary mutableCopy] autorelease];
+    NSMutableIndexSet* indexes = [NSMutableIndexSet indexSetWithIndex:0];
+    [indexes addIndex:2];
+    [indexes addIndex:4];
+    [dict insertObjects:[NSArray arrayWithObjects:@"G", @"H", @"I", nil]
+                forKeys:[NSArray arrayWithObjects:@"0", @"1", @"2", nil]
+              atIndexes:indexes];
+    NSArray* expectedKeys = [NSArray arrayWithObjects:@"0", @"A", @"1", @"B", @"2", @"C", nil];
+    STAssertEqualObjects(expectedKeys, [dict allKeys], @"insertObjects:forKeys:atIndexes: failed");
+    STAssertEqualObjects(@"H", [dict objectForKey:@"1"], @"insertObjects:forKeys:atIndexes: failed");
+    [self assertIndexesForKeysInDictionary:dict];
+
+    [dict moveObjectsAtIndexes:indexes toIndex:3];
+    expectedKeys = [NSArray arrayWithObjects:@"A", @"B", @"C", @"0", @"1", @"2", nil];
+    STAssertEqualObjects(expectedKeys, [dict allKeys], @"moveObjectsAtIndexes:toIndex: failed");
+    [self assertIndexesForKeysInDictionary:dict];
+
+    [dict removeObjectsAtIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(1, 3)]];
+    [dict removeObjectsForKeys:[NSArray arrayWithObjects:@"2", @"X", nil]];
+    expectedKeys = [NSArray arrayWithObjects:@"A", @"1", nil];
+    STAssertEqualObjects(expectedKeys, [dict allKeys], @"batch removes failed");
+    STAssertEqualObjects(@"H", [dict objectAtIndex:1], @"batch removes failed");
+    [self assertIndexesForKeysInDictionary:dict];
+
+    STAssertThrows([dict insertObjects:[NSArray arrayWithObject:@"J"]
+                               forKeys:[NSArray arrayWithObject:@"A"]
+                             atIndexes:[NSIndexSet indexSetWithIndex:0]], @"Inserting existing key should throw");
+}
+
+-(void)testCopiesAreIndependentAfterMutation;
+{
+	CWOrderedDictionary* dict = [[orderedDictionary mutableCopy] autorelease];
+    CWOrderedDictionary* snapshot = [[dict copy] autorelease];
+    STAssertEqualObjects(dict, snapshot, @"copy not equal to original");
+    [dict removeObjectForKey:@"B"];
+    [dict setObject:@"G" forKey:@"A"];
+    NSArray* expectedKeys = [NSArray arrayWithObjects:@"A", @"B", @"C", nil];
+    STAssertEqualObjects(expectedKeys, [snapshot allKeys], @"copy changed by mutating original");
+    STAssertEqualObjects(@"D", [snapshot objectForKey:@"A"], @"copy changed by mutating original");
+    
+    CWOrderedDictionary* otherSnapshot = [[dict copy] autorelease];
+    STAssertEqualObjects(@"C", [otherSnapshot keyAtIndex:1], @"keyAtIndex: on copy failed");
+    [otherSnapshot insertObject:@"H" forKey:@"0" atIndex:0];
+    expectedKeys = [NSArray arrayWithObjects:@"A", @"C", nil];
+    STAssertEqualObjects(expectedKeys, [dict allKeys], @"original changed by mutating copy");
+    STAssertEqualObjects(@"G", [dict objectAtIndex:0], @"original changed by mutating copy");
+    [self assertIndexesForKeysInDictionary:otherSnapshot];
+}
+
+-(void)enumerateSnapshot:(NSArray*)arguments;
+{
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+	CWOrderedDictionary* snapshot = [arguments objectAtIndex:0];
+    NSMutableArray* results = [arguments objectAtIndex:1];
+    BOOL inOrder = YES;
+    for (NSInteger pass = 0; pass < 100; pass++) {
+    	NSInteger previous = -1;
+        for (NSNumber* key in snapshot) {
+        	inOrder = inOrder && [key integerValue] > previous;
+            previous = [key integerValue];
+        }
+        inOrder = inOrder && [[snapshot keyAtIndex:pass] integerValue] == pass * 2 + 1;
+        inOrder = inOrder && [[snapshot allValues] count] == [snapshot count];
+    }
+    @synchronized(results) {
+    	[results addObject:[NSNumber numberWithBool:inOrder]];
+    }
+    [pool drain];
+}
+
+-(void)testEnumerateCopyWithHolesFromManyThreads;
+{
+	CWOrderedDictionary* dict = [CWOrderedDictionary dictionary];
+    for (NSInteger i = 0; i < 10000; i++) {
+    	[dict setObject:[NSNumber numberWithInteger:i] forKey:[NSNumber numberWithInteger:i]];
+    }
+    for (NSInteger i = 0; i < 10000; i += 2) {
+    	[dict removeObjectForKey:[NSNumber numberWithInteger:i]];
+    }
+    CWOrderedDictionary* snapshot = [[dict copy] autorelease];
+    NSMutableArray* results = [NSMutableArray array];
+    NSArray* arguments = [NSArray arrayWithObjects:snapshot, results, nil];
+    for (NSInteger i = 0; i < 8; i++) {
+    	[NSThread detachNewThreadSelector:@selector(enumerateSnapshot:) toTarget:self withObject:arguments];
+    }
+    NSDate* timeout = [NSDate dateWithTimeIntervalSinceNow:10];
+    while ([timeout timeIntervalSinceNow] > 0) {
+    	@synchronized(results) {
+        	if ([results count] == 8) {
+            	break;
+            }
+        }
+        [NSThread sleepForTimeInterval:0.01];
+    }
+    @synchronized(results) {
+    	STAssertTrue([results count] == 8, @"Not all threads finished");
+        STAssertFalse([results containsObject:[NSNumber numberWithBool:NO]], @"Copy read out of order");
+    }
+    STAssertTrue([snapshot count] == 5000, @"Wrong count");
+}
+
+-(void)testKeyedArchiving;
+{
+	NSData* data = [NSKeyedArchiver archivedDataWithRootObject:orderedDictionary];
+    CWOrderedDictionary* dict = [NSKeyedUnarchiver unarchiveObjectWithData:data];
+    STAssertTrue([dict isKindOfClass:[CWOrderedDictionary class]], @"Unarchived wrong class");
+    STAssertEqualObjects(orderedDictionary, dict, @"Unarchived dictionary not equal");
+}
+
+-(void)testCompactArchiving;
+{
+	CWOrderedDictionary* dict = [[orderedDictionary mutableCopy] autorelease];
+    [dict setObject:[NSNumber numberWithInteger:-42] forKey:[NSNumber numberWithInteger:1]];
+    [dict setObject:[NSNumber numberWithDouble:0.5] forKey:@"double"];
+    [dict setObject:[NSNumber numberWithBool:YES] forKey:@"bool"];
+    [dict setObject:[NSDate dateWithTimeIntervalSince1970:0] forKey:@"date"];
+    [dict setObject:@"\u00e5\u00e4\u00f6" forKey:@"utf8"];
+    [dict removeObjectForKey:@"B"];
+    
+    NSData* data = [dict compactArchivedData];
+    CWOrderedDictionary* unarchived = [[[CWOrderedDictionary alloc] initWithCompactArchivedData:data] autorelease];
+    STAssertEqualObjects([dict allKeys], [unarchived allKeys], @"Keys not properly ordered");
+    STAssertEqualObjects(@"F", [unarchived objectForKey:@"C"], @"Lazy value not decoded");
+    STAssertEqualObjects([NSNumber numberWithBool:YES], [unarchived objectAtIndex:4], @"Lazy value not decoded");
+    STAssertEqualObjects(dict, unarchived, @"Unarchived dictionary not equal");
+    
+    [unarchived removeObjectForKey:@"A"];
+    [unarchived insertObject:@"G" forKey:@"0" atIndex:0];
+    CWOrderedDictionary* rearchived = [[[CWOrderedDictionary alloc] initWithCompactArchivedData:[unarchived compactArchivedData]] autorelease];
+    STAssertEqualObjects(unarchived, rearchived, @"Rearchived dictionary not equal");
+    
+    STAssertNil([[[CWOrderedDictionary alloc] initWithCompactArchivedData:[data subdataWithRange:NSMakeRange(0, [data length] - 1)]] autorelease], @"Truncated archive accepted");
+}
+
+-(void)testCompactArchiveWithUndecodableValue;
+{
+	CWOrderedDictionary* dict = [CWOrderedDictionary dictionary];
+    [dict setObject:@"ab" forKey:@"key"];
+    NSMutableData* data = [[[dict compactArchivedData] mutableCopy] autorelease];
+    // Replace the value string with invalid UTF-8, keeping the record length.
+    uint8_t* bytes = [data mutableBytes];
+    bytes[[data length] - 2] = 0xff;
+    bytes[[data length] - 1] = 0xfe;
+    CWOrderedDictionary* unarchived = [[[CWOrderedDictionary alloc] initWithCompactArchivedData:data] autorelease];
+    STAssertTrue([unarchived count] == 1, @"Key not decoded");
+    STAssertThrowsSpecificNamed([unarchived objectForKey:@"key"], NSException, NSInvalidArchiveOperationException, @"Undecodable value returned");
+    STAssertThrowsSpecificNamed([unarchived allValues], NSException, NSInvalidArchiveOperationException, @"Undecodable value returned");
+}
+
+-(void)testTaggedPointerValues;
+{
+	// Small numbers and short strings are tagged pointers on 64 bit run-times.
+	NSNumber* one = [NSNumber numberWithInt:1];
+    NSString* shortString = [NSString stringWithFormat:@"%@", @"ab"];
+	CWOrderedDictionary* dict = [CWOrderedDictionary dictionary];
+    [dict setObject:one forKey:@"one"];
+    [dict setObject:shortString forKey:@"short"];
+    STAssertEqualObjects(one, [dict objectForKey:@"one"], @"Tagged value not read back");
+    STAssertEqualObjects(shortString, [dict objectAtIndex:1], @"Tagged value not read back");
+    CWOrderedDictionary* copy = [[dict copy] autorelease];
+    [dict removeObjectForKey:@"one"];
+    STAssertEqualObjects(one, [copy objectForKey:@"one"], @"Tagged value not copied");
+    
+    CWOrderedDictionary* unarchived = [[[CWOrderedDictionary alloc] initWithCompactArchivedData:[copy compactArchivedData]] autorelease];
+    [unarchived setObject:[NSNumber numberWithInt:2] forKey:@"two"];
+    STAssertEqualObjects([NSNumber numberWithInt:2], [unarchived objectForKey:@"two"], @"Tagged value not read back");
+    STAssertEqualObjects(one, [unarchived objectForKey:@"one"], @"Lazy value not decoded");
+}
+
+-(void)testSortByValueUsingDescriptors;
+{
+	CWOrderedDictionary* dict = [CWOrderedDictionary dictionary];
+    [dict setObject:[NSNumber numberWithInt:3] forKey:@"A"];
+    [dict setObject:[NSNumber numberWithDouble:1.5] forKey:@"B"];
+    [dict setObject:[NSNumber numberWithInt:3] forKey:@"C"];
+    [dict setObject:[NSNumber numberWithLongLong:-2] forKey:@"D"];
+    [dict setObject:[NSNumber numberWithInt:7] forKey:@"E"];
+    [dict removeObjectForKey:@"E"];
+    NSArray* descriptors = [NSArray arrayWithObject:[NSSortDescriptor sortDescriptorWithKey:@"self" ascending:NO]];
+    [dict sortByValueUsingDescriptors:descriptors];
+    NSArray* expected = [NSArray arrayWithObjects:@"A", @"C", @"B", @"D", nil];
+    STAssertEqualObjects(expected, [dict allKeys], @"Values not sorted, or equal values not kept in order");
+    [self assertIndexesForKeysInDictionary:dict];
+    
+    [dict sortByKeyUsingDescriptors:[NSArray arrayWithObject:[NSSortDescriptor sortDescriptorWithKey:@"lowercaseString" ascending:YES]]];
+    expected = [NSArray arrayWithObjects:@"A", @"B", @"C", @"D", nil];
+    STAssertEqualObjects(expected, [dict allKeys], @"Keys not sorted");
+}
+
+-(void)testSortWithNilKeyValues;
+{
+	CWOrderedDictionary* dict = [CWOrderedDictionary dictionary];
+    [dict setObject:[NSDictionary dictionaryWithObject:@"b" forKey:@"name"] forKey:@"A"];
+    [dict setObject:[NSDictionary dictionary] forKey:@"B"];
+    [dict setObject:[NSDictionary dictionaryWithObject:@"a" forKey:@"name"] forKey:@"C"];
+    [dict setObject:[NSDictionary dictionary] forKey:@"D"];
+    [dict sortByValueUsingDescriptors:[NSArray arrayWithObject:[NSSortDescriptor sortDescriptorWithKey:@"name" ascending:YES]]];
+    NSArray* expected = [NSArray arrayWithObjects:@"B", @"D", @"C", @"A", nil];
+    STAssertEqualObjects(expected, [dict allKeys], @"Nil not ordered first");
+    [dict sortByValueUsingDescriptors:[NSArray arrayWithObject:[NSSortDescriptor sortDescriptorWithKey:@"name" ascending:NO]]];
+    expected = [NSArray arrayWithObjects:@"A", @"C", @"B", @"D", nil];
+    STAssertEqualObjects(expected, [dict allKeys], @"Nil not ordered last when descending");
+}
+
 @end
@@ -0,0 +1,125 @@
+//
+//  CWPipelineTest.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWPipelineTest.h"
+
+
+@implementation CWPipelineTest
+
+-(void)testChannelEndOfStream;
+{
+	CWChannel* channel = [[[CWChannel alloc] initWithCapacity:2] autorelease];
+    STAssertTrue([channel putObject:@"a"], @"Could not put");
+    STAssertTrue([channel putObject:@"b"], @"Could not put");
+    [channel close];
+    STAssertFalse([channel putObject:@"c"], @"Put to closed channel");
+    NSUInteger sequenceNumber = 0;
+    STAssertEqualObjects([channel takeObject], @"a", @"Wrong object");
+    STAssertEqualObjects([channel takeObjectWithSequenceNumber:&sequenceNumber], @"b", @"Wrong object");
+    STAssertTrue(sequenceNumber == 1, @"Wrong sequence number");
+    STAssertNil([channel takeObject], @"Object after end of stream");
+}
+
+-(id)increment:(NSNumber*)number;
+{
+	[NSThread sleepForTimeInterval:(random() % 5) / 1000.0];
+	return [NSNumber numberWithInt:[number intValue] + 1];
+}
+
+-(id)dropOdd:(NSNumber*)number;
+{
+	return [number intValue] % 2 ? nil : number;
+}
+
+-(id)sleep:(NSNumber*)number;
+{
+	[NSThread sleepForTimeInterval:0.01];
+    return number;
+}
+
+-(id)raiseOnFive:(NSNumber*)number;
+{
+	if ([number intValue] == 5) {
+    	[NSException raise:NSInternalInconsistencyException format:@"Five"];
+    }
+    return number;
+}
+
+-(void)testOrderedPipeline;
+{
+	CWPipeline* pipeline = [[[CWPipeline alloc] initWithChannelCapacity:4 ordered:YES] autorelease];
+    [pipeline addStageWithName:@"increment" target:self selector:@selector(increment:) concurrency:4];
+    CWPipelineStage* dropStage = [pipeline addStageWithName:@"drop" target:self selector:@selector(dropOdd:) concurrency:2];
+    CWChannel* output = [[[CWChannel alloc] initWithCapacity:100] autorelease];
+    [pipeline setOutputChannel:output];
+    [pipeline start];
+    for (int i = 0; i < 100; i++) {
+    	STAssertTrue([pipeline addObject:[NSNumber numberWithInt:i]], @"Could not add");
+    }
+    [pipeline finish];
+    STAssertTrue([pipeline waitUntilFinished], @"Pipeline aborted");
+    STAssertTrue([dropStage processedCount] == 100, @"Wrong processed count");
+    STAssertTrue([dropStage outputCount] == 50, @"Wrong output count");
+    for (int i = 2; i <= 100; i += 2) {
+    	STAssertEqualObjects([output takeObject], [NSNumber numberWithInt:i], @"Out of order");
+    }
+    STAssertNil([output takeObject], @"No end of stream");
+}
+
+-(void)testSlowStageBlocksEarlierStages;
+{
+	CWPipeline* pipeline = [[[CWPipeline alloc] initWithChannelCapacity:2 ordered:NO] autorelease];
+    CWPipelineStage* fastStage = [pipeline addStageWithName:@"fast" target:self selector:@selector(dropOdd:) concurrency:1];
+    CWPipelineStage* slowStage = [pipeline addStageWithName:@"slow" target:self selector:@selector(sleep:) concurrency:1];
+    [pipeline start];
+    for (int i = 0; i < 20; i += 2) {
+    	[pipeline addObject:[NSNumber numberWithInt:i]];
+    }
+    [pipeline finish];
+    [pipeline waitUntilFinished];
+    STAssertTrue([slowStage processedCount] == 10, @"Wrong processed count");
+    STAssertTrue([fastStage blockedTime] > 0.05, @"Fast stage not blocked");
+    STAssertTrue([slowStage utilization] > [fastStage utilization], @"Wrong bottleneck");
+}
+
+-(void)testExceptionAbortsPipeline;
+{
+	CWPipeline* pipeline = [[[CWPipeline alloc] initWithChannelCapacity:2 ordered:NO] autorelease];
+    [pipeline addStageWithName:@"raise" target:self selector:@selector(raiseOnFive:) concurrency:2];
+    [pipeline start];
+    for (int i = 0; i < 10 && [pipeline addObject:[NSNumber numberWithInt:i]]; i++) {
+    }
+    STAssertFalse([pipeline waitUntilFinished], @"Pipeline not aborted");
+    STAssertTrue([pipeline isAborted], @"Pipeline not aborted");
+    STAssertEqualObjects([[pipeline exception] reason], @"Five", @"Wrong exception");
+    STAssertFalse([pipeline addObject:@"late"], @"Added to aborted pipeline");
+}
+
+@end
@@ -0,0 +1,86 @@
+//
+//  CWSortedArrayTest.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWSortedArrayTest.h"
+
+
+@implementation CWSortedArrayTest
+
+-(void)testObjectsAreSortedAfterInsertsAndRemoves;
+{
+	CWSortedArray* sortedArray = [[[CWSortedArray alloc] init] autorelease];
+    NSMutableArray* expected = [NSMutableArray array];
+    srandom(42);
+    for (NSInteger i = 0; i < 10000; i++) {
+    	NSNumber* number = [NSNumber numberWithLong:random() % 5000];
+        NSUInteger index = [sortedArray addObject:number];
+        STAssertTrue(index == [sortedArray lowerBoundForObject:number], @"Inserted at wrong index");
+        [expected addObject:number];
+    }
+    for (NSInteger i = 0; i < 5000; i += 2) {
+    	NSNumber* number = [NSNumber numberWithInteger:i];
+        [sortedArray removeObject:number];
+        NSUInteger index = [expected indexOfObject:number];
+        if (index != NSNotFound) {
+        	[expected removeObjectAtIndex:index];
+        }
+    }
+    [expected sortUsingSelector:@selector(compare:)];
+    STAssertTrue([sortedArray count] == [expected count], @"Wrong count");
+    STAssertEqualObjects(expected, [sortedArray allObjects], @"Objects not sorted");
+    NSUInteger index = 0;
+    for (id object in sortedArray) {
+    	STAssertEqualObjects([expected objectAtIndex:index], object, @"Fast enumeration out of order");
+        STAssertEqualObjects([expected objectAtIndex:index], [sortedArray objectAtIndex:index], @"objectAtIndex: failed");
+        index++;
+    }
+    STAssertTrue(index == [expected count], @"Fast enumeration missed objects");
+    while ([sortedArray count] > 0) {
+    	[sortedArray removeObjectAtIndex:[sortedArray count] / 2];
+    }
+    STAssertTrue([[sortedArray allObjects] count] == 0, @"Not empty after removing all objects");
+}
+
+-(void)testBoundsAndRanges;
+{
+	CWSortedArray* sortedArray = [[[CWSortedArray alloc] initSortedUsingDescriptors:[NSArray arrayWithObject:[NSSortDescriptor sortDescriptorWithKey:@"self" ascending:YES]]] autorelease];
+    [sortedArray addObjectsFromArray:[NSArray arrayWithObjects:@"d", @"b", @"a", @"c", @"b", @"e", nil]];
+    STAssertTrue([sortedArray lowerBoundForObject:@"b"] == 1, @"lowerBound failed");
+    STAssertTrue([sortedArray upperBoundForObject:@"b"] == 3, @"upperBound failed");
+    STAssertTrue([sortedArray indexOfObject:@"c"] == 3, @"indexOfObject: failed");
+    STAssertTrue([sortedArray indexOfObject:@"bb"] == NSNotFound, @"indexOfObject: found missing object");
+    NSRange range = [sortedArray rangeOfObjectsFromObject:@"b" toObject:@"d"];
+    NSArray* expected = [NSArray arrayWithObjects:@"b", @"b", @"c", @"d", nil];
+    STAssertEqualObjects(expected, [sortedArray objectsInRange:range], @"Range failed");
+    range = [sortedArray rangeOfObjectsFromObject:@"x" toObject:@"z"];
+    STAssertTrue(range.length == 0, @"Range for missing objects not empty");
+}
+
+@end
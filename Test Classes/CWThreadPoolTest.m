@@ -0,0 +1,66 @@
+//
+//  CWThreadPoolTest.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWThreadPoolTest.h"
+
+
+@implementation CWThreadPoolTest
+
+-(void)incrementRunCount;
+{
+	[condition lock];
+    [threads addObject:[NSThread currentThread]];
+    runCount++;
+    [condition signal];
+    [condition unlock];
+}
+
+-(void)testPerformOnBoundedThreads;
+{
+	CWThreadPool* pool = [[[CWThreadPool alloc] initWithMaximumThreadCount:2 idleTimeout:0.1] autorelease];
+    condition = [[NSCondition alloc] init];
+    threads = [[NSMutableSet alloc] init];
+    runCount = 0;
+    for (NSInteger i = 0; i < 1000; i++) {
+    	[pool performSelector:@selector(incrementRunCount) onTarget:self withObject:nil];
+    }
+    NSDate* timeout = [NSDate dateWithTimeIntervalSinceNow:10];
+    [condition lock];
+    while (runCount < 1000 && [condition waitUntilDate:timeout]);
+    [condition unlock];
+    STAssertTrue(runCount == 1000, @"Not all selectors performed");
+    STAssertTrue([threads count] <= 2, @"Maximum thread count exceeded");
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:1]];
+    STAssertTrue([pool threadCount] == 0, @"Idle threads did not exit");
+    [threads release];
+    [condition release];
+}
+
+@end
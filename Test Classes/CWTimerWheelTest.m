@@ -0,0 +1,169 @@
+//
+//  CWTimerWheelTest.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWTimerWheelTest.h"
+#import "NSInvocation+CWVariableArguments.h"
+
+
+@implementation CWTimerWheelTest
+
+-(void)timerFiredWithDeadline:(NSNumber*)deadline;
+{
+	NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+    NSTimeInterval time = [deadline doubleValue];
+    // Allow for millisecond resolution, and NSDate and the monotonic clock
+    // differing slightly.
+    if (time < lastDeadline - 0.002) {
+    	outOfOrderCount++;
+    }
+    if (now < time - 0.002) {
+    	earlyCount++;
+    }
+    maximumDrift = MAX(maximumDrift, now - time);
+    lastDeadline = time;
+    firedCount++;
+}
+
+-(void)testOrderAndDriftOfManyTimers;
+{
+	CWTimerWheel* wheel = [CWTimerWheel currentWheel];
+    firedCount = outOfOrderCount = earlyCount = 0;
+    lastDeadline = maximumDrift = 0;
+    for (NSInteger i = 0; i < 100000; i++) {
+        NSTimeInterval delay = 0.5 + (i * 7919 % 1000) / 1000.0;
+        NSTimeInterval deadline = [NSDate timeIntervalSinceReferenceDate] + delay;
+    	[wheel performSelector:@selector(timerFiredWithDeadline:)
+                      onTarget:self
+                    withObject:[NSNumber numberWithDouble:deadline]
+                    afterDelay:delay];
+    }
+    STAssertTrue([wheel count] == 100000, @"Wrong pending count");
+    NSDate* timeout = [NSDate dateWithTimeIntervalSinceNow:10];
+    while (firedCount < 100000 && [timeout timeIntervalSinceNow] > 0) {
+    	[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:timeout];
+    }
+    STAssertTrue(firedCount == 100000, @"Not all timers fired");
+    STAssertTrue(outOfOrderCount == 0, @"Timers fired out of order");
+    STAssertTrue(earlyCount == 0, @"Timers fired early");
+    STAssertTrue(maximumDrift < 0.25, @"Timers fired too late");
+    STAssertTrue([wheel count] == 0, @"Wrong pending count");
+}
+
+-(void)testCancelTimers;
+{
+	CWTimerWheel* wheel = [CWTimerWheel currentWheel];
+    firedCount = outOfOrderCount = earlyCount = 0;
+    lastDeadline = maximumDrift = 0;
+    NSMutableArray* handles = [NSMutableArray array];
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    for (NSInteger i = 0; i < 1000; i++) {
+    	[handles addObject:[wheel performSelector:@selector(timerFiredWithDeadline:)
+                                         onTarget:self
+                                       withObject:[NSNumber numberWithDouble:start + 0.1]
+                                       afterDelay:0.1]];
+    }
+    for (NSInteger i = 0; i < 1000; i += 2) {
+    	STAssertTrue([[handles objectAtIndex:i] cancel], @"Could not cancel");
+    }
+    STAssertFalse([[handles objectAtIndex:0] cancel], @"Cancelled twice");
+    STAssertTrue([wheel count] == 500, @"Wrong pending count");
+    NSInvocation* invocation = [NSInvocation invocationWithMethodSignature:[self methodSignatureForSelector:@selector(timerFiredWithDeadline:)]];
+    [invocation setTarget:self];
+    [invocation setSelector:@selector(timerFiredWithDeadline:)];
+    [[invocation invokeAfterDelay:0.05] cancel];
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.5]];
+    STAssertTrue(firedCount == 500, @"Cancelled timers fired");
+    STAssertTrue([[handles objectAtIndex:1] isFired], @"Timer not fired");
+    STAssertTrue([[handles objectAtIndex:0] isCancelled], @"Timer not cancelled");
+}
+
+/*
+ * Schedule timers with the same delay on the current thread's wheel, and
+ * return the objects in the order fired.
+ */
+-(NSArray*)firedOrderOfTimersWithEqualDelay;
+{
+	CWTimerWheel* wheel = [CWTimerWheel currentWheel];
+    NSMutableArray* fired = [NSMutableArray array];
+    for (NSInteger i = 0; i < 10000; i++) {
+    	[wheel performSelector:@selector(addObject:)
+                      onTarget:fired
+                    withObject:[NSNumber numberWithInteger:i]
+                    afterDelay:0.1];
+    }
+    NSDate* timeout = [NSDate dateWithTimeIntervalSinceNow:5];
+    while ([fired count] < 10000 && [timeout timeIntervalSinceNow] > 0) {
+    	[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:timeout];
+    }
+    return fired;
+}
+
+-(void)scheduleTimersInBackground:(NSMutableArray*)result;
+{
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    NSArray* fired = [self firedOrderOfTimersWithEqualDelay];
+    @synchronized(result) {
+	    [result addObject:fired];
+    }
+    [pool drain];
+}
+
+-(void)testInsertionOrderOnConcurrentWheels;
+{
+	NSMutableArray* results = [NSMutableArray array];
+    for (NSInteger i = 0; i < 3; i++) {
+    	[NSThread detachNewThreadSelector:@selector(scheduleTimersInBackground:) toTarget:self withObject:results];
+    }
+    NSArray* fired = [self firedOrderOfTimersWithEqualDelay];
+    NSDate* timeout = [NSDate dateWithTimeIntervalSinceNow:5];
+    while ([timeout timeIntervalSinceNow] > 0) {
+    	@synchronized(results) {
+        	if ([results count] == 3) {
+            	break;
+            }
+        }
+        [NSThread sleepForTimeInterval:0.01];
+    }
+    @synchronized(results) {
+	    [results addObject:fired];
+    }
+    STAssertTrue([results count] == 4, @"Background wheels did not finish");
+    for (NSArray* order in results) {
+    	STAssertTrue([order count] == 10000, @"Not all timers fired");
+        for (NSInteger i = 0; i < (NSInteger)[order count]; i++) {
+        	if ([[order objectAtIndex:i] integerValue] != i) {
+            	STFail(@"Timers with equal delay fired out of insertion order");
+                break;
+            }
+        }
+    }
+}
+
+@end
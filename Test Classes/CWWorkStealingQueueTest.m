@@ -0,0 +1,180 @@
+//
+//  CWWorkStealingQueueTest.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "CWWorkStealingQueueTest.h"
+#import "NSOperationQueue+CWDefaultQueue.h"
+#import "CWAtomic.h"
+
+static volatile int32_t CWTaskCount = 0;
+
+static void CWIncrementTaskCount(void* context)
+{
+	CWAtomicIncrement32(&CWTaskCount);
+}
+
+
+@implementation CWWorkStealingQueueTest
+
+-(void)incrementTaskCount:(id)object;
+{
+	CWAtomicIncrement32(&CWTaskCount);
+}
+
+-(void)testAllTasksAreRun;
+{
+	CWWorkStealingQueue* queue = [[[CWWorkStealingQueue alloc] initWithWorkerCount:4] autorelease];
+    CWTaskCount = 0;
+    [queue setSuspended:YES];
+    for (NSInteger i = 0; i < 10000; i++) {
+    	[queue addOperationWithFunction:&CWIncrementTaskCount context:NULL];
+        [queue addOperationWithTarget:self selector:@selector(incrementTaskCount:) object:nil];
+    }
+    STAssertTrue(CWTaskCount == 0, @"Tasks run while suspended");
+    STAssertTrue([queue operationCount] == 20000, @"Wrong operation count");
+    [queue setSuspended:NO];
+    [queue waitUntilAllOperationsAreFinished];
+    STAssertTrue(CWTaskCount == 20000, @"Not all tasks run");
+    STAssertTrue([queue operationCount] == 0, @"Operations left after waiting");
+}
+
+-(void)testOperationsWithDependencies;
+{
+	CWWorkStealingQueue* queue = [[[CWWorkStealingQueue alloc] initWithWorkerCount:2] autorelease];
+    CWTaskCount = 0;
+    NSInvocationOperation* first = [[[NSInvocationOperation alloc] initWithTarget:self selector:@selector(incrementTaskCount:) object:nil] autorelease];
+    NSInvocationOperation* second = [[[NSInvocationOperation alloc] initWithTarget:self selector:@selector(incrementTaskCount:) object:nil] autorelease];
+    [second addDependency:first];
+    [queue addOperation:second];
+    [queue addOperation:first];
+    [queue waitUntilAllOperationsAreFinished];
+    STAssertTrue([first isFinished] && [second isFinished], @"Operations not finished");
+    STAssertTrue(CWTaskCount == 2, @"Not all operations run");
+}
+
+-(void)testDefaultQueueMethodsUseInstalledQueue;
+{
+	NSOperationQueue* oldQueue = [[NSOperationQueue defaultQueue] retain];
+    CWWorkStealingQueue* queue = [[[CWWorkStealingQueue alloc] init] autorelease];
+    [NSOperationQueue setDefaultQueue:queue];
+    CWTaskCount = 0;
+    NSInvocationOperation* operation = [self performSelectorInDefaultQueue:@selector(incrementTaskCount:) withObject:nil];
+    [operation waitUntilFinished];
+    STAssertTrue(CWTaskCount == 1, @"Operation not run");
+    [NSOperationQueue setDefaultQueue:oldQueue];
+    [oldQueue release];
+}
+
+-(void)recordTaskOrder:(NSArray*)orderAndNumber;
+{
+	NSMutableArray* order = [orderAndNumber objectAtIndex:0];
+    @synchronized(order) {
+    	[order addObject:[orderAndNumber objectAtIndex:1]];
+    }
+}
+
+-(void)addOrderedTasks:(NSArray*)queueAndOrder;
+{
+	CWWorkStealingQueue* queue = [queueAndOrder objectAtIndex:0];
+    for (NSInteger i = 0; i < 3; i++) {
+    	NSArray* orderAndNumber = [NSArray arrayWithObjects:[queueAndOrder objectAtIndex:1], [NSNumber numberWithInteger:i], nil];
+    	[queue addOperationWithTarget:self selector:@selector(recordTaskOrder:) object:orderAndNumber];
+    }
+}
+
+-(void)testWorkerRunsNewestTaskFirst;
+{
+	CWWorkStealingQueue* queue = [[[CWWorkStealingQueue alloc] initWithWorkerCount:1] autorelease];
+    NSMutableArray* order = [NSMutableArray array];
+    [queue addOperationWithTarget:self selector:@selector(addOrderedTasks:) object:[NSArray arrayWithObjects:queue, order, nil]];
+    [queue waitUntilAllOperationsAreFinished];
+    NSArray* expectedOrder = [NSArray arrayWithObjects:[NSNumber numberWithInt:2], [NSNumber numberWithInt:1], [NSNumber numberWithInt:0], nil];
+    STAssertEqualObjects(expectedOrder, order, @"Tasks added by a worker not run newest first");
+}
+
+-(void)testWorkerRunsAddedTasksInOrder;
+{
+	CWWorkStealingQueue* queue = [[[CWWorkStealingQueue alloc] initWithWorkerCount:1] autorelease];
+    NSMutableArray* order = [NSMutableArray array];
+    NSMutableArray* expectedOrder = [NSMutableArray array];
+    [queue setSuspended:YES];
+    for (NSInteger i = 0; i < 100; i++) {
+    	NSNumber* number = [NSNumber numberWithInteger:i];
+        [expectedOrder addObject:number];
+    	[queue addOperationWithTarget:self selector:@selector(recordTaskOrder:) object:[NSArray arrayWithObjects:order, number, nil]];
+    }
+    [queue setSuspended:NO];
+    [queue waitUntilAllOperationsAreFinished];
+    STAssertEqualObjects(expectedOrder, order, @"Tasks added from outside the workers not run oldest first");
+}
+
+-(void)spinForDuration:(NSNumber*)duration;
+{
+	CFAbsoluteTime end = CFAbsoluteTimeGetCurrent() + [duration doubleValue];
+    while (CFAbsoluteTimeGetCurrent() < end) {
+    }
+}
+
+/*
+ * Wall time to run tasks spinning for 1 us to 1 ms, about 0.2 s of work per
+ * duration, on a CWWorkStealingQueue and on a NSOperationQueue with the same
+ * number of threads. Only logged, the overhead per task dominates for short
+ * tasks.
+ */
+-(void)testTaskDurationsComparedToOperationQueue;
+{
+	NSUInteger workerCount = [[NSProcessInfo processInfo] activeProcessorCount];
+	CWWorkStealingQueue* stealingQueue = [[[CWWorkStealingQueue alloc] initWithWorkerCount:workerCount] autorelease];
+    NSOperationQueue* operationQueue = [[[NSOperationQueue alloc] init] autorelease];
+    [operationQueue setMaxConcurrentOperationCount:workerCount];
+    for (NSTimeInterval duration = 1.0e-6; duration < 2.0e-3; duration *= 10) {
+    	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+        NSNumber* durationNumber = [NSNumber numberWithDouble:duration];
+        NSUInteger taskCount = MIN((NSUInteger)(0.2 / duration), 100000);
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger i = 0; i < taskCount; i++) {
+        	[stealingQueue addOperationWithTarget:self selector:@selector(spinForDuration:) object:durationNumber];
+        }
+        [stealingQueue waitUntilAllOperationsAreFinished];
+        NSTimeInterval stealingTime = CFAbsoluteTimeGetCurrent() - start;
+        start = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger i = 0; i < taskCount; i++) {
+        	NSOperation* operation = [[NSInvocationOperation alloc] initWithTarget:self selector:@selector(spinForDuration:) object:durationNumber];
+        	[operationQueue addOperation:operation];
+            [operation release];
+        }
+        [operationQueue waitUntilAllOperationsAreFinished];
+        NSTimeInterval operationTime = CFAbsoluteTimeGetCurrent() - start;
+        NSLog(@"%lu tasks of %.0f us on %lu threads: %.3f s work stealing, %.3f s NSOperationQueue",
+              (unsigned long)taskCount, duration * 1.0e6, (unsigned long)workerCount, stealingTime, operationTime);
+        [pool drain];
+    }
+}
+
+@end
@@ -51,4 +51,7 @@
 -(void)testTranslatorTranslatesURLTag;
 -(void)testTranslatorTranslatesURLAttribute;
 
+-(void)testTranslatorInternsStrings;
+-(void)testTranslatorInternsStringsForKeys;
+
 @end
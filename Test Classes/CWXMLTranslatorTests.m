@@ -185,6 +185,38 @@
     STAssertTrue([[object objectForKey:@"a"] isKindOfClass:[NSURL class]], @"Should be an NSURL, is %@", NSStringFromClass([[object objectForKey:@"a"] class]));
 }
 
+-(void)testTranslatorInternsStrings;
+{
+    CWXMLTranslator* translator = [self translatorWithDSLString:@"a>>@root:NSMutableDictionary{b>>b;.c>>c;};"];
+    translator.internsStrings = YES;
+    
+    NSArray* objects = [self objectsByTranslatingXMLString:@"<xml><a c='C'><b>B</b></a><a c='C'><b>B</b></a></xml>"
+                                            withTranslator:translator];
+    STAssertEquals(2u, [objects count], @"Should have two root objects");
+    NSDictionary* first = [objects objectAtIndex:0];
+    NSDictionary* last = [objects lastObject];
+    STAssertEqualObjects(@"B", [first objectForKey:@"b"], @"Object for key b should be 'B'");
+    STAssertTrue([first objectForKey:@"b"] == [last objectForKey:@"b"], @"Tag values should be interned");
+    STAssertTrue([first objectForKey:@"c"] == [last objectForKey:@"c"], @"Attribute values should be interned");
+    STAssertFalse([[first objectForKey:@"b"] isKindOfClass:[NSMutableString class]], @"Interned strings should be immutable");
+}
+
+-(void)testTranslatorInternsStringsForKeys;
+{
+    CWXMLTranslator* translator = [self translatorWithDSLString:@"a>>@root:NSMutableDictionary{b>>b;c>>c;};"];
+    translator.internsStrings = YES;
+    translator.internedStringKeys = [NSSet setWithObject:@"b"];
+    
+    NSArray* objects = [self objectsByTranslatingXMLString:@"<xml><a><b>B</b><c>C</c></a><a><b>B</b><c>C</c></a></xml>"
+                                            withTranslator:translator];
+    STAssertEquals(2u, [objects count], @"Should have two root objects");
+    NSDictionary* first = [objects objectAtIndex:0];
+    NSDictionary* last = [objects lastObject];
+    STAssertTrue([first objectForKey:@"b"] == [last objectForKey:@"b"], @"Values for key b should be interned");
+    STAssertFalse([first objectForKey:@"c"] == [last objectForKey:@"c"], @"Values for key c should not be interned");
+    STAssertEqualObjects([first objectForKey:@"c"], [last objectForKey:@"c"], @"Values for key c should be equal");
+}
+
 #pragma mark --- Delegate methods
 
 -(id)xmlTranslator:(CWXMLTranslator *)translator objectInstanceOfClass:(Class)aClass fromXMLname:(NSString *)name xmlAttributes:(NSDictionary *)attributes toKey:(NSString *)key shouldSkip:(BOOL *)skip;
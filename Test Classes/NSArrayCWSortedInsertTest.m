@@ -0,0 +1,76 @@
+//
+//  NSArrayCWSortedInsertTest.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "NSArrayCWSortedInsertTest.h"
+
+
+@implementation NSArrayCWSortedInsertTest
+
+-(void)testInsertObjectsFromArray;
+{
+	NSMutableArray* array = [NSMutableArray array];
+    NSMutableArray* inserted = [NSMutableArray array];
+    srandom(42);
+    for (NSInteger i = 0; i < 2000; i++) {
+    	[array addObject:[NSNumber numberWithLong:random() % 1000]];
+        [inserted addObject:[NSNumber numberWithLong:random() % 1200]];
+    }
+    [array sortUsingSelector:@selector(compare:)];
+    NSMutableArray* expected = [[array mutableCopy] autorelease];
+    for (id object in inserted) {
+    	[expected insertObject:object sortedUsingSelector:@selector(compare:)];
+    }
+    [array insertObjectsFromArray:inserted sortedUsingSelector:@selector(compare:)];
+    STAssertEqualObjects(expected, array, @"Merged objects not sorted");
+}
+
+-(void)testInsertObjectsFromArrayMergePolicies;
+{
+	NSArray* descriptors = [NSArray arrayWithObject:[NSSortDescriptor sortDescriptorWithKey:@"intValue" ascending:YES]];
+    NSArray* original = [NSArray arrayWithObjects:@"1a", @"3a", @"5a", nil];
+    NSArray* inserted = [NSArray arrayWithObjects:@"3c", @"4a", @"3b", @"0a", nil];
+    
+    NSMutableArray* array = [[original mutableCopy] autorelease];
+    [array insertObjectsFromArray:inserted sortedUsingDescriptors:descriptors mergePolicy:CWSortedInsertKeepBoth];
+    NSArray* expected = [NSArray arrayWithObjects:@"0a", @"1a", @"3a", @"3c", @"3b", @"4a", @"5a", nil];
+    STAssertEqualObjects(expected, array, @"Keep both policy failed");
+    
+    array = [[original mutableCopy] autorelease];
+    [array insertObjectsFromArray:inserted sortedUsingDescriptors:descriptors mergePolicy:CWSortedInsertKeepFirst];
+    expected = [NSArray arrayWithObjects:@"0a", @"1a", @"3a", @"4a", @"5a", nil];
+    STAssertEqualObjects(expected, array, @"Keep first policy failed");
+    
+    array = [[original mutableCopy] autorelease];
+    [array insertObjectsFromArray:inserted sortedUsingDescriptors:descriptors mergePolicy:CWSortedInsertKeepLast];
+    expected = [NSArray arrayWithObjects:@"0a", @"1a", @"3b", @"4a", @"5a", nil];
+    STAssertEqualObjects(expected, array, @"Keep last policy failed");
+}
+
+@end
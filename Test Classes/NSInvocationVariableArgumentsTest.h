@@ -32,20 +32,32 @@
 #import <Foundation/Foundation.h>
 
 @interface NSInvocationVariableArgumentsTest : SenTestCase {
+	int8_t storedInt8;
+    id storedObject;
+    long storedLong;
+    unsigned long storedUnsignedLong;
+    NSUInteger forwardedCount;
 }
 
 -(void)testMarshalBOOLArguments;
 -(void)testMarshalIntegerArguments;
 -(void)testMarshalRealArguments;
 -(void)testMarshalStructArguments;
+-(void)testMarshalMixedArguments;
+-(void)testMarshalSpeed;
 
 
 -(void)testInvokeOnDefaulQueue;
 
 -(void)testInvokeInBackground;
 
+-(void)testInvokeConcurrentlyWithAllTargets;
+
 -(void)testCurrentThreadProxy;
 -(void)testBackgroundProxy;
 -(void)testQueueProxy;
+-(void)testQueueProxyScalarAndObjectArguments;
+-(void)testQueueProxyLongArguments;
+-(void)testProxyForwardingSpeed;
 
 @end
@@ -111,11 +111,69 @@ typedef struct {
     a.d.a = NO;
     a.d.b = self;
     a.d.c = YES;
+#if defined(__i386__) || defined(__arm__)
     [[NSInvocation invocationWithTarget:self
                                selector:@selector(assertRange:stupid:marker:)
                         retainArguments:YES,
       NSMakeRange(1, 41),
       a, 0x12345678] invoke];
+#else
+	// Arbitrary structs can not be read from a va_list on 64 bit ABIs.
+    STAssertThrowsSpecificNamed(([NSInvocation invocationWithTarget:self
+                                                           selector:@selector(assertRange:stupid:marker:)
+                                                    retainArguments:YES,
+                                  NSMakeRange(1, 41),
+                                  a, 0x12345678]),
+                                NSException, NSInvalidArgumentException, @"Unsupported struct marshalled");
+#endif
+}
+
+-(void)assertChar:(char)a float:(float)b range:(NSRange)c object:(id)d double:(double)e longLong:(long long)f short:(unsigned short)g marker:(int)m;
+{
+	STAssertTrue(a == -7, @"-7");
+    STAssertTrue(b == 0.5f, @"0.5");
+    STAssertTrue(NSEqualRanges(c, NSMakeRange(3, 4)), @"{3, 4}");
+    STAssertTrue(d == self, @"self");
+    STAssertTrue(e == 2.25, @"2.25");
+    STAssertTrue(f == -1234567890123LL, @"-1234567890123");
+    STAssertTrue(g == 65535, @"65535");
+    STAssertEquals(0x12345678, m, @"marker");
+}
+
+-(void)testMarshalMixedArguments;
+{
+	// Twice, to use the cached argument layout.
+	for (int i = 0; i < 2; i++) {
+        [[NSInvocation invocationWithTarget:self
+                                   selector:@selector(assertChar:float:range:object:double:longLong:short:marker:)
+                            retainArguments:YES, (char)-7, 0.5f, NSMakeRange(3, 4), self, 2.25,
+          -1234567890123LL, (unsigned short)65535, 0x12345678] invoke];
+    }
+}
+
+/*
+ * Invocations per second created from variable arguments, with the argument
+ * layout cached after the first. Logged only.
+ */
+-(void)testMarshalSpeed;
+{
+	const NSUInteger count = 100000;
+    SEL selector = @selector(assertChar:float:range:object:double:longLong:short:marker:);
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    for (NSUInteger index = 0; index < count; index++) {
+    	[NSInvocation invocationWithTarget:self
+                                  selector:selector
+                           retainArguments:NO, (char)-7, 0.5f, NSMakeRange(3, 4), self, 2.25,
+         -1234567890123LL, (unsigned short)65535, 0x12345678];
+        if (index % 1000 == 999) {
+        	[pool drain];
+            pool = [[NSAutoreleasePool alloc] init];
+        }
+    }
+    CFAbsoluteTime time = CFAbsoluteTimeGetCurrent() - start;
+    [pool drain];
+    NSLog(@"Marshalled %lu invocations with 8 arguments: %.0f/s", (unsigned long)count, count / time);
 }
 
 -(int)addInt:(int)a withInt:(int)b;
@@ -156,6 +214,21 @@ typedef struct {
     }
 }
 
+-(void)testInvokeConcurrentlyWithAllTargets;
+{
+	NSMutableArray* targets = [NSMutableArray array];
+    for (int i = 0; i < 200; i++) {
+    	[targets addObject:[NSNumber numberWithInt:i]];
+    }
+    NSInvocation* invocation = [NSInvocation invocationForInstancesOfClass:[NSNumber class]
+                                                              withSelector:@selector(intValue)
+                                                           retainArguments:YES];
+    NSArray* results = [invocation invokeConcurrentlyWithAllTargets:targets
+                                                 maximumConcurrency:4
+                                                       returnValues:YES];
+    STAssertEqualObjects(results, targets, @"Return values not in target order");
+}
+
 -(void)testCurrentThreadProxy;
 {
     NSConditionLock* lock = [[NSConditionLock alloc] initWithCondition:0];
@@ -187,4 +260,79 @@ typedef struct {
     }
 }
 
+-(void)storeInt8:(int8_t)a object:(id)b;
+{
+    STAssertFalse([NSThread isMainThread], @"Must be background thread");
+	storedInt8 = a;
+    storedObject = b;
+}
+
+-(void)testQueueProxyScalarAndObjectArguments;
+{
+	NSObject* object = [[[NSObject alloc] init] autorelease];
+    for (int i = 0; i < 2; i++) {
+    	storedInt8 = 0;
+        storedObject = nil;
+		[[[self defaultQueueProxy] waitUntilDone] storeInt8:-11 object:object];
+	    STAssertTrue(storedInt8 == -11, @"-11");
+    	STAssertTrue(storedObject == object, @"object");
+    }
+}
+
+-(void)storeLong:(long)a unsignedLong:(unsigned long)b;
+{
+	storedLong = a;
+    storedUnsignedLong = b;
+}
+
+-(void)testQueueProxyLongArguments;
+{
+    for (int i = 0; i < 2; i++) {
+    	storedLong = 0;
+        storedUnsignedLong = 0;
+		[[[self defaultQueueProxy] waitUntilDone] storeLong:LONG_MIN unsignedLong:ULONG_MAX];
+	    STAssertTrue(storedLong == LONG_MIN, @"LONG_MIN");
+    	STAssertTrue(storedUnsignedLong == ULONG_MAX, @"ULONG_MAX");
+    }
+}
+
+-(void)countInteger:(NSInteger)value;
+{
+	forwardedCount++;
+}
+
+-(void)countDouble:(double)value;
+{
+	forwardedCount++;
+}
+
+/*
+ * Messages per second forwarded by a current thread proxy, through the fast
+ * path for integer arguments and through the NSInvocation path for a double
+ * argument. Logged only, the ratio depends on the runtime.
+ */
+-(void)testProxyForwardingSpeed;
+{
+	const NSUInteger count = 100000;
+    id proxy = [self threadProxy:[NSThread currentThread]];
+    forwardedCount = 0;
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    for (NSUInteger index = 0; index < count; index++) {
+    	[proxy countInteger:index];
+    }
+    CFAbsoluteTime fastTime = CFAbsoluteTimeGetCurrent() - start;
+    [pool drain];
+    pool = [[NSAutoreleasePool alloc] init];
+    start = CFAbsoluteTimeGetCurrent();
+    for (NSUInteger index = 0; index < count; index++) {
+    	[proxy countDouble:index];
+    }
+    CFAbsoluteTime invocationTime = CFAbsoluteTimeGetCurrent() - start;
+    [pool drain];
+    STAssertTrue(forwardedCount == 2 * count, @"Messages lost");
+    NSLog(@"Forwarded %lu messages: fast path %.0f/s, NSInvocation path %.0f/s, %.1fx",
+          (unsigned long)count, count / fastTime, count / invocationTime, invocationTime / fastTime);
+}
+
 @end
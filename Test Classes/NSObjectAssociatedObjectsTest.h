@@ -40,5 +40,7 @@
 -(void)testAssociatedObjectsAssignPolicy;
 -(void)testAssociatedObjectsCopyPolicy;
 -(void)testAssociatedObjectsRetainPolicy;
+-(void)testManyAssociatedObjects;
+-(void)testConcurrentAssociatedObjects;
 
 @end
@@ -84,4 +84,52 @@ static char* const key = "key";
 	STAssertTrue(associatedObject == fetchedObject, @"Fetched associated object is pointer identity.");
 }
 
+-(void)testManyAssociatedObjects;
+{
+	static char keys[6];
+    for (int i = 0; i < 6; i++) {
+	    [object setAssociatedObject:associatedObject forStaticKey:&keys[i]];
+    }
+    STAssertEquals([associatedObject retainCount], 7u, @"Associated object retain count should be 7");
+    NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    for (int i = 0; i < 6; i++) {
+	    STAssertTrue([object associatedObjectForStaticKey:&keys[i]] == associatedObject, @"Wrong associated object");
+    }
+    for (int i = 0; i < 6; i++) {
+	    [object setAssociatedObject:nil forStaticKey:&keys[i]];
+        STAssertNil([object associatedObjectForStaticKey:&keys[i]], @"Associated object not removed");
+    }
+    [pool drain];
+    STAssertEquals([associatedObject retainCount], 1u, @"Associated object retain count should be 1");
+}
+
+-(void)associateObjects:(NSArray*)objects;
+{
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    for (int i = 0; i < 1000; i++) {
+	    for (id anObject in objects) {
+        	[anObject setAssociatedObject:anObject forStaticKey:key withAssociationPolicy:OBJC_ASSOCIATION_ASSIGN];
+            [anObject associatedObjectForStaticKey:key];
+            [anObject setAssociatedObject:nil forStaticKey:key];
+        }
+    }
+    [pool drain];
+}
+
+-(void)testConcurrentAssociatedObjects;
+{
+	NSMutableArray* objects = [NSMutableArray array];
+    for (int i = 0; i < 64; i++) {
+    	[objects addObject:[[[NSObject alloc] init] autorelease]];
+    }
+    NSOperationQueue* queue = [[[NSOperationQueue alloc] init] autorelease];
+    for (int i = 0; i < 4; i++) {
+    	[queue addOperation:[[[NSInvocationOperation alloc] initWithTarget:self selector:@selector(associateObjects:) object:objects] autorelease]];
+    }
+    [queue waitUntilAllOperationsAreFinished];
+    for (id anObject in objects) {
+    	STAssertNil([anObject associatedObjectForStaticKey:key], @"Associated object not removed");
+    }
+}
+
 @end
@@ -0,0 +1,154 @@
+//
+//  NSOperationQueueCWBoundedQueueTest.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "NSOperationQueueCWBoundedQueueTest.h"
+#import "NSError+CWAdditions.h"
+#import "NSOperationQueue+CWDefaultQueue.h"
+#import "NSOperationQueue+CWReplaceOperation.h"
+#import "CWCancellationGroup.h"
+
+
+@implementation NSOperationQueueCWBoundedQueueTest
+
+-(void)doNothing;
+{
+}
+
+-(void)testRejectWhenFull;
+{
+	NSOperationQueue* queue = [[[NSOperationQueue alloc] init] autorelease];
+    [queue setMaximumPendingOperationCount:0 maximumPendingWeight:100 overflowPolicy:CWQueueOverflowPolicyReject];
+    [queue setSuspended:YES];
+    NSError* error = nil;
+    STAssertTrue([queue addOperation:[[[NSOperation alloc] init] autorelease] weight:60 error:&error], @"Could not add");
+    STAssertTrue([queue addOperation:[[[NSOperation alloc] init] autorelease] weight:40 error:&error], @"Could not add");
+    STAssertFalse([queue addOperation:[[[NSOperation alloc] init] autorelease] weight:1 error:&error], @"Added to full queue");
+    STAssertEqualObjects([error domain], CWFoundationAdditionsErrorDomain, @"Wrong error domain");
+    STAssertTrue([error code] == CWOperationQueueFullError, @"Wrong error code");
+    STAssertNil([self performSelector:@selector(doNothing) onQueue:queue withObject:nil], @"Added to full queue");
+    STAssertTrue([queue pendingWeight] == 100, @"Wrong pending weight");
+    STAssertTrue([queue boundedQueueMetrics].rejectedCount == 2, @"Wrong rejected count");
+    [queue setSuspended:NO];
+    [queue waitUntilAllOperationsAreFinished];
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    STAssertTrue([queue pendingOperationCount] == 0, @"Finished operations pending");
+}
+
+-(void)testDropOldestWhenFull;
+{
+	NSOperationQueue* queue = [[[NSOperationQueue alloc] init] autorelease];
+    [queue setMaximumPendingOperationCount:2 maximumPendingWeight:0 overflowPolicy:CWQueueOverflowPolicyDropOldest];
+    [queue setSuspended:YES];
+    NSMutableArray* operations = [NSMutableArray array];
+    for (int i = 0; i < 5; i++) {
+    	NSOperation* operation = [[[NSOperation alloc] init] autorelease];
+        [operations addObject:operation];
+	    STAssertTrue([queue addOperation:operation weight:1 error:NULL], @"Could not add");
+    }
+    STAssertTrue([[operations objectAtIndex:2] isCancelled], @"Oldest not dropped");
+    STAssertFalse([[operations objectAtIndex:3] isCancelled], @"Newest dropped");
+    STAssertTrue([queue pendingOperationCount] == 2, @"Wrong pending count");
+    STAssertTrue([queue boundedQueueMetrics].droppedCount == 3, @"Wrong dropped count");
+    [queue setSuspended:NO];
+    [queue waitUntilAllOperationsAreFinished];
+}
+
+-(void)testFinishedOperationsAreUnlinked;
+{
+	NSOperationQueue* queue = [[[NSOperationQueue alloc] init] autorelease];
+    [queue setMaximumPendingOperationCount:3 maximumPendingWeight:0 overflowPolicy:CWQueueOverflowPolicyDropOldest];
+    NSOperation* blocker = [[[NSOperation alloc] init] autorelease];
+    NSMutableArray* operations = [NSMutableArray array];
+    for (int i = 0; i < 3; i++) {
+    	NSOperation* operation = [[[NSOperation alloc] init] autorelease];
+        if (i != 1) {
+        	[operation addDependency:blocker];
+        }
+        [operations addObject:operation];
+	    STAssertTrue([queue addOperation:operation weight:1 error:NULL], @"Could not add");
+    }
+    [(NSOperation*)[operations objectAtIndex:1] waitUntilFinished];
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    STAssertTrue([queue pendingOperationCount] == 2, @"Finished operation not unlinked");
+    NSOperation* operation = [[[NSOperation alloc] init] autorelease];
+    [operation addDependency:blocker];
+    STAssertTrue([queue addOperation:operation weight:1 error:NULL], @"Could not add");
+    STAssertTrue([queue boundedQueueMetrics].droppedCount == 0, @"Dropped with room left");
+    operation = [[[NSOperation alloc] init] autorelease];
+    STAssertTrue([queue addOperation:operation weight:1 error:NULL], @"Could not add");
+    STAssertTrue([[operations objectAtIndex:0] isCancelled], @"Oldest not dropped");
+    STAssertFalse([[operations objectAtIndex:2] isCancelled], @"Newer dropped");
+    [queue addOperation:blocker];
+    [queue waitUntilAllOperationsAreFinished];
+}
+
+-(void)testCoalescedAndGroupedOperationsAreBounded;
+{
+	NSOperationQueue* queue = [[[NSOperationQueue alloc] init] autorelease];
+    [queue setMaximumPendingOperationCount:1 maximumPendingWeight:0 overflowPolicy:CWQueueOverflowPolicyReject];
+    [queue setSuspended:YES];
+    NSOperation* operation = [[[NSOperation alloc] init] autorelease];
+    [queue addOperation:operation coalescingKey:@"A"];
+    STAssertTrue([queue pendingOperationCount] == 1, @"Coalesced operation not bounded");
+    [queue addOperation:[[[NSOperation alloc] init] autorelease] coalescingKey:@"B"];
+    STAssertTrue([queue operationForCoalescingKey:@"B"] == nil, @"Rejected operation in coalescing table");
+    CWCancellationGroup* group = [CWCancellationGroup group];
+    STAssertNil([self performSelector:@selector(doNothing) onQueue:queue withObject:nil cancellationGroup:group], @"Added to full queue");
+    STAssertTrue([group operationCount] == 0, @"Rejected operation in group");
+    STAssertTrue([queue boundedQueueMetrics].rejectedCount == 2, @"Wrong rejected count");
+    [queue setSuspended:NO];
+    [queue waitUntilAllOperationsAreFinished];
+}
+
+-(void)addOperationToQueue:(NSOperationQueue*)queue;
+{
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+	[queue addOperation:[[[NSOperation alloc] init] autorelease] weight:1 error:NULL];
+    [pool drain];
+}
+
+-(void)testBlockWhenFull;
+{
+	NSOperationQueue* queue = [[[NSOperationQueue alloc] init] autorelease];
+    [queue setMaximumPendingOperationCount:1 maximumPendingWeight:0 overflowPolicy:CWQueueOverflowPolicyBlock];
+    [queue setSuspended:YES];
+    [self addOperationToQueue:queue];
+    [NSThread detachNewThreadSelector:@selector(addOperationToQueue:) toTarget:self withObject:queue];
+    [NSThread sleepForTimeInterval:0.1];
+    STAssertTrue([queue operationCount] == 1, @"Producer not blocked");
+    [queue setSuspended:NO];
+    [NSThread sleepForTimeInterval:0.1];
+    [queue waitUntilAllOperationsAreFinished];
+    CWBoundedQueueMetrics metrics = [queue boundedQueueMetrics];
+    STAssertTrue(metrics.blockedCount == 1, @"Wrong blocked count");
+    STAssertTrue(metrics.blockedTime > 0.05, @"Wrong blocked time");
+}
+
+@end
@@ -0,0 +1,95 @@
+//
+//  NSOperationQueueCWInstrumentationTest.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "NSOperationQueueCWInstrumentationTest.h"
+#import "NSOperationQueue+CWDefaultQueue.h"
+#import "NSObject+CWInvocationProxy.h"
+
+
+@implementation NSOperationQueueCWInstrumentationTest
+
+-(void)testHistogramPercentiles;
+{
+	CWHistogram* histogram = [[[CWHistogram alloc] init] autorelease];
+    for (uint64_t value = 1; value <= 1000; value++) {
+    	[histogram recordValue:value];
+    }
+    STAssertTrue([histogram count] == 1000, @"Wrong count");
+    STAssertTrue([histogram maximum] == 1000, @"Wrong maximum");
+    STAssertEqualsWithAccuracy([histogram mean], 500.5, 0.001, @"Wrong mean");
+    uint64_t median = [histogram valueAtPercentile:50];
+    STAssertTrue(median >= 500 && median <= 500 * 1.125, @"Median out of bounds");
+    STAssertTrue([histogram valueAtPercentile:100] == 1000, @"Wrong maximum percentile");
+    CWHistogram* copy = [[histogram copy] autorelease];
+    [histogram reset];
+    STAssertTrue([histogram count] == 0, @"Not reset");
+    STAssertTrue([copy count] == 1000, @"Copy reset");
+}
+
+-(void)sleepMilliseconds:(NSNumber*)milliseconds;
+{
+	[NSThread sleepForTimeInterval:[milliseconds doubleValue] / 1000];
+}
+
+-(void)doNothing;
+{
+}
+
+-(void)testInstrumentedQueueStatistics;
+{
+	NSOperationQueue* queue = [[[NSOperationQueue alloc] init] autorelease];
+    [queue setMaxConcurrentOperationCount:1];
+    STAssertNil([queue statistics], @"Statistics for uninstrumented queue");
+    [queue setInstrumented:YES perSelector:YES];
+    [queue setSuspended:YES];
+    for (int i = 0; i < 4; i++) {
+    	[self performSelector:@selector(sleepMilliseconds:) onQueue:queue withObject:[NSNumber numberWithInt:10]];
+    }
+    [[self queueProxy:queue] doNothing];
+    STAssertTrue([[queue statistics] currentDepth] == 5, @"Wrong depth");
+    [queue setSuspended:NO];
+    [queue waitUntilAllOperationsAreFinished];
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    CWQueueStatistics* statistics = [queue statistics];
+    STAssertTrue([statistics currentDepth] == 0, @"Wrong depth");
+    STAssertTrue([statistics peakDepth] == 5, @"Wrong peak depth");
+    STAssertTrue([[statistics runTime] count] == 5, @"Wrong run count");
+    STAssertTrue([[statistics runTime] maximum] >= 10000, @"Wrong run time");
+    STAssertTrue([[statistics waitTime] maximum] >= 40000, @"Wrong wait time");
+    CWQueueStatistics* sleepStatistics = [[statistics selectorStatistics] objectForKey:@"sleepMilliseconds:"];
+    STAssertTrue([[sleepStatistics runTime] count] == 4, @"Wrong selector run count");
+    STAssertTrue([[[[statistics selectorStatistics] objectForKey:@"doNothing"] runTime] count] == 1, @"Proxied selector not attributed");
+    [queue resetStatistics];
+    STAssertTrue([[[queue statistics] runTime] count] == 0, @"Not reset");
+    [queue setInstrumented:NO];
+    STAssertFalse([queue isInstrumented], @"Still instrumented");
+}
+
+@end
@@ -0,0 +1,85 @@
+//
+//  NSOperationQueueCWReplaceOperationTest.m
+//  CWFoundation
+//  Created by Fredrik Olsson 
+//
+//  Copyright (c) 2011, Jayway AB All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Jayway AB nor the names of its contributors may 
+//       be used to endorse or promote products derived from this software 
+//       without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL JAYWAY AB BE LIABLE FOR ANY DIRECT, INDIRECT, 
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+//  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+//  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+//  OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "NSOperationQueueCWReplaceOperationTest.h"
+
+
+@implementation NSOperationQueueCWReplaceOperationTest
+
+-(void)testReplaceOperation;
+{
+	NSOperationQueue* queue = [[[NSOperationQueue alloc] init] autorelease];
+    [queue setSuspended:YES];
+    NSOperation* oldOperation = [[[NSOperation alloc] init] autorelease];
+    NSOperation* newOperation = [[[NSOperation alloc] init] autorelease];
+    [queue addOperation:oldOperation];
+    STAssertTrue([queue replaceOperation:oldOperation withOperation:newOperation], @"Old operation not cancelled");
+    STAssertTrue([oldOperation isCancelled], @"Old operation not cancelled");
+    STAssertTrue([queue isSuspended], @"Suspended state not restored");
+    [queue setSuspended:NO];
+    [queue waitUntilAllOperationsAreFinished];
+    STAssertFalse([newOperation isCancelled], @"New operation cancelled");
+    STAssertFalse([queue replaceOperation:oldOperation withOperation:[[[NSOperation alloc] init] autorelease]], @"Finished operation cancelled");
+    [queue waitUntilAllOperationsAreFinished];
+}
+
+-(void)testCoalescingKeyCancelsPendingOperation;
+{
+	NSOperationQueue* queue = [[[NSOperationQueue alloc] init] autorelease];
+    [queue setSuspended:YES];
+    NSOperation* first = [[[NSOperation alloc] init] autorelease];
+    NSOperation* second = [[[NSOperation alloc] init] autorelease];
+    NSOperation* other = [[[NSOperation alloc] init] autorelease];
+    STAssertFalse([queue addOperation:first coalescingKey:@"A"], @"Cancelled without pending operation");
+    STAssertFalse([queue addOperation:other coalescingKey:@"B"], @"Cancelled operation for other key");
+    STAssertTrue([queue addOperation:second coalescingKey:@"A"], @"Pending operation not cancelled");
+    STAssertTrue([first isCancelled], @"Pending operation not cancelled");
+    STAssertFalse([other isCancelled], @"Operation for other key cancelled");
+    STAssertTrue([queue operationForCoalescingKey:@"A"] == second, @"Wrong operation for key");
+    [queue setSuspended:NO];
+    [queue waitUntilAllOperationsAreFinished];
+}
+
+-(void)testFinishedOperationIsRemovedFromTable;
+{
+	NSOperationQueue* queue = [[[NSOperationQueue alloc] init] autorelease];
+    NSMutableString* key = [NSMutableString stringWithString:@"A"];
+    NSOperation* operation = [[[NSOperation alloc] init] autorelease];
+    [queue addOperation:operation coalescingKey:key];
+    [key appendString:@"B"];
+    [queue waitUntilAllOperationsAreFinished];
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    STAssertNil([queue operationForCoalescingKey:@"A"], @"Finished operation not removed");
+    NSOperation* nextOperation = [[[NSOperation alloc] init] autorelease];
+    STAssertFalse([queue addOperation:nextOperation coalescingKey:@"A"], @"Finished operation cancelled");
+    [queue waitUntilAllOperationsAreFinished];
+}
+
+@end